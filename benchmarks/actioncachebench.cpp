@@ -0,0 +1,194 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "benchmarks.hpp"
+
+#include "jjmake/jjmakecontext.hpp"
+#include "jjmake/node.hpp"
+#include "jjmake/remotecache.hpp"
+#include "jbase/jinttostring.hpp"
+#include "josutils/jclock.hpp"
+#include "josutils/jfilehandle.hpp"
+#include "josutils/jfilesystem.hpp"
+#include "josutils/jopen.hpp"
+#include "josutils/jpath.hpp"
+#include "josutils/jstat.hpp"
+#include "josutils/jthreading.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace jjm; 
+using namespace std; 
+
+namespace
+{
+    //Stands in for a compiler: sleeps, and writes an output made from the
+    //content of its input.
+    class CompileNode : public Node
+    {
+    public:
+        CompileNode(Path const& input_, Path const& output_, unsigned long millis_, size_t outputBytes_)
+            : Node(output_.getStringRep(), vector<Path>(1, input_), vector<Path>(1, output_)),
+            input(input_), output(output_), millis(millis_), outputBytes(outputBytes_) {}
+        Path input; 
+        Path output; 
+        unsigned long millis; 
+        size_t outputBytes; 
+        virtual std::string getCommand() const { return "compile"; }
+        virtual bool execute()
+        {   if ( ! isOutOfDate())
+                return false; 
+            beginExecution(); 
+            string source; 
+            {   FileHandleOwner in(FileOpener().openExistingOnly().readOnly().open(input)); 
+                char buffer[256]; 
+                for (ssize_t n; (n = in.get().read(buffer, sizeof(buffer))) >= 0; )
+                    source.append(buffer, n); 
+            }
+            jjm::sleep(millis); 
+            string object; 
+            while (object.size() < outputBytes)
+                object += source; 
+            object.resize(outputBytes); 
+            FileHandleOwner out(FileOpener().createOrOpen().truncate().writeOnly().open(output)); 
+            out.get().writeComplete(object.data(), object.size()); 
+            return true; 
+        }
+    }; 
+
+    Path sourcePath(Path const& dir, int i) { return Path::join(dir, Path("src-" + toDecStr(i) + ".c")); }
+    Path objectPath(Path const& dir, int i) { return Path::join(dir, Path("obj-" + toDecStr(i) + ".o")); }
+
+    //Every source names the branch, as if every file differed between the
+    //branches.
+    void checkout(Path const& dir, int numGoals, string const& branch)
+    {   for (int i = 0; i < numGoals; ++i)
+        {   string const text = "int f" + toDecStr(i) + "() { return 0; } /* " + branch + " */\n"; 
+            FileHandleOwner file(FileOpener().createOrOpen().truncate().writeOnly().open(sourcePath(dir, i))); 
+            file.get().writeComplete(text.data(), text.size()); 
+        }
+    }
+
+    //Removes the files under the directory, but not the directories, so that a
+    //run does not start with the state of an earlier run.
+    void removeFilesRecursively(Path const& dir)
+    {   if (Stat::stat2(dir).type != FileType::Directory)
+            return; 
+        vector<string> const names = listDirectory(dir); 
+        for (size_t i = 0; i < names.size(); ++i)
+        {   Path const path = Path::join(dir, Path(names[i])); 
+            if (Stat::stat2(path).type == FileType::Directory)
+                removeFilesRecursively(path); 
+            else
+                removeFile(path); 
+        }
+    }
+
+    //Returns the wall time in milliseconds.
+    double runBuild(Path const& dir, Path const& stateDir, bool useCache, int numThreads, int numGoals,
+            unsigned long millis, size_t outputBytes, string const& cacheServerAddress)
+    {
+        JjmakeContext::Arguments arguments; 
+        arguments.allGoals = true; 
+        arguments.numThreads = numThreads; 
+        arguments.stateDir = stateDir.getStringRep(); 
+        arguments.actionCacheBytes = useCache ? std::int64_t(1024) * 1024 * 1024 : 0; 
+        arguments.cacheServerAddress = cacheServerAddress; 
+
+        std::int64_t start = 0, end = 0; 
+        {   SilenceStdOut silence; 
+            JjmakeContext context(arguments); 
+            for (int i = 0; i < numGoals; ++i)
+                context.newNode(new CompileNode(sourcePath(dir, i), objectPath(dir, i), millis, outputBytes)); 
+            start = getMonotonicClockNanoSec(); 
+            context.execute(); 
+            end = getMonotonicClockNanoSec(); 
+        }
+        return (end - start) / 1e6; 
+    }
+
+    void removeObjects(Path const& dir, int numGoals)
+    {   for (int i = 0; i < numGoals; ++i)
+            removeFile(objectPath(dir, i)); 
+    }
+
+    class ServerMain
+    {
+    public:
+        ServerMain(CacheServer * server_) : server(server_) {}
+        void operator() () { server->run(); }
+    private:
+        CacheServer * server; 
+    }; 
+}
+
+int jjm::actionCacheBenchmark(vector<string> const& args)
+{
+    int const numThreads = static_cast<int>(getIntegerOption(args, "--threads=", 4)); 
+    int const numGoals = static_cast<int>(getIntegerOption(args, "--goals=", 200)); 
+    unsigned long const millis = static_cast<unsigned long>(getIntegerOption(args, "--compile-millis=", 20)); 
+    size_t const outputBytes = static_cast<size_t>(getIntegerOption(args, "--output-kb=", 64)) * 1024; 
+
+    Path const dir = Path("jjmake-actioncache-benchmark.tmp").getAbsolutePath(); 
+    removeFilesRecursively(dir); 
+    createDirectories(dir); 
+
+    cout << "Action cache, " << numThreads << " threads, " << numGoals << " goals of "
+         << millis << " ms writing " << outputBytes / 1024 << " KiB each" << std::endl; 
+    cout << fixed << setprecision(1); 
+    for (int useCache = 0; useCache < 2; ++useCache)
+    {   Path const stateDir = Path::join(dir, Path(useCache ? "state-cache" : "state-nocache")); 
+        checkout(dir, numGoals, "a"); 
+        double const first = runBuild(dir, stateDir, useCache != 0, numThreads, numGoals, millis, outputBytes, ""); 
+        checkout(dir, numGoals, "b"); 
+        double const other = runBuild(dir, stateDir, useCache != 0, numThreads, numGoals, millis, outputBytes, ""); 
+        checkout(dir, numGoals, "a"); 
+        double const back = runBuild(dir, stateDir, useCache != 0, numThreads, numGoals, millis, outputBytes, ""); 
+        cout << (useCache ? "with the cache     " : "without the cache  ")
+             << "branch a " << setw(8) << first << " ms, branch b " << setw(8) << other
+             << " ms, back to a " << setw(8) << back << " ms" << std::endl; 
+    }
+    removeFilesRecursively(dir); 
+    return 0; 
+}
+
+int jjm::cacheServerBenchmark(vector<string> const& args)
+{
+    int const numThreads = static_cast<int>(getIntegerOption(args, "--threads=", 4)); 
+    int const numGoals = static_cast<int>(getIntegerOption(args, "--goals=", 200)); 
+    unsigned long const millis = static_cast<unsigned long>(getIntegerOption(args, "--compile-millis=", 20)); 
+    size_t const outputBytes = static_cast<size_t>(getIntegerOption(args, "--output-kb=", 64)) * 1024; 
+
+    Path const dir = Path("jjmake-cacheserver-benchmark.tmp").getAbsolutePath(); 
+    removeFilesRecursively(dir); 
+    createDirectories(dir); 
+    checkout(dir, numGoals, "a"); 
+
+    //The hosts share the build directory and the server, and each has a 
+    //state directory, and so an action cache, of its own. 
+    CacheServer server; 
+    server.open(Path::join(dir, Path("server")), std::int64_t(1024) * 1024 * 1024, "127.0.0.1:0"); 
+    double uploading = 0, downloading = 0, alone = 0; 
+    {   Thread serverThread(ServerMain( & server), Thread::JoinInDtor); 
+        uploading = runBuild(dir, Path::join(dir, Path("host-1")), true, numThreads, numGoals, millis, outputBytes, server.getAddress()); 
+        removeObjects(dir, numGoals); 
+        downloading = runBuild(dir, Path::join(dir, Path("host-2")), true, numThreads, numGoals, millis, outputBytes, server.getAddress()); 
+        removeObjects(dir, numGoals); 
+        alone = runBuild(dir, Path::join(dir, Path("host-3")), true, numThreads, numGoals, millis, outputBytes, ""); 
+        server.stop(); 
+    }
+
+    cout << "Cache server over TCP, " << numThreads << " threads, " << numGoals << " goals of " 
+         << millis << " ms writing " << outputBytes / 1024 << " KiB each" << std::endl; 
+    cout << fixed << setprecision(1) 
+         << "first host, executing and uploading   " << setw(8) << uploading << " ms" << std::endl 
+         << "second host, downloading               " << setw(8) << downloading << " ms" << std::endl 
+         << "third host, without the server         " << setw(8) << alone << " ms" << std::endl; 
+    removeFilesRecursively(dir); 
+    return 0; 
+}
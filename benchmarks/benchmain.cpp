@@ -0,0 +1,111 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "benchmarks.hpp"
+
+#include "jbase/jfatal.hpp"
+#include "jbase/jinttostring.hpp"
+
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+#ifdef _WIN32
+    #include <io.h>
+    #include <fcntl.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+using namespace std;
+
+long long jjm::getIntegerOption(vector<string> const& args, string const& prefix, long long defaultValue)
+{
+    long long result = defaultValue; 
+    for (vector<string>::const_iterator arg = args.begin(); arg != args.end(); ++arg)
+    {   if (arg->compare(0, prefix.size(), prefix) != 0)
+            continue; 
+        if (false == decStrToInteger(result, arg->substr(prefix.size())))
+            throw std::runtime_error("Not a valid number in option \"" + *arg + "\"."); 
+    }
+    return result; 
+}
+
+#ifdef _WIN32
+    jjm::SilenceStdOut::SilenceStdOut() : saved(_dup(1))
+    {   int const devNull = _open("NUL", _O_WRONLY);
+        if (saved < 0 || devNull < 0 || _dup2(devNull, 1) < 0)
+            JFATAL(0, 0);
+        _close(devNull);
+    }
+    jjm::SilenceStdOut::~SilenceStdOut() { _dup2(saved, 1); _close(saved); }
+#else
+    jjm::SilenceStdOut::SilenceStdOut() : saved(dup(1))
+    {   int const devNull = open("/dev/null", O_WRONLY);
+        if (saved < 0 || devNull < 0 || dup2(devNull, 1) < 0)
+            JFATAL(0, 0);
+        close(devNull);
+    }
+    jjm::SilenceStdOut::~SilenceStdOut() { dup2(saved, 1); close(saved); }
+#endif
+
+namespace
+{
+    typedef int (*BenchmarkFunction)(vector<string> const& ); 
+
+    map<string, BenchmarkFunction> getBenchmarks()
+    {
+        map<string, BenchmarkFunction> x; 
+        x["action-cache"] = & jjm::actionCacheBenchmark; 
+        x["cache-server"] = & jjm::cacheServerBenchmark; 
+        x["capture"] = & jjm::captureBenchmark; 
+        x["critical-path"] = & jjm::criticalPathBenchmark; 
+        x["deps-log"] = & jjm::depsLogBenchmark; 
+        x["history"] = & jjm::historyBenchmark; 
+        x["output"] = & jjm::outputBenchmark; 
+        x["parallel-include"] = & jjm::parallelIncludeBenchmark; 
+        x["pools"] = & jjm::poolBenchmark; 
+        x["remote-exec"] = & jjm::remoteExecBenchmark; 
+        x["spawn"] = & jjm::spawnBenchmark; 
+        x["stat-cache"] = & jjm::statCacheBenchmark; 
+        x["threadpool"] = & jjm::threadPoolBenchmark; 
+        return x; 
+    }
+}
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        map<string, BenchmarkFunction> const benchmarks = getBenchmarks(); 
+        vector<string> args(argv + 1, argv + argc); 
+        if (args.size() == 0)
+        {   //run everything with default options
+            for (map<string, BenchmarkFunction>::const_iterator b = benchmarks.begin(); b != benchmarks.end(); ++b)
+            {   int const x = b->second(args); 
+                if (x != 0)
+                    return x; 
+            }
+            return 0; 
+        }
+        map<string, BenchmarkFunction>::const_iterator b = benchmarks.find(args[0]); 
+        if (b == benchmarks.end())
+        {   std::cerr << "Unknown benchmark \"" << args[0] << "\". Known benchmarks:\n"; 
+            for (b = benchmarks.begin(); b != benchmarks.end(); ++b)
+                std::cerr << "    " << b->first << "\n"; 
+            return 1; 
+        }
+        args.erase(args.begin()); 
+        return b->second(args); 
+    } catch (std::exception & e)
+    {   std::cerr << typeid(e).name() << ":\n";
+        std::cerr << e.what() << endl;
+    }
+    return 1;
+}
@@ -0,0 +1,104 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#ifndef BENCHMARKS_BENCHMARKS_HPP_HEADER_GUARD
+#define BENCHMARKS_BENCHMARKS_HPP_HEADER_GUARD
+
+#include <string>
+#include <vector>
+
+namespace jjm
+{
+
+//Returns the value of the last "<prefix><integer>" argument, or defaultValue. 
+//Throws std::exception when the value is not an integer. 
+long long getIntegerOption(std::vector<std::string> const& args, std::string const& prefix, long long defaultValue); 
+
+//Silences the "[jjmake] Executing goal" lines for the lifetime of this
+//object by pointing stdout at the null device.
+class SilenceStdOut
+{
+public:
+    SilenceStdOut(); 
+    ~SilenceStdOut(); 
+private:
+    SilenceStdOut(SilenceStdOut const& ); //not defined, not copyable
+    SilenceStdOut& operator= (SilenceStdOut const& ); //not defined, not copyable
+    int saved;
+};
+
+//Each benchmark takes the command line arguments after the benchmark name, 
+//prints its results to stdout, and returns the process exit code. 
+
+//Tasks per second of jjm::ThreadPool against the original single-mutex pool.
+//Options: --max-threads=<N> --tasks=<N>
+int threadPoolBenchmark(std::vector<std::string> const& args); 
+
+//Wall time of a synthetic graph of sleeping goals, with and without critical
+//path ordering. 
+//Options: --threads=<N> --chain=<N> --chain-millis=<N> --leaves=<N> --leaf-millis=<N>
+int criticalPathBenchmark(std::vector<std::string> const& args); 
+
+//Throughput of the depfile parser, and time to log the parsed inputs, load 
+//the deps log, and find the inputs of every goal. 
+//Options: --goals=<N> --headers=<N>
+int depsLogBenchmark(std::vector<std::string> const& args); 
+
+//Time to record, compact, load, and search the goal history. 
+//Options: --goals=<N>
+int historyBenchmark(std::vector<std::string> const& args); 
+
+//Wall time of --just-print over independent goals with each --output-sync 
+//mode, and of printing as many lines from the threads without the graph, 
+//with stdout pointed at the null device. 
+//Options: --threads=<N> --goals=<N>
+int outputBenchmark(std::vector<std::string> const& args); 
+
+//Wall time of sleeping goals, some of them in a resource pool, and the most
+//goals of the pool which executed at once. Fails when that exceeds the depth.
+//Options: --threads=<N> --depth=<N> --links=<N> --link-millis=<N> --compiles=<N> --compile-millis=<N>
+int poolBenchmark(std::vector<std::string> const& args); 
+
+//Time of a clean and of an up-to-date build of touch-node goals which share
+//one input, and the number of stat system calls saved by the stat cache. 
+//Options: --threads=<N> --goals=<N>
+int statCacheBenchmark(std::vector<std::string> const& args); 
+
+//Wall time of SyncExec capturing a child's flood of compiler warnings 
+//through pipes, through memfd files, and through memfd files left mapped. 
+//Options: --mb=<N>
+int captureBenchmark(std::vector<std::string> const& args); 
+
+//Spawns per second with fork() and with posix_spawn(), against the resident
+//memory of the parent, which stands in for the graph of a large build. 
+//Options: --spawns=<N> --max-rss-mb=<N> --open-fds=<N>
+int spawnBenchmark(std::vector<std::string> const& args); 
+
+//Time of building goals on one branch, on another, and on the first again, 
+//with and without the action cache, which restores the outputs of the first 
+//build instead of executing the goals. 
+//Options: --threads=<N> --goals=<N> --compile-millis=<N> --output-kb=<N>
+int actionCacheBenchmark(std::vector<std::string> const& args); 
+
+//Time of building the same goals on three hosts: the first executes them 
+//and uploads the outputs to a cache server in this process, the second 
+//downloads them, and the third executes them without the server. 
+//Options: --threads=<N> --goals=<N> --compile-millis=<N> --output-kb=<N>
+int cacheServerBenchmark(std::vector<std::string> const& args); 
+
+//Wall time of goals executed by a Dispatcher locally, and with remote workers
+//in this process, for goals which are worth sending and for goals whose 
+//inputs take longer to send than the goals take to execute. 
+//Options: --local-jobs=<N> --workers=<N> --worker-slots=<N> --goals=<N> --compile-millis=<N> --large-input-mb=<N>
+int remoteExecBenchmark(std::vector<std::string> const& args); 
+
+//Time of evaluating many build files of touch-node goals, with one include 
+//per file, and with one parallel-include of every file. 
+//Options: --threads=<N> --files=<N> --goals=<N>
+int parallelIncludeBenchmark(std::vector<std::string> const& args); 
+
+} //namespace jjm
+
+#endif
@@ -0,0 +1,80 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "benchmarks.hpp"
+
+#include "jbase/jinttostring.hpp"
+#include "josutils/jclock.hpp"
+#include "josutils/jprocess.hpp"
+
+#ifndef _WIN32
+    #include <sys/resource.h>
+#endif
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace jjm;
+using namespace std;
+
+#ifdef _WIN32
+
+int jjm::captureBenchmark(vector<string> const& )
+{
+    cout << "The capture benchmark compares memfd and pipe capture, and is not supported on windows." << std::endl;
+    return 0;
+}
+
+#else
+
+namespace
+{
+    double parentCpuMillis()
+    {   rusage usage;
+        getrusage(RUSAGE_SELF, & usage);
+        return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e3
+            + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e3;
+    }
+
+    //Captures numBytes of compiler style warnings, half on stdout and half
+    //on stderr, and prints the wall time and the CPU time of this process.
+    void captureRun(char const * name, SyncExec::Capture capture, long long numBytes)
+    {
+        string const line = "src/jjmake/parsercontext.cpp:1234:17: warning: unused variable 'x' [-Wunused-variable]";
+        string const half = toDecStr(numBytes / 2);
+        string const script = "yes \"" + line + "\" | head -c " + half + " & yes \"" + line + "\" | head -c " + half + " 1>&2; wait";
+        ProcessBuilder pb;
+        pb.arg("sh").arg("-c").arg(script).pipeOut().pipeErr();
+
+        double const cpuStart = parentCpuMillis();
+        std::int64_t const start = getMonotonicClockNanoSec();
+        SyncExec exec(pb, Utf8String(), capture);
+        size_t const captured = exec.outSize() + exec.errSize();
+        std::int64_t const end = getMonotonicClockNanoSec();
+        double const cpuEnd = parentCpuMillis();
+
+        double const millis = (end - start) / 1e6;
+        cout << left << setw(10) << name << right << fixed << setprecision(1)
+             << setw(10) << millis << " ms  "
+             << setw(8) << (captured / (1024.0 * 1024.0)) / (millis / 1e3) << " MB/s  "
+             << setw(8) << cpuEnd - cpuStart << " ms parent cpu" << std::endl;
+    }
+}
+
+int jjm::captureBenchmark(vector<string> const& args)
+{
+    long long const numMegabytes = getIntegerOption(args, "--mb=", 1024);
+    long long const numBytes = numMegabytes * 1024 * 1024;
+
+    cout << "Capturing " << numMegabytes << " MB of diagnostics with SyncExec" << std::endl;
+    captureRun("pipes", SyncExec::CapturePipes, numBytes);
+    captureRun("files", SyncExec::CaptureFiles, numBytes);
+    captureRun("mapped", SyncExec::CaptureMapped, numBytes);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,113 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "benchmarks.hpp"
+
+#include "jjmake/jjmakecontext.hpp"
+#include "jjmake/node.hpp"
+#include "jbase/jinttostring.hpp"
+#include "jbase/juniqueptr.hpp"
+#include "josutils/jclock.hpp"
+#include "josutils/jpath.hpp"
+#include "josutils/jthreading.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace jjm;
+using namespace std;
+
+namespace
+{
+    //A goal which only sleeps, standing in for a compile or link step.
+    //The paths are never touched.
+    class SleepNode : public Node
+    {
+    public:
+        SleepNode(string const& goalName_, vector<Path> const& inputPaths_, vector<Path> const& outputPaths_, unsigned long millis_)
+            : Node(goalName_, inputPaths_, outputPaths_), millis(millis_) {}
+        unsigned long millis;
+        virtual bool execute() { beginExecution(); jjm::sleep(millis); return true; }
+    };
+
+    //Fixed width, so the name order of the goals is also their numeric order.
+    string goalPath(string const& prefix, int i)
+    {   string name = toDecStr(i); 
+        name.insert(0, 6 - std::min<size_t>(6, name.size()), '0'); 
+        name.insert(0, prefix); 
+    #ifdef _WIN32
+        return "C:/jjmake-benchmark/" + name;
+    #else
+        return "/jjmake-benchmark/" + name;
+    #endif
+    }
+
+    //A chain of long goals next to many short independent goals. The chain
+    //sorts first by name, so it is queued first, and without critical path
+    //ordering the LIFO queues start it last.
+    //Returns the wall time in milliseconds.
+    double runGraph(bool criticalPathFirst, int numThreads, int chainLength, unsigned long chainMillis, int numLeaves, unsigned long leafMillis)
+    {
+        JjmakeContext::Arguments arguments;
+        arguments.allGoals = true;
+        arguments.numThreads = numThreads;
+        arguments.criticalPathFirst = criticalPathFirst;
+        arguments.stateDir = ""; //no goal history, only the declared weights
+
+        vector<SleepNode*> newNodes;
+        for (int i = 0; i < chainLength; ++i)
+        {   string const name = goalPath("a-chain-", i);
+            vector<Path> inputs;
+            if (i > 0)
+                inputs.push_back(Path(goalPath("a-chain-", i - 1)));
+            vector<Path> outputs(1, Path(name));
+            newNodes.push_back(new SleepNode(name, inputs, outputs, chainMillis));
+            arguments.rootEvalText += "(goal-weight '" + name + "' " + toDecStr(chainMillis) + ")\n";
+        }
+        for (int i = 0; i < numLeaves; ++i)
+        {   string const name = goalPath("leaf-", i);
+            vector<Path> outputs(1, Path(name));
+            newNodes.push_back(new SleepNode(name, vector<Path>(), outputs, leafMillis));
+            arguments.rootEvalText += "(goal-weight '" + name + "' " + toDecStr(leafMillis) + ")\n";
+        }
+
+        JjmakeContext context(arguments);
+        for (size_t i = 0; i < newNodes.size(); ++i)
+            context.newNode(newNodes[i]);
+
+        SilenceStdOut silence;
+        std::int64_t const start = getMonotonicClockNanoSec();
+        context.execute();
+        std::int64_t const end = getMonotonicClockNanoSec();
+        return (end - start) / 1e6;
+    }
+}
+
+int jjm::criticalPathBenchmark(vector<string> const& args)
+{
+    int const numThreads = static_cast<int>(getIntegerOption(args, "--threads=", 4));
+    int const chainLength = static_cast<int>(getIntegerOption(args, "--chain=", 10));
+    unsigned long const chainMillis = static_cast<unsigned long>(getIntegerOption(args, "--chain-millis=", 20));
+    int const numLeaves = static_cast<int>(getIntegerOption(args, "--leaves=", 60));
+    unsigned long const leafMillis = static_cast<unsigned long>(getIntegerOption(args, "--leaf-millis=", 20));
+
+    double const totalMillis = double(chainLength) * chainMillis + double(numLeaves) * leafMillis;
+    double const lowerBound = std::max(double(chainLength) * chainMillis, totalMillis / numThreads);
+
+    cout << "Critical path ordering, " << numThreads << " threads, "
+         << "chain of " << chainLength << " x " << chainMillis << " ms, "
+         << numLeaves << " independent goals x " << leafMillis << " ms" << std::endl;
+    double const unordered = runGraph(false, numThreads, chainLength, chainMillis, numLeaves, leafMillis);
+    double const ordered = runGraph(true, numThreads, chainLength, chainMillis, numLeaves, leafMillis);
+    cout << fixed << setprecision(1)
+         << "lower bound          " << setw(8) << lowerBound << " ms" << std::endl
+         << "--no-critical-path   " << setw(8) << unordered << " ms" << std::endl
+         << "critical path first  " << setw(8) << ordered << " ms" << std::endl
+         << "saved                " << setw(8) << unordered - ordered << " ms" << std::endl;
+    return 0;
+}
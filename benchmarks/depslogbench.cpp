@@ -0,0 +1,131 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "benchmarks.hpp"
+
+#include "jjmake/depslog.hpp"
+#include "jbase/jfatal.hpp"
+#include "jbase/jinttostring.hpp"
+#include "josutils/jclock.hpp"
+#include "josutils/jfilesystem.hpp"
+#include "josutils/jpath.hpp"
+#include "josutils/jstat.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace jjm; 
+using namespace std; 
+
+namespace
+{
+    string goalName(long i)
+    {
+        return "/home/user/src/project/module" + toDecStr(i % 100) + "/obj/file" + toDecStr(i) + ".o"; 
+    }
+
+    //The headers of a goal, mostly shared with the other goals, as a 
+    //compiler would list them. Every tenth header has a space in its name. 
+    string headerName(long goal, long i)
+    {
+        long const n = (i * 7 + (i < 20 ? goal : 0)) % 2000; 
+        return "/usr/include/project/module" + toDecStr(n % 100) + (n % 10 == 0 ? "/with space" : "/header") + toDecStr(n) + ".h"; 
+    }
+
+    string escape(string const& name)
+    {
+        string result; 
+        for (size_t i = 0; i < name.size(); ++i)
+        {   if (name[i] == ' ')
+                result += '\\'; 
+            result += name[i]; 
+        }
+        return result; 
+    }
+
+    string makeDepfile(long goal, long numHeaders)
+    {
+        string text = goalName(goal) + ": /home/user/src/project/file" + toDecStr(goal) + ".c"; 
+        for (long i = 0; i < numHeaders; ++i)
+            text += " \\\n  " + escape(headerName(goal, i)); 
+        text += "\n"; 
+        return text; 
+    }
+
+    double millisSince(std::int64_t start)
+    {
+        return (getMonotonicClockNanoSec() - start) / 1e6; 
+    }
+}
+
+int jjm::depsLogBenchmark(vector<string> const& args)
+{
+    long const numGoals = static_cast<long>(getIntegerOption(args, "--goals=", 10 * 1000)); 
+    long const numHeaders = static_cast<long>(getIntegerOption(args, "--headers=", 200)); 
+    Path const path = Path("jjmake-depslog-benchmark.tmp").getAbsolutePath(); 
+    if (Stat::stat2(path).type != FileType::NoExist)
+        removeFile(path); 
+
+    vector<string> depfiles; 
+    size_t totalBytes = 0; 
+    for (long g = 0; g < numGoals; ++g)
+    {   depfiles.push_back(makeDepfile(g, numHeaders)); 
+        totalBytes += depfiles.back().size(); 
+    }
+
+    cout << "Deps log, " << numGoals << " goals of " << numHeaders << " headers, " << totalBytes / (1024 * 1024)
+         << " MiB of depfiles, file \"" << path.getStringRep() << "\"" << std::endl; 
+    cout << fixed << setprecision(1); 
+    {   DepfileParser parser; 
+        size_t numPrerequisites = 0; 
+        std::int64_t const start = getMonotonicClockNanoSec(); 
+        for (long g = 0; g < numGoals; ++g)
+        {   if ( ! parser.parse(depfiles[g].data(), depfiles[g].data() + depfiles[g].size()))
+                JFATAL(g, depfiles[g]); 
+            numPrerequisites += parser.getPrerequisites().size(); 
+        }
+        double const millis = millisSince(start); 
+        if (numPrerequisites != static_cast<size_t>(numGoals * (numHeaders + 1)))
+            JFATAL(numPrerequisites, 0); 
+        cout << "parse depfiles          " << setw(10) << millis << " ms, " << setw(8) << totalBytes / (1024 * 1024) / (millis / 1000)
+             << " MiB/s" << std::endl; 
+    }
+    {   DepsLog depsLog; 
+        depsLog.load(path); 
+        std::int64_t const start = getMonotonicClockNanoSec(); 
+        DepfileParser parser; 
+        for (long g = 0; g < numGoals; ++g)
+        {   parser.parse(depfiles[g].data(), depfiles[g].data() + depfiles[g].size()); 
+            vector<DepfileParser::Token> const& prerequisites = parser.getPrerequisites(); 
+            vector<Path> inputs; 
+            for (size_t i = 0; i < prerequisites.size(); ++i)
+                inputs.push_back(Path(string(prerequisites[i].data, prerequisites[i].size))); 
+            depsLog.record(goalName(g), inputs); 
+        }
+        depsLog.flush(); 
+        cout << "parse, record and flush " << setw(10) << millisSince(start) << " ms, file "
+             << Stat::stat2(path).sizeBytes / 1024 << " KiB" << std::endl; 
+    }
+    {   DepsLog depsLog; 
+        std::int64_t const start = getMonotonicClockNanoSec(); 
+        depsLog.load(path); 
+        cout << "load                    " << setw(10) << millisSince(start) << " ms" << std::endl; 
+        std::int64_t const findStart = getMonotonicClockNanoSec(); 
+        size_t numInputs = 0; 
+        for (long g = 0; g < numGoals; ++g)
+        {   vector<Path> inputs; 
+            if ( ! depsLog.find(goalName(g), inputs))
+                JFATAL(g, 0); 
+            numInputs += inputs.size(); 
+        }
+        if (numInputs != static_cast<size_t>(numGoals * (numHeaders + 1)))
+            JFATAL(numInputs, 0); 
+        cout << "find every goal         " << setw(10) << millisSince(findStart) << " ms" << std::endl; 
+    }
+    removeFile(path); 
+    return 0; 
+}
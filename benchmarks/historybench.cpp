@@ -0,0 +1,95 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "benchmarks.hpp"
+
+#include "jjmake/history.hpp"
+#include "jbase/jfatal.hpp"
+#include "jbase/jinttostring.hpp"
+#include "josutils/jclock.hpp"
+#include "josutils/jfilesystem.hpp"
+#include "josutils/jpath.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace jjm;
+using namespace std;
+
+namespace
+{
+    string goalName(long i)
+    {
+        return "/home/user/src/project/module" + toDecStr(i % 1000) + "/obj/file" + toDecStr(i) + ".o"; 
+    }
+
+    double millisSince(std::int64_t start)
+    {
+        return (getMonotonicClockNanoSec() - start) / 1e6; 
+    }
+}
+
+int jjm::historyBenchmark(vector<string> const& args)
+{
+    long const numGoals = static_cast<long>(getIntegerOption(args, "--goals=", 1000 * 1000)); 
+    Path const path = Path("jjmake-history-benchmark.tmp").getAbsolutePath(); 
+    removeFile(path); 
+
+    cout << "Goal history, " << numGoals << " goals, file \"" << path.getStringRep() << "\"" << std::endl; 
+    cout << fixed << setprecision(1); 
+    {   History history; 
+        history.load(path); 
+        std::int64_t const start = getMonotonicClockNanoSec(); 
+        for (long i = 0; i < numGoals; ++i)
+        {   History::Entry entry; 
+            entry.durationNanoSec = i; 
+            entry.finishTimeNanoSec = 2 * i; 
+            history.record(goalName(i), entry); 
+        }
+        cout << "record                " << setw(10) << millisSince(start) << " ms" << std::endl; 
+        std::int64_t const start2 = getMonotonicClockNanoSec(); 
+        history.flush(); 
+        cout << "flush with compaction " << setw(10) << millisSince(start2) << " ms" << std::endl; 
+    }
+    {   History history; 
+        std::int64_t const start = getMonotonicClockNanoSec(); 
+        history.load(path); 
+        cout << "load                  " << setw(10) << millisSince(start) << " ms" << std::endl; 
+        if (history.size() != static_cast<size_t>(numGoals))
+            JFATAL(history.size(), 0); 
+
+        vector<string> names; 
+        for (long i = 0; i < numGoals; ++i)
+            names.push_back(goalName(i)); 
+        std::int64_t const start2 = getMonotonicClockNanoSec(); 
+        for (long i = 0; i < numGoals; ++i)
+        {   History::Entry entry; 
+            if ( ! history.find(names[i], entry) || entry.durationNanoSec != i || entry.finishTimeNanoSec != 2 * i)
+                JFATAL(i, 0); 
+        }
+        cout << "find every goal       " << setw(10) << millisSince(start2) << " ms" << std::endl; 
+
+        //As a build does, in order of goal name. 
+        vector<pair<string, long> > sortedNames; 
+        for (long i = 0; i < numGoals; ++i)
+            sortedNames.push_back(make_pair(names[i], i)); 
+        std::sort(sortedNames.begin(), sortedNames.end()); 
+        std::int64_t const start3 = getMonotonicClockNanoSec(); 
+        History::SortedFinder finder(history); 
+        for (long i = 0; i < numGoals; ++i)
+        {   History::Entry entry; 
+            long const x = sortedNames[i].second; 
+            if ( ! finder.find(sortedNames[i].first, entry) || entry.durationNanoSec != x || entry.finishTimeNanoSec != 2 * x)
+                JFATAL(i, 0); 
+        }
+        cout << "find sorted goals     " << setw(10) << millisSince(start3) << " ms" << std::endl; 
+    }
+    removeFile(path); 
+    return 0; 
+}
@@ -0,0 +1,114 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "benchmarks.hpp"
+
+#include "jjmake/jjmakecontext.hpp"
+#include "jjmake/node.hpp"
+#include "jbase/jinttostring.hpp"
+#include "josutils/jclock.hpp"
+#include "josutils/jpath.hpp"
+#include "josutils/jthreading.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace jjm;
+using namespace std;
+
+namespace
+{
+    //Never executed, only printed. 
+    class PrintedNode : public Node
+    {
+    public:
+        PrintedNode(string const& goalName_, vector<Path> const& outputPaths_)
+            : Node(goalName_, vector<Path>(), outputPaths_) {}
+        virtual bool execute() { return false; }
+    };
+
+    //Returns the wall time in milliseconds of --just-print over numGoals 
+    //independent goals. 
+    double runJustPrint(JjmakeContext::OutputSync outputSync, int numThreads, int numGoals)
+    {
+        JjmakeContext::Arguments arguments;
+        arguments.executionMode = JjmakeContext::PrintGoals; 
+        arguments.allGoals = true;
+        arguments.numThreads = numThreads;
+        arguments.outputSync = outputSync; 
+        arguments.stateDir = ""; 
+
+        JjmakeContext context(arguments);
+        for (int i = 0; i < numGoals; ++i)
+        {
+        #ifdef _WIN32
+            string const name = "C:/jjmake-benchmark/printed-" + toDecStr(i);
+        #else
+            string const name = "/jjmake-benchmark/printed-" + toDecStr(i);
+        #endif
+            context.newNode(new PrintedNode(name, vector<Path>(1, Path(name))));
+        }
+
+        SilenceStdOut silence;
+        std::int64_t const start = getMonotonicClockNanoSec();
+        context.execute();
+        std::int64_t const end = getMonotonicClockNanoSec();
+        return (end - start) / 1e6;
+    }
+
+    class PrintLines
+    {
+    public:
+        PrintLines(JjmakeContext * context_, int numLines_) : context(context_), numLines(numLines_) {}
+        void operator() ()
+        {   for (int i = 0; i < numLines; ++i)
+                context->toStdOut("[jjmake] Goal: /jjmake-benchmark/printed-" + toDecStr(i) + "\n"); 
+        }
+    private:
+        JjmakeContext * context; 
+        int numLines; 
+    };
+
+    //Returns the wall time in milliseconds of numThreads threads printing 
+    //numLines lines each, without the graph. 
+    double runPrintOnly(JjmakeContext::OutputSync outputSync, int numThreads, int numLines)
+    {
+        JjmakeContext::Arguments arguments;
+        arguments.outputSync = outputSync; 
+        arguments.stateDir = ""; 
+
+        SilenceStdOut silence;
+        std::int64_t const start = getMonotonicClockNanoSec();
+        {   JjmakeContext context(arguments); //the destructor waits for the writer
+            vector<Thread*> threads; 
+            for (int i = 0; i < numThreads; ++i)
+                threads.push_back(new Thread(PrintLines(&context, numLines), Thread::JoinInDtor)); 
+            for (int i = 0; i < numThreads; ++i)
+                delete threads[i]; 
+        }
+        std::int64_t const end = getMonotonicClockNanoSec();
+        return (end - start) / 1e6;
+    }
+}
+
+int jjm::outputBenchmark(vector<string> const& args)
+{
+    int const numThreads = static_cast<int>(getIntegerOption(args, "--threads=", 4));
+    int const numGoals = static_cast<int>(getIntegerOption(args, "--goals=", 200000));
+
+    cout << numThreads << " threads, " << numGoals << " goals, stdout to the null device" << std::endl;
+    JjmakeContext::OutputSync const modes[] = { JjmakeContext::OutputSyncNone, JjmakeContext::OutputSyncLine, JjmakeContext::OutputSyncGoal }; 
+    char const * const names[] = { "none", "line", "goal" }; 
+    cout << "                     --just-print   printing only" << std::endl; 
+    for (int m = 0; m < 3; ++m)
+    {   double const justPrint = runJustPrint(modes[m], numThreads, numGoals); 
+        double const printOnly = runPrintOnly(modes[m], numThreads, numGoals / numThreads); 
+        cout << fixed << setprecision(1)
+             << "--output-sync=" << names[m] << "   " << setw(10) << justPrint << " ms" << setw(13) << printOnly << " ms" << std::endl;
+    }
+    return 0;
+}
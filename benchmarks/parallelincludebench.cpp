@@ -0,0 +1,96 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "benchmarks.hpp"
+
+#include "jjmake/jjmakecontext.hpp"
+#include "jbase/jinttostring.hpp"
+#include "josutils/jclock.hpp"
+#include "josutils/jfilehandle.hpp"
+#include "josutils/jfilesystem.hpp"
+#include "josutils/jopen.hpp"
+#include "josutils/jpath.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace jjm; 
+using namespace std; 
+
+namespace
+{
+    string buildFilePath(Path const& dir, long i)
+    {
+        return Path::join(dir, Path("dir-" + toDecStr(i) + ".txt")).getStringRep(); 
+    }
+
+    //A build file of one directory, with some arithmetic per goal, as the 
+    //generated build files of a large tree have. 
+    string makeBuildFile(Path const& dir, long file, long numGoals)
+    {
+        string text; 
+        for (long g = 0; g < numGoals; ++g)
+        {   string const name = Path::join(dir, Path("out-" + toDecStr(file) + "-" + toDecStr(g) + ".o")).getStringRep(); 
+            text += "(set n (add " + toDecStr(g) + " 1))\n"; 
+            text += "(touch-node '" + name + "' '" + name + ".c')\n"; 
+        }
+        return text; 
+    }
+
+    //Returns the wall time in milliseconds. 
+    double runParse(Path const& dir, int numThreads, long numFiles, bool parallel)
+    {
+        JjmakeContext::Arguments arguments; 
+        arguments.allGoals = true; 
+        arguments.numThreads = numThreads; 
+        arguments.executionMode = JjmakeContext::PrintGoals; 
+        arguments.stateDir = ""; 
+        if (parallel)
+        {   arguments.rootEvalText += "(parallel-include"; 
+            for (long i = 0; i < numFiles; ++i)
+                arguments.rootEvalText += " '" + buildFilePath(dir, i) + "'"; 
+            arguments.rootEvalText += ")\n"; 
+        }else
+        {   for (long i = 0; i < numFiles; ++i)
+                arguments.rootEvalText += "(include '" + buildFilePath(dir, i) + "')\n"; 
+        }
+
+        JjmakeContext context(arguments); 
+        SilenceStdOut silence; 
+        std::int64_t const start = getMonotonicClockNanoSec(); 
+        context.execute(); 
+        std::int64_t const end = getMonotonicClockNanoSec(); 
+        return (end - start) / 1e6; 
+    }
+}
+
+int jjm::parallelIncludeBenchmark(vector<string> const& args)
+{
+    int const numThreads = static_cast<int>(getIntegerOption(args, "--threads=", 4)); 
+    long const numFiles = static_cast<long>(getIntegerOption(args, "--files=", 1000)); 
+    long const numGoals = static_cast<long>(getIntegerOption(args, "--goals=", 50)); 
+    Path const dir = Path("jjmake-parallelinclude-benchmark.tmp").getAbsolutePath(); 
+    createDirectories(dir); 
+    for (long i = 0; i < numFiles; ++i)
+    {   string const text = makeBuildFile(dir, i, numGoals); 
+        FileHandleOwner file(FileOpener().createOrOpen().truncate().writeOnly().open(Path(buildFilePath(dir, i)))); 
+        file.get().writeComplete(text.data(), text.size()); 
+    }
+
+    cout << "Parallel include, " << numThreads << " threads, " << numFiles << " build files of "
+         << numGoals << " goals, printing the goals" << std::endl; 
+    double const serial = runParse(dir, numThreads, numFiles, false); 
+    double const parallel = runParse(dir, numThreads, numFiles, true); 
+    cout << fixed << setprecision(1)
+         << "include            " << setw(10) << serial << " ms" << std::endl
+         << "parallel-include   " << setw(10) << parallel << " ms" << std::endl; 
+
+    for (long i = 0; i < numFiles; ++i)
+        removeFile(Path(buildFilePath(dir, i))); 
+    removeDirectory(dir); 
+    return 0; 
+}
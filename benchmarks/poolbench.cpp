@@ -0,0 +1,127 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "benchmarks.hpp"
+
+#include "jjmake/jjmakecontext.hpp"
+#include "jjmake/node.hpp"
+#include "jbase/jinttostring.hpp"
+#include "josutils/jclock.hpp"
+#include "josutils/jpath.hpp"
+#include "josutils/jthreading.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace jjm;
+using namespace std;
+
+namespace
+{
+    //Counts the goals of the pool which are executing at once. 
+    std::atomic<int> numRunningLinks(0); 
+    std::atomic<int> maxRunningLinks(0); 
+
+    //A goal which only sleeps. Links also count themselves. 
+    class SleepNode : public Node
+    {
+    public:
+        SleepNode(string const& goalName_, vector<Path> const& outputPaths_, unsigned long millis_, bool isLink_)
+            : Node(goalName_, vector<Path>(), outputPaths_), millis(millis_), isLink(isLink_) {}
+        unsigned long millis; 
+        bool isLink; 
+        virtual bool execute()
+        {   beginExecution(); 
+            if ( ! isLink)
+            {   jjm::sleep(millis); 
+                return true; 
+            }
+            int const running = ++numRunningLinks; 
+            for (int max = maxRunningLinks; running > max && ! maxRunningLinks.compare_exchange_weak(max, running); )
+                ; 
+            jjm::sleep(millis); 
+            --numRunningLinks; 
+            return true; 
+        }
+    };
+
+    string goalPath(string const& prefix, int i)
+    {
+    #ifdef _WIN32
+        return "C:/jjmake-benchmark/" + prefix + toDecStr(i);
+    #else
+        return "/jjmake-benchmark/" + prefix + toDecStr(i);
+    #endif
+    }
+
+    //The goals declare their durations as weights, as the goal history would,
+    //so that the longer links are preferred. 
+    //Returns the wall time in milliseconds. 
+    double runGraph(int poolDepth, int numThreads, int numLinks, unsigned long linkMillis, int numCompiles, unsigned long compileMillis)
+    {
+        JjmakeContext::Arguments arguments; 
+        arguments.allGoals = true; 
+        arguments.numThreads = numThreads; 
+        arguments.stateDir = ""; 
+        if (poolDepth > 0)
+            arguments.rootEvalText += "(pool link " + toDecStr(poolDepth) + ")\n"; 
+
+        vector<SleepNode*> newNodes; 
+        for (int i = 0; i < numLinks; ++i)
+        {   string const name = goalPath("a-link-", i); 
+            newNodes.push_back(new SleepNode(name, vector<Path>(1, Path(name)), linkMillis, true)); 
+            arguments.rootEvalText += "(goal-weight '" + name + "' " + toDecStr(linkMillis) + ")\n"; 
+            if (poolDepth > 0)
+                arguments.rootEvalText += "(goal-pool '" + name + "' link)\n"; 
+        }
+        for (int i = 0; i < numCompiles; ++i)
+        {   string const name = goalPath("compile-", i); 
+            newNodes.push_back(new SleepNode(name, vector<Path>(1, Path(name)), compileMillis, false)); 
+            arguments.rootEvalText += "(goal-weight '" + name + "' " + toDecStr(compileMillis) + ")\n"; 
+        }
+
+        JjmakeContext context(arguments); 
+        for (size_t i = 0; i < newNodes.size(); ++i)
+            context.newNode(newNodes[i]); 
+
+        numRunningLinks = 0; 
+        maxRunningLinks = 0; 
+        SilenceStdOut silence; 
+        std::int64_t const start = getMonotonicClockNanoSec(); 
+        context.execute(); 
+        std::int64_t const end = getMonotonicClockNanoSec(); 
+        return (end - start) / 1e6; 
+    }
+}
+
+int jjm::poolBenchmark(vector<string> const& args)
+{
+    int const numThreads = static_cast<int>(getIntegerOption(args, "--threads=", 8)); 
+    int const poolDepth = static_cast<int>(getIntegerOption(args, "--depth=", 2)); 
+    int const numLinks = static_cast<int>(getIntegerOption(args, "--links=", 8)); 
+    unsigned long const linkMillis = static_cast<unsigned long>(getIntegerOption(args, "--link-millis=", 50)); 
+    int const numCompiles = static_cast<int>(getIntegerOption(args, "--compiles=", 120)); 
+    unsigned long const compileMillis = static_cast<unsigned long>(getIntegerOption(args, "--compile-millis=", 10)); 
+
+    double const totalMillis = double(numLinks) * linkMillis + double(numCompiles) * compileMillis; 
+    double const lowerBound = std::max(double(numLinks) * linkMillis / poolDepth, totalMillis / numThreads); 
+
+    cout << "Resource pools, " << numThreads << " threads, "
+         << numLinks << " links x " << linkMillis << " ms in a pool of depth " << poolDepth << ", "
+         << numCompiles << " compiles x " << compileMillis << " ms" << std::endl; 
+    double const unpooled = runGraph(0, numThreads, numLinks, linkMillis, numCompiles, compileMillis); 
+    int const unpooledMax = maxRunningLinks; 
+    double const pooled = runGraph(poolDepth, numThreads, numLinks, linkMillis, numCompiles, compileMillis); 
+    int const pooledMax = maxRunningLinks; 
+    cout << fixed << setprecision(1)
+         << "lower bound with pool " << setw(8) << lowerBound << " ms" << std::endl
+         << "without pool          " << setw(8) << unpooled << " ms, at most " << unpooledMax << " links at once" << std::endl
+         << "with pool             " << setw(8) << pooled << " ms, at most " << pooledMax << " links at once" << std::endl; 
+    return 0; 
+}
@@ -0,0 +1,186 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "benchmarks.hpp"
+
+#include "jjmake/remoteexec.hpp"
+#include "jbase/jfatal.hpp"
+#include "jbase/jinttostring.hpp"
+#include "josutils/jclock.hpp"
+#include "josutils/jfilehandle.hpp"
+#include "josutils/jfilesystem.hpp"
+#include "josutils/jopen.hpp"
+#include "josutils/jpath.hpp"
+#include "josutils/jstat.hpp"
+#include "josutils/jthreading.hpp"
+
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace jjm; 
+using namespace std; 
+
+namespace
+{
+    class WorkerMain
+    {
+    public:
+        WorkerMain(RemoteWorker * worker_) : worker(worker_) {}
+        void operator() () { worker->run(); }
+    private:
+        RemoteWorker * worker; 
+    }; 
+
+    //Executes the commands, taking the next one until none is left. 
+    class DispatchMain
+    {
+    public:
+        DispatchMain(Dispatcher * dispatcher_, vector<ExecCommand> const* commands_, std::atomic<size_t> * next_, std::atomic<int> * numFailed_)
+            : dispatcher(dispatcher_), commands(commands_), next(next_), numFailed(numFailed_) {}
+        void operator() ()
+        {   for (size_t i; (i = (*next)++) < commands->size(); )
+            {   if (dispatcher->execute((*commands)[i]).exitcode != 0)
+                    ++*numFailed; 
+            }
+        }
+    private:
+        Dispatcher * dispatcher; 
+        vector<ExecCommand> const* commands; 
+        std::atomic<size_t> * next; 
+        std::atomic<int> * numFailed; 
+    }; 
+
+    void removeTree(Path const& path)
+    {   Stat const st = Stat::lstat2(path); 
+        if (st.type == FileType::Directory)
+        {   vector<string> const names = listDirectory(path); 
+            for (size_t i = 0; i < names.size(); ++i)
+                removeTree(Path::join(path, Path(names[i]))); 
+            removeDirectory(path); 
+        }else if (st.type != FileType::NoExist)
+            removeFile(path); 
+    }
+
+    //Incompressible content, so that the transfers are not shrunk by the 
+    //compression of the chunks. 
+    void writeRandomFile(Path const& path, size_t sizeBytes, std::uint64_t seed)
+    {   string content(sizeBytes, '\0'); 
+        std::uint64_t x = seed * 2654435761u + 1; 
+        for (size_t i = 0; i < sizeBytes; ++i)
+        {   x ^= x << 13; 
+            x ^= x >> 7; 
+            x ^= x << 17; 
+            content[i] = static_cast<char>(x); 
+        }
+        FileHandleOwner file(FileOpener().createOrOpen().truncate().writeOnly().open(path)); 
+        file.get().writeComplete(content.data(), content.size()); 
+    }
+
+    //Goals which sleep, and copy their own input to their output. Every goal 
+    //also reads a header shared by all of them. 
+    vector<ExecCommand> makeCommands(Path const& dir, int numGoals, unsigned long millis, size_t inputBytes, size_t sharedBytes)
+    {   Path const shared = Path::join(dir, Path("shared.h")); 
+        writeRandomFile(shared, sharedBytes, 0); 
+        string const seconds = toDecStr(millis / 1000) + "." + toDecStr(1000 + millis % 1000).substr(1); 
+        vector<ExecCommand> commands; 
+        for (int i = 0; i < numGoals; ++i)
+        {   string const source = "src-" + toDecStr(i) + ".c"; 
+            string const object = "obj-" + toDecStr(i) + ".o"; 
+            writeRandomFile(Path::join(dir, Path(source)), inputBytes, i + 1); 
+            removeFile(Path::join(dir, Path(object))); 
+            ExecCommand command; 
+            command.dir = dir; 
+            command.args.push_back("sh"); 
+            command.args.push_back("-c"); 
+            command.args.push_back("sleep " + seconds + " && cat shared.h " + source + " > " + object); 
+            command.inputs.push_back(shared); 
+            command.inputs.push_back(Path::join(dir, Path(source))); 
+            command.outputs.push_back(Path::join(dir, Path(object))); 
+            command.weightMillis = millis; 
+            commands.push_back(command); 
+        }
+        return commands; 
+    }
+
+    void runScenario(string const& label, Path const& dir, int numLocalJobs, int numWorkers, int numWorkerSlots,
+            vector<ExecCommand> const& commands)
+    {
+        vector<RemoteWorker*> workers; 
+        vector<Thread*> workerThreads; 
+        std::int64_t start = 0, end = 0; 
+        std::atomic<int> numFailed(0); 
+        Dispatcher dispatcher(numLocalJobs); 
+        {   for (int w = 0; w < numWorkers; ++w)
+            {   workers.push_back(new RemoteWorker); 
+                workers.back()->open(Path::join(dir, Path("worker-" + toDecStr(w))), std::int64_t(1024) * 1024 * 1024, numWorkerSlots,
+                        "unix:" + Path::join(dir, Path("worker-" + toDecStr(w) + ".sock")).getStringRep()); 
+                workerThreads.push_back(new Thread(WorkerMain(workers.back()), Thread::JoinInDtor)); 
+                dispatcher.addWorker(workers.back()->getAddress(), std::int64_t(5) * 1000 * 1000 * 1000); 
+            }
+
+            std::atomic<size_t> next(0); 
+            vector<Thread*> threads; 
+            start = getMonotonicClockNanoSec(); 
+            for (int t = 0; t < numLocalJobs + numWorkers * numWorkerSlots; ++t)
+                threads.push_back(new Thread(DispatchMain( & dispatcher, & commands, & next, & numFailed), Thread::JoinInDtor)); 
+            for (size_t t = 0; t < threads.size(); ++t)
+                delete threads[t]; 
+            end = getMonotonicClockNanoSec(); 
+
+            for (size_t w = 0; w < workers.size(); ++w)
+                workers[w]->stop(); 
+            for (size_t w = 0; w < workers.size(); ++w)
+            {   delete workerThreads[w]; 
+                delete workers[w]; 
+            }
+        }
+        if (numFailed != 0)
+            JFATAL(numFailed, label); 
+        for (size_t i = 0; i < commands.size(); ++i)
+        {   if (Stat::stat2(commands[i].outputs[0]).type != FileType::RegularFile)
+                JFATAL(i, label); 
+        }
+        cout << label << setw(8) << (end - start) / 1e6 << " ms, local " << setw(4) << dispatcher.getNumLocal()
+             << ", remote " << setw(4) << dispatcher.getNumRemote() << ", sent " << setw(8) << dispatcher.getNumBytesSent() / 1024
+             << " KiB" << std::endl; 
+    }
+}
+
+int jjm::remoteExecBenchmark(vector<string> const& args)
+{
+    int const numLocalJobs = static_cast<int>(getIntegerOption(args, "--local-jobs=", 2)); 
+    int const numWorkers = static_cast<int>(getIntegerOption(args, "--workers=", 3)); 
+    int const numWorkerSlots = static_cast<int>(getIntegerOption(args, "--worker-slots=", 2)); 
+    int const numGoals = static_cast<int>(getIntegerOption(args, "--goals=", 48)); 
+    unsigned long const millis = static_cast<unsigned long>(getIntegerOption(args, "--compile-millis=", 100)); 
+    size_t const largeInputBytes = static_cast<size_t>(getIntegerOption(args, "--large-input-mb=", 32)) * 1024 * 1024; 
+
+    Path const dir = Path("jjmake-remoteexec-benchmark.tmp").getAbsolutePath(); 
+    removeTree(dir); 
+    createDirectories(dir); 
+
+    cout << "Remote execution over Unix domain sockets, " << numLocalJobs << " local jobs, " << numWorkers
+         << " workers of " << numWorkerSlots << " slots in this process" << std::endl; 
+    cout << fixed << setprecision(1); 
+
+    vector<ExecCommand> const compute = makeCommands(dir, numGoals, millis, 16 * 1024, 1024 * 1024); 
+    cout << numGoals << " goals of " << millis << " ms with 16 KiB inputs and a shared 1 MiB header" << std::endl; 
+    runScenario("    local only      ", dir, numLocalJobs, 0, numWorkerSlots, compute); 
+    runScenario("    with the workers", dir, numLocalJobs, numWorkers, numWorkerSlots, compute); 
+
+    //Sending each input takes longer than executing the goal locally, so 
+    //the dispatcher should keep most goals local. 
+    int const numLarge = numLocalJobs * 4; 
+    vector<ExecCommand> const transfer = makeCommands(dir, numLarge, 5, largeInputBytes, 0); 
+    cout << numLarge << " goals of 5 ms with " << largeInputBytes / (1024 * 1024) << " MiB inputs of their own" << std::endl; 
+    runScenario("    local only      ", dir, numLocalJobs, 0, numWorkerSlots, transfer); 
+    runScenario("    with the workers", dir, numLocalJobs, numWorkers, numWorkerSlots, transfer); 
+
+    removeTree(dir); 
+    return 0; 
+}
@@ -0,0 +1,104 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "benchmarks.hpp"
+
+#include "jbase/juniqueptr.hpp"
+#include "josutils/jclock.hpp"
+#include "josutils/jprocess.hpp"
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/resource.h>
+    #include <unistd.h>
+#endif
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace jjm;
+using namespace std;
+
+#ifdef _WIN32
+
+int jjm::spawnBenchmark(vector<string> const& )
+{
+    cout << "The spawn benchmark compares fork() and posix_spawn(), and is not supported on windows." << std::endl; 
+    return 0; 
+}
+
+#else
+
+namespace
+{
+    //Spawns and joins "true" numSpawns times. 
+    //Returns the spawns per second. 
+    double spawnRate(bool forkExec, int numSpawns)
+    {
+        ProcessBuilder builder; 
+        builder.forkExec(forkExec).arg("true"); 
+        std::int64_t const start = getMonotonicClockNanoSec(); 
+        for (int i = 0; i < numSpawns; ++i)
+        {   UniquePtr<Process*> process(builder.spawn()); 
+            process.get()->join(); 
+        }
+        std::int64_t const end = getMonotonicClockNanoSec(); 
+        return numSpawns / ((end - start) / 1e9); 
+    }
+
+    //Holds numFds close-on-exec descriptors open, standing in for the 
+    //file handles of a large build, which every spawn has to close. 
+    class OpenFds
+    {
+    public:
+        explicit OpenFds(int numFds)
+        {   rlimit limit; 
+            if (0 == getrlimit(RLIMIT_NOFILE, &limit) && limit.rlim_cur < limit.rlim_max)
+            {   limit.rlim_cur = limit.rlim_max; 
+                setrlimit(RLIMIT_NOFILE, &limit); 
+            }
+            for (int i = 0; i < numFds; ++i)
+            {   int const fd = open("/dev/null", O_RDONLY | O_CLOEXEC); 
+                if (fd == -1)
+                    break; 
+                fds.push_back(fd); 
+            }
+        }
+        ~OpenFds()
+        {   for (size_t i = 0; i < fds.size(); ++i)
+                close(fds[i]); 
+        }
+        vector<int> fds; 
+    private:
+        OpenFds(OpenFds const& ); //not defined, not copyable
+        OpenFds& operator= (OpenFds const& ); //not defined, not copyable
+    };
+}
+
+int jjm::spawnBenchmark(vector<string> const& args)
+{
+    int const numSpawns = static_cast<int>(getIntegerOption(args, "--spawns=", 200)); 
+    long long const maxMegaBytes = getIntegerOption(args, "--max-rss-mb=", 1024); 
+    OpenFds openFds(static_cast<int>(getIntegerOption(args, "--open-fds=", 0))); 
+
+    cout << "Spawns per second of \"true\", " << numSpawns << " spawns, "
+         << openFds.fds.size() << " open file descriptors, "
+         << "against the resident memory of the parent" << std::endl; 
+    cout << "  memory       fork()   posix_spawn()" << std::endl; 
+    //Touched memory stands in for a large graph. 
+    vector<char> graph; 
+    for (long long megaBytes = 0; megaBytes <= maxMegaBytes; megaBytes = megaBytes ? megaBytes * 4 : 64)
+    {   graph.assign(static_cast<size_t>(megaBytes) * 1024 * 1024, 1); 
+        double const forkRate = spawnRate(true, numSpawns); 
+        double const spawnRate_ = spawnRate(false, numSpawns); 
+        cout << fixed << setprecision(0)
+             << setw(6) << megaBytes << " MB  " << setw(10) << forkRate << "  " << setw(14) << spawnRate_ << std::endl; 
+    }
+    return 0; 
+}
+
+#endif
@@ -0,0 +1,80 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "benchmarks.hpp"
+
+#include "jjmake/jjmakecontext.hpp"
+#include "jjmake/statcache.hpp"
+#include "jbase/jinttostring.hpp"
+#include "josutils/jclock.hpp"
+#include "josutils/jfilehandle.hpp"
+#include "josutils/jfilesystem.hpp"
+#include "josutils/jopen.hpp"
+#include "josutils/jpath.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace jjm;
+using namespace std;
+
+namespace
+{
+    string outputPath(Path const& dir, long i)
+    {
+        return Path::join(dir, Path("out-" + toDecStr(i) + ".txt")).getStringRep(); 
+    }
+
+    //Returns the wall time in milliseconds. 
+    double runBuild(Path const& dir, int numThreads, long numGoals, std::int64_t & statCalls, std::int64_t & savedStatCalls)
+    {
+        JjmakeContext::Arguments arguments; 
+        arguments.allGoals = true; 
+        arguments.numThreads = numThreads; 
+        arguments.stateDir = ""; 
+        string const header = Path::join(dir, Path("header.h")).getStringRep(); 
+        for (long i = 0; i < numGoals; ++i)
+            arguments.rootEvalText += "(touch-node '" + outputPath(dir, i) + "' '" + header + "')\n"; 
+
+        JjmakeContext context(arguments); 
+        SilenceStdOut silence; 
+        std::int64_t const start = getMonotonicClockNanoSec(); 
+        context.execute(); 
+        std::int64_t const end = getMonotonicClockNanoSec(); 
+        statCalls = context.getStatCache().getNumStatCalls(); 
+        savedStatCalls = context.getStatCache().getNumSavedStatCalls(); 
+        return (end - start) / 1e6; 
+    }
+}
+
+int jjm::statCacheBenchmark(vector<string> const& args)
+{
+    int const numThreads = static_cast<int>(getIntegerOption(args, "--threads=", 4)); 
+    long const numGoals = static_cast<long>(getIntegerOption(args, "--goals=", 10 * 1000)); 
+    Path const dir = Path("jjmake-statcache-benchmark.tmp").getAbsolutePath(); 
+    createDirectories(dir); 
+    {   FileHandleOwner header(FileOpener().createOrOpen().readWrite().open(Path::join(dir, Path("header.h")))); 
+    }
+    for (long i = 0; i < numGoals; ++i)
+        removeFile(Path(outputPath(dir, i))); 
+
+    cout << "Stat cache, " << numThreads << " threads, " << numGoals << " touch-node goals sharing one input" << std::endl; 
+    cout << fixed << setprecision(1); 
+    char const * const names[] = { "clean build       ", "up-to-date build  " }; 
+    for (int run = 0; run < 2; ++run)
+    {   std::int64_t statCalls = 0; 
+        std::int64_t savedStatCalls = 0; 
+        double const millis = runBuild(dir, numThreads, numGoals, statCalls, savedStatCalls); 
+        cout << names[run] << setw(10) << millis << " ms, " 
+             << statCalls << " stat calls, " << savedStatCalls << " saved" << std::endl; 
+    }
+
+    for (long i = 0; i < numGoals; ++i)
+        removeFile(Path(outputPath(dir, i))); 
+    removeFile(Path::join(dir, Path("header.h"))); 
+    return 0; 
+}
@@ -0,0 +1,239 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "benchmarks.hpp"
+
+#include "jbase/juniqueptr.hpp"
+#include "josutils/jclock.hpp"
+#include "josutils/jthreading.hpp"
+
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+using namespace jjm;
+using namespace std;
+
+namespace
+{
+    //The original jjm::ThreadPool: a single vector of pending tasks behind a 
+    //single mutex, popped LIFO, with one notify_one() per addTask(). 
+    //Kept here verbatim as the baseline for comparison. 
+    class LegacyThreadPool
+    {
+    public:
+        LegacyThreadPool(int numThreads)
+            : stopflag(false), numRunningTasks(0)
+        {
+            WorkerMain workerMain;
+            workerMain.pool = this;
+            for (int i = 0; i < numThreads; ++i)
+            {   createdThreads.push_back(0);
+                createdThreads.back() = new Thread(workerMain, Thread::JoinInDtor);
+            }
+        }
+        ~LegacyThreadPool()
+        {
+            setStopFlag();
+            for (size_t i=0; i<createdThreads.size(); ++i)
+                delete createdThreads[i];
+        }
+        void waitUntilIdle()
+        {
+            Lock g(mutex);
+            for (;;)
+            {   if (numRunningTasks == 0 && pendingTasks.size() == 0)
+                    return; 
+                if (numRunningTasks == 0 && stopflag)
+                    return; 
+                wait(g, idleCondition); 
+            }
+        }
+        void addTask(Thread::Runnable* task)
+        {
+            UniquePtr<Thread::Runnable*> task2(task);
+            {
+                Lock g(mutex);
+                pendingTasks.push_back(0);
+                pendingTasks.back() = task2.release();
+            }
+            newTaskCondition.notify_one();
+        }
+        //The legacy pool had no bulk interface. 
+        void addTasks(vector<Thread::Runnable*> & tasks)
+        {
+            for (size_t i = 0; i < tasks.size(); ++i)
+                addTask(tasks[i]); 
+            tasks.clear(); 
+        }
+        void setStopFlag()
+        {
+            {
+                Lock g(mutex);
+                stopflag = true;
+            }
+            newTaskCondition.notify_all();
+        }
+    private:
+        class WorkerMain
+        {   
+        public:
+            LegacyThreadPool * pool;
+            void operator() ()
+            {
+                Lock g(pool->mutex);
+                for (;;)
+                {   UniquePtr<Thread::Runnable*> task;
+                    for (;;)
+                    {   if (pool->stopflag)
+                        {   pool->idleCondition.notify_all();
+                            return;
+                        }
+                        if (pool->pendingTasks.size())
+                        {   task.reset(pool->pendingTasks.back());
+                            pool->pendingTasks.pop_back();
+                            break;
+                        }
+                        if (0 == pool->numRunningTasks)
+                            pool->idleCondition.notify_all();
+                        wait(g, pool->newTaskCondition);
+                    }
+                    ++pool->numRunningTasks;
+                    {
+                        ReverseLock rg(g);
+                        task->run();
+                    }
+                    --pool->numRunningTasks;
+                }
+            }
+        };
+        Mutex mutex;
+        CondVar newTaskCondition;
+        CondVar idleCondition;
+        bool stopflag;
+        int numRunningTasks;
+        vector<Thread*> createdThreads;
+        vector<Thread::Runnable*> pendingTasks;
+    };
+
+    //Does a trivial amount of work, like a cheap up-to-date goal. 
+    class CountingTask : public Thread::Runnable
+    {
+    public:
+        CountingTask(atomic<long> & counter_) : counter(counter_) {}
+        atomic<long> & counter; 
+        virtual void run() { ++counter; }
+    };
+
+    //Models phase2: every finished task makes "fanout" new tasks ready, until
+    //"depth" is reached. The new tasks are added from inside the worker. 
+    template <typename Pool>
+    class FanOutTask : public Thread::Runnable
+    {
+    public:
+        FanOutTask(Pool & pool_, atomic<long> & counter_, int depth_, int fanout_) 
+            : pool(pool_), counter(counter_), depth(depth_), fanout(fanout_) {}
+        Pool & pool; 
+        atomic<long> & counter; 
+        int depth; 
+        int fanout; 
+        virtual void run() 
+        {   ++counter; 
+            if (depth == 0)
+                return; 
+            vector<Thread::Runnable*> children; 
+            for (int i = 0; i < fanout; ++i)
+                children.push_back(new FanOutTask(pool, counter, depth - 1, fanout)); 
+            pool.addTasks(children); 
+        }
+    };
+
+    //Tasks are added by the main thread, one call per task. 
+    template <typename Pool>
+    double flatOneByOne(int numThreads, long numTasks)
+    {
+        Pool pool(numThreads); 
+        atomic<long> counter(0); 
+        std::int64_t const start = getMonotonicClockNanoSec(); 
+        for (long i = 0; i < numTasks; ++i)
+            pool.addTask(new CountingTask(counter)); 
+        pool.waitUntilIdle(); 
+        std::int64_t const end = getMonotonicClockNanoSec(); 
+        if (counter != numTasks)
+            JFATAL(0, 0); 
+        return numTasks / ((end - start) / 1e9); 
+    }
+
+    //Tasks are added by the main thread in one bulk call. 
+    template <typename Pool>
+    double flatBulk(int numThreads, long numTasks)
+    {
+        Pool pool(numThreads); 
+        atomic<long> counter(0); 
+        vector<Thread::Runnable*> tasks; 
+        for (long i = 0; i < numTasks; ++i)
+            tasks.push_back(new CountingTask(counter)); 
+        std::int64_t const start = getMonotonicClockNanoSec(); 
+        pool.addTasks(tasks); 
+        pool.waitUntilIdle(); 
+        std::int64_t const end = getMonotonicClockNanoSec(); 
+        if (counter != numTasks)
+            JFATAL(0, 0); 
+        return numTasks / ((end - start) / 1e9); 
+    }
+
+    template <typename Pool>
+    double fanOut(int numThreads, long numTasks)
+    {
+        //pick a depth so that the tree has at least numTasks nodes
+        int const fanout = 4; 
+        int depth = 0; 
+        long total = 1; 
+        for (long level = 1; total < numTasks; ++depth)
+        {   level *= fanout; 
+            total += level; 
+        }
+        Pool pool(numThreads); 
+        atomic<long> counter(0); 
+        std::int64_t const start = getMonotonicClockNanoSec(); 
+        pool.addTask(new FanOutTask<Pool>(pool, counter, depth, fanout)); 
+        pool.waitUntilIdle(); 
+        std::int64_t const end = getMonotonicClockNanoSec(); 
+        if (counter != total)
+            JFATAL(0, 0); 
+        return total / ((end - start) / 1e9); 
+    }
+
+    void printRow(char const * scenario, int numThreads, double legacy, double current)
+    {
+        cout << setw(12) << left << scenario 
+             << " threads " << setw(3) << right << numThreads 
+             << "   legacy " << setw(12) << static_cast<long long>(legacy) << " tasks/s"
+             << "   work-stealing " << setw(12) << static_cast<long long>(current) << " tasks/s"
+             << "   speedup " << fixed << setprecision(2) << current / legacy << "x" 
+             << endl; 
+    }
+}
+
+int jjm::threadPoolBenchmark(vector<string> const& args)
+{
+    int const maxThreads = static_cast<int>(getIntegerOption(args, "--max-threads=", 16)); 
+    long const numTasks = static_cast<long>(getIntegerOption(args, "--tasks=", 200 * 1000)); 
+
+    cout << "ThreadPool throughput, " << numTasks << " trivial tasks per run" << endl; 
+    vector<int> threadCounts; 
+    for (int t = 1; t < maxThreads; t *= 2)
+        threadCounts.push_back(t); 
+    threadCounts.push_back(maxThreads); 
+
+    for (size_t i = 0; i < threadCounts.size(); ++i)
+    {   int const t = threadCounts[i]; 
+        printRow("addTask", t, flatOneByOne<LegacyThreadPool>(t, numTasks), flatOneByOne<ThreadPool>(t, numTasks)); 
+        printRow("addTasks", t, flatBulk<LegacyThreadPool>(t, numTasks), flatBulk<ThreadPool>(t, numTasks)); 
+        printRow("fan-out", t, fanOut<LegacyThreadPool>(t, numTasks), fanOut<ThreadPool>(t, numTasks)); 
+    }
+    return 0; 
+}
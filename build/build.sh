@@ -256,10 +256,31 @@ link_exe  "bin/$platform/jjmake/jjmake"  "tmp/$platform/jjmake/"*$obj_ext  \
     "${linkagainst_iconv_opts[@]}"
 x=$?; if test $x -ne 0; then exit 1; fi
 
+#the jjmake objects, except the one with main(), for the tests and the 
+#benchmarks 
+objs=("tmp/$platform/jjmake/"*$obj_ext)
+objs2=()
+for obj in "${objs[@]}" ; do
+  if echo "$obj" | grep '/main\'$obj_ext > /dev/null ; then continue ; fi
+  objs2=("${objs2[@]}" "$obj")
+done
+
 #tests
 compile_cpps "tmp/$platform/tests/" tests/*.cpp "-I${PWD}" 
 x=$?; if test $x -ne 0; then exit 1; fi
 link_exe  "bin/$platform/tests/tests"  "tmp/$platform/tests/"*$obj_ext  \
+    "${objs2[@]}" \
+    "tmp/$platform/jbase/jbase$staticlib_ext" \
+    "tmp/$platform/josutils/josutils$staticlib_ext" \
+    "tmp/$platform/junicode/junicode$staticlib_ext" \
+    "${linkagainst_iconv_opts[@]}"
+x=$?; if test $x -ne 0; then exit 1; fi
+
+#benchmarks
+compile_cpps "tmp/$platform/benchmarks/" benchmarks/*.cpp "-I${PWD}" 
+x=$?; if test $x -ne 0; then exit 1; fi
+link_exe  "bin/$platform/benchmarks/benchmarks"  "tmp/$platform/benchmarks/"*$obj_ext  \
+    "${objs2[@]}" \
     "tmp/$platform/jbase/jbase$staticlib_ext" \
     "tmp/$platform/josutils/josutils$staticlib_ext" \
     "tmp/$platform/junicode/junicode$staticlib_ext" \
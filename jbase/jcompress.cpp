@@ -0,0 +1,134 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "jcompress.hpp"
+
+#include "jstdint.hpp"
+
+#include <vector>
+
+namespace
+{
+    //The limits of the format: a match is at least 4 bytes, at most 65535 
+    //bytes back, and the last 5 bytes of a block, and the last match start 
+    //12 bytes before its end, are literals. 
+    size_t const minMatch = 4; 
+    size_t const maxOffset = 65535; 
+    size_t const lastLiterals = 5; 
+    size_t const matchFindLimit = 12; 
+    int const hashBits = 16; 
+
+    inline std::uint32_t read32(unsigned char const * p)
+    {   return p[0] | (p[1] << 8) | (p[2] << 16) | (std::uint32_t(p[3]) << 24); 
+    }
+
+    inline size_t hash4(unsigned char const * p)
+    {   return (read32(p) * 2654435761U) >> (32 - hashBits); 
+    }
+
+    //A length of 15 or more continues in bytes of 255, ended by a smaller one.
+    void appendLength(std::string & out, size_t length)
+    {   for ( ; length >= 255; length -= 255)
+            out.push_back(static_cast<char>(255)); 
+        out.push_back(static_cast<char>(length)); 
+    }
+
+    void appendSequence(std::string & out, unsigned char const * literals, size_t numLiterals, size_t offset, size_t matchLength)
+    {   size_t const matchCode = matchLength ? matchLength - minMatch : 0; 
+        out.push_back(static_cast<char>(((numLiterals < 15 ? numLiterals : 15) << 4) | (matchCode < 15 ? matchCode : 15))); 
+        if (numLiterals >= 15)
+            appendLength(out, numLiterals - 15); 
+        out.append(reinterpret_cast<char const *>(literals), numLiterals); 
+        if (matchLength == 0)
+            return; 
+        out.push_back(static_cast<char>(offset & 0xFF)); 
+        out.push_back(static_cast<char>(offset >> 8)); 
+        if (matchCode >= 15)
+            appendLength(out, matchCode - 15); 
+    }
+
+    bool readLength(unsigned char const * & p, unsigned char const * end, size_t & length)
+    {   for (;;)
+        {   if (p == end)
+                return false; 
+            unsigned char const x = *p++; 
+            length += x; 
+            if (x != 255)
+                return true; 
+        }
+    }
+}
+
+void jjm::compressBlock(void const * data, size_t sizeBytes, std::string & out)
+{
+    unsigned char const * const src = static_cast<unsigned char const *>(data); 
+    size_t anchor = 0; 
+    if (sizeBytes > matchFindLimit)
+    {   //positions plus one, so that 0 is no position 
+        std::vector<std::uint32_t> table(size_t(1) << hashBits, 0); 
+        size_t const matchEndLimit = sizeBytes - lastLiterals; 
+        for (size_t pos = 0; pos + matchFindLimit <= sizeBytes; )
+        {   size_t const h = hash4(src + pos); 
+            size_t const candidate = table[h]; 
+            table[h] = static_cast<std::uint32_t>(pos + 1); 
+            if (candidate == 0 || pos - (candidate - 1) > maxOffset || read32(src + candidate - 1) != read32(src + pos))
+            {   ++pos; 
+                continue; 
+            }
+            size_t const match = candidate - 1; 
+            size_t length = minMatch; 
+            while (pos + length < matchEndLimit && src[match + length] == src[pos + length])
+                ++length; 
+            appendSequence(out, src + anchor, pos - anchor, pos - match, length); 
+            pos += length; 
+            anchor = pos; 
+        }
+    }
+    appendSequence(out, src + anchor, sizeBytes - anchor, 0, 0); 
+}
+
+bool jjm::decompressBlock(void const * data, size_t sizeBytes, size_t rawSizeBytes, std::string & out)
+{
+    unsigned char const * p = static_cast<unsigned char const *>(data); 
+    unsigned char const * const end = p + sizeBytes; 
+    size_t const start = out.size(); 
+    out.resize(start + rawSizeBytes); 
+    char * const dest = rawSizeBytes ? & out[start] : 0; 
+    size_t done = 0; 
+    for (;;)
+    {   if (p == end)
+            return false; 
+        unsigned char const token = *p++; 
+
+        size_t numLiterals = token >> 4; 
+        if (numLiterals == 15 && ! readLength(p, end, numLiterals))
+            return false; 
+        if (numLiterals > size_t(end - p) || numLiterals > rawSizeBytes - done)
+            return false; 
+        for (size_t i = 0; i < numLiterals; ++i)
+            dest[done + i] = static_cast<char>(p[i]); 
+        p += numLiterals; 
+        done += numLiterals; 
+        if (p == end)
+            return done == rawSizeBytes; 
+
+        if (end - p < 2)
+            return false; 
+        size_t const offset = p[0] | (p[1] << 8); 
+        p += 2; 
+        if (offset == 0 || offset > done)
+            return false; 
+        size_t matchLength = token & 15; 
+        if (matchLength == 15 && ! readLength(p, end, matchLength))
+            return false; 
+        matchLength += minMatch; 
+        if (matchLength > rawSizeBytes - done)
+            return false; 
+        //byte by byte, as the match may overlap the bytes it produces 
+        for (size_t i = 0; i < matchLength; ++i)
+            dest[done + i] = dest[done - offset + i]; 
+        done += matchLength; 
+    }
+}
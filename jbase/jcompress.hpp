@@ -0,0 +1,27 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#ifndef JBASE_JCOMPRESS_HPP_HEADER_GUARD
+#define JBASE_JCOMPRESS_HPP_HEADER_GUARD
+
+#include <stddef.h>
+#include <string>
+
+namespace jjm
+{
+
+//A fast compression of one block of bytes, in the LZ4 block format. It favors
+//speed over ratio, so that it pays off even on a fast network. 
+//Appends the compressed block to out. 
+void compressBlock(void const * data, size_t sizeBytes, std::string & out); 
+
+//Appends the rawSizeBytes bytes of a block from compressBlock() to out. 
+//Returns false, with out in an unspecified state, when the block is malformed
+//or does not decompress to exactly rawSizeBytes bytes. 
+bool decompressBlock(void const * data, size_t sizeBytes, size_t rawSizeBytes, std::string & out); 
+
+} //namespace jjm
+
+#endif
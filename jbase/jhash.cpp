@@ -0,0 +1,91 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "jhash.hpp"
+
+namespace
+{
+    std::uint64_t const prime1 = 0x9E3779B185EBCA87ULL; 
+    std::uint64_t const prime2 = 0xC2B2AE3D27D4EB4FULL; 
+    std::uint64_t const prime3 = 0x165667B19E3779F9ULL; 
+    std::uint64_t const prime4 = 0x85EBCA77C2B2AE63ULL; 
+    std::uint64_t const prime5 = 0x27D4EB2F165667C5ULL; 
+
+    inline std::uint64_t rotateLeft(std::uint64_t x, int bits) { return (x << bits) | (x >> (64 - bits)); }
+
+    //little endian loads, independent of the byte order of the machine
+    inline std::uint64_t read64(unsigned char const * p)
+    {   std::uint64_t x = 0; 
+        for (int i = 7; i >= 0; --i)
+            x = (x << 8) | p[i]; 
+        return x; 
+    }
+    inline std::uint64_t read32(unsigned char const * p)
+    {   std::uint64_t x = 0; 
+        for (int i = 3; i >= 0; --i)
+            x = (x << 8) | p[i]; 
+        return x; 
+    }
+
+    inline std::uint64_t round(std::uint64_t acc, std::uint64_t input)
+    {   acc += input * prime2; 
+        acc = rotateLeft(acc, 31); 
+        return acc * prime1; 
+    }
+
+    inline std::uint64_t mergeRound(std::uint64_t acc, std::uint64_t val)
+    {   acc ^= round(0, val); 
+        return acc * prime1 + prime4; 
+    }
+}
+
+std::uint64_t jjm::hash64(void const * data, size_t sizeBytes, std::uint64_t seed)
+{
+    unsigned char const * p = static_cast<unsigned char const *>(data); 
+    unsigned char const * const end = p + sizeBytes; 
+    std::uint64_t h = 0; 
+
+    if (sizeBytes >= 32)
+    {   std::uint64_t v1 = seed + prime1 + prime2; 
+        std::uint64_t v2 = seed + prime2; 
+        std::uint64_t v3 = seed; 
+        std::uint64_t v4 = seed - prime1; 
+        for ( ; end - p >= 32; p += 32)
+        {   v1 = round(v1, read64(p)); 
+            v2 = round(v2, read64(p + 8)); 
+            v3 = round(v3, read64(p + 16)); 
+            v4 = round(v4, read64(p + 24)); 
+        }
+        h = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) + rotateLeft(v4, 18); 
+        h = mergeRound(h, v1); 
+        h = mergeRound(h, v2); 
+        h = mergeRound(h, v3); 
+        h = mergeRound(h, v4); 
+    }else
+        h = seed + prime5; 
+
+    h += static_cast<std::uint64_t>(sizeBytes); 
+
+    for ( ; end - p >= 8; p += 8)
+    {   h ^= round(0, read64(p)); 
+        h = rotateLeft(h, 27) * prime1 + prime4; 
+    }
+    if (end - p >= 4)
+    {   h ^= read32(p) * prime1; 
+        h = rotateLeft(h, 23) * prime2 + prime3; 
+        p += 4; 
+    }
+    for ( ; p != end; ++p)
+    {   h ^= (*p) * prime5; 
+        h = rotateLeft(h, 11) * prime1; 
+    }
+
+    h ^= h >> 33; 
+    h *= prime2; 
+    h ^= h >> 29; 
+    h *= prime3; 
+    h ^= h >> 32; 
+    return h; 
+}
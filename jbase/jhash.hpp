@@ -0,0 +1,23 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#ifndef JBASE_JHASH_HPP_HEADER_GUARD
+#define JBASE_JHASH_HPP_HEADER_GUARD
+
+#include "jstdint.hpp"
+#include <stddef.h>
+
+namespace jjm
+{
+
+//A fast non-cryptographic 64 bit hash, the XXH64 algorithm. 
+//The result does not depend on the byte order of the machine, so it can be
+//stored in files and compared across machines. 
+//Do not use it where an attacker chooses the input. 
+std::uint64_t hash64(void const * data, size_t sizeBytes, std::uint64_t seed = 0); 
+
+} //namespace jjm
+
+#endif
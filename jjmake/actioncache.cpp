@@ -0,0 +1,275 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "actioncache.hpp"
+
+#include "jbase/jinttostring.hpp"
+#include "josutils/jfilehandle.hpp"
+#include "josutils/jfilesystem.hpp"
+#include "josutils/jopen.hpp"
+#include "josutils/jstat.hpp"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+using namespace jjm; 
+using namespace std; 
+
+namespace
+{
+    char const actionMagic[] = "jjmake-action 1"; 
+
+    bool endsWith(string const& s, string const& suffix)
+    {   return s.size() >= suffix.size() && 0 == s.compare(s.size() - suffix.size(), suffix.size(), suffix); 
+    }
+
+    class ActionFile
+    {
+    public:
+        ActionFile() : lastUseNanoSec(0) {}
+        string name; 
+        std::int64_t lastUseNanoSec; 
+        vector<string> blobNames; 
+        bool operator< (ActionFile const& x) const { return lastUseNanoSec > x.lastUseNanoSec; } //most recent first
+    }; 
+}
+
+jjm::ActionCache::ActionCache()
+    : maxBytes(0), numHits(0), numMisses(0), numStored(0), numEvicted(0), numStoredSinceTrim(0)
+{}
+
+void jjm::ActionCache::open(Path const& dir_, std::int64_t maxBytes_)
+{
+    Path const newBlobsDir = Path::join(dir_, Path("blobs")); 
+    Path const newActionsDir = Path::join(dir_, Path("actions")); 
+    createDirectories(newBlobsDir); 
+    createDirectories(newActionsDir); 
+    dir = dir_; 
+    blobsDir = newBlobsDir; 
+    actionsDir = newActionsDir; 
+    maxBytes = maxBytes_; 
+}
+
+jjm::Path jjm::ActionCache::getActionPath(std::uint64_t key) const
+{
+    return Path::join(actionsDir, Path(toHexStr(key))); 
+}
+
+bool jjm::ActionCache::readAction(Path const& path, std::vector<Blob> & blobs)
+{
+    blobs.clear(); 
+    string text; 
+    try
+    {   FileHandleOwner file(FileOpener().openExistingOnly().readOnly().open(path)); 
+        char buffer[4096]; 
+        for (;;)
+        {   ssize_t const n = file.get().read(buffer, sizeof(buffer)); 
+            if (n < 0)
+                break; 
+            text.append(buffer, n); 
+        }
+    } catch (std::exception & )
+    {   return false; 
+    }
+
+    istringstream in(text); 
+    string line; 
+    if ( ! getline(in, line) || line != actionMagic)
+        return false; 
+    while (getline(in, line))
+    {   Blob blob; 
+        istringstream fields(line); 
+        if ( ! (fields >> blob.name >> blob.sizeBytes >> blob.lastWriteTimeNanoSec))
+            return false; 
+        blobs.push_back(blob); 
+    }
+    return true; 
+}
+
+bool jjm::ActionCache::findBlobs(std::uint64_t key, std::vector<Path> & blobPaths)
+{
+    blobPaths.clear(); 
+    Path const actionPath = getActionPath(key); 
+    vector<Blob> blobs; 
+    if ( ! readAction(actionPath, blobs))
+        return false; 
+    for (size_t i = 0; i < blobs.size(); ++i)
+    {   Path const blobPath = Path::join(blobsDir, Path(blobs[i].name)); 
+        Stat const st = Stat::stat2(blobPath); 
+        if (st.type != FileType::RegularFile
+                || st.sizeBytes != blobs[i].sizeBytes
+                || st.lastWriteTimeNanoSec != blobs[i].lastWriteTimeNanoSec)
+        {   //Evicted, or modified in place through an output which was
+            //restored by hard link.
+            try
+            {   removeFile(actionPath); 
+            } catch (std::exception & )
+            {
+            }
+            blobPaths.clear(); 
+            return false; 
+        }
+        blobPaths.push_back(blobPath); 
+    }
+    return true; 
+}
+
+bool jjm::ActionCache::restore(std::uint64_t key, std::vector<Path> const& outputs)
+{
+    vector<Path> blobPaths; 
+    if ( ! findBlobs(key, blobPaths) || blobPaths.size() != outputs.size())
+    {   ++numMisses; 
+        return false; 
+    }
+    try
+    {   for (size_t i = 0; i < blobPaths.size(); ++i)
+        {   removeFile(outputs[i]); 
+            createDirectories(outputs[i].getParent()); 
+            //Never by hard link, so that the output is a file of its own, 
+            //and with the last write time of a fresh output, so that goals 
+            //which compare timestamps see it as newer than their outputs. 
+            copyFile(blobPaths[i], outputs[i], false); 
+            setFileTimesToNow(outputs[i]); 
+        }
+        setFileTimesToNow(getActionPath(key)); 
+    } catch (std::exception & )
+    {   ++numMisses; 
+        return false; 
+    }
+    ++numHits; 
+    return true; 
+}
+
+bool jjm::ActionCache::lookup(std::uint64_t key, std::vector<Path> & blobPaths)
+{
+    if ( ! findBlobs(key, blobPaths))
+    {   ++numMisses; 
+        return false; 
+    }
+    try
+    {   setFileTimesToNow(getActionPath(key)); 
+    } catch (std::exception & )
+    {   //evicted meanwhile, which the caller finds when it opens the blobs 
+    }
+    ++numHits; 
+    return true; 
+}
+
+bool jjm::ActionCache::isStored(std::uint64_t key) const
+{
+    return Stat::stat2(getActionPath(key)).type == FileType::RegularFile; 
+}
+
+void jjm::ActionCache::store(std::uint64_t key, std::vector<Path> const& outputs, std::vector<std::uint64_t> const& contentHashes)
+{
+    if (outputs.size() != contentHashes.size())
+        throw std::runtime_error("jjm::ActionCache::store() failed. Cause:\nThe number of content hashes does not match the number of outputs."); 
+    Path const actionPath = getActionPath(key); 
+    if (Stat::stat2(actionPath).type == FileType::RegularFile)
+        return; 
+
+    string const keyName = toHexStr(key); 
+    string text = string(actionMagic) + "\n"; 
+    for (size_t i = 0; i < outputs.size(); ++i)
+    {   Stat const outputStat = Stat::stat(outputs[i]); 
+        if (outputStat.type != FileType::RegularFile)
+            return; //only regular files are kept
+        string const blobName = toHexStr(contentHashes[i]) + "-" + toDecStr(outputStat.sizeBytes); 
+        Path const blobPath = Path::join(blobsDir, Path(blobName)); 
+
+        //A blob with other links may have been modified through them, and is
+        //replaced by a file of its own.
+        Stat blobStat = Stat::stat2(blobPath); 
+        if (blobStat.type != FileType::RegularFile || blobStat.linkCount != 1 || blobStat.sizeBytes != outputStat.sizeBytes)
+        {   Path const tmpPath = Path::join(blobsDir, Path(blobName + "." + keyName + ".tmp")); 
+            removeFile(tmpPath); 
+            copyFile(outputs[i], tmpPath, false); 
+            renameFile(tmpPath, blobPath); 
+            blobStat = Stat::stat(blobPath); 
+        }
+        text += blobName + " " + toDecStr(blobStat.sizeBytes) + " " + toDecStr(blobStat.lastWriteTimeNanoSec) + "\n"; 
+    }
+
+    //Write a new file and rename it into place, so that a crash never leaves
+    //a partial action.
+    Path const tmpPath(actionPath.getStringRep() + ".tmp"); 
+    {   FileHandleOwner out(FileOpener().createOrOpen().truncate().writeOnly().open(tmpPath)); 
+        out.get().writeComplete(text.data(), text.size()); 
+        if (0 != out.release().close2())
+            throw std::runtime_error("jjm::ActionCache::store() failed. Cause:\nClosing \"" + tmpPath.getStringRep() + "\" failed."); 
+    }
+    renameFile(tmpPath, actionPath); 
+    ++numStored; 
+    ++numStoredSinceTrim; 
+}
+
+void jjm::ActionCache::trim()
+{
+    if ( ! isOpen() || numStoredSinceTrim == 0)
+        return; 
+    numStoredSinceTrim = 0; 
+
+    //Leftovers of interrupted stores are removed.
+    map<string, std::uint64_t> blobSizes; 
+    std::uint64_t totalBytes = 0; 
+    vector<string> const blobNames = listDirectory(blobsDir); 
+    for (vector<string>::const_iterator b = blobNames.begin(); b != blobNames.end(); ++b)
+    {   Path const blobPath = Path::join(blobsDir, Path(*b)); 
+        if (endsWith(*b, ".tmp"))
+        {   removeFile(blobPath); 
+            continue; 
+        }
+        Stat const st = Stat::stat2(blobPath); 
+        blobSizes[*b] = st.sizeBytes; 
+        totalBytes += st.sizeBytes; 
+    }
+    if (totalBytes <= static_cast<std::uint64_t>(maxBytes))
+        return; 
+
+    vector<ActionFile> actions; 
+    vector<string> const actionNames = listDirectory(actionsDir); 
+    for (vector<string>::const_iterator a = actionNames.begin(); a != actionNames.end(); ++a)
+    {   Path const actionPath = Path::join(actionsDir, Path(*a)); 
+        vector<Blob> blobs; 
+        if (endsWith(*a, ".tmp") || ! readAction(actionPath, blobs))
+        {   removeFile(actionPath); 
+            continue; 
+        }
+        actions.push_back(ActionFile()); 
+        actions.back().name = *a; 
+        actions.back().lastUseNanoSec = Stat::stat2(actionPath).lastWriteTimeNanoSec; 
+        for (size_t i = 0; i < blobs.size(); ++i)
+            actions.back().blobNames.push_back(blobs[i].name); 
+    }
+    std::sort(actions.begin(), actions.end()); 
+
+    //Keep the most recently used actions which fit. Once one does not fit,
+    //every less recently used action is evicted too.
+    set<string> keptBlobs; 
+    std::uint64_t keptBytes = 0; 
+    bool evicting = false; 
+    for (vector<ActionFile>::iterator a = actions.begin(); a != actions.end(); ++a)
+    {   std::uint64_t newBytes = 0; 
+        for (size_t i = 0; i < a->blobNames.size(); ++i)
+        {   if (keptBlobs.count(a->blobNames[i]) == 0 && blobSizes.count(a->blobNames[i]))
+                newBytes += blobSizes[a->blobNames[i]]; 
+        }
+        if (evicting || keptBytes + newBytes > static_cast<std::uint64_t>(maxBytes))
+        {   evicting = true; 
+            removeFile(Path::join(actionsDir, Path(a->name))); 
+            ++numEvicted; 
+            continue; 
+        }
+        keptBytes += newBytes; 
+        keptBlobs.insert(a->blobNames.begin(), a->blobNames.end()); 
+    }
+    for (map<string, std::uint64_t>::const_iterator b = blobSizes.begin(); b != blobSizes.end(); ++b)
+    {   if (keptBlobs.count(b->first) == 0)
+            removeFile(Path::join(blobsDir, Path(b->first))); 
+    }
+}
@@ -0,0 +1,115 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#ifndef JJMAKE_ACTIONCACHE_HPP_HEADER_GUARD
+#define JJMAKE_ACTIONCACHE_HPP_HEADER_GUARD
+
+#include "jbase/jstdint.hpp"
+#include "josutils/jpath.hpp"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace jjm
+{
+
+/* ActionCache keeps the outputs of successful goal executions, so that a goal
+whose command and inputs match an earlier execution has its outputs restored
+instead of executing again, such as after switching branches and back.
+
+The cache is a directory of two directories. "blobs" holds the content of
+output files, named by content hash and size, so that equal outputs of
+different goals are stored once. "actions" holds a small file per key from
+Signatures::getActionKey(), which lists the blobs of the outputs in order.
+Outputs are restored with copyFile(), that is by reflink, else by copy, and
+with their last write times set to now, as if the goal had just executed. 
+
+Every action file records the size and last write time of its blobs, and an
+action with a blob which no longer matches is a miss, and is removed. A blob
+with other links, such as from a cache which restored by hard link, is 
+replaced rather than reused by store().
+
+When the blobs exceed the size limit, the least recently used actions are
+evicted, together with the blobs which no remaining action lists. A hit sets
+the last write time of its action file. */
+class ActionCache
+{
+public:
+    ActionCache(); 
+
+    //Creates the directories when they do not exist.
+    //Throws std::exception on errors.
+    void open(Path const& dir, std::int64_t maxBytes); 
+    bool isOpen() const { return ! dir.isEmpty(); }
+
+    //On a hit, replaces the outputs with the files stored for the key and
+    //returns true. Returns false on a miss, leaving the outputs as they were,
+    //or when restoring failed part way, leaving some outputs removed.
+    //It is safe to call concurrently.
+    bool restore(std::uint64_t key, std::vector<Path> const& outputs); 
+
+    //On a hit, returns true with the paths of the blobs of the outputs, in 
+    //order, and counts the hit as restore() does. Returns false on a miss. 
+    //The blobs must not be modified, and trim() may remove them, although
+    //not while they are open. 
+    //It is safe to call concurrently. 
+    bool lookup(std::uint64_t key, std::vector<Path> & blobPaths); 
+
+    //Whether an action is stored for the key, without checking its blobs. 
+    bool isStored(std::uint64_t key) const; 
+
+    //Stores the outputs, which are regular files with the given content
+    //hashes, for the key. Does nothing when the key is already stored.
+    //It is safe to call concurrently.
+    //Throws std::exception on errors.
+    void store(std::uint64_t key, std::vector<Path> const& outputs, std::vector<std::uint64_t> const& contentHashes); 
+
+    //Evicts the least recently used actions until the blobs fit the limit.
+    //Does nothing when nothing was stored since open() or the last trim().
+    //Must not be called concurrently with the other functions.
+    //Throws std::exception on errors.
+    void trim(); 
+
+    std::int64_t getNumHits() const { return numHits; }
+    std::int64_t getNumMisses() const { return numMisses; }
+    std::int64_t getNumStored() const { return numStored; }
+    std::int64_t getNumEvicted() const { return numEvicted; }
+
+private:
+    ActionCache(ActionCache const& ); //not defined, not copyable
+    ActionCache& operator= (ActionCache const& ); //not defined, not copyable
+
+    class Blob
+    {
+    public:
+        Blob() : sizeBytes(0), lastWriteTimeNanoSec(0) {}
+        std::string name; 
+        std::uint64_t sizeBytes; 
+        std::int64_t lastWriteTimeNanoSec; 
+    }; 
+
+    Path getActionPath(std::uint64_t key) const; 
+    //Returns false when the action is missing, or one of its blobs no longer
+    //matches, in which case the action is removed. 
+    bool findBlobs(std::uint64_t key, std::vector<Path> & blobPaths); 
+    //Returns false when the file is missing or malformed.
+    static bool readAction(Path const& path, std::vector<Blob> & blobs); 
+
+    Path dir; 
+    Path blobsDir; 
+    Path actionsDir; 
+    std::int64_t maxBytes; 
+
+    std::atomic<std::int64_t> numHits; 
+    std::atomic<std::int64_t> numMisses; 
+    std::atomic<std::int64_t> numStored; 
+    std::atomic<std::int64_t> numEvicted; 
+    std::atomic<std::int64_t> numStoredSinceTrim; 
+}; 
+
+} //namespace jjm
+
+#endif
@@ -0,0 +1,94 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "concurrency.hpp"
+
+#include "josutils/jsysload.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace jjm;
+using namespace std;
+
+namespace
+{
+    int const sampleMillis = 1000; 
+    int const samplesAfterChange = 5; 
+    double const highPressurePercent = 25; 
+    double const lowPressurePercent = 10; 
+}
+
+class jjm::ConcurrencyController::SamplerMain
+{
+public:
+    ConcurrencyController * controller; 
+    void operator() ()
+    {
+        for (;;)
+        {   //Sleep in short steps, so that the destructor does not wait long.
+            for (int slept = 0; slept < sampleMillis; slept += 100)
+            {   if (controller->stopFlag)
+                    return; 
+                jjm::sleep(100); 
+            }
+            controller->sample(); 
+        }
+    }
+};
+
+jjm::ConcurrencyController::ConcurrencyController(ThreadPool & pool_, int initialLimit, double maxLoad_)
+    : 
+    pool(pool_), 
+    maxLoad(maxLoad_), 
+    numSamplesUntilChange(samplesAfterChange), 
+    lowestLimit(initialLimit), 
+    highestLimit(initialLimit), 
+    stopFlag(false)
+{
+    pool.setConcurrencyLimit(initialLimit); 
+    SamplerMain samplerMain; 
+    samplerMain.controller = this; 
+    sampler.reset(new Thread(samplerMain, Thread::JoinInDtor)); 
+}
+
+jjm::ConcurrencyController::~ConcurrencyController()
+{
+    stopFlag = true; 
+    sampler.reset(); 
+}
+
+void jjm::ConcurrencyController::sample()
+{
+    double load = 0; 
+    double pressure = 0; 
+    bool const haveLoad = getLoadAverage(load); 
+    bool const havePressure = getCpuPressure(pressure); 
+    if (numSamplesUntilChange > 0)
+    {   --numSamplesUntilChange; 
+        return; 
+    }
+
+    int const limit = pool.getConcurrencyLimit(); 
+    int newLimit = limit; 
+    if ((haveLoad && load > maxLoad) || (havePressure && pressure > highPressurePercent))
+    {   int excess = 1; 
+        if (haveLoad && load > maxLoad)
+            excess = std::max(1, static_cast<int>(std::ceil(load - maxLoad))); 
+        newLimit = std::max(1, limit - excess); 
+    }else if (( ! haveLoad || load <= maxLoad - 1) && ( ! havePressure || pressure < lowPressurePercent))
+    {   if (haveLoad || havePressure)
+            newLimit = std::min(pool.getNumThreads(), limit + 1); 
+    }
+    if (newLimit == limit)
+        return; 
+
+    pool.setConcurrencyLimit(newLimit); 
+    numSamplesUntilChange = samplesAfterChange; 
+    if (newLimit < lowestLimit)
+        lowestLimit = newLimit; 
+    if (newLimit > highestLimit)
+        highestLimit = newLimit; 
+}
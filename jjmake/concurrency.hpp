@@ -0,0 +1,61 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#ifndef JJMAKE_CONCURRENCY_HPP_HEADER_GUARD
+#define JJMAKE_CONCURRENCY_HPP_HEADER_GUARD
+
+#include "jbase/juniqueptr.hpp"
+#include "josutils/jthreading.hpp"
+
+#include <atomic>
+
+namespace jjm
+{
+
+/* ConcurrencyController adjusts the concurrency limit of a ThreadPool to the 
+load of the machine, between 1 and the number of threads of the pool. A 
+background thread samples the load average and the CPU pressure about once
+a second. 
+
+The machine is overloaded when the load average exceeds maxLoad, or when 
+runnable tasks waited for a processor more than a quarter of the time. The
+limit is then lowered by the excess load, at least by one. The machine has
+room when the load average is at least one below maxLoad, and the tasks 
+waited less than a tenth of the time. The limit is then raised by one. 
+
+The load average covers the last minute, and the kernel updates it every 
+five seconds, so the limit is left alone for five seconds after a change, 
+until the change shows. The pressure covers the last ten seconds, and when 
+the system reports it, it catches overload before the load average does. */
+class ConcurrencyController
+{
+public:
+    //Sets the limit of the pool to initialLimit, and starts sampling. 
+    ConcurrencyController(ThreadPool & pool, int initialLimit, double maxLoad); 
+    //Stops sampling. The limit of the pool is left as it is. 
+    ~ConcurrencyController(); 
+
+    int getLowestLimit() const { return lowestLimit; }
+    int getHighestLimit() const { return highestLimit; }
+
+private:
+    ConcurrencyController(ConcurrencyController const& ); //not defined, not copyable
+    ConcurrencyController& operator= (ConcurrencyController const& ); //not defined, not copyable
+
+    class SamplerMain; 
+    void sample(); 
+
+    ThreadPool & pool; 
+    double const maxLoad; 
+    int numSamplesUntilChange; 
+    std::atomic<int> lowestLimit; 
+    std::atomic<int> highestLimit; 
+    std::atomic<bool> stopFlag; 
+    UniquePtr<Thread*> sampler; 
+}; 
+
+} //namespace jjm
+
+#endif
@@ -0,0 +1,140 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "consolewriter.hpp"
+
+#include "josutils/jstdstreams.hpp"
+
+#include <stdexcept>
+
+using namespace jjm;
+using namespace std;
+
+namespace
+{
+    std::size_t const maxQueuedBytes = 4 * 1024 * 1024; 
+}
+
+class jjm::ConsoleWriter::WriterMain
+{
+public:
+    explicit WriterMain(ConsoleWriter * writer_) : writer(writer_) {}
+    void operator() () { writer->run(); }
+private:
+    ConsoleWriter * writer; 
+}; 
+
+jjm::ConsoleWriter::ConsoleWriter() 
+    : queuedBytes(0), numQueued(0), numWritten(0), numBatches(0), failed(false), stopping(false)
+{
+    thread.reset(new Thread(WriterMain(this), Thread::JoinInDtor)); 
+}
+
+jjm::ConsoleWriter::~ConsoleWriter()
+{
+    {   Lock lock(mutex); 
+        stopping = true; 
+        queuedCondition.notify_all(); 
+    }
+    thread.get()->join(); 
+}
+
+void jjm::ConsoleWriter::waitForRoom(Lock & lock)
+{
+    while (queuedBytes > maxQueuedBytes)
+        wait(lock, writtenCondition); 
+}
+
+void jjm::ConsoleWriter::write(bool toStdErr, Utf8String const& text)
+{
+    Lock lock(mutex); 
+    waitForRoom(lock); 
+    if (queue.empty())
+        queuedCondition.notify_one(); 
+    queue.push_back(Segment(toStdErr, text)); 
+    queuedBytes += text.size(); 
+    ++numQueued; 
+}
+
+void jjm::ConsoleWriter::writeBlock(std::vector<Segment> & block)
+{
+    Lock lock(mutex); 
+    waitForRoom(lock); 
+    if (queue.empty())
+        queuedCondition.notify_one(); 
+    for (size_t i = 0; i < block.size(); ++i)
+    {   queue.push_back(Segment(block[i].toStdErr, Utf8String())); 
+        queue.back().text.swap(block[i].text); 
+        queuedBytes += queue.back().text.size(); 
+    }
+    numQueued += block.size(); 
+    block.clear(); 
+}
+
+void jjm::ConsoleWriter::flush()
+{
+    Lock lock(mutex); 
+    std::int64_t const target = numQueued; 
+    while (numWritten < target)
+        wait(lock, writtenCondition); 
+    if (failed)
+    {   failed = false; 
+        throw std::runtime_error("Writing to stdout or stderr failed."); 
+    }
+}
+
+std::int64_t jjm::ConsoleWriter::getNumBatches()
+{
+    Lock lock(mutex); 
+    return numBatches; 
+}
+
+void jjm::ConsoleWriter::run()
+{
+    vector<Segment> batch; 
+    for (;;)
+    {   {   Lock lock(mutex); 
+            while (queue.empty() && ! stopping)
+                wait(lock, queuedCondition); 
+            if (queue.empty())
+                return; 
+            batch.swap(queue); 
+            queuedBytes = 0; 
+            writtenCondition.notify_all(); //room for the waiting callers
+        }
+
+        //stdout and stderr may be the same terminal, so the stream written 
+        //so far is flushed before switching to the other one. 
+        bool ok = true; 
+        bool outPending = false; 
+        bool errPending = false; 
+        for (size_t i = 0; i < batch.size(); ++i)
+        {   if (batch[i].toStdErr && outPending)
+            {   ok = (jout() << jjm::flush) && ok; 
+                outPending = false; 
+            }
+            if ( ! batch[i].toStdErr && errPending)
+            {   ok = (jerr() << jjm::flush) && ok; 
+                errPending = false; 
+            }
+            BufferedOutputStream & stream = batch[i].toStdErr ? jerr() : jout(); 
+            ok = (stream << batch[i].text) && ok; 
+            (batch[i].toStdErr ? errPending : outPending) = true; 
+        }
+        if (outPending)
+            ok = (jout() << jjm::flush) && ok; 
+        if (errPending)
+            ok = (jerr() << jjm::flush) && ok; 
+
+        {   Lock lock(mutex); 
+            numWritten += batch.size(); 
+            ++numBatches; 
+            if ( ! ok)
+                failed = true; 
+            writtenCondition.notify_all(); 
+        }
+        batch.clear(); 
+    }
+}
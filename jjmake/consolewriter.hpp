@@ -0,0 +1,80 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#ifndef JJMAKE_CONSOLEWRITER_HPP_HEADER_GUARD
+#define JJMAKE_CONSOLEWRITER_HPP_HEADER_GUARD
+
+#include "jbase/jstdint.hpp"
+#include "jbase/juniqueptr.hpp"
+#include "josutils/jthreading.hpp"
+#include "junicode/jutfstring.hpp"
+
+#include <vector>
+
+namespace jjm
+{
+
+/* ConsoleWriter writes to jout() and jerr() from a background thread. The
+threads of the build queue their text and return. The writer takes 
+everything queued since its last batch, writes it in order, and flushes 
+once per batch, so that short lines from many threads become few large 
+writes, and the threads do not take turns on a lock for every line. 
+
+A block of segments is written together, without text queued by other 
+threads in between. Callers which queue faster than the console takes it
+wait while more than a few megabytes are queued. */
+class ConsoleWriter
+{
+public:
+    class Segment
+    {
+    public:
+        Segment(bool toStdErr_, Utf8String const& text_) : toStdErr(toStdErr_), text(text_) {}
+        bool toStdErr; 
+        Utf8String text; 
+    }; 
+
+    ConsoleWriter(); 
+
+    //Writes what is still queued, ignoring errors. 
+    ~ConsoleWriter(); 
+
+    void write(bool toStdErr, Utf8String const& text); 
+
+    //Queues the segments as one block, and empties block. 
+    void writeBlock(std::vector<Segment> & block); 
+
+    //Waits until everything queued before the call is written. 
+    //Throws std::exception when writing failed since the last flush(). 
+    void flush(); 
+
+    //The number of batches written so far. 
+    std::int64_t getNumBatches(); 
+
+private:
+    ConsoleWriter(ConsoleWriter const& ); //not defined, not copyable
+    ConsoleWriter& operator= (ConsoleWriter const& ); //not defined, not copyable
+
+    class WriterMain; 
+    void run(); 
+    void waitForRoom(Lock & lock); 
+
+    Mutex mutex; 
+    CondVar queuedCondition; 
+    CondVar writtenCondition; 
+    std::vector<Segment> queue; 
+    std::size_t queuedBytes; 
+    std::int64_t numQueued; 
+    std::int64_t numWritten; 
+    std::int64_t numBatches; 
+    bool failed; 
+    bool stopping; 
+
+    UniquePtr<Thread*> thread; 
+}; 
+
+} //namespace jjm
+
+#endif
@@ -6,16 +6,20 @@
 #include "parsercontext.hpp"
 
 #include "node.hpp"
+#include "remoteexec.hpp"
+#include "statcache.hpp"
 #include "jbase/jfatal.hpp"
 #include "jbase/jinttostring.hpp"
 #include "jbase/jstdint.hpp"
 #include "jbase/juniqueptr.hpp"
 #include "josutils/jfilehandle.hpp"
 #include "josutils/jfilestreams.hpp"
+#include "josutils/jfilesystem.hpp"
 #include "josutils/jopen.hpp"
 #include "josutils/jpath.hpp"
 #include "josutils/jstat.hpp"
 #include "josutils/jstdstreams.hpp"
+#include "josutils/jworker.hpp"
 #include <errno.h>
 #include <fstream>
 #include <vector>
@@ -83,6 +87,146 @@ namespace
         }
     };
 
+    class ExecNode : public jjm::Node
+    {
+    public:
+        ExecNode(Path const& dir_, vector<string> const& args_, vector<Path> const& inputPaths_, vector<Path> const& outputPaths_, 
+                Path const& depfile_, Path const& dyndepFile_)
+            : Node(outputPaths_[0].getStringRep(), inputPaths_, outputPaths_),
+            dir(dir_), args(args_), depfile(depfile_), dyndepFile(dyndepFile_)
+            {}
+        Path dir; 
+        vector<string> args; 
+        Path depfile; //empty for none
+        Path dyndepFile; //empty for none, and otherwise also an output
+        virtual std::string getCommand() const 
+        {   string command = "exec-node " + dir.getStringRep(); 
+            for (size_t i = 0; i < args.size(); ++i)
+                command += " " + args[i]; 
+            return command; 
+        }
+        virtual bool getDepfile(Path & depfile_, Path & baseDir) const
+        {   depfile_ = depfile; 
+            baseDir = dir; 
+            return ! depfile.isEmpty(); 
+        }
+        virtual bool getDyndepFile(Path & dyndepFile_, Path & baseDir) const
+        {   dyndepFile_ = dyndepFile; 
+            baseDir = dir; 
+            return ! dyndepFile.isEmpty(); 
+        }
+        virtual bool execute()
+        {   
+            if ( ! isAlwaysMake() && ! isOutOfDate())
+                return false; 
+            beginExecution(); 
+            Graph const& graph = getGraph(); 
+            ExecCommand command; 
+            command.dir = dir; 
+            command.args = args; 
+            //A remote worker is sent the discovered inputs too, such as the 
+            //headers which the compiler read the last time. 
+            Graph::IdRange const inputRanges[2] = { graph.getInputPaths(getId()), graph.getDiscoveredInputPaths(getId()) }; 
+            for (int r = 0; r < 2; ++r)
+            {   for (Graph::PathId const * p = inputRanges[r].begin(); p != inputRanges[r].end(); ++p)
+                {   command.inputs.push_back(graph.getPath(*p)); 
+                    std::uint64_t contentHash = 0; 
+                    if (command.inputHashes.size() + 1 == command.inputs.size() && getContentHash(*p, contentHash))
+                        command.inputHashes.push_back(contentHash); 
+                }
+            }
+            //The dispatcher hashes the inputs itself when some are not hashed. 
+            command.inputs.insert(command.inputs.end(), getDynamicInputPaths().begin(), getDynamicInputPaths().end()); 
+            Graph::IdRange const outputs = graph.getOutputPaths(getId()); 
+            for (Graph::PathId const * p = outputs.begin(); p != outputs.end(); ++p)
+                command.outputs.push_back(graph.getPath(*p)); 
+            command.outputs.insert(command.outputs.end(), getDynamicOutputPaths().begin(), getDynamicOutputPaths().end()); 
+            command.weightMillis = getWeightMillis(); 
+            command.jobServer = getJobServer(); 
+            if ( ! depfile.isEmpty())
+            {   //A depfile left by an earlier execution is not taken for the 
+                //depfile of this one. 
+                removeFile(depfile); 
+                command.outputs.push_back(depfile); 
+                command.localOnly = inputRanges[1].size() == 0; 
+            }
+
+            ExecResult result = getDispatcher() ? getDispatcher()->execute(command) : executeLocally(command); 
+            if (result.warning.size())
+                toStdErr("[jjmake] Warning: " + result.warning); 
+            if (result.exitcode != 0 && result.workerAddress.size() && ! depfile.isEmpty())
+            {   //The discovered inputs are of the last execution, and a source 
+                //may include a header since then, which the worker lacked. 
+                command.localOnly = true; 
+                result = getDispatcher()->execute(command); 
+            }
+            if (result.exitcode != 0)
+                throw std::runtime_error("The command failed with exit status " + toDecStr(result.exitcode) 
+                        + (result.workerAddress.size() ? " on the remote worker \"" + result.workerAddress + "\"." : string(".")) 
+                        + (result.output.size() ? " Output:\n" + result.output : string())); 
+            if (result.output.size())
+                toStdOut(result.output[result.output.size() - 1] == '\n' ? result.output : result.output + "\n"); 
+            return true; 
+        }
+    }; 
+
+    //(exec-node <output> [--depfile=<depfile>] [--dyndep=<dyndep file>] <input>... -- <command> <argument>...) 
+    //The command runs in the directory of the build file, and must name its 
+    //output and inputs by relative paths, and use no other files, so that 
+    //it may execute on a remote worker. The inputs which the command writes 
+    //to the depfile, as by gcc -MMD -MF <depfile>, are also inputs of the 
+    //goal from the next run on. The command may also write a dyndep file, 
+    //which is another output of the goal, to add inputs and outputs to the 
+    //goals which depend on it, as described by DyndepParser. 
+    class ExecNodeFunction : public jjm::ParserContext::NativeFunction
+    {
+    public: 
+        ExecNodeFunction() {}
+        virtual vector<Utf8String> eval(ParserContext * c, vector<Utf8String> const& arguments) 
+        {
+            if (arguments.size() < 4)
+                throw std::runtime_error("Function '" + arguments[0] + "' takes 3 or more additional arguments."); 
+
+            //.PWD guaranteed to already be canonized via Path::getRealPath()
+            ParserContext::Value const * pwdClass = c->getValue(".PWD"); 
+            if (pwdClass == 0 || pwdClass->value.size() != 1)
+                JFATAL(0, 0);
+            Path pwdPath(pwdClass->value[0]); 
+            if ( ! pwdPath.isAbsolute())
+                JFATAL(0, 0); 
+
+            vector<Path> outputPaths(1, Path::join(pwdPath, Path(arguments[1]))); 
+            vector<Path> inputPaths;
+            vector<string> args; 
+            Path depfile; 
+            string const depfileOption = "--depfile="; 
+            Path dyndepFile; 
+            string const dyndepOption = "--dyndep="; 
+            bool separated = false; 
+            for (size_t i = 2; i < arguments.size(); ++i)
+            {   if (separated)
+                    args.push_back(arguments[i]); 
+                else if (arguments[i] == "--")
+                    separated = true; 
+                else if (arguments[i].compare(0, depfileOption.size(), depfileOption) == 0)
+                    depfile = Path::join(pwdPath, Path(arguments[i].substr(depfileOption.size()))); 
+                else if (arguments[i].compare(0, dyndepOption.size(), dyndepOption) == 0)
+                {   dyndepFile = Path::join(pwdPath, Path(arguments[i].substr(dyndepOption.size()))); 
+                    if (dyndepFile.getStringRep() != outputPaths[0].getStringRep())
+                        outputPaths.push_back(dyndepFile); 
+                }else
+                    inputPaths.push_back(Path::join(pwdPath, Path(arguments[i]))); 
+            }
+            if (args.empty())
+                throw std::runtime_error("Function '" + arguments[0] + "' takes a command after \"--\"."); 
+
+            UniquePtr<ExecNode*> node(new ExecNode(pwdPath, args, inputPaths, outputPaths, depfile, dyndepFile)); 
+            c->newNode(node.release()); 
+
+            return vector<Utf8String>(); 
+        }
+    };
+
     class GetFunction : public jjm::ParserContext::NativeFunction
     {
     public:
@@ -160,6 +304,58 @@ namespace
         }
     };
 
+    //Goals of path-based nodes are absolute paths, so goal-weight and 
+    //goal-pool also try the goal relative to .PWD. Returns that name. 
+    string getAlternateGoalName(ParserContext * c, Utf8String const& goalName)
+    {
+        ParserContext::Value const * pwdClass = c->getValue(".PWD"); 
+        if (pwdClass == 0 || pwdClass->value.size() != 1)
+            JFATAL(0, 0);
+        Path const pwdPath(pwdClass->value[0]); 
+        return Path::join(pwdPath, Path(goalName)).getStringRep(); 
+    }
+
+    //(goal-weight <goal> <weight>)
+    //The weight is the estimated duration of the goal in milliseconds. 
+    //Without a declared weight, a goal weighs its duration from the goal 
+    //history, or 1. Goals on the longest weighted path are executed first. 
+    class GoalWeightFunction : public jjm::ParserContext::NativeFunction
+    {
+    public:
+        GoalWeightFunction() {}
+        virtual vector<Utf8String> eval(ParserContext * c, vector<Utf8String> const& arguments) 
+        {
+            if (arguments.size() != 3)
+                throw std::runtime_error("Function '" + arguments[0] + "' takes exactly 2 additional arguments."); 
+            std::int64_t weight; 
+            if (false == jjm::decStrToInteger(weight, arguments[2]))
+                throw std::runtime_error("Function '" + arguments[0] + "' was given non-numeric argument \"" + arguments[2] + "\"."); 
+            if (weight < 0)
+                throw std::runtime_error("Function '" + arguments[0] + "' was given negative weight \"" + arguments[2] + "\"."); 
+
+            c->setGoalWeight(arguments[1], getAlternateGoalName(c, arguments[1]), weight); 
+            return vector<Utf8String>(); 
+        }
+    };
+
+    //(goal-pool <goal> <pool>)
+    //Assigns the goal to a pool declared with 'pool'. 
+    class GoalPoolFunction : public jjm::ParserContext::NativeFunction
+    {
+    public:
+        GoalPoolFunction() {}
+        virtual vector<Utf8String> eval(ParserContext * c, vector<Utf8String> const& arguments) 
+        {
+            if (arguments.size() != 3)
+                throw std::runtime_error("Function '" + arguments[0] + "' takes exactly 2 additional arguments."); 
+            if (arguments[2].size() == 0)
+                throw std::runtime_error("Function '" + arguments[0] + "' does not accept an empty pool name."); 
+
+            c->setGoalPool(arguments[1], getAlternateGoalName(c, arguments[1]), arguments[2]); 
+            return vector<Utf8String>(); 
+        }
+    };
+
     class IfFunction : public jjm::ParserContext::NativeFunction
     {
     public:
@@ -191,98 +387,139 @@ namespace
         }
     };
 
-    class IncludeFunction : public jjm::ParserContext::NativeFunction
+    //Reads the build file, relative to ".PWD", and evaluates it in the 
+    //context, with ".PWD" and ".FILE" of the file. 
+    void includeFile(ParserContext * c, Utf8String const& functionName, Utf8String const& fileName)
     {
-    public:
-        IncludeFunction() {}
-        virtual vector<Utf8String> eval(ParserContext * c, vector<Utf8String> const& arguments) 
-        {
-            if (arguments.size() != 2)
-                throw std::runtime_error("Function '" + arguments[0] + "' takes exactly 1 additional argument.");
-            
-            Utf8String prevDotPwd;
-            jjm::ParserContext::Value const* prevDotPwdClass = c->getValue(".PWD");
-            if (prevDotPwdClass && prevDotPwdClass->value.size())
-                prevDotPwd = prevDotPwdClass->value[0]; 
-
-            Utf8String prevFile;
-            jjm::ParserContext::Value const* prevFileClass = c->getValue(".FILE");
-            if (prevFileClass && prevFileClass->value.size())
-                prevFile = prevFileClass->value[0]; 
-
-            Utf8String prevLine;
-            jjm::ParserContext::Value const* prevLineClass = c->getValue(".LINE");
-            if (prevLineClass && prevLineClass->value.size())
-                prevLine = prevLineClass->value[0]; 
-
-            Utf8String prevCol;
-            jjm::ParserContext::Value const* prevColClass = c->getValue(".COL");
-            if (prevColClass && prevColClass->value.size())
-                prevCol = prevColClass->value[0]; 
-
-            Path const path = Path::join(Path(prevDotPwd), Path(arguments[1]).getAbsolutePath()); 
-
-            //TODO need to use current locale for POSIX multi-byte Utf8String
-            FileHandleOwner file;
-            try
-            {   file.reset(FileOpener().readOnly().openExistingOnly().open(path));
-            }catch (std::exception & e)
-            {   Utf8String message;
-                message += Utf8String() + "Function 'include' unable to open file \"" + path.getStringRep() + "\". Cause:\n"; 
-                message += e.what(); 
-                throw std::runtime_error(message); 
-            }
-            FileStream inputStream(file.release()); 
-            BufferedInputStream in( & inputStream); 
-
-            Utf8String contents; 
-            for (;;)
-            {   size_t oldSize = contents.size();
-                size_t fetchSize = 16 * 1024; 
-                contents.resize(oldSize + fetchSize); 
-
-                //Assumes Utf8String uses contiguous storage. 
-                //Not gauranteed by C++03. It is guaranteed by C++11. 
-                //True of all commercial implementations. 
-                in.read(&contents[0] + oldSize, fetchSize); 
+        Utf8String prevDotPwd;
+        jjm::ParserContext::Value const* prevDotPwdClass = c->getValue(".PWD");
+        if (prevDotPwdClass && prevDotPwdClass->value.size())
+            prevDotPwd = prevDotPwdClass->value[0]; 
+
+        Utf8String prevFile;
+        jjm::ParserContext::Value const* prevFileClass = c->getValue(".FILE");
+        if (prevFileClass && prevFileClass->value.size())
+            prevFile = prevFileClass->value[0]; 
+
+        Utf8String prevLine;
+        jjm::ParserContext::Value const* prevLineClass = c->getValue(".LINE");
+        if (prevLineClass && prevLineClass->value.size())
+            prevLine = prevLineClass->value[0]; 
+
+        Utf8String prevCol;
+        jjm::ParserContext::Value const* prevColClass = c->getValue(".COL");
+        if (prevColClass && prevColClass->value.size())
+            prevCol = prevColClass->value[0]; 
+
+        Path const path = Path::join(Path(prevDotPwd), Path(fileName).getAbsolutePath()); 
+
+        //Recorded before the file is opened, so that a missing file is 
+        //also watched. 
+        c->addBuildFile(path.getStringRep()); 
+
+        //TODO need to use current locale for POSIX multi-byte Utf8String
+        FileHandleOwner file;
+        try
+        {   file.reset(FileOpener().readOnly().openExistingOnly().open(path));
+        }catch (std::exception & e)
+        {   Utf8String message;
+            message += Utf8String() + "Function '" + functionName + "' unable to open file \"" + path.getStringRep() + "\". Cause:\n"; 
+            message += e.what(); 
+            throw std::runtime_error(message); 
+        }
+        FileStream inputStream(file.release()); 
+        BufferedInputStream in( & inputStream); 
+
+        Utf8String contents; 
+        for (;;)
+        {   size_t oldSize = contents.size();
+            size_t fetchSize = 16 * 1024; 
+            contents.resize(oldSize + fetchSize); 
+
+            //Assumes Utf8String uses contiguous storage. 
+            //Not gauranteed by C++03. It is guaranteed by C++11. 
+            //True of all commercial implementations. 
+            in.read(&contents[0] + oldSize, fetchSize); 
 #ifdef _WIN32
-                DWORD const lastError = GetLastError(); 
+            DWORD const lastError = GetLastError(); 
 #else
-                int const lastErrno = errno; 
+            int const lastErrno = errno; 
 #endif
 
-                ssize_t gcount = in.gcount(); 
-                contents.resize(oldSize + gcount); 
-                if (in)
-                    continue;
-                if (in.isEof())
-                    break;
+            ssize_t gcount = in.gcount(); 
+            contents.resize(oldSize + gcount); 
+            if (in)
+                continue;
+            if (in.isEof())
+                break;
 #ifdef _WIN32
-                throw std::runtime_error(Utf8String() 
-                        + "Function 'include': Failure when reading from file \"" + path.getStringRep() + "\". "
-                        + "GetLastError() " + toDecStr(lastError) + "."); 
+            throw std::runtime_error(Utf8String() 
+                    + "Function '" + functionName + "': Failure when reading from file \"" + path.getStringRep() + "\". "
+                    + "GetLastError() " + toDecStr(lastError) + "."); 
 #else
-                throw std::runtime_error(Utf8String() 
-                        + "Function 'include': Failure when reading from file \"" + path.getStringRep() + "\". "
-                        + "errno " + toDecStr(lastErrno) + "."); 
+            throw std::runtime_error(Utf8String() 
+                    + "Function '" + functionName + "': Failure when reading from file \"" + path.getStringRep() + "\". "
+                    + "errno " + toDecStr(lastErrno) + "."); 
 #endif
-            }
+        }
 
-            c->setValue(".PWD", path.getParent().getStringRep()); 
-            c->setValue(".FILE", path.getStringRep()); 
-            c->setValue(".LINE", "1"); 
-            c->setValue(".COL", "1");  
+        c->setValue(".PWD", path.getParent().getStringRep()); 
+        c->setValue(".FILE", path.getStringRep()); 
+        c->setValue(".LINE", "1"); 
+        c->setValue(".COL", "1");  
 
-            c->eval(contents); 
+        c->eval(contents); 
 
-            c->setValue(".PWD", prevDotPwd); 
-            c->setValue(".FILE", prevFile); 
-            c->setValue(".LINE", prevLine); 
-            c->setValue(".COL", prevCol); 
+        c->setValue(".PWD", prevDotPwd); 
+        c->setValue(".FILE", prevFile); 
+        c->setValue(".LINE", prevLine); 
+        c->setValue(".COL", prevCol); 
+    }
 
-            vector<Utf8String> result; 
-            return result; 
+    class IncludeFunction : public jjm::ParserContext::NativeFunction
+    {
+    public:
+        IncludeFunction() {}
+        virtual vector<Utf8String> eval(ParserContext * c, vector<Utf8String> const& arguments) 
+        {
+            if (arguments.size() != 2)
+                throw std::runtime_error("Function '" + arguments[0] + "' takes exactly 1 additional argument.");
+            includeFile(c, arguments[0], arguments[1]); 
+            return vector<Utf8String>(); 
+        }
+    };
+
+    //Syntax: 
+    //  (parallel-include <file> ...)
+    //As include of each file, one after another, except that the files are 
+    //read and evaluated concurrently, and that the variables which a file 
+    //sets are not seen by the including file or by the other files. See 
+    //ParserContext::runSplit(). 
+    class ParallelIncludeFunction : public jjm::ParserContext::NativeFunction
+    {
+    public:
+        ParallelIncludeFunction() {}
+        virtual vector<Utf8String> eval(ParserContext * c, vector<Utf8String> const& arguments) 
+        {
+            vector<IncludeTask> includeTasks(arguments.size() - 1); 
+            vector<ParserContext::SplitTask*> tasks; 
+            for (size_t i = 1; i < arguments.size(); ++i)
+            {   includeTasks[i - 1].functionName = & arguments[0]; 
+                includeTasks[i - 1].fileName = & arguments[i]; 
+                tasks.push_back( & includeTasks[i - 1]); 
+            }
+            c->runSplit(tasks); 
+            return vector<Utf8String>(); 
         }
+    private:
+        class IncludeTask : public ParserContext::SplitTask
+        {
+        public:
+            IncludeTask() : functionName(0), fileName(0) {}
+            Utf8String const * functionName; 
+            Utf8String const * fileName; 
+            virtual void run(ParserContext * c) { includeFile(c, *functionName, *fileName); }
+        }; 
     };
 
     class PrintFunction : public jjm::ParserContext::NativeFunction
@@ -305,6 +542,30 @@ namespace
         }
     };
 
+    //(pool <name> <depth>)
+    //Declares a pool of goals, such as links, of which at most <depth> 
+    //execute at once. Goals outside of the pool are not limited by it. 
+    class PoolFunction : public jjm::ParserContext::NativeFunction
+    {
+    public:
+        PoolFunction() {}
+        virtual vector<Utf8String> eval(ParserContext * c, vector<Utf8String> const& arguments) 
+        {
+            if (arguments.size() != 3)
+                throw std::runtime_error("Function '" + arguments[0] + "' takes exactly 2 additional arguments."); 
+            if (arguments[1].size() == 0)
+                throw std::runtime_error("Function '" + arguments[0] + "' does not accept an empty pool name."); 
+            std::int32_t depth; 
+            if (false == jjm::decStrToInteger(depth, arguments[2]))
+                throw std::runtime_error("Function '" + arguments[0] + "' was given non-numeric argument \"" + arguments[2] + "\"."); 
+            if (depth < 1)
+                throw std::runtime_error("Function '" + arguments[0] + "' was given a depth less than 1 \"" + arguments[2] + "\"."); 
+
+            c->declarePool(arguments[1], depth); 
+            return vector<Utf8String>(); 
+        }
+    };
+
     class SetFunction : public jjm::ParserContext::NativeFunction
     {
     public:
@@ -356,19 +617,24 @@ namespace
             targetPath(path_)
             {}
         Path targetPath; 
-        Stat targetStat; 
-        virtual void execute()
+        virtual std::string getCommand() const { return "touch-node"; }
+        virtual bool hasStampOutputs() const { return true; }
+        virtual bool execute()
         {   
-            targetStat = Stat::stat(targetPath); 
+            Graph const& graph = getGraph(); 
+            StatCache & statCache = getStatCache(); 
+            Graph::PathId const target = graph.getOutputPaths(getId())[0]; 
+            Stat const targetStat = statCache.stat(target); 
 
             if (targetStat.type == FileType::NoExist)
             {   touchFile(); 
-                return; 
+                return true; 
             }
             if (targetStat.type == FileType::RegularFile)
-            {   if (hasNewerDependency())
-                    touchFile(); 
-                return; 
+            {   if ( ! isAlwaysMake() && ! isOutOfDate())
+                    return false; 
+                touchFile(); 
+                return true; 
             }
             if (targetStat.type == FileType::Directory)
                 throw std::runtime_error("Cannot create regular file \"" + targetPath.getStringRep() + "\" because a directory exists that has the same name."); 
@@ -380,12 +646,10 @@ namespace
         }
         void touchFile()
         {
-            FileHandleOwner file(FileOpener().createOrOpen().readWrite().open(targetPath)); 
-            //TODO set timestamp
-        }
-        bool hasNewerDependency()
-        {
-            return true; 
+            beginExecution(); 
+            {   FileHandleOwner file(FileOpener().createOrOpen().readWrite().open(targetPath)); 
+            }
+            setFileTimesToNow(targetPath); 
         }
     }; 
 
@@ -420,6 +684,106 @@ namespace
         }
     };
 
+    //(worker-tool <key> <max-workers> <max-requests> <command> <argument>...)
+    //A max-requests of 0 means a worker is never recycled. 
+    class WorkerToolFunction : public jjm::ParserContext::NativeFunction
+    {
+    public:
+        WorkerToolFunction() {}
+        virtual vector<Utf8String> eval(ParserContext * c, vector<Utf8String> const& arguments) 
+        {
+            if (arguments.size() < 5)
+                throw std::runtime_error("Function '" + arguments[0] + "' takes 4 or more additional arguments."); 
+            if (arguments[1].size() == 0)
+                throw std::runtime_error("Function '" + arguments[0] + "' does not accept an empty tool key."); 
+            std::int32_t maxWorkers; 
+            if (false == jjm::decStrToInteger(maxWorkers, arguments[2]) || maxWorkers < 1)
+                throw std::runtime_error("Function '" + arguments[0] + "' was given a maximum number of workers which is not a positive number \"" + arguments[2] + "\"."); 
+            std::int32_t maxRequests; 
+            if (false == jjm::decStrToInteger(maxRequests, arguments[3]) || maxRequests < 0)
+                throw std::runtime_error("Function '" + arguments[0] + "' was given a maximum number of requests which is not a number \"" + arguments[3] + "\"."); 
+
+            c->declareWorkerTool(arguments[1], maxWorkers, maxRequests, vector<string>(arguments.begin() + 4, arguments.end())); 
+            return vector<Utf8String>(); 
+        }
+    };
+
+    class WorkerNode : public jjm::Node
+    {
+    public:
+        WorkerNode(string const& toolKey_, vector<string> const& request_, vector<Path> const& inputPaths_, vector<Path> const& outputPaths_)
+            : Node(outputPaths_[0].getStringRep(), inputPaths_, outputPaths_),
+            toolKey(toolKey_), request(request_)
+            {}
+        string toolKey; 
+        vector<string> request; 
+        virtual std::string getCommand() const 
+        {   string command = "worker-node " + toolKey; 
+            for (size_t i = 0; i < request.size(); ++i)
+                command += " " + request[i]; 
+            return command; 
+        }
+        virtual bool execute()
+        {   
+            if ( ! isAlwaysMake() && ! isOutOfDate())
+                return false; 
+            beginExecution(); 
+            WorkerPool::Response const response = getWorkerPool().request(toolKey, request); 
+            if (response.exitcode != 0)
+                throw std::runtime_error("The worker of tool \"" + toolKey + "\" failed with exit status " 
+                        + toDecStr(response.exitcode) + "." + (response.output.size() ? " Output:\n" + response.output : string())); 
+            if (response.output.size())
+                toStdOut(response.output[response.output.size() - 1] == '\n' ? response.output : response.output + "\n"); 
+            return true; 
+        }
+    }; 
+
+    //(worker-node <key> <output> <input>... [-- <argument>...])
+    //The request sent to a worker of the tool is the arguments after "--", 
+    //or without "--", the absolute path of the output followed by the 
+    //absolute paths of the inputs. 
+    class WorkerNodeFunction : public jjm::ParserContext::NativeFunction
+    {
+    public: 
+        WorkerNodeFunction() {}
+        virtual vector<Utf8String> eval(ParserContext * c, vector<Utf8String> const& arguments) 
+        {
+            if (arguments.size() < 3)
+                throw std::runtime_error("Function '" + arguments[0] + "' takes 2 or more additional arguments."); 
+
+            //.PWD guaranteed to already be canonized via Path::getRealPath()
+            ParserContext::Value const * pwdClass = c->getValue(".PWD"); 
+            if (pwdClass == 0 || pwdClass->value.size() != 1)
+                JFATAL(0, 0);
+            Path pwdPath(pwdClass->value[0]); 
+            if ( ! pwdPath.isAbsolute())
+                JFATAL(0, 0); 
+
+            vector<Path> outputPaths(1, Path::join(pwdPath, Path(arguments[2]))); 
+            vector<Path> inputPaths;
+            vector<string> request; 
+            bool separated = false; 
+            for (size_t i = 3; i < arguments.size(); ++i)
+            {   if (separated)
+                    request.push_back(arguments[i]); 
+                else if (arguments[i] == "--")
+                    separated = true; 
+                else
+                    inputPaths.push_back(Path::join(pwdPath, Path(arguments[i]))); 
+            }
+            if ( ! separated)
+            {   request.push_back(outputPaths[0].getStringRep()); 
+                for (size_t i = 0; i < inputPaths.size(); ++i)
+                    request.push_back(inputPaths[i].getStringRep()); 
+            }
+
+            UniquePtr<WorkerNode*> node(new WorkerNode(arguments[1], request, inputPaths, outputPaths)); 
+            c->newNode(node.release()); 
+
+            return vector<Utf8String>(); 
+        }
+    };
+
 }
 
 void jjm::ParserContext::registerBuiltInFunctions()
@@ -428,16 +792,23 @@ void jjm::ParserContext::registerBuiltInFunctions()
     r["add"]     = new AddFunction; 
     r["eq"]      = new EqualsFunction; 
     r["equ"]     = new EqualsFunction; 
+    r["exec-node"] = new ExecNodeFunction; 
     r["get"]     = new GetFunction; 
     r["get@"]    = new GetAtFunction; 
     r["get*"]    = new GetStarFunction; 
+    r["goal-pool"] = new GoalPoolFunction; 
+    r["goal-weight"] = new GoalWeightFunction; 
     r["if"]      = new IfFunction; 
     r["include"] = new IncludeFunction; 
     r["neq"]     = new NotEqualsFunction; 
+    r["parallel-include"] = new ParallelIncludeFunction; 
+    r["pool"]    = new PoolFunction; 
     r["print"]   = new PrintFunction; 
     r["set"]     = new SetFunction; 
     r["seta"]    = new SetaFunction; 
     r["touch-node"] = new TouchNodeFunction; 
+    r["worker-node"] = new WorkerNodeFunction; 
+    r["worker-tool"] = new WorkerToolFunction; 
 }
 
 bool jjm::ParserContext::registerBuiltInFunctions2 = (jjm::ParserContext::registerBuiltInFunctions(), false); 
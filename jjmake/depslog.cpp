@@ -0,0 +1,399 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "depslog.hpp"
+
+#include "jbase/jhash.hpp"
+#include "josutils/jfilehandle.hpp"
+#include "josutils/jfilesystem.hpp"
+#include "josutils/jmmap.hpp"
+#include "josutils/jopen.hpp"
+#include "josutils/jstat.hpp"
+
+#include <string.h>
+#include <stdexcept>
+
+using namespace jjm; 
+using namespace std; 
+
+
+namespace
+{
+    inline bool isBlank(char c) { return c == ' ' || c == '\t'; }
+    inline bool isWordEnd(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+}
+
+bool jjm::DepfileParser::parse(char const * begin, char const * end)
+{
+    prerequisites.clear(); 
+    //Nothing unescaped is longer than its text, so reserving the size of the 
+    //text keeps the tokens which point into the buffer valid. 
+    unescaped.clear(); 
+    unescaped.reserve(end - begin); 
+
+    bool inTargets = true; 
+    bool haveTargets = false; 
+    for (char const * p = begin; p != end; )
+    {   //Blanks separate words, and an escaped newline continues the rule.
+        if (isBlank(*p) || *p == '\r')
+        {   ++p; 
+            continue; 
+        }
+        if (*p == '\\' && end - p >= 2 && p[1] == '\n')
+        {   p += 2; 
+            continue; 
+        }
+        if (*p == '\\' && end - p >= 3 && p[1] == '\r' && p[2] == '\n')
+        {   p += 3; 
+            continue; 
+        }
+        if (*p == '\n')
+        {   if (inTargets && haveTargets)
+                return false; 
+            inTargets = true; 
+            haveTargets = false; 
+            ++p; 
+            continue; 
+        }
+        if (*p == '#')
+        {   while (p != end && *p != '\n')
+                ++p; 
+            continue; 
+        }
+        if (inTargets && *p == ':')
+        {   if ( ! haveTargets)
+                return false; 
+            inTargets = false; 
+            ++p; 
+            continue; 
+        }
+
+        //A word, copied only once an escape is found in it. 
+        char const * const start = p; 
+        char const * wordEnd = 0; 
+        size_t const copyStart = unescaped.size(); 
+        bool copying = false; 
+        bool endsTargets = false; 
+        while (wordEnd == 0)
+        {   if (p == end || isWordEnd(*p))
+            {   wordEnd = p; 
+                break; 
+            }
+            char const c = *p; 
+            if (c == '\\')
+            {   //2N+1 backslashes and a blank are N backslashes and the
+                //blank, and 2N backslashes and a blank are N backslashes 
+                //which end the word. Other backslashes are as they are, such 
+                //as those of Windows paths. 
+                char const * q = p; 
+                while (q != end && *q == '\\')
+                    ++q; 
+                size_t const n = q - p; 
+                if (q != end && (isBlank(*q) || *q == '#'))
+                {   if ( ! copying)
+                    {   unescaped.append(start, p); 
+                        copying = true; 
+                    }
+                    unescaped.append(n / 2, '\\'); 
+                    if (*q == '#' || n % 2 == 1)
+                    {   unescaped += *q; 
+                        p = q + 1; 
+                    }else
+                    {   p = q; 
+                        wordEnd = p; 
+                    }
+                    continue; 
+                }
+                bool const continuesLine = q != end && (*q == '\n' || (*q == '\r' && end - q >= 2 && q[1] == '\n')); 
+                if (continuesLine && n % 2 == 1)
+                    --q; //the last backslash escapes the newline
+                if (copying)
+                    unescaped.append(p, q); 
+                p = q; 
+                if (continuesLine)
+                    wordEnd = p; 
+                continue; 
+            }
+            if (c == '$' && end - p >= 2 && p[1] == '$')
+            {   if ( ! copying)
+                {   unescaped.append(start, p); 
+                    copying = true; 
+                }
+                unescaped += '$'; 
+                p += 2; 
+                continue; 
+            }
+            if (c == ':' && inTargets && (p + 1 == end || isWordEnd(p[1])))
+            {   wordEnd = p; 
+                endsTargets = true; 
+                ++p; 
+                break; 
+            }
+            if (copying)
+                unescaped += c; 
+            ++p; 
+        }
+
+        if (inTargets)
+        {   haveTargets = true; 
+            if (endsTargets)
+                inTargets = false; 
+            continue; 
+        }
+        if (copying)
+        {   if (unescaped.size() > copyStart)
+                prerequisites.push_back(Token(unescaped.data() + copyStart, unescaped.size() - copyStart)); 
+        }else if (wordEnd != start)
+            prerequisites.push_back(Token(start, wordEnd - start)); 
+    }
+    return ! (inTargets && haveTargets); 
+}
+
+
+namespace
+{
+    //File layout: 
+    //  FileHeader 
+    //  records, each a Record, the name padded to a multiple of 8, and the 
+    //  ids padded to a multiple of 8 
+
+    char const fileMagic[8] = { 'J', 'J', 'M', 'D', 'E', 'P', 'S', '1' }; 
+    std::uint32_t const byteOrderMark = 0x01020304; 
+    std::uint32_t const recordMarker = 0x5350454A; 
+
+    struct FileHeader
+    {   char magic[8]; 
+        std::uint32_t byteOrderMark; 
+        std::uint32_t reserved; 
+    }; 
+
+    enum RecordType
+    {   PathRecordType = 1, //the name is a path, which gets the next path id
+        DepsRecordType = 2  //the name is a goal, and the ids are of its discovered inputs
+    }; 
+
+    struct Record
+    {   std::uint32_t marker; 
+        std::uint32_t type; 
+        std::uint32_t nameLength; 
+        std::uint32_t numIds; 
+        std::uint64_t check; //hash of the record, with check 0, of the name and of the ids
+    }; 
+
+    //Compaction rewrites the whole file, so only do it when most deps records 
+    //are dead, and the file is not tiny. 
+    std::size_t const minRecordsForCompaction = 4096; 
+
+    std::size_t const maxAppendBufferBytes = 64 * 1024; 
+
+    inline std::size_t padTo8(std::size_t x) { return (x + 7) & ~static_cast<std::size_t>(7); }
+
+    std::uint64_t computeCheck(Record r, char const * name, char const * ids)
+    {   r.check = 0; 
+        std::uint64_t const h = hash64(name, r.nameLength, hash64( & r, sizeof(r))); 
+        return hash64(ids, r.numIds * sizeof(std::uint32_t), h); 
+    }
+
+    //Returns false at the end of the data, or when the record is torn or 
+    //corrupt. 
+    bool readRecord(MemoryMappedFile const& file, std::size_t & offset, Record & r, string & name, vector<std::uint32_t> & ids)
+    {   if (file.size() - offset < sizeof(r))
+            return false; 
+        memcpy( & r, file.data() + offset, sizeof(r)); 
+        std::size_t const idsBytes = static_cast<std::size_t>(r.numIds) * sizeof(std::uint32_t); 
+        if (r.marker != recordMarker || file.size() - offset - sizeof(r) < padTo8(r.nameLength)
+                || file.size() - offset - sizeof(r) - padTo8(r.nameLength) < padTo8(idsBytes))
+            return false; 
+        char const * const namePtr = file.data() + offset + sizeof(r); 
+        char const * const idsPtr = namePtr + padTo8(r.nameLength); 
+        if (r.check != computeCheck(r, namePtr, idsPtr))
+            return false; 
+        name.assign(namePtr, r.nameLength); 
+        ids.resize(r.numIds); 
+        if (idsBytes)
+            memcpy( & ids[0], idsPtr, idsBytes); 
+        offset += sizeof(r) + padTo8(r.nameLength) + padTo8(idsBytes); 
+        return true; 
+    }
+
+    void appendRecord(string & buffer, std::uint32_t type, string const& name, vector<std::uint32_t> const& ids)
+    {   string idBytes; 
+        if (ids.size())
+            idBytes.assign(reinterpret_cast<char const*>( & ids[0]), ids.size() * sizeof(std::uint32_t)); 
+        Record r; 
+        memset( & r, 0, sizeof(r)); 
+        r.marker = recordMarker; 
+        r.type = type; 
+        r.nameLength = static_cast<std::uint32_t>(name.size()); 
+        r.numIds = static_cast<std::uint32_t>(ids.size()); 
+        r.check = computeCheck(r, name.data(), idBytes.data()); 
+        buffer.append(reinterpret_cast<char const*>( & r), sizeof(r)); 
+        buffer.append(name); 
+        buffer.append(padTo8(name.size()) - name.size(), '\0'); 
+        buffer.append(idBytes); 
+        buffer.append(padTo8(idBytes.size()) - idBytes.size(), '\0'); 
+    }
+}
+
+
+jjm::DepsLog::DepsLog() : numJournalRecords(0), numRecorded(0) {}
+
+jjm::DepsLog::~DepsLog() {}
+
+void jjm::DepsLog::load(Path const& path_)
+{
+    Lock lock(mutex); 
+    path = path_; 
+    paths.clear(); 
+    pathIds.clear(); 
+    goals.clear(); 
+    appendBuffer.clear(); 
+    numJournalRecords = 0; 
+
+    bool needsCompaction = true; 
+    if (Stat::stat(path).type != FileType::NoExist)
+    {   MemoryMappedFile file; 
+        {   FileHandleOwner handle(FileOpener().openExistingOnly().readOnly().open(path)); 
+            file.map(handle.get()); 
+        }
+
+        FileHeader header; 
+        bool const valid = file.size() >= sizeof(header)
+                && 0 == memcmp(file.data(), fileMagic, sizeof(fileMagic))
+                && (memcpy( & header, file.data(), sizeof(header)), header.byteOrderMark == byteOrderMark); 
+        if (valid)
+        {   //Replay the journal. Stop at the first torn or corrupt record.
+            std::size_t offset = sizeof(header); 
+            std::size_t numDepsRecords = 0; 
+            Record r; 
+            string name; 
+            vector<std::uint32_t> ids; 
+            for (std::size_t next = offset; readRecord(file, next, r, name, ids); offset = next)
+            {   if (r.type == PathRecordType)
+                {   if ( ! pathIds.insert(make_pair(name, static_cast<std::uint32_t>(paths.size()))).second)
+                        break; 
+                    paths.push_back(Path(name)); 
+                }else if (r.type == DepsRecordType)
+                {   bool idsValid = true; 
+                    for (size_t i = 0; i < ids.size(); ++i)
+                        idsValid = idsValid && ids[i] < paths.size(); 
+                    if ( ! idsValid)
+                        break; 
+                    goals[name].swap(ids); 
+                    ++numDepsRecords; 
+                }
+                ++numJournalRecords; 
+            }
+            bool const torn = offset != file.size(); 
+            needsCompaction = torn
+                    || (numDepsRecords >= minRecordsForCompaction && numDepsRecords - goals.size() > goals.size()); 
+        }
+    }
+    if (needsCompaction)
+        compact(); 
+}
+
+void jjm::DepsLog::compact()
+{
+    //Only the paths of live goals are kept, numbered again in order of use. 
+    vector<Path> newPaths; 
+    map<string, std::uint32_t> newPathIds; 
+    vector<std::uint32_t> newIds(paths.size(), static_cast<std::uint32_t>(-1)); 
+    string buffer; 
+    FileHeader header; 
+    memset( & header, 0, sizeof(header)); 
+    memcpy(header.magic, fileMagic, sizeof(fileMagic)); 
+    header.byteOrderMark = byteOrderMark; 
+    buffer.append(reinterpret_cast<char const*>( & header), sizeof(header)); 
+    vector<std::uint32_t> const noIds; 
+    for (map<string, vector<std::uint32_t> >::iterator g = goals.begin(); g != goals.end(); ++g)
+    {   for (size_t i = 0; i < g->second.size(); ++i)
+        {   std::uint32_t & id = newIds[g->second[i]]; 
+            if (id == static_cast<std::uint32_t>(-1))
+            {   id = static_cast<std::uint32_t>(newPaths.size()); 
+                newPaths.push_back(paths[g->second[i]]); 
+                newPathIds[newPaths.back().getStringRep()] = id; 
+                appendRecord(buffer, PathRecordType, newPaths.back().getStringRep(), noIds); 
+            }
+            g->second[i] = id; 
+        }
+        appendRecord(buffer, DepsRecordType, g->first, g->second); 
+    }
+
+    //Write a new file and rename it over the old one, so that a crash leaves 
+    //either the old file or the new file. 
+    Path const tmpPath(path.getStringRep() + ".tmp"); 
+    {   FileHandleOwner out(FileOpener().createOrOpen().truncate().writeOnly().open(tmpPath)); 
+        out.get().writeComplete(buffer.data(), buffer.size()); 
+        if (0 != out.release().close2())
+            throw std::runtime_error("jjm::DepsLog::compact() failed. Cause:\nClosing \"" + tmpPath.getStringRep() + "\" failed."); 
+    }
+    renameFile(tmpPath, path); 
+    paths.swap(newPaths); 
+    pathIds.swap(newPathIds); 
+    numJournalRecords = paths.size() + goals.size(); 
+}
+
+bool jjm::DepsLog::find(std::string const& goalName, std::vector<Path> & inputs) const
+{
+    Lock lock(mutex); 
+    map<string, vector<std::uint32_t> >::const_iterator g = goals.find(goalName); 
+    if (g == goals.end() || g->second.empty())
+        return false; 
+    for (size_t i = 0; i < g->second.size(); ++i)
+        inputs.push_back(paths[g->second[i]]); 
+    return true; 
+}
+
+std::uint32_t jjm::DepsLog::getPathId(std::string const& name)
+{
+    map<string, std::uint32_t>::const_iterator p = pathIds.find(name); 
+    if (p != pathIds.end())
+        return p->second; 
+    std::uint32_t const id = static_cast<std::uint32_t>(paths.size()); 
+    paths.push_back(Path(name)); 
+    pathIds[name] = id; 
+    appendRecord(appendBuffer, PathRecordType, name, vector<std::uint32_t>()); 
+    return id; 
+}
+
+bool jjm::DepsLog::record(std::string const& goalName, std::vector<Path> const& inputs)
+{
+    Lock lock(mutex); 
+    if ( ! isLoaded())
+        return false; 
+    vector<std::uint32_t> ids; 
+    ids.reserve(inputs.size()); 
+    for (size_t i = 0; i < inputs.size(); ++i)
+        ids.push_back(getPathId(inputs[i].getStringRep())); 
+    vector<std::uint32_t> & logged = goals[goalName]; 
+    if (logged == ids)
+        return false; 
+    appendRecord(appendBuffer, DepsRecordType, goalName, ids); 
+    logged.swap(ids); 
+    ++numRecorded; 
+    if (appendBuffer.size() >= maxAppendBufferBytes)
+        flushImpl(); 
+    return true; 
+}
+
+void jjm::DepsLog::flush()
+{
+    Lock lock(mutex); 
+    flushImpl(); 
+}
+
+void jjm::DepsLog::flushImpl()
+{
+    if (appendBuffer.empty() || ! isLoaded())
+        return; 
+    //As with Signatures, a record torn by a crash or by a concurrent writer 
+    //ends the journal as far as load() is concerned. 
+    FileHandleOwner out(FileOpener().createOrOpen().writeOnly().append().open(path)); 
+    out.get().writeComplete(appendBuffer.data(), appendBuffer.size()); 
+    appendBuffer.clear(); 
+    if (0 != out.release().close2())
+        throw std::runtime_error("jjm::DepsLog::flush() failed. Cause:\nClosing \"" + path.getStringRep() + "\" failed."); 
+}
@@ -0,0 +1,128 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#ifndef JJMAKE_DEPSLOG_HPP_HEADER_GUARD
+#define JJMAKE_DEPSLOG_HPP_HEADER_GUARD
+
+#include "jbase/jstdint.hpp"
+#include "josutils/jpath.hpp"
+#include "josutils/jthreading.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace jjm
+{
+
+/* Scans a depfile, the Makefile rules which gcc -MD and clang -MD write, for
+the prerequisites of its rules. The targets are skipped.
+
+The text is scanned in place. A prerequisite without escapes is returned as
+a pointer into the text, and only a prerequisite with escapes, "\ " for a
+space, "\#" for '#' and "$$" for '$', is copied, once, into a buffer of the
+parser. The returned pointers are valid until the text or the parser is
+destroyed, or parse() is called again. */
+class DepfileParser
+{
+public:
+    class Token
+    {
+    public:
+        Token(char const * data_, std::size_t size_) : data(data_), size(size_) {}
+        char const * data; 
+        std::size_t size; 
+    }; 
+
+    DepfileParser() {}
+
+    //Returns false when the text is not a list of rules, such as a rule 
+    //without a colon. 
+    bool parse(char const * begin, char const * end); 
+
+    //In the order of the text, with duplicates. 
+    std::vector<Token> const& getPrerequisites() const { return prerequisites; }
+
+private:
+    DepfileParser(DepfileParser const& ); //not defined, not copyable
+    DepfileParser& operator= (DepfileParser const& ); //not defined, not copyable
+
+    std::vector<Token> prerequisites; 
+    std::string unescaped; 
+}; 
+
+
+/* DepsLog is the record of the inputs of each goal which its last successful
+execution discovered, such as the headers which a compiler read, kept
+between runs of jjmake. The inputs are taken from the depfile of the goal,
+and the depfile is then removed, so later runs read no text.
+
+The file is a journal of binary records. A path record names the next path
+id, and a deps record lists the ids of the discovered inputs of a goal, so a
+header shared by many goals is written once. Appends are buffered, and a
+batch is written with a single append. load() replays the journal, where a
+later deps record replaces an earlier one of the same goal. It stops at the
+first torn or corrupt record. When most deps records are dead, or the tail is
+torn, load() compacts the journal.
+
+The file uses the byte order of the machine which wrote it. A file which is
+not a deps log of this machine is discarded and replaced. */
+class DepsLog
+{
+public:
+    DepsLog(); 
+    ~DepsLog(); 
+
+    //Reads the file when it exists. 
+    //Throws std::exception on errors. 
+    void load(Path const& path); 
+    bool isLoaded() const { return ! path.isEmpty(); }
+
+    //Appends the logged inputs of the goal to inputs. Returns false when the 
+    //goal has none. 
+    //It is safe to call concurrently. 
+    bool find(std::string const& goalName, std::vector<Path> & inputs) const; 
+
+    //Replaces the logged inputs of the goal. Returns true when they differ 
+    //from the logged inputs. Does nothing before load(). 
+    //It is safe to call concurrently. 
+    //Throws std::exception on errors. 
+    bool record(std::string const& goalName, std::vector<Path> const& inputs); 
+
+    //Appends all buffered records to the file. Does nothing before load(). 
+    //Throws std::exception on errors. 
+    void flush(); 
+
+    std::int64_t getNumRecorded() const { return numRecorded; }
+    //As of load(). 
+    std::size_t getNumJournalRecords() const { return numJournalRecords; }
+
+private:
+    DepsLog(DepsLog const& ); //not defined, not copyable
+    DepsLog& operator= (DepsLog const& ); //not defined, not copyable
+
+    void compact(); 
+    //Returns the id of the path, and appends a path record for a new path. 
+    //Called with the mutex. 
+    std::uint32_t getPathId(std::string const& name); 
+    void flushImpl(); 
+
+    Path path; 
+
+    mutable Mutex mutex; //protects the members below
+    std::vector<Path> paths; //by id
+    std::map<std::string, std::uint32_t> pathIds; 
+    std::map<std::string, std::vector<std::uint32_t> > goals; 
+    std::string appendBuffer; 
+    std::size_t numJournalRecords; 
+
+    std::atomic<std::int64_t> numRecorded; 
+}; 
+
+} //namespace jjm
+
+#endif
@@ -0,0 +1,214 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "dyndep.hpp"
+
+#include "jbase/jinttostring.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace jjm; 
+using namespace std; 
+
+
+namespace
+{
+    inline bool isNewline(char const * p, char const * end)
+    {   return *p == '\n' || (*p == '\r' && end - p >= 2 && p[1] == '\n'); 
+    }
+
+    //The lexer of one dyndep file. Words end at a blank, a colon, a pipe or 
+    //a newline, unless escaped. 
+    class Scanner
+    {
+    public:
+        Scanner(char const * begin_, char const * end_) : begin(begin_), p(begin_), end(end_) {}
+
+        bool atEnd() const { return p == end; }
+        bool atNewline() const { return p != end && isNewline(p, end); }
+        char peek() const { return *p; }
+        void advance() { ++p; }
+
+        void skipNewline()
+        {   p += *p == '\r' ? 2 : 1; 
+        }
+
+        void skipLine()
+        {   while (p != end && *p != '\n')
+                ++p; 
+            if (p != end)
+                ++p; 
+        }
+
+        //Skips blanks, and escaped newlines with the indentation after them. 
+        void skipBlanks()
+        {   for (;;)
+            {   if (p != end && *p == ' ')
+                    ++p; 
+                else if (end - p >= 2 && *p == '$' && isNewline(p + 1, end))
+                    p += p[1] == '\r' ? 3 : 2; 
+                else
+                    return; 
+            }
+        }
+
+        //Reads a word, or with inValue the rest of the line. 
+        void readWord(string & word, bool inValue)
+        {   word.clear(); 
+            while (p != end)
+            {   char const c = *p; 
+                if (c == '$')
+                {   if (end - p < 2)
+                        fail("A \"$\" ends the file."); 
+                    char const e = p[1]; 
+                    if (e == ' ' || e == ':' || e == '$')
+                    {   word += e; 
+                        p += 2; 
+                        continue; 
+                    }
+                    if (isNewline(p + 1, end))
+                    {   p += e == '\r' ? 3 : 2; 
+                        while (p != end && *p == ' ')
+                            ++p; 
+                        continue; 
+                    }
+                    fail("Variables are not supported in dyndep files."); 
+                }
+                if (isNewline(p, end))
+                    break; 
+                if ( ! inValue && (c == ' ' || c == ':' || c == '|'))
+                    break; 
+                word += c; 
+                ++p; 
+            }
+            if (inValue)
+            {   while (word.size() && word[word.size() - 1] == ' ')
+                    word.erase(word.size() - 1); 
+            }
+        }
+
+        //Reads " = value" up to the end of the line. 
+        void readBinding(string & value)
+        {   skipBlanks(); 
+            if (p == end || *p != '=')
+                fail("Expected \"=\"."); 
+            ++p; 
+            skipBlanks(); 
+            readWord(value, true); 
+        }
+
+        void expectEndOfLine()
+        {   skipBlanks(); 
+            if (p == end)
+                return; 
+            if ( ! isNewline(p, end))
+                fail(string("Unexpected \"") + *p + "\"."); 
+            skipNewline(); 
+        }
+
+        void fail(string const& message) const
+        {   throw std::runtime_error("jjm::DyndepParser::parse() failed. Cause:\nLine "
+                    + toDecStr(1 + std::count(begin, p, '\n')) + ": " + message); 
+        }
+
+    private:
+        char const * const begin; 
+        char const * p; 
+        char const * const end; 
+    }; 
+
+    //Reads words into the list until a colon, a pipe or the end of the line. 
+    void readWords(Scanner & scanner, vector<string> & words)
+    {   string word; 
+        for (;;)
+        {   scanner.skipBlanks(); 
+            if (scanner.atEnd() || scanner.atNewline() || scanner.peek() == ':' || scanner.peek() == '|')
+                return; 
+            scanner.readWord(word, false); 
+            words.push_back(word); 
+        }
+    }
+}
+
+
+void jjm::DyndepParser::parse(char const * begin, char const * end)
+{
+    entries.clear(); 
+    Scanner scanner(begin, end); 
+    bool haveVersion = false; 
+    string word; 
+    while ( ! scanner.atEnd())
+    {   if (scanner.atNewline())
+        {   scanner.skipNewline(); 
+            continue; 
+        }
+        bool const indented = scanner.peek() == ' '; 
+        scanner.skipBlanks(); 
+        if (scanner.atEnd())
+            break; 
+        if (scanner.atNewline())
+            continue; 
+        if (scanner.peek() == '#')
+        {   scanner.skipLine(); 
+            continue; 
+        }
+        scanner.readWord(word, false); 
+        if (word.empty())
+            scanner.fail(string("Unexpected \"") + scanner.peek() + "\"."); 
+
+        if (indented)
+        {   //A binding of the build statement above it. 
+            if (entries.empty())
+                scanner.fail("An indented binding is not of a build statement."); 
+            string value; 
+            scanner.readBinding(value); 
+            scanner.expectEndOfLine(); 
+            continue; 
+        }
+        if (word == "ninja_dyndep_version")
+        {   string value; 
+            scanner.readBinding(value); 
+            if (value != "1" && value != "1.0")
+                scanner.fail("Unsupported ninja_dyndep_version \"" + value + "\"."); 
+            scanner.expectEndOfLine(); 
+            haveVersion = true; 
+            continue; 
+        }
+        if (word != "build")
+            scanner.fail("Expected \"build\", not \"" + word + "\"."); 
+        if ( ! haveVersion)
+            scanner.fail("The file does not start with ninja_dyndep_version."); 
+
+        Entry entry; 
+        vector<string> outputs; 
+        readWords(scanner, outputs); 
+        if (outputs.size() != 1)
+            scanner.fail("A build statement names exactly one output."); 
+        entry.output = outputs[0]; 
+        if ( ! scanner.atEnd() && scanner.peek() == '|')
+        {   scanner.advance(); 
+            if ( ! scanner.atEnd() && scanner.peek() == '|')
+                scanner.fail("Order-only outputs are not supported."); 
+            readWords(scanner, entry.implicitOutputs); 
+        }
+        if (scanner.atEnd() || scanner.peek() != ':')
+            scanner.fail("Expected \":\"."); 
+        scanner.advance(); 
+        scanner.skipBlanks(); 
+        scanner.readWord(word, false); 
+        if (word != "dyndep")
+            scanner.fail("Expected \"dyndep\", not \"" + word + "\"."); 
+        scanner.skipBlanks(); 
+        if ( ! scanner.atEnd() && scanner.peek() == '|')
+        {   scanner.advance(); 
+            if ( ! scanner.atEnd() && scanner.peek() == '|')
+                scanner.fail("Order-only inputs are not supported."); 
+            readWords(scanner, entry.implicitInputs); 
+        }
+        scanner.expectEndOfLine(); 
+        entries.push_back(entry); 
+    }
+}
@@ -0,0 +1,56 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#ifndef JJMAKE_DYNDEP_HPP_HEADER_GUARD
+#define JJMAKE_DYNDEP_HPP_HEADER_GUARD
+
+#include <string>
+#include <vector>
+
+namespace jjm
+{
+
+/* Parses a dyndep file, in the format of the dyndep files of ninja, which a
+goal writes to add inputs and outputs to other goals while they wait for it,
+such as the Fortran modules which a scanner found. For example:
+    ninja_dyndep_version = 1
+    build foo.o | foo.mod: dyndep | bar.mod
+    build bar.o | bar.mod: dyndep
+
+Each build statement names one output of a goal, then "|" and the outputs
+to add, and after ": dyndep", "|" and the inputs to add. Both lists are
+optional. "$ ", "$:" and "$$" escape a space, a colon and a dollar sign, and
+"$" at the end of a line continues it. Indented bindings, such as
+"restat = 1", are accepted and ignored. */
+class DyndepParser
+{
+public:
+    class Entry
+    {
+    public:
+        std::string output; 
+        std::vector<std::string> implicitOutputs; 
+        std::vector<std::string> implicitInputs; 
+    }; 
+
+    DyndepParser() {}
+
+    //Throws std::exception when the text is not a dyndep file, naming the 
+    //line. 
+    void parse(char const * begin, char const * end); 
+
+    //In the order of the text. 
+    std::vector<Entry> const& getEntries() const { return entries; }
+
+private:
+    DyndepParser(DyndepParser const& ); //not defined, not copyable
+    DyndepParser& operator= (DyndepParser const& ); //not defined, not copyable
+
+    std::vector<Entry> entries; 
+}; 
+
+} //namespace jjm
+
+#endif
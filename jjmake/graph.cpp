@@ -0,0 +1,277 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "graph.hpp"
+
+#include "node.hpp"
+#include "jbase/jfatal.hpp"
+#include "josutils/jthreading.hpp"
+
+#include <algorithm>
+#include <set>
+#include <stdexcept>
+
+using namespace jjm;
+using namespace std;
+
+
+namespace
+{
+    struct PathLess
+    {   vector<Path> const * paths; 
+        bool operator() (Graph::PathId a, string const& b) const { return (*paths)[a].getStringRep() < b; }
+        bool operator() (string const& a, Graph::PathId b) const { return a < (*paths)[b].getStringRep(); }
+    }; 
+
+    struct PathStringLess
+    {   bool operator() (Path const& a, string const& b) const { return a.getStringRep() < b; }
+    }; 
+
+    //Heap bytes of a string, assuming the short string optimization. 
+    inline size_t stringHeapBytes(string const& s) { return s.capacity() < sizeof(s) ? 0 : s.capacity() + 1; }
+
+    //Per-node lists from the builder, as path ids. 
+    void toPathIds(
+                vector<string> const& pathStrings, 
+                vector<Path> const& paths, 
+                vector<uint32_t> & ids)
+    {
+        ids.resize(pathStrings.size()); 
+        for (size_t i = 0; i < pathStrings.size(); ++i)
+        {   vector<Path>::const_iterator p = std::lower_bound(paths.begin(), paths.end(), pathStrings[i], PathStringLess()); 
+            if (p == paths.end() || p->getStringRep() != pathStrings[i])
+                JFATAL(0, pathStrings[i]); 
+            ids[i] = static_cast<uint32_t>(p - paths.begin()); 
+        }
+    }
+}
+
+
+jjm::Graph::PathId jjm::Graph::findPath(Path const& path) const
+{
+    vector<Path>::const_iterator p = std::lower_bound(paths.begin(), paths.end(), path.getStringRep(), PathStringLess()); 
+    if (p == paths.end() || p->getStringRep() != path.getStringRep())
+        return noPath(); 
+    return static_cast<PathId>(p - paths.begin()); 
+}
+
+void jjm::Graph::swap(Graph & other)
+{
+    nodes.swap(other.nodes); 
+    dependencyOffsets.swap(other.dependencyOffsets); 
+    dependencyIds.swap(other.dependencyIds); 
+    dependentOffsets.swap(other.dependentOffsets); 
+    dependentIds.swap(other.dependentIds); 
+    inputPathOffsets.swap(other.inputPathOffsets); 
+    inputPathIds.swap(other.inputPathIds); 
+    discoveredInputPathOffsets.swap(other.discoveredInputPathOffsets); 
+    discoveredInputPathIds.swap(other.discoveredInputPathIds); 
+    outputPathOffsets.swap(other.outputPathOffsets); 
+    outputPathIds.swap(other.outputPathIds); 
+    paths.swap(other.paths); 
+    producers.swap(other.producers); 
+}
+
+std::size_t jjm::Graph::getMemoryUsage() const
+{
+    size_t x = sizeof(*this); 
+    x += nodes.capacity() * sizeof(Node*); 
+    x += dependencyOffsets.capacity() * sizeof(uint32_t); 
+    x += dependencyIds.capacity() * sizeof(NodeId); 
+    x += dependentOffsets.capacity() * sizeof(uint32_t); 
+    x += dependentIds.capacity() * sizeof(NodeId); 
+    x += inputPathOffsets.capacity() * sizeof(uint32_t); 
+    x += inputPathIds.capacity() * sizeof(PathId); 
+    x += discoveredInputPathOffsets.capacity() * sizeof(uint32_t); 
+    x += discoveredInputPathIds.capacity() * sizeof(PathId); 
+    x += outputPathOffsets.capacity() * sizeof(uint32_t); 
+    x += outputPathIds.capacity() * sizeof(PathId); 
+    x += paths.capacity() * sizeof(Path); 
+    for (size_t i = 0; i < paths.size(); ++i)
+        x += stringHeapBytes(paths[i].getStringRep()); 
+    x += producers.capacity() * sizeof(NodeId); 
+    return x; 
+}
+
+std::size_t jjm::Graph::estimatePointerGraphMemoryUsage() const
+{
+    //Each node had a std::set<Node*> of dependencies and of dependents, a 
+    //mutex, a counter, an activated flag, and its own vectors of paths. 
+    //The context had a map from input path to consumers, and from output path
+    //to producer. A red-black tree node is three pointers and a color. 
+    size_t const treeNodeBytes = 4 * sizeof(void*); 
+    size_t x = 0; 
+    x += nodes.size() * (2 * sizeof(std::set<Node*>) + sizeof(Mutex) + sizeof(ssize_t) + sizeof(bool)); 
+    x += 2 * dependencyIds.size() * (treeNodeBytes + sizeof(Node*)); 
+    x += nodes.size() * 2 * sizeof(std::vector<Path>); 
+    for (size_t i = 0; i < inputPathIds.size(); ++i)
+        x += sizeof(Path) + stringHeapBytes(paths[inputPathIds[i]].getStringRep()); 
+    for (size_t i = 0; i < outputPathIds.size(); ++i)
+        x += sizeof(Path) + stringHeapBytes(paths[outputPathIds[i]].getStringRep()); 
+    vector<char> isInput(paths.size(), 0); 
+    for (size_t i = 0; i < inputPathIds.size(); ++i)
+    {   if ( ! isInput[inputPathIds[i]])
+        {   isInput[inputPathIds[i]] = 1; 
+            x += treeNodeBytes + sizeof(string) + sizeof(vector<Node*>) + stringHeapBytes(paths[inputPathIds[i]].getStringRep()); 
+        }
+        x += sizeof(Node*); 
+    }
+    for (size_t i = 0; i < outputPathIds.size(); ++i)
+        x += treeNodeBytes + sizeof(string) + sizeof(Node*) + stringHeapBytes(paths[outputPathIds[i]].getStringRep()); 
+    return x; 
+}
+
+
+void jjm::Graph::Builder::addNode(Node * node, std::vector<Path> const& inputPaths_, std::vector<Path> const& outputPaths_, 
+        std::vector<Path> const& discoveredInputPaths_)
+{
+    if (nodes.size() >= static_cast<size_t>(noNode()))
+        throw std::runtime_error("Too many nodes."); 
+    if (inputPathOffsets.empty())
+    {   inputPathOffsets.push_back(0); 
+        discoveredInputPathOffsets.push_back(0); 
+        outputPathOffsets.push_back(0); 
+    }
+    nodes.push_back(node); 
+    for (size_t i = 0; i < inputPaths_.size(); ++i)
+        inputPaths.push_back(inputPaths_[i].getStringRep()); 
+    for (size_t i = 0; i < discoveredInputPaths_.size(); ++i)
+        discoveredInputPaths.push_back(discoveredInputPaths_[i].getStringRep()); 
+    for (size_t i = 0; i < outputPaths_.size(); ++i)
+        outputPaths.push_back(outputPaths_[i].getStringRep()); 
+    inputPathOffsets.push_back(static_cast<uint32_t>(inputPaths.size())); 
+    discoveredInputPathOffsets.push_back(static_cast<uint32_t>(discoveredInputPaths.size())); 
+    outputPathOffsets.push_back(static_cast<uint32_t>(outputPaths.size())); 
+    if (inputPaths.size() >= static_cast<size_t>(noPath()) || outputPaths.size() >= static_cast<size_t>(noPath())
+            || discoveredInputPaths.size() >= static_cast<size_t>(noPath()))
+        throw std::runtime_error("Too many paths."); 
+}
+
+void jjm::Graph::Builder::build(Graph & graph)
+{
+    size_t const numNodes = nodes.size(); 
+    if (inputPathOffsets.empty())
+    {   inputPathOffsets.push_back(0); 
+        discoveredInputPathOffsets.push_back(0); 
+        outputPathOffsets.push_back(0); 
+    }
+
+    //the path table
+    vector<string> allPaths(inputPaths); 
+    allPaths.insert(allPaths.end(), discoveredInputPaths.begin(), discoveredInputPaths.end()); 
+    allPaths.insert(allPaths.end(), outputPaths.begin(), outputPaths.end()); 
+    std::sort(allPaths.begin(), allPaths.end()); 
+    allPaths.erase(std::unique(allPaths.begin(), allPaths.end()), allPaths.end()); 
+    vector<Path> paths; 
+    paths.reserve(allPaths.size()); 
+    for (size_t i = 0; i < allPaths.size(); ++i)
+        paths.push_back(Path(allPaths[i])); 
+    vector<string>().swap(allPaths); 
+
+    vector<PathId> inputPathIds; 
+    toPathIds(inputPaths, paths, inputPathIds); 
+    vector<string>().swap(inputPaths); 
+    vector<PathId> discoveredInputPathIds; 
+    toPathIds(discoveredInputPaths, paths, discoveredInputPathIds); 
+    vector<string>().swap(discoveredInputPaths); 
+    vector<PathId> outputPathIds; 
+    toPathIds(outputPaths, paths, outputPathIds); 
+    vector<string>().swap(outputPaths); 
+
+    //check for two nodes with the same output path
+    vector<NodeId> producers(paths.size(), noNode()); 
+    for (NodeId n = 0; n < numNodes; ++n)
+    {   for (uint32_t i = outputPathOffsets[n]; i < outputPathOffsets[n + 1]; ++i)
+        {   NodeId & producer = producers[outputPathIds[i]]; 
+            if (producer != noNode())
+            {   throw std::runtime_error(string()
+                        + "Found two nodes with the same output path:\n"
+                        + "Node 1: " + nodes[n]->goalName + "\n"
+                        + "Node 2: " + nodes[producer]->goalName + "\n"
+                        + "Path: " + paths[outputPathIds[i]].getStringRep() + "\n"
+                        ); 
+            }
+            producer = n; 
+        }
+    }
+
+    //check for an output path inside of another output path
+    //The paths inside of a directory are contiguous in sorted order. 
+    vector<PathId> sortedOutputs; 
+    for (PathId p = 0; p < paths.size(); ++p)
+    {   if (producers[p] != noNode())
+            sortedOutputs.push_back(p); 
+    }
+    PathLess pathLess; 
+    pathLess.paths = & paths; 
+    for (size_t i = 0; i < sortedOutputs.size(); ++i)
+    {   string prefix = paths[sortedOutputs[i]].getStringRep(); 
+        if (prefix.size() == 0 || prefix[prefix.size() - 1] != '/')
+            prefix += '/'; 
+        vector<PathId>::const_iterator inside = std::lower_bound(sortedOutputs.begin(), sortedOutputs.end(), prefix, pathLess); 
+        if (inside == sortedOutputs.end())
+            continue; 
+        string const& insideString = paths[*inside].getStringRep(); 
+        if (insideString.compare(0, prefix.size(), prefix) != 0)
+            continue; 
+        throw std::runtime_error(string()
+                + "Found two nodes with conflicting output paths:\n"
+                + "Node 1: " + nodes[producers[sortedOutputs[i]]]->goalName + "\n"
+                + "Path: " + paths[sortedOutputs[i]].getStringRep() + "\n"
+                + "Node 2: " + nodes[producers[*inside]]->goalName + "\n"
+                + "Path: " + insideString + "\n"
+                ); 
+    }
+
+    //implicit dependencies: a node depends on the producers of its inputs
+    vector<uint32_t> dependencyOffsets; 
+    dependencyOffsets.reserve(numNodes + 1); 
+    dependencyOffsets.push_back(0); 
+    vector<NodeId> dependencyIds; 
+    for (NodeId n = 0; n < numNodes; ++n)
+    {   size_t const first = dependencyIds.size(); 
+        for (uint32_t i = inputPathOffsets[n]; i < inputPathOffsets[n + 1]; ++i)
+        {   NodeId const producer = producers[inputPathIds[i]]; 
+            if (producer != noNode() && producer != n)
+                dependencyIds.push_back(producer); 
+        }
+        std::sort(dependencyIds.begin() + first, dependencyIds.end()); 
+        dependencyIds.erase(std::unique(dependencyIds.begin() + first, dependencyIds.end()), dependencyIds.end()); 
+        dependencyOffsets.push_back(static_cast<uint32_t>(dependencyIds.size())); 
+    }
+
+    //the reverse edges, by counting sort
+    vector<uint32_t> dependentOffsets(numNodes + 1, 0); 
+    for (size_t i = 0; i < dependencyIds.size(); ++i)
+        ++dependentOffsets[dependencyIds[i] + 1]; 
+    for (size_t n = 0; n < numNodes; ++n)
+        dependentOffsets[n + 1] += dependentOffsets[n]; 
+    vector<NodeId> dependentIds(dependencyIds.size()); 
+    {   vector<uint32_t> next(dependentOffsets.begin(), dependentOffsets.end() - 1); 
+        for (NodeId n = 0; n < numNodes; ++n)
+        {   for (uint32_t i = dependencyOffsets[n]; i < dependencyOffsets[n + 1]; ++i)
+                dependentIds[next[dependencyIds[i]]++] = n; 
+        }
+    }
+
+    graph.nodes.swap(nodes); 
+    graph.dependencyOffsets.swap(dependencyOffsets); 
+    graph.dependencyIds.swap(dependencyIds); 
+    graph.dependentOffsets.swap(dependentOffsets); 
+    graph.dependentIds.swap(dependentIds); 
+    graph.inputPathOffsets.swap(inputPathOffsets); 
+    graph.inputPathIds.swap(inputPathIds); 
+    graph.discoveredInputPathOffsets.swap(discoveredInputPathOffsets); 
+    graph.discoveredInputPathIds.swap(discoveredInputPathIds); 
+    graph.outputPathOffsets.swap(outputPathOffsets); 
+    graph.outputPathIds.swap(outputPathIds); 
+    graph.paths.swap(paths); 
+    graph.producers.swap(producers); 
+
+    vector<Node*>().swap(nodes); 
+    vector<uint32_t>().swap(inputPathOffsets); 
+    vector<uint32_t>().swap(discoveredInputPathOffsets); 
+    vector<uint32_t>().swap(outputPathOffsets); 
+}
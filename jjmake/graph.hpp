@@ -0,0 +1,149 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#ifndef JJMAKE_GRAPH_HPP_HEADER_GUARD
+#define JJMAKE_GRAPH_HPP_HEADER_GUARD
+
+#include "jbase/jstdint.hpp"
+#include "josutils/jpath.hpp"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace jjm
+{
+
+class Node; 
+
+/* Graph is the dependency graph, frozen once phase1 is done. 
+
+Nodes are numbered with dense 32-bit ids in goal name order, and paths with
+dense 32-bit ids in path order. Per-node lists are stored in compressed sparse
+row form: one array of ids for all nodes, and an array of offsets into it, 
+indexed by node id. For example, the dependencies of node n are 
+    dependencyIds[dependencyOffsets[n]] .. dependencyIds[dependencyOffsets[n+1] - 1]
+
+The discovered inputs of a node are the inputs which its last successful 
+execution reported, such as the headers listed by the depfile of a compiler,
+as opposed to the inputs written in the build files. They are compared like
+inputs, but they do not make the node depend on their producers, so a 
+generated header must still be written as an input. 
+
+A Graph is immutable once built, so it may be read concurrently without 
+locking. */
+class Graph
+{
+public:
+    typedef std::uint32_t NodeId; 
+    typedef std::uint32_t PathId; 
+    static NodeId noNode() { return static_cast<NodeId>(-1); }
+    static PathId noPath() { return static_cast<PathId>(-1); }
+
+    //A contiguous range of node ids or path ids. 
+    class IdRange
+    {
+    public:
+        IdRange(std::uint32_t const * first_, std::uint32_t const * last_) : first(first_), last(last_) {}
+        std::uint32_t const * begin() const { return first; }
+        std::uint32_t const * end() const { return last; }
+        std::size_t size() const { return last - first; }
+        std::uint32_t operator[] (std::size_t i) const { return first[i]; }
+    private:
+        std::uint32_t const * first; 
+        std::uint32_t const * last; 
+    }; 
+
+    class Builder; 
+
+    Graph() {}
+
+    //Exchanges the contents of the graphs. Used to replace a frozen graph 
+    //with a rebuilt one. 
+    void swap(Graph & other); 
+
+    std::size_t getNumNodes() const { return nodes.size(); }
+    std::size_t getNumEdges() const { return dependencyIds.size(); }
+    std::size_t getNumPaths() const { return paths.size(); }
+
+    Node * getNode(NodeId node) const { return nodes[node]; }
+    IdRange getDependencies(NodeId node) const { return getRange(dependencyOffsets, dependencyIds, node); }
+    IdRange getDependents(NodeId node) const { return getRange(dependentOffsets, dependentIds, node); }
+    IdRange getInputPaths(NodeId node) const { return getRange(inputPathOffsets, inputPathIds, node); }
+    IdRange getDiscoveredInputPaths(NodeId node) const { return getRange(discoveredInputPathOffsets, discoveredInputPathIds, node); }
+    IdRange getOutputPaths(NodeId node) const { return getRange(outputPathOffsets, outputPathIds, node); }
+
+    Path const& getPath(PathId path) const { return paths[path]; }
+    //Returns noPath() when the path is not an input or output of any node. 
+    PathId findPath(Path const& path) const; 
+    //Returns noNode() when no node outputs the path. 
+    NodeId getProducer(PathId path) const { return producers[path]; }
+
+    //Heap and inline bytes of this graph, excluding allocator overhead, and 
+    //excluding the nodes themselves. 
+    std::size_t getMemoryUsage() const; 
+
+    //Estimated bytes of the same graph as std::set<Node*> edges and per-node
+    //path vectors, as jjmake represented it before graphs were frozen. 
+    std::size_t estimatePointerGraphMemoryUsage() const; 
+
+private:
+    Graph(Graph const& ); //not defined, not copyable
+    Graph& operator= (Graph const& ); //not defined, not copyable
+
+    static IdRange getRange(std::vector<std::uint32_t> const& offsets, std::vector<std::uint32_t> const& ids, NodeId node)
+    {   std::uint32_t const * const base = ids.empty() ? 0 : & ids[0]; 
+        return IdRange(base + offsets[node], base + offsets[node + 1]); 
+    }
+
+    std::vector<Node*> nodes; 
+    std::vector<std::uint32_t> dependencyOffsets; 
+    std::vector<NodeId> dependencyIds; 
+    std::vector<std::uint32_t> dependentOffsets; 
+    std::vector<NodeId> dependentIds; 
+    std::vector<std::uint32_t> inputPathOffsets; 
+    std::vector<PathId> inputPathIds; 
+    std::vector<std::uint32_t> discoveredInputPathOffsets; 
+    std::vector<PathId> discoveredInputPathIds; 
+    std::vector<std::uint32_t> outputPathOffsets; 
+    std::vector<PathId> outputPathIds; 
+
+    std::vector<Path> paths; //sorted
+    std::vector<NodeId> producers; //by path id
+}; 
+
+
+/* Builds a Graph. Nodes must be added in goal name order. 
+A node depends on the node which outputs one of its input paths. */
+class Graph::Builder
+{
+public:
+    Builder() {}
+
+    //Does not take ownership. 
+    void addNode(Node * node, std::vector<Path> const& inputPaths, std::vector<Path> const& outputPaths, 
+            std::vector<Path> const& discoveredInputPaths); 
+
+    //Throws std::exception when two nodes output the same path, or when a 
+    //node outputs a path inside another output path. 
+    //The builder is left empty. 
+    void build(Graph & graph); 
+
+private:
+    Builder(Builder const& ); //not defined, not copyable
+    Builder& operator= (Builder const& ); //not defined, not copyable
+
+    std::vector<Node*> nodes; 
+    std::vector<std::string> inputPaths; 
+    std::vector<std::uint32_t> inputPathOffsets; 
+    std::vector<std::string> discoveredInputPaths; 
+    std::vector<std::uint32_t> discoveredInputPathOffsets; 
+    std::vector<std::string> outputPaths; 
+    std::vector<std::uint32_t> outputPathOffsets; 
+}; 
+
+} //namespace jjm
+
+#endif
@@ -0,0 +1,389 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "history.hpp"
+
+#include "jbase/jfatal.hpp"
+#include "josutils/jfilehandle.hpp"
+#include "josutils/jfilesystem.hpp"
+#include "josutils/jopen.hpp"
+#include "josutils/jstat.hpp"
+
+#include <string.h>
+#include <stdexcept>
+#include <vector>
+
+using namespace jjm;
+using namespace std;
+
+
+namespace
+{
+    //File layout: 
+    //  FileHeader
+    //  SnapshotRecord[numSnapshotRecords], sorted by name
+    //  the names of the snapshot records
+    //  padding to a multiple of 8, which is FileHeader::logOffset
+    //  log records, each a LogRecord followed by the name, padded to a multiple of 8
+
+    char const fileMagic[8] = { 'J', 'J', 'M', 'H', 'I', 'S', 'T', '2' }; 
+    std::uint32_t const byteOrderMark = 0x01020304; 
+    std::uint32_t const logRecordMarker = 0x474F4C4A; 
+
+    struct FileHeader
+    {   char magic[8]; 
+        std::uint32_t byteOrderMark; 
+        std::uint32_t reserved; 
+        std::uint64_t numSnapshotRecords; 
+        std::uint64_t logOffset; 
+    }; 
+
+    struct SnapshotRecord
+    {   std::uint64_t nameOffset; //from the start of the file
+        std::uint32_t nameLength; 
+        std::int32_t exitStatus; 
+        std::int64_t durationNanoSec; 
+        std::int64_t finishTimeNanoSec; 
+        std::int64_t peakRssBytes; 
+    }; 
+
+    struct LogRecord
+    {   std::uint32_t marker; 
+        std::uint32_t nameLength; 
+        std::int32_t exitStatus; 
+        std::uint32_t reserved; 
+        std::int64_t durationNanoSec; 
+        std::int64_t finishTimeNanoSec; 
+        std::int64_t peakRssBytes; 
+    }; 
+
+    //Compaction rewrites the whole file, so only do it when the log is a 
+    //sizable fraction of the file, or when the file is small anyway. 
+    std::size_t const smallSnapshotRecords = 64 * 1024; 
+    std::size_t const logToSnapshotRatio = 8; 
+
+    std::size_t const maxAppendBufferBytes = 64 * 1024; 
+
+    inline std::size_t padTo8(std::size_t x) { return (x + 7) & ~static_cast<std::size_t>(7); }
+
+    //Same order as std::string::compare. 
+    inline int compareNames(char const * a, std::size_t aSize, std::string const& b)
+    {   int const x = memcmp(a, b.data(), aSize < b.size() ? aSize : b.size()); 
+        if (x != 0)
+            return x; 
+        if (aSize < b.size())
+            return -1; 
+        if (aSize > b.size())
+            return 1; 
+        return 0; 
+    }
+
+    void appendLogRecord(std::string & buffer, std::string const& goalName, History::Entry const& entry)
+    {   LogRecord r; 
+        memset( & r, 0, sizeof(r)); 
+        r.marker = logRecordMarker; 
+        r.nameLength = static_cast<std::uint32_t>(goalName.size()); 
+        r.exitStatus = entry.exitStatus; 
+        r.durationNanoSec = entry.durationNanoSec; 
+        r.finishTimeNanoSec = entry.finishTimeNanoSec; 
+        r.peakRssBytes = entry.peakRssBytes; 
+        buffer.append(reinterpret_cast<char const*>( & r), sizeof(r)); 
+        buffer.append(goalName); 
+        buffer.append(padTo8(goalName.size()) - goalName.size(), '\0'); 
+    }
+
+    //Reads the log records of data into entries, the later records of a goal
+    //replacing the earlier ones. Returns false when the log ends with a torn 
+    //or corrupt record, which ends the log. 
+    bool readLog(char const * data, std::size_t size, map<string, History::Entry> & entries, std::size_t & numRecords)
+    {   for (std::size_t offset = 0; offset < size; )
+        {   LogRecord r; 
+            if (size - offset < sizeof(r))
+                return false; 
+            memcpy( & r, data + offset, sizeof(r)); 
+            if (r.marker != logRecordMarker || size - offset - sizeof(r) < padTo8(r.nameLength))
+                return false; 
+            History::Entry & entry = entries[string(data + offset + sizeof(r), r.nameLength)]; 
+            entry.durationNanoSec = r.durationNanoSec; 
+            entry.finishTimeNanoSec = r.finishTimeNanoSec; 
+            entry.peakRssBytes = r.peakRssBytes; 
+            entry.exitStatus = r.exitStatus; 
+            ++numRecords; 
+            offset += sizeof(r) + padTo8(r.nameLength); 
+        }
+        return true; 
+    }
+}
+
+
+jjm::History::History() : numSnapshotRecords(0), numGoals(0), numLogRecords(0), tornLog(false) {}
+
+jjm::History::~History() {}
+
+void jjm::History::load(Path const& path_)
+{
+    path = path_; 
+    //A missing or invalid file is replaced by an empty one, which is cheap. 
+    //Compacting a large log is left to flush(). 
+    if ( ! readFile())
+        compact(); 
+}
+
+bool jjm::History::readFile()
+{
+    file.unmap(); 
+    numSnapshotRecords = 0; 
+    numGoals = 0; 
+    logEntries.clear(); 
+    numLogRecords = 0; 
+    tornLog = false; 
+
+    mapFile(); 
+
+    //Validate the snapshot. Individual names are bounds checked on use. 
+    FileHeader header; 
+    bool valid = file.size() >= sizeof(header); 
+    if (valid)
+    {   memcpy( & header, file.data(), sizeof(header)); 
+        valid = memcmp(header.magic, fileMagic, sizeof(fileMagic)) == 0
+                && header.byteOrderMark == byteOrderMark
+                && header.logOffset <= file.size()
+                && header.numSnapshotRecords <= (file.size() - sizeof(header)) / sizeof(SnapshotRecord)
+                && sizeof(header) + header.numSnapshotRecords * sizeof(SnapshotRecord) <= header.logOffset; 
+    }
+    if ( ! valid)
+    {   file.unmap(); 
+        return false; 
+    }
+    numSnapshotRecords = static_cast<std::size_t>(header.numSnapshotRecords); 
+
+    std::size_t const logOffset = static_cast<std::size_t>(header.logOffset); 
+    tornLog = ! readLog(file.data() + logOffset, file.size() - logOffset, logEntries, numLogRecords); 
+
+    numGoals = numSnapshotRecords + logEntries.size(); 
+    for (map<string, Entry>::const_iterator e = logEntries.begin(); e != logEntries.end(); ++e)
+    {   Entry ignored; 
+        if (findInSnapshot(e->first, ignored))
+            --numGoals; 
+    }
+    return true; 
+}
+
+void jjm::History::mapFile()
+{
+    file.unmap(); 
+    if (Stat::stat(path).type == FileType::NoExist)
+        return; 
+    FileHandleOwner handle(FileOpener().openExistingOnly().readOnly().open(path)); 
+    file.map(handle.get()); 
+}
+
+bool jjm::History::find(std::string const& goalName, Entry & entry) const
+{
+    map<string, Entry>::const_iterator e = logEntries.find(goalName); 
+    if (e != logEntries.end())
+    {   entry = e->second; 
+        return true; 
+    }
+    return findInSnapshot(goalName, entry); 
+}
+
+bool jjm::History::findInSnapshot(std::string const& goalName, Entry & entry) const
+{
+    char const * const records = file.data() + sizeof(FileHeader); 
+    std::size_t low = 0; 
+    std::size_t high = numSnapshotRecords; 
+    while (low < high)
+    {   std::size_t const middle = low + (high - low) / 2; 
+        SnapshotRecord r; 
+        memcpy( & r, records + middle * sizeof(r), sizeof(r)); 
+        if (r.nameOffset > file.size() || r.nameLength > file.size() - r.nameOffset)
+            return false; //corrupt
+        int const x = compareNames(file.data() + r.nameOffset, r.nameLength, goalName); 
+        if (x == 0)
+        {   entry.durationNanoSec = r.durationNanoSec; 
+            entry.finishTimeNanoSec = r.finishTimeNanoSec; 
+            entry.peakRssBytes = r.peakRssBytes; 
+            entry.exitStatus = r.exitStatus; 
+            return true; 
+        }
+        if (x < 0)
+            low = middle + 1; 
+        else
+            high = middle; 
+    }
+    return false; 
+}
+
+jjm::History::SortedFinder::SortedFinder(History const& history_) 
+    : history(history_), nextSnapshotRecord(0), nextLogEntry(history_.logEntries.begin()) 
+{}
+
+bool jjm::History::SortedFinder::find(std::string const& goalName, Entry & entry)
+{
+    while (nextLogEntry != history.logEntries.end() && nextLogEntry->first < goalName)
+        ++nextLogEntry; 
+    //Log entries are newer, so they take precedence over the snapshot. 
+    if (nextLogEntry != history.logEntries.end() && nextLogEntry->first == goalName)
+    {   entry = nextLogEntry->second; 
+        return true; 
+    }
+
+    char const * const records = history.file.data() + sizeof(FileHeader); 
+    for ( ; nextSnapshotRecord < history.numSnapshotRecords; ++nextSnapshotRecord)
+    {   SnapshotRecord r; 
+        memcpy( & r, records + nextSnapshotRecord * sizeof(r), sizeof(r)); 
+        if (r.nameOffset > history.file.size() || r.nameLength > history.file.size() - r.nameOffset)
+            continue; //corrupt
+        int const x = compareNames(history.file.data() + r.nameOffset, r.nameLength, goalName); 
+        if (x > 0)
+            return false; 
+        if (x == 0)
+        {   entry.durationNanoSec = r.durationNanoSec; 
+            entry.finishTimeNanoSec = r.finishTimeNanoSec; 
+            entry.peakRssBytes = r.peakRssBytes; 
+            entry.exitStatus = r.exitStatus; 
+            ++nextSnapshotRecord; 
+            return true; 
+        }
+    }
+    return false; 
+}
+
+void jjm::History::compact()
+{
+    //Merge the sorted snapshot with the sorted log entries. Log entries are 
+    //newer, so they replace snapshot entries of the same goal. 
+    vector<SnapshotRecord> records; 
+    string names; 
+    {
+        char const * const oldRecords = file.data() + sizeof(FileHeader); 
+        map<string, Entry>::const_iterator e = logEntries.begin(); 
+        std::size_t i = 0; 
+        while (i < numSnapshotRecords || e != logEntries.end())
+        {   SnapshotRecord r; 
+            bool const haveOld = i < numSnapshotRecords; 
+            if (haveOld)
+            {   memcpy( & r, oldRecords + i * sizeof(r), sizeof(r)); 
+                if (r.nameOffset > file.size() || r.nameLength > file.size() - r.nameOffset)
+                {   ++i; //corrupt, drop it
+                    continue; 
+                }
+            }
+            int x = 0; 
+            if ( ! haveOld)
+                x = 1; 
+            else if (e == logEntries.end())
+                x = -1; 
+            else
+                x = compareNames(file.data() + r.nameOffset, r.nameLength, e->first); 
+
+            SnapshotRecord n; 
+            memset( & n, 0, sizeof(n)); 
+            n.nameOffset = names.size(); //relative to the names, fixed up below
+            if (x < 0)
+            {   n.nameLength = r.nameLength; 
+                n.exitStatus = r.exitStatus; 
+                n.durationNanoSec = r.durationNanoSec; 
+                n.finishTimeNanoSec = r.finishTimeNanoSec; 
+                n.peakRssBytes = r.peakRssBytes; 
+                names.append(file.data() + r.nameOffset, r.nameLength); 
+                ++i; 
+            }else
+            {   n.nameLength = static_cast<std::uint32_t>(e->first.size()); 
+                n.exitStatus = e->second.exitStatus; 
+                n.durationNanoSec = e->second.durationNanoSec; 
+                n.finishTimeNanoSec = e->second.finishTimeNanoSec; 
+                n.peakRssBytes = e->second.peakRssBytes; 
+                names.append(e->first); 
+                if (x == 0)
+                    ++i; //the newer log entry replaces the snapshot entry
+                ++e; 
+            }
+            records.push_back(n); 
+        }
+    }
+
+    FileHeader header; 
+    memset( & header, 0, sizeof(header)); 
+    memcpy(header.magic, fileMagic, sizeof(fileMagic)); 
+    header.byteOrderMark = byteOrderMark; 
+    header.numSnapshotRecords = records.size(); 
+    std::size_t const namesOffset = sizeof(header) + records.size() * sizeof(SnapshotRecord); 
+    header.logOffset = padTo8(namesOffset + names.size()); 
+    for (std::size_t i = 0; i < records.size(); ++i)
+        records[i].nameOffset += namesOffset; 
+
+    //Write a new file and rename it over the old one, so that a crash leaves
+    //either the old file or the new file. 
+    Path const tmpPath(path.getStringRep() + ".tmp"); 
+    {   FileHandleOwner out(FileOpener().createOrOpen().truncate().writeOnly().open(tmpPath)); 
+        out.get().writeComplete( & header, sizeof(header)); 
+        if (records.size())
+            out.get().writeComplete( & records[0], records.size() * sizeof(SnapshotRecord)); 
+        names.append(static_cast<std::size_t>(header.logOffset) - namesOffset - names.size(), '\0'); 
+        out.get().writeComplete(names.data(), names.size()); 
+        if (0 != out.release().close2())
+            throw std::runtime_error("jjm::History::compact() failed. Cause:\nClosing \"" + tmpPath.getStringRep() + "\" failed."); 
+    }
+    file.unmap(); 
+    renameFile(tmpPath, path); 
+
+    mapFile(); 
+    numSnapshotRecords = records.size(); 
+    numGoals = records.size(); 
+    logEntries.clear(); 
+    numLogRecords = 0; 
+    tornLog = false; 
+}
+
+void jjm::History::record(std::string const& goalName, Entry const& entry)
+{
+    Lock lock(appendMutex); 
+    if (path.isEmpty())
+        return; 
+    appendLogRecord(appendBuffer, goalName, entry); 
+    ++numLogRecords; 
+    if (appendBuffer.size() >= maxAppendBufferBytes)
+        flushImpl(); 
+}
+
+void jjm::History::flush()
+{
+    Lock lock(appendMutex); 
+    flushImpl(); 
+    if (path.isEmpty() || numLogRecords == 0)
+        return; 
+    if (numSnapshotRecords < smallSnapshotRecords || numLogRecords * logToSnapshotRatio > numSnapshotRecords)
+    {   //Read the file again, for the records appended since load(). 
+        readFile(); 
+        compact(); 
+    }
+}
+
+void jjm::History::flushImpl()
+{
+    if (appendBuffer.empty())
+        return; 
+    if (tornLog)
+    {   //Records appended after a torn record would be lost, so compact the 
+        //file and the buffered records instead of appending. 
+        readFile(); 
+        std::size_t numBufferedRecords = 0; 
+        readLog(appendBuffer.data(), appendBuffer.size(), logEntries, numBufferedRecords); 
+        compact(); 
+        appendBuffer.clear(); 
+        return; 
+    }
+    //With append, records go to the end of the file even when another jjmake
+    //process is appending. A record torn by a crash or by a concurrent writer
+    //ends the log as far as load() is concerned. load() only notes it, and 
+    //the first append after the next load() compacts it away, as above. 
+    FileHandleOwner out(FileOpener().createOrOpen().writeOnly().append().open(path)); 
+    out.get().writeComplete(appendBuffer.data(), appendBuffer.size()); 
+    appendBuffer.clear(); 
+    if (0 != out.release().close2())
+        throw std::runtime_error("jjm::History::flush() failed. Cause:\nClosing \"" + path.getStringRep() + "\" failed."); 
+}
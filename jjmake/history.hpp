@@ -0,0 +1,123 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#ifndef JJMAKE_HISTORY_HPP_HEADER_GUARD
+#define JJMAKE_HISTORY_HPP_HEADER_GUARD
+
+#include "jbase/jstdint.hpp"
+#include "josutils/jmmap.hpp"
+#include "josutils/jpath.hpp"
+#include "josutils/jthreading.hpp"
+
+#include <cstddef>
+#include <map>
+#include <string>
+
+namespace jjm
+{
+
+/* History is the record of the most recent execution of each goal, kept
+between runs of jjmake. 
+
+The file is a snapshot sorted by goal name, followed by an append-only log. 
+record() appends to the log. load() maps the file into memory, and find() 
+binary searches the mapped snapshot, so loading does not parse or copy the 
+snapshot. SortedFinder finds the goals of a whole build by one merge with the 
+snapshot instead. 
+
+Compaction rewrites the whole file, so it is not done by load(). flush() 
+compacts the log into a new snapshot when the log is large compared to the 
+snapshot. A torn tail of the log is compacted away before the first append. 
+
+The file uses the byte order of the machine which wrote it. A file which is
+not a history file of this machine is discarded and replaced. */
+class History
+{
+public:
+    class Entry
+    {
+    public:
+        Entry() : durationNanoSec(0), finishTimeNanoSec(0), peakRssBytes(0), exitStatus(0) {}
+        std::int64_t durationNanoSec; 
+        std::int64_t finishTimeNanoSec; //system clock, time since unix epoch
+        //The largest peak resident set size of the processes of the goal, 
+        //or 0 when unknown. 
+        std::int64_t peakRssBytes; 
+        std::int32_t exitStatus; //0 for success
+    }; 
+
+    History(); 
+    ~History(); 
+
+    //Creates the file when it does not exist. 
+    //Throws std::exception on errors. 
+    void load(Path const& path); 
+
+    //Returns false when the goal has no entry. 
+    //Entries recorded since load() may not be visible. 
+    bool find(std::string const& goalName, Entry & entry) const; 
+
+    /* Finds the entries of goals given in increasing order of name, as 
+    std::string compares them, by merging them with the sorted snapshot and 
+    log. Finding n goals is linear in n and the size of the history, instead
+    of a binary search per goal. The history must not be loaded or flushed 
+    while a SortedFinder uses it. */
+    class SortedFinder
+    {
+    public:
+        explicit SortedFinder(History const& history_); 
+
+        //Returns false when the goal has no entry. The goal name must be 
+        //greater than the goal name of the previous call. 
+        bool find(std::string const& goalName, Entry & entry); 
+
+    private:
+        SortedFinder(SortedFinder const& ); //not defined, not copyable
+        SortedFinder& operator= (SortedFinder const& ); //not defined, not copyable
+
+        History const& history; 
+        std::size_t nextSnapshotRecord; 
+        std::map<std::string, Entry>::const_iterator nextLogEntry; 
+    }; 
+
+    //The number of goals with entries, as of load(). 
+    std::size_t size() const { return numGoals; }
+
+    //Does nothing before load(). 
+    //It is safe to call record() concurrently. Records are buffered, and they
+    //may be written before flush(). 
+    //Throws std::exception on errors. 
+    void record(std::string const& goalName, Entry const& entry); 
+
+    //Appends all buffered records to the file, and compacts the file when 
+    //its log has grown large. Call it at the end of the build. 
+    //Throws std::exception on errors. 
+    void flush(); 
+
+private:
+    History(History const& ); //not defined, not copyable
+    History& operator= (History const& ); //not defined, not copyable
+
+    void mapFile(); 
+    bool readFile(); 
+    bool findInSnapshot(std::string const& goalName, Entry & entry) const; 
+    void compact(); 
+    void flushImpl(); 
+
+    Path path; 
+    MemoryMappedFile file; 
+    std::size_t numSnapshotRecords; 
+    std::size_t numGoals; 
+    std::map<std::string, Entry> logEntries; //entries in the log but not the snapshot, as of load()
+    std::size_t numLogRecords; //in the file, including those appended since load()
+    bool tornLog; //the log ends with a torn or corrupt record
+
+    Mutex appendMutex; //protects this->appendBuffer, numLogRecords, and tornLog
+    std::string appendBuffer; 
+}; 
+
+} //namespace jjm
+
+#endif
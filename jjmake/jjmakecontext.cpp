@@ -5,20 +5,87 @@
 
 #include "jjmakecontext.hpp"
 
+#include "dyndep.hpp"
 #include "parsercontext.hpp"
+#include "jbase/jinttostring.hpp"
+#include "josutils/jclock.hpp"
+#include "josutils/jfilehandle.hpp"
+#include "josutils/jfilesystem.hpp"
+#include "josutils/jmmap.hpp"
+#include "josutils/jopen.hpp"
 #include "josutils/jstdstreams.hpp"
+#include "josutils/jsysload.hpp"
 #include "josutils/jpath.hpp"
+#include "josutils/jprocess.hpp"
+#include "josutils/jthreading.hpp"
+#include "josutils/jwatch.hpp"
+
+#include <algorithm>
 
 using namespace std;
 
+namespace
+{
+    std::int64_t const workerConnectTimeoutNanoSec = std::int64_t(5) * 1000 * 1000 * 1000; 
+
+    //Set while the calling thread executes a goal with OutputSyncGoal. 
+    JJM_THREAD_LOCAL vector<jjm::ConsoleWriter::Segment> * goalOutput = 0; 
+
+    inline string escapeSingleQuote(string const& x)
+    {
+        string r;
+        for (size_t i=0; i < x.size(); ++i)
+        {   if (x[i] == '\'')
+            {   r += '\'';
+                r += '\\';
+                r += '\'';
+                r += '\'';
+            }else
+                r += x[i]; 
+        }
+        return r; 
+    }
+
+    bool containsPath(vector<jjm::Path> const& paths, jjm::Path const& path)
+    {   for (vector<jjm::Path>::const_iterator p = paths.begin(); p != paths.end(); ++p)
+        {   if (p->getStringRep() == path.getStringRep())
+                return true; 
+        }
+        return false; 
+    }
+
+    //Orders a heap of node ids by priority, highest first. 
+    class LowerPriority
+    {
+    public:
+        LowerPriority(vector<std::int64_t> const& priorities_) : priorities( & priorities_) {}
+        bool operator() (jjm::Graph::NodeId a, jjm::Graph::NodeId b) const { return (*priorities)[a] < (*priorities)[b]; }
+    private:
+        vector<std::int64_t> const * priorities; 
+    }; 
+}
+
 jjm::JjmakeContext::JjmakeContext(Arguments const& arguments_)
     : 
     arguments(arguments_), 
-    threadPool(arguments_.numThreads),
-    failFlag(false)
+    threadPool(arguments_.autoThreads ? 2 * getNumOnlineCpus() : arguments_.numThreads),
+    failFlag(false), 
+    numSkippedByEarlyCutoff(0), 
+    numDynamicEdges(0), 
+    numDynamicallyActivated(0), 
+    discoveredInputsChanged(false), 
+    numDepfilesRead(0), 
+    admittedMemory(0), 
+    numAdmitted(0), 
+    numDelayedByMemory(0)
 
 {
+    if (arguments.outputSync != OutputSyncNone)
+        consoleWriter.reset(new ConsoleWriter); 
+    workerPool.setTimeout(arguments.workerToolTimeoutMillis * 1000 * 1000); 
     rootParserContext.reset(ParserContext::newRoot(this)); 
+    if (arguments.autoThreads)
+        arguments.numThreads = threadPool.getNumThreads(); 
     if (arguments.numThreads < 1)
         JFATAL(0, 0); 
 }
@@ -28,8 +95,61 @@ jjm::JjmakeContext::~JjmakeContext()
     for (map<std::string, Node*>::iterator node = nodes.begin(); node != nodes.end(); ++node)
         delete node->second; 
     nodes.clear(); 
+    try
+    {   flushOutput(); 
+    } catch (std::exception & )
+    {
+    }
+}
+
+void jjm::JjmakeContext::print(bool toStdErr, Utf8String const& str)
+{
+    if (goalOutput)
+    {   goalOutput->push_back(ConsoleWriter::Segment(toStdErr, str)); 
+        return; 
+    }
+    if (consoleWriter.get())
+    {   consoleWriter.get()->write(toStdErr, str); 
+        return; 
+    }
+    Lock lock(stdOutErrMutex); 
+    if (toStdErr && ! (jerr() << str << flush))
+        throw std::runtime_error("Writing to stderr failed."); 
+    if ( ! toStdErr && ! (jout() << str << flush))
+        throw std::runtime_error("Writing to stdout failed."); 
+}
+
+void jjm::JjmakeContext::flushOutput()
+{
+    if (consoleWriter.get())
+        consoleWriter.get()->flush(); 
 }
 
+//With OutputSyncGoal, collects what the calling thread prints while it 
+//executes one goal, and writes it as one block when the goal completes. 
+class jjm::JjmakeContext::GoalOutputScope
+{
+public:
+    explicit GoalOutputScope(JjmakeContext * context_) 
+        : context(context_), active(context_->arguments.outputSync == OutputSyncGoal && goalOutput == 0)
+    {   if (active)
+            goalOutput = & segments; 
+    }
+    ~GoalOutputScope()
+    {   if ( ! active)
+            return; 
+        goalOutput = 0; 
+        if (segments.size())
+            context->consoleWriter.get()->writeBlock(segments); 
+    }
+private:
+    GoalOutputScope(GoalOutputScope const& ); //not defined, not copyable
+    GoalOutputScope& operator= (GoalOutputScope const& ); //not defined, not copyable
+    JjmakeContext * context; 
+    bool active; 
+    vector<ConsoleWriter::Segment> segments; 
+}; 
+
 class jjm::JjmakeContext::InitialParseNode : public jjm::Thread::Runnable
 {
 public: 
@@ -58,18 +178,46 @@ public:
 
 void jjm::JjmakeContext::execute()
 {
+    startConcurrencyController(); 
+    startJobServer(); 
+    startDispatcher(); 
     phase1(); 
 
-    initPathMaps();
-    createImplicitDependencies(); 
+    loadDepsLog(); 
+    freezeGraph(); 
 
     activateSpecifiedGoals();
-    enableDependenciesDependents(); 
+    enableDependenciesDependents(arguments.dependencyMode); 
+    loadHistory(); 
+    loadSignatures(); 
+    executeActivatedGoals(); 
+    if (arguments.watch)
+        watch(); 
+    if (failFlag && arguments.keepGoing)
+        throw std::runtime_error("Execution failed. See previous error messages."); 
+}
+
+void jjm::JjmakeContext::executeActivatedGoals()
+{
     setNumOutstandingPrereqs();
+    applyGoalWeights(); 
+    applyGoalPools(); 
+    computePriorities(); 
+    applyMemoryPredictions(); 
+    hashSourceFiles(); 
     
     phase2(); 
-    if (failFlag && arguments.keepGoing)
-        throw std::runtime_error("Execution failed. See previous error messages."); 
+    for (Graph::NodeId n = 0; n < graph.getNumNodes(); ++n)
+    {   if (dynamicallyActivated[n])
+            activated[n] = 1; 
+    }
+    history.flush(); 
+    signatures.flush(); 
+    depsLog.flush(); 
+    actionCache.trim(); 
+    if (arguments.printStats)
+        printStats(); 
+    flushOutput(); 
 }
 
 void jjm::JjmakeContext::phase1()
@@ -83,123 +231,107 @@ void jjm::JjmakeContext::phase1()
     threadPool.waitUntilIdle(); 
 }
 
-void jjm::JjmakeContext::initPathMaps()
+void jjm::JjmakeContext::freezeGraph()
 {
+    //Node ids follow the goal name order of this->nodes. 
+    //When the graph is frozen again in watch mode, the paths of the nodes 
+    //which were already frozen are taken from the old graph. The old graph is
+    //kept when building the new one fails. 
+    //The discovered inputs are those of the deps log, which is up to date 
+    //with the goals executed so far. 
+    Graph::Builder builder; 
+    vector<Path> inputPaths; 
+    vector<Path> outputPaths; 
+    vector<Path> discoveredInputPaths; 
     for (map<string, Node*>::iterator node = nodes.begin(); node != nodes.end(); ++node)
-    {   
-        for (vector<Path>::const_iterator inputPath = node->second->inputPaths.begin();
-                    inputPath != node->second->inputPaths.end(); 
-                    ++inputPath)
-        {
-            string inputPathString = inputPath->getStringRep(); 
-            inputPathMap[inputPathString].push_back(node->second); 
-        }
-        
-        for (vector<Path>::const_iterator outputPath = node->second->outputPaths.begin();
-                    outputPath != node->second->outputPaths.end(); 
-                    ++outputPath)
-        {   string outputPathString = outputPath->getStringRep(); 
-            Node * & node2 = outputPathMap[outputPathString]; 
-            if (node2 != 0)
-            {   throw std::runtime_error(string()
-                        + "Found two nodes with the same output path:\n"
-                        + "Node 1: " + node->second->goalName + "\n"
-                        + "Node 2: " + node2->goalName + "\n"
-                        + "Path: " + outputPathString + "\n"
-                        ); 
-            }
-            node2 = node->second; 
+    {   Graph::NodeId const oldId = node->second->id; 
+        discoveredInputPaths.clear(); 
+        depsLog.find(node->first, discoveredInputPaths); 
+        if (oldId == Graph::noNode())
+        {   builder.addNode(node->second, node->second->inputPaths, node->second->outputPaths, discoveredInputPaths); 
+            continue; 
         }
+        inputPaths.clear(); 
+        outputPaths.clear(); 
+        Graph::IdRange const inputs = graph.getInputPaths(oldId); 
+        for (Graph::PathId const * p = inputs.begin(); p != inputs.end(); ++p)
+            inputPaths.push_back(graph.getPath(*p)); 
+        Graph::IdRange const outputs = graph.getOutputPaths(oldId); 
+        for (Graph::PathId const * p = outputs.begin(); p != outputs.end(); ++p)
+            outputPaths.push_back(graph.getPath(*p)); 
+        builder.addNode(node->second, inputPaths, outputPaths, discoveredInputPaths); 
     }
-
-    //check for conflicting output paths
-    map<string, jjm::Node*>::const_iterator prev = outputPathMap.begin(); 
-    map<string, jjm::Node*>::const_iterator curr = prev; 
-    if (curr == outputPathMap.end())
-        return; 
-    ++curr; 
-    for ( ; curr != outputPathMap.end(); ++prev, ++curr)
-    {
-        //with lexicographic sort, with conflicting paths, the shorter path will be first
-        if (prev->first.size() <= curr->first.size() 
-                && std::equal(prev->first.begin(), prev->first.end(), curr->first.begin()))
-        {
-            throw std::runtime_error(string()
-                    + "Found two nodes with conflicting output paths:\n"
-                    + "Node 1: " + prev->second->goalName + "\n"
-                    + "Path: " + prev->first + "\n"
-                    + "Node 2: " + curr->second->goalName + "\n"
-                    + "Path: " + curr->first + "\n"
-                    ); 
-        }
+    {   Graph newGraph; 
+        builder.build(newGraph); 
+        graph.swap(newGraph); 
     }
-}
+    discoveredInputsChanged = false; 
 
-namespace
-{
-    int comp(string const& x, string const& y)
-    {
-        for (size_t i=0; ; ++i)
-        {   if (x.size() == i && y.size() == i)
-                return 0;
-            if (x.size() == i)
-                return -1;
-            if (y.size() == i)
-                return 1; 
-            if (x[i] < y[i])
-                return -1;
-            if (x[i] > y[i])
-                return 1;
-        }
+    Graph::NodeId id = 0; 
+    for (map<string, Node*>::iterator node = nodes.begin(); node != nodes.end(); ++node, ++id)
+    {   node->second->id = id; 
+        node->second->graph = & graph; 
+        node->second->statCache = & statCache; 
+        node->second->jobServer = jobServer.get(); 
+        node->second->workerPool = & workerPool; 
+        node->second->dispatcher = dispatcher.get(); 
+        node->second->context = this; 
+        node->second->alwaysMake = arguments.alwaysMake; 
+        vector<Path>().swap(node->second->inputPaths); 
+        vector<Path>().swap(node->second->outputPaths); 
     }
+    resetGoalState(); 
 }
 
-void jjm::JjmakeContext::createImplicitDependencies()
+void jjm::JjmakeContext::resetGoalState()
 {
-    map<string, vector<Node*> >::iterator input = inputPathMap.begin(); 
-    map<string, Node*>::iterator output = outputPathMap.begin(); 
-    for (;;)
-    {   if (input == inputPathMap.end() || output == outputPathMap.end())
-            break;
-        string const& input2 = input->first; 
-        string const& output2 = output->first; 
-        int d = comp(input2, output2); 
-        if (d == 0)
-        {   for (vector<Node*>::iterator inputNode = input->second.begin(); inputNode != input->second.end(); ++inputNode)
-            {   (**inputNode).dependencies.insert(output->second);
-                output->second->dependents.insert(*inputNode); 
-            }
-            ++input;
-            ++output;
-        }
-        if (d < 0)
-            ++input; 
-        if (d > 0)
-            ++output; 
+    size_t const numNodes = graph.getNumNodes(); 
+    activated.assign(numNodes, 0); 
+    weights.assign(numNodes, 1); 
+    priorities.assign(numNodes, 0); 
+    dependencyExecuted.assign(numNodes, 0); 
+    completed.assign(numNodes, 0); 
+    vector<std::atomic<std::int32_t> > counters(numNodes); 
+    numOutstandingPrereqs.swap(counters); 
+    statCache.reset(graph); 
+
+    //The dyndep files are applied again by the next build. 
+    dynamicallyActivated.assign(numNodes, 0); 
+    dynamicProducers.clear(); 
+    dynamicConsumers.clear(); 
+    consumerOffsets.clear(); 
+    consumerIds.clear(); 
+    vector<vector<Graph::NodeId> >(numNodes).swap(dynamicDependents); 
+    dependentsReleased.assign(numNodes, 0); 
+    releasedByExecution.assign(numNodes, 0); 
+    for (Graph::NodeId n = 0; n < numNodes; ++n)
+    {   vector<Path>().swap(graph.getNode(n)->dynamicInputPaths); 
+        vector<Path>().swap(graph.getNode(n)->dynamicOutputPaths); 
     }
 }
 
 void jjm::JjmakeContext::setNumOutstandingPrereqs()
 {
-    if (arguments.dependencyMode == AllDependencies)
-    {   for (map<string, Node*>::iterator node = nodes.begin(); node != nodes.end(); ++node)
-        {   if (node->second->activated)
-                node->second->numOutstandingPrereqs = node->second->dependencies.size(); 
-        }
-    }
-    if (arguments.dependencyMode == AllDependents)
-    {   for (map<string, Node*>::iterator node = nodes.begin(); node != nodes.end(); ++node)
-        {   if (node->second->activated)
-                node->second->numOutstandingPrereqs = node->second->dependents.size(); 
+    if (arguments.dependencyMode == NoDependencies)
+        return; 
+    bool const forward = arguments.dependencyMode == AllDependencies; 
+    for (Graph::NodeId n = 0; n < graph.getNumNodes(); ++n)
+    {   if ( ! activated[n])
+            continue; 
+        Graph::IdRange const upstream = forward ? graph.getDependencies(n) : graph.getDependents(n); 
+        std::int32_t count = 0; 
+        for (Graph::NodeId const * u = upstream.begin(); u != upstream.end(); ++u)
+        {   if (activated[*u])
+                ++count; 
         }
+        numOutstandingPrereqs[n] = count; 
     }
 }
 
 void jjm::JjmakeContext::activateSpecifiedGoals()
 {
     if (arguments.allGoals)
-    {   for (map<string, Node*>::iterator node = nodes.begin(); node != nodes.end(); ++node)
-            node->second->activated = true; 
+    {   activated.assign(graph.getNumNodes(), 1); 
         return; 
     }
 
@@ -210,7 +342,7 @@ void jjm::JjmakeContext::activateSpecifiedGoals()
     {
         map<string, Node*>::const_iterator node = nodes.find(*g); 
         if (node != nodes.end())
-        {   node->second->activated = true; 
+        {   activated[node->second->id] = 1; 
             continue; 
         }
 
@@ -219,15 +351,15 @@ void jjm::JjmakeContext::activateSpecifiedGoals()
         if ( ! p1.isEmpty())
         {   node = nodes.find(p1.getStringRep());
             if (node != nodes.end())
-            {   node->second->activated = true; 
+            {   activated[node->second->id] = 1; 
                 continue; 
             }
         }
 
         if ( ! p1.isEmpty())
-        {   map<string, Node*>::iterator n = outputPathMap.find(p1.getStringRep());
-            if (n != outputPathMap.end())
-            {   node->second->activated = true;
+        {   Graph::PathId const path = graph.findPath(p1); 
+            if (path != Graph::noPath() && graph.getProducer(path) != Graph::noNode())
+            {   activated[graph.getProducer(path)] = 1; 
                 continue; 
             }
         }
@@ -236,86 +368,864 @@ void jjm::JjmakeContext::activateSpecifiedGoals()
     }
 }
 
-void jjm::JjmakeContext::enableDependenciesDependents()
+void jjm::JjmakeContext::enableDependenciesDependents(DependencyMode mode)
 {
-    if (arguments.dependencyMode == NoDependencies)
+    if (mode == NoDependencies)
+        return; 
+
+    bool const forward = mode == AllDependencies; 
+    vector<Graph::NodeId> pending; 
+    for (Graph::NodeId n = 0; n < graph.getNumNodes(); ++n)
+    {   if (activated[n])
+            pending.push_back(n);
+    }
+    for ( ; pending.size(); )
+    {   Graph::NodeId const n = pending.back();
+        pending.pop_back();
+        Graph::IdRange const upstream = forward ? graph.getDependencies(n) : graph.getDependents(n); 
+        for (Graph::NodeId const * u = upstream.begin(); u != upstream.end(); ++u)
+        {   if ( ! activated[*u])
+            {   activated[*u] = 1;
+                pending.push_back(*u); 
+            }
+        }
+    }
+}
+
+void jjm::JjmakeContext::loadHistory()
+{
+    if (arguments.stateDir.empty() || arguments.executionMode != ExecuteGoals)
+        return; 
+    Path const stateDir = Path(arguments.stateDir).getAbsolutePath(); 
+    try
+    {   createDirectories(stateDir); 
+        history.load(Path::join(stateDir, Path("history"))); 
+    }catch (std::exception & e)
+    {   throw std::runtime_error(string() + "Failed to load the goal history in \"" + stateDir.getStringRep() + "\". Cause:\n" + e.what()); 
+    }
+}
+
+void jjm::JjmakeContext::loadSignatures()
+{
+    if (arguments.stateDir.empty() || arguments.executionMode != ExecuteGoals)
+        return; 
+    Path const stateDir = Path(arguments.stateDir).getAbsolutePath(); 
+    try
+    {   createDirectories(stateDir); 
+        signatures.load(Path::join(stateDir, Path("signatures"))); 
+    }catch (std::exception & e)
+    {   throw std::runtime_error(string() + "Failed to load the file signatures in \"" + stateDir.getStringRep() + "\". Cause:\n" + e.what()); 
+    }
+    if (arguments.actionCacheBytes > 0 && ! actionCache.isOpen())
+    {   try
+        {   actionCache.open(Path::join(stateDir, Path("cache")), arguments.actionCacheBytes); 
+        }catch (std::exception & e)
+        {   throw std::runtime_error(string() + "Failed to open the action cache in \"" + stateDir.getStringRep() + "\". Cause:\n" + e.what()); 
+        }
+    }
+    if ( ! arguments.cacheServerAddress.empty() && ! remoteCache.isOpen())
+        remoteCache.open(arguments.cacheServerAddress, arguments.cacheServerTimeoutMillis * 1000 * 1000); 
+    attachSignatures(); 
+}
+
+void jjm::JjmakeContext::loadDepsLog()
+{
+    if (arguments.stateDir.empty() || arguments.executionMode != ExecuteGoals || depsLog.isLoaded())
         return; 
+    Path const stateDir = Path(arguments.stateDir).getAbsolutePath(); 
+    try
+    {   createDirectories(stateDir); 
+        depsLog.load(Path::join(stateDir, Path("deps"))); 
+    }catch (std::exception & e)
+    {   throw std::runtime_error(string() + "Failed to load the deps log in \"" + stateDir.getStringRep() + "\". Cause:\n" + e.what()); 
+    }
+}
 
-    vector<Node*> pending; 
+void jjm::JjmakeContext::attachSignatures()
+{
+    signatures.attach(graph, statCache); 
     for (map<string, Node*>::iterator node = nodes.begin(); node != nodes.end(); ++node)
-    {   if (node->second->activated)
-            pending.push_back(node->second);
-    }
-    if (arguments.dependencyMode == AllDependencies)
-    {   for ( ; pending.size(); )
-        {   Node * node = pending.back();
-            pending.pop_back();
-            for (set<Node*>::iterator d = node->dependencies.begin(); d != node->dependencies.end(); ++d)
-            {   if ( ! (**d).activated)
-                {   (**d).activated = true;
-                    pending.push_back(*d); 
-                }
+        node->second->signatures = & signatures; 
+}
+
+class jjm::JjmakeContext::HashFilesRunnable : public jjm::Thread::Runnable
+{
+public:
+    HashFilesRunnable() : context(0) {}
+    jjm::JjmakeContext * context; 
+    vector<Graph::PathId> paths; 
+    virtual void run()
+    {
+        for (size_t i = 0; i < paths.size(); ++i)
+        {   if (context->failFlag && ! context->arguments.keepGoing)
+                return; 
+            //Errors are reported by the goals which read the file. 
+            try
+            {   std::uint64_t ignored = 0; 
+                context->signatures.getContentHash(paths[i], ignored); 
+            }catch (std::exception & )
+            {
             }
         }
     }
-    if (arguments.dependencyMode == AllDependents)
-    {   for ( ; pending.size(); )
-        {   Node * node = pending.back();
-            pending.pop_back();
-            for (set<Node*>::iterator d = node->dependents.begin(); d != node->dependents.end(); ++d)
-            {   if ( ! (**d).activated)
-                {   (**d).activated = true;
-                    pending.push_back(*d); 
-                }
+};
+
+void jjm::JjmakeContext::hashSourceFiles()
+{
+    if ( ! signatures.isLoaded())
+        return; 
+
+    //Source files are the inputs which no goal outputs. Their signatures are
+    //known before any goal executes, so they are computed up front in 
+    //parallel. The outputs of goals are hashed when the goals which read 
+    //them execute. 
+    vector<char> seen(graph.getNumPaths(), 0); 
+    vector<Graph::PathId> sources; 
+    for (Graph::NodeId n = 0; n < graph.getNumNodes(); ++n)
+    {   if ( ! activated[n])
+            continue; 
+        Graph::IdRange const inputRanges[2] = { graph.getInputPaths(n), graph.getDiscoveredInputPaths(n) }; 
+        for (int r = 0; r < 2; ++r)
+        {   for (Graph::PathId const * input = inputRanges[r].begin(); input != inputRanges[r].end(); ++input)
+            {   if (seen[*input] || graph.getProducer(*input) != Graph::noNode())
+                    continue; 
+                seen[*input] = 1; 
+                sources.push_back(*input); 
             }
         }
     }
+    if (sources.empty())
+        return; 
+
+    size_t const numTasks = std::min<size_t>(sources.size(), 4 * static_cast<size_t>(std::max(1, arguments.numThreads))); 
+    vector<Thread::Runnable*> newRunnables; 
+    struct Guard
+    {   vector<Thread::Runnable*> & v; 
+        Guard(vector<Thread::Runnable*> & v_) : v(v_) {}
+        ~Guard() { for (size_t i = 0; i < v.size(); ++i) delete v[i]; }
+    } guard(newRunnables); 
+    for (size_t t = 0; t < numTasks; ++t)
+    {   UniquePtr<HashFilesRunnable*> newRunnable(new HashFilesRunnable); 
+        newRunnable.get()->context = this; 
+        for (size_t i = t; i < sources.size(); i += numTasks)
+            newRunnable.get()->paths.push_back(sources[i]); 
+        newRunnables.push_back(0); 
+        newRunnables.back() = newRunnable.release(); 
+    }
+    threadPool.addTasks(newRunnables); 
+    threadPool.waitUntilIdle(); 
+}
+
+void jjm::JjmakeContext::recordExecution(Node * node, std::int64_t startNanoSec, std::int32_t exitStatus, 
+        std::vector<Path> const* discoveredInputs)
+{
+    History::Entry entry; 
+    entry.durationNanoSec = getMonotonicClockNanoSec() - startNanoSec; 
+    entry.finishTimeNanoSec = getSystemClockNanoSec(); 
+    entry.peakRssBytes = getJoinedPeakRssBytes(); 
+    entry.exitStatus = exitStatus; 
+    history.record(node->goalName, entry); 
+
+    if (signatures.isLoaded())
+    {   if (exitStatus == 0)
+            signatures.recordSuccess(node->id, discoveredInputs); 
+        else
+            signatures.recordFailure(node->id); 
+    }
+}
+
+bool jjm::JjmakeContext::ingestDepfile(Graph::NodeId id, std::vector<Path> & discoveredInputs, bool & changed)
+{
+    changed = false; 
+    discoveredInputs.clear(); 
+    Node * const node = graph.getNode(id); 
+    Path depfile; 
+    Path baseDir; 
+    if ( ! depsLog.isLoaded() || ! node->getDepfile(depfile, baseDir) || Stat::stat2(depfile).type == FileType::NoExist)
+        return false; 
+
+    //The inputs of the build files are compared anyway, so only the other 
+    //inputs are logged, each once. 
+    set<string> seen; 
+    Graph::IdRange const inputs = graph.getInputPaths(id); 
+    for (Graph::PathId const * p = inputs.begin(); p != inputs.end(); ++p)
+        seen.insert(graph.getPath(*p).getStringRep()); 
+    {   MemoryMappedFile file; 
+        {   FileHandleOwner handle(FileOpener().openExistingOnly().readOnly().open(depfile)); 
+            file.map(handle.get()); 
+        }
+        DepfileParser parser; 
+        if ( ! parser.parse(file.data(), file.data() + file.size()))
+            throw std::runtime_error("The depfile \"" + depfile.getStringRep() + "\" is not a list of Makefile rules."); 
+        vector<DepfileParser::Token> const& prerequisites = parser.getPrerequisites(); 
+        for (size_t i = 0; i < prerequisites.size(); ++i)
+        {   Path const input = Path::join(baseDir, Path(string(prerequisites[i].data, prerequisites[i].size))); 
+            if (seen.insert(input.getStringRep()).second)
+                discoveredInputs.push_back(input); 
+        }
+    }
+    changed = depsLog.record(node->goalName, discoveredInputs); 
+    if (changed)
+        discoveredInputsChanged = true; 
+    removeFile(depfile); 
+    ++numDepfilesRead; 
+    return true; 
+}
+
+void jjm::JjmakeContext::applyDyndepFile(Graph::NodeId id, std::vector<Graph::NodeId> & ready)
+{
+    Node * const node = graph.getNode(id); 
+    Path dyndepFile; 
+    Path baseDir; 
+    if ( ! node->getDyndepFile(dyndepFile, baseDir))
+        return; 
+    if (Stat::stat2(dyndepFile).type == FileType::NoExist)
+    {   if (arguments.executionMode == PrintGoals)
+            return; 
+        throw std::runtime_error("The goal did not write its dyndep file \"" + dyndepFile.getStringRep() + "\"."); 
+    }
+    DyndepParser parser; 
+    try
+    {   MemoryMappedFile file; 
+        {   FileHandleOwner handle(FileOpener().openExistingOnly().readOnly().open(dyndepFile)); 
+            file.map(handle.get()); 
+        }
+        parser.parse(file.data(), file.data() + file.size()); 
+    }catch (std::exception & e)
+    {   throw std::runtime_error("Cannot read the dyndep file \"" + dyndepFile.getStringRep() + "\". Cause:\n" + e.what()); 
+    }
+
+    //Every goal named by the file waits for this goal, and has not started. 
+    class Target
+    {
+    public:
+        Graph::NodeId node; 
+        vector<Path> outputs; 
+        vector<Path> inputs; 
+    }; 
+    vector<Target> targets; 
+    vector<DyndepParser::Entry> const& entries = parser.getEntries(); 
+    for (size_t e = 0; e < entries.size(); ++e)
+    {   Path const output = Path::join(baseDir, Path(entries[e].output)); 
+        Graph::PathId const path = graph.findPath(output); 
+        Graph::NodeId const target = path == Graph::noPath() ? Graph::noNode() : graph.getProducer(path); 
+        if (target == Graph::noNode())
+            throw std::runtime_error("The dyndep file \"" + dyndepFile.getStringRep() + "\" names \"" 
+                    + output.getStringRep() + "\", which is not an output of a goal."); 
+        Graph::IdRange const dependencies = graph.getDependencies(target); 
+        if (std::find(dependencies.begin(), dependencies.end(), id) == dependencies.end())
+            throw std::runtime_error("The dyndep file \"" + dyndepFile.getStringRep() + "\" names goal \"" 
+                    + graph.getNode(target)->goalName + "\", which does not depend on goal \"" + node->goalName 
+                    + "\". It must read the dyndep file, or another output of the goal."); 
+        targets.push_back(Target()); 
+        targets.back().node = target; 
+        for (size_t i = 0; i < entries[e].implicitOutputs.size(); ++i)
+            targets.back().outputs.push_back(Path::join(baseDir, Path(entries[e].implicitOutputs[i]))); 
+        for (size_t i = 0; i < entries[e].implicitInputs.size(); ++i)
+            targets.back().inputs.push_back(Path::join(baseDir, Path(entries[e].implicitInputs[i]))); 
+    }
+
+    //The outputs are added first, so that the inputs find their producers 
+    //in any order of the statements. 
+    Lock lock(dynamicEdgesMutex); 
+    for (vector<Target>::const_iterator t = targets.begin(); t != targets.end(); ++t)
+    {   Node * const target = graph.getNode(t->node); 
+        for (vector<Path>::const_iterator output = t->outputs.begin(); output != t->outputs.end(); ++output)
+        {   Graph::NodeId const producer = findDynamicProducer(*output); 
+            if (producer == t->node)
+                continue; 
+            if (producer != Graph::noNode())
+                throw std::runtime_error("The dyndep file \"" + dyndepFile.getStringRep() + "\" adds the output \"" 
+                        + output->getStringRep() + "\" to goal \"" + target->goalName + "\", but goal \"" 
+                        + graph.getNode(producer)->goalName + "\" outputs it."); 
+            dynamicProducers[output->getStringRep()] = t->node; 
+            target->dynamicOutputPaths.push_back(*output); 
+
+            //The goals which read the output now wait for the target. 
+            Graph::PathId const path = graph.findPath(*output); 
+            if (path != Graph::noPath())
+            {   Graph::IdRange const consumers = getConsumers(path); 
+                for (Graph::NodeId const * c = consumers.begin(); c != consumers.end(); ++c)
+                    addDynamicEdge(t->node, *c, dyndepFile, ready); 
+            }
+            map<string, vector<Graph::NodeId> >::iterator waiting = dynamicConsumers.find(output->getStringRep()); 
+            if (waiting != dynamicConsumers.end())
+            {   vector<Graph::NodeId> consumers; 
+                consumers.swap(waiting->second); 
+                dynamicConsumers.erase(waiting); 
+                for (vector<Graph::NodeId>::const_iterator c = consumers.begin(); c != consumers.end(); ++c)
+                    addDynamicEdge(t->node, *c, dyndepFile, ready); 
+            }
+        }
+    }
+    for (vector<Target>::const_iterator t = targets.begin(); t != targets.end(); ++t)
+    {   Node * const target = graph.getNode(t->node); 
+        Graph::IdRange const inputs = graph.getInputPaths(t->node); 
+        for (vector<Path>::const_iterator input = t->inputs.begin(); input != t->inputs.end(); ++input)
+        {   Graph::PathId const path = graph.findPath(*input); 
+            if ((path != Graph::noPath() && std::find(inputs.begin(), inputs.end(), path) != inputs.end())
+                    || containsPath(target->dynamicInputPaths, *input))
+                continue; 
+            target->dynamicInputPaths.push_back(*input); 
+            Graph::NodeId const producer = findDynamicProducer(*input); 
+            if (producer != Graph::noNode())
+                addDynamicEdge(producer, t->node, dyndepFile, ready); 
+            else
+                dynamicConsumers[input->getStringRep()].push_back(t->node); 
+        }
+    }
+}
+
+void jjm::JjmakeContext::addDynamicEdge(Graph::NodeId dependency, Graph::NodeId dependent, Path const& dyndepFile, 
+        std::vector<Graph::NodeId> & ready)
+{
+    //An inactive dependent does not execute, but it may still be activated 
+    //by a later edge, which then adds the edges of its dynamic inputs. 
+    if ( ! isActive(dependent))
+        return; 
+    Graph::IdRange const dependencies = graph.getDependencies(dependent); 
+    vector<Graph::NodeId> const& dependents = dynamicDependents[dependency]; 
+    if (std::find(dependencies.begin(), dependencies.end(), dependency) != dependencies.end()
+            || std::find(dependents.begin(), dependents.end(), dependent) != dependents.end())
+        return; 
+
+    string const edge = "The dyndep file \"" + dyndepFile.getStringRep() + "\" makes goal \"" 
+            + graph.getNode(dependent)->goalName + "\" depend on goal \"" + graph.getNode(dependency)->goalName + "\""; 
+    vector<Graph::NodeId> cycle; 
+    if (dependency == dependent)
+        cycle.push_back(dependent); 
+    else
+    {   if ( ! isActive(dependency))
+            activateDynamically(dependency, dependent, dyndepFile, ready); 
+        findDependentsPath(dependent, dependency, cycle); 
+    }
+    if (cycle.size())
+    {   string message = edge + ", which would make a dependency cycle. Each goal depends on the one before it:\n"; 
+        for (size_t i = 0; i < cycle.size(); ++i)
+            message += "    " + graph.getNode(cycle[i])->goalName + "\n"; 
+        message += "    " + graph.getNode(dependent)->goalName + "\n"; 
+        throw std::runtime_error(message); 
+    }
+
+    std::int32_t count = numOutstandingPrereqs[dependent]; 
+    do
+    {   if (count <= 0)
+            throw std::runtime_error(edge + ", which already started. Goals which read the outputs that a dyndep file " 
+                    "adds must depend on the goal which writes it."); 
+    }while ( ! numOutstandingPrereqs[dependent].compare_exchange_weak(count, count + 1)); 
+    linkDynamicEdge(dependency, dependent, ready); 
+}
+
+void jjm::JjmakeContext::linkDynamicEdge(Graph::NodeId dependency, Graph::NodeId dependent, std::vector<Graph::NodeId> & ready)
+{
+    ++numDynamicEdges; 
+    bool executed = false; 
+    {   Lock lock(getDependentsMutex(dependency)); 
+        if ( ! dependentsReleased[dependency])
+        {   dynamicDependents[dependency].push_back(dependent); 
+            return; 
+        }
+        executed = releasedByExecution[dependency] != 0; 
+    }
+    if (executed)
+        setDependencyExecuted(dependent); 
+    releasePrereq(dependent, ready); 
+}
+
+void jjm::JjmakeContext::activateDynamically(Graph::NodeId node, Graph::NodeId dependent, Path const& dyndepFile, 
+        std::vector<Graph::NodeId> & ready)
+{
+    //Every new goal is held at one outstanding prerequisite until its edges
+    //are added. Its priority follows from the goal which first needed it. 
+    vector<Graph::NodeId> added(1, node); 
+    dynamicallyActivated[node] = 1; 
+    numOutstandingPrereqs[node] = 1; 
+    priorities[node] = std::max(priorities[node], priorities[dependent] + weights[node]); 
+    for (size_t i = 0; i < added.size(); ++i)
+    {   Graph::IdRange const dependencies = graph.getDependencies(added[i]); 
+        for (Graph::NodeId const * d = dependencies.begin(); d != dependencies.end(); ++d)
+        {   if (isActive(*d))
+                continue; 
+            dynamicallyActivated[*d] = 1; 
+            numOutstandingPrereqs[*d] = 1; 
+            priorities[*d] = std::max(priorities[*d], priorities[added[i]] + weights[*d]); 
+            added.push_back(*d); 
+        }
+    }
+    numDynamicallyActivated += added.size(); 
+
+    for (vector<Graph::NodeId>::const_iterator n = added.begin(); n != added.end(); ++n)
+    {   Graph::IdRange const dependencies = graph.getDependencies(*n); 
+        for (Graph::NodeId const * d = dependencies.begin(); d != dependencies.end(); ++d)
+        {   ++numOutstandingPrereqs[*n]; 
+            linkDynamicEdge(*d, *n, ready); 
+        }
+    }
+    for (vector<Graph::NodeId>::const_iterator n = added.begin(); n != added.end(); ++n)
+    {   vector<Path> const& inputs = graph.getNode(*n)->dynamicInputPaths; 
+        for (vector<Path>::const_iterator input = inputs.begin(); input != inputs.end(); ++input)
+        {   Graph::NodeId const producer = findDynamicProducer(*input); 
+            if (producer != Graph::noNode())
+                addDynamicEdge(producer, *n, dyndepFile, ready); 
+        }
+    }
+    for (vector<Graph::NodeId>::const_iterator n = added.begin(); n != added.end(); ++n)
+        releasePrereq(*n, ready); 
+}
+
+jjm::Graph::NodeId jjm::JjmakeContext::findDynamicProducer(Path const& path) const
+{
+    Graph::PathId const id = graph.findPath(path); 
+    if (id != Graph::noPath() && graph.getProducer(id) != Graph::noNode())
+        return graph.getProducer(id); 
+    map<string, Graph::NodeId>::const_iterator producer = dynamicProducers.find(path.getStringRep()); 
+    return producer == dynamicProducers.end() ? Graph::noNode() : producer->second; 
+}
+
+void jjm::JjmakeContext::findDependentsPath(Graph::NodeId first, Graph::NodeId last, std::vector<Graph::NodeId> & path) const
+{
+    //Completed goals are passed through too, though no path from a goal 
+    //which has not started leads through them. 
+    path.clear(); 
+    map<Graph::NodeId, Graph::NodeId> parents; 
+    parents[first] = Graph::noNode(); 
+    vector<Graph::NodeId> pending(1, first); 
+    while (pending.size())
+    {   Graph::NodeId const n = pending.back(); 
+        pending.pop_back(); 
+        if (n == last)
+        {   for (Graph::NodeId p = n; p != Graph::noNode(); p = parents[p])
+                path.push_back(p); 
+            std::reverse(path.begin(), path.end()); 
+            return; 
+        }
+        Graph::IdRange const dependents = graph.getDependents(n); 
+        for (Graph::NodeId const * d = dependents.begin(); d != dependents.end(); ++d)
+        {   if (isActive(*d) && parents.insert(make_pair(*d, n)).second)
+                pending.push_back(*d); 
+        }
+        vector<Graph::NodeId> const& more = dynamicDependents[n]; 
+        for (vector<Graph::NodeId>::const_iterator d = more.begin(); d != more.end(); ++d)
+        {   if (parents.insert(make_pair(*d, n)).second)
+                pending.push_back(*d); 
+        }
+    }
+}
+
+jjm::Graph::IdRange jjm::JjmakeContext::getConsumers(Graph::PathId path)
+{
+    if (consumerOffsets.empty())
+    {   consumerOffsets.assign(graph.getNumPaths() + 1, 0); 
+        for (Graph::NodeId n = 0; n < graph.getNumNodes(); ++n)
+        {   Graph::IdRange const inputs = graph.getInputPaths(n); 
+            for (Graph::PathId const * p = inputs.begin(); p != inputs.end(); ++p)
+                ++consumerOffsets[*p + 1]; 
+        }
+        for (size_t p = 1; p < consumerOffsets.size(); ++p)
+            consumerOffsets[p] += consumerOffsets[p - 1]; 
+        consumerIds.resize(consumerOffsets.back()); 
+        vector<std::uint32_t> next(consumerOffsets.begin(), consumerOffsets.end() - 1); 
+        for (Graph::NodeId n = 0; n < graph.getNumNodes(); ++n)
+        {   Graph::IdRange const inputs = graph.getInputPaths(n); 
+            for (Graph::PathId const * p = inputs.begin(); p != inputs.end(); ++p)
+                consumerIds[next[*p]++] = n; 
+        }
+    }
+    Graph::NodeId const * const base = consumerIds.empty() ? 0 : & consumerIds[0]; 
+    return Graph::IdRange(base + consumerOffsets[path], base + consumerOffsets[path + 1]); 
+}
+
+void jjm::JjmakeContext::releaseDynamicDependents(Graph::NodeId node, bool executed, std::vector<Graph::NodeId> & ready)
+{
+    vector<Graph::NodeId> dependents; 
+    {   Lock lock(getDependentsMutex(node)); 
+        dependentsReleased[node] = 1; 
+        releasedByExecution[node] = executed; 
+        dependents = dynamicDependents[node]; 
+    }
+    for (vector<Graph::NodeId>::const_iterator d = dependents.begin(); d != dependents.end(); ++d)
+    {   if (executed)
+            setDependencyExecuted(*d); 
+        releasePrereq(*d, ready); 
+    }
+}
+
+void jjm::JjmakeContext::setDependencyExecuted(Graph::NodeId node)
+{
+    //Several dependencies may complete at once. The dependent reads the 
+    //flag without the lock once it is ready, which is after every write. 
+    Lock lock(getDependentsMutex(node)); 
+    dependencyExecuted[node] = 1; 
+}
+
+void jjm::JjmakeContext::releasePrereq(Graph::NodeId node, std::vector<Graph::NodeId> & ready)
+{
+    std::int32_t const numOutstandingPrereqsOfNode = --numOutstandingPrereqs[node]; 
+    if (numOutstandingPrereqsOfNode < 0)
+        JFATAL(0, 0); 
+    if (numOutstandingPrereqsOfNode == 0)
+        ready.push_back(node); 
+}
+
+void jjm::JjmakeContext::applyGoalWeights()
+{
+    //The weight of a goal is its duration in milliseconds from its last 
+    //successful execution, unless the build file declares a weight. Node 
+    //ids are in order of goal name, so the goals are found by one merge with
+    //the history. 
+    if (history.size())
+    {   History::SortedFinder finder(history); 
+        for (Graph::NodeId n = 0; n < graph.getNumNodes(); ++n)
+        {   History::Entry entry; 
+            if (activated[n]
+                    && finder.find(graph.getNode(n)->goalName, entry) 
+                    && entry.exitStatus == 0)
+                weights[n] = std::max<std::int64_t>(1, entry.durationNanoSec / (1000 * 1000)); 
+        }
+    }
+
+    for (vector<GoalWeight>::const_iterator w = goalWeights.begin(); w != goalWeights.end(); ++w)
+    {   map<string, Node*>::iterator node = nodes.find(w->goalName); 
+        if (node == nodes.end())
+            node = nodes.find(w->alternateGoalName); 
+        if (node == nodes.end())
+            throw std::runtime_error("Cannot find matching node for goal-weight \"" + w->goalName + "\"."); 
+        weights[node->second->id] = w->weight; 
+    }
+}
+
+void jjm::JjmakeContext::applyGoalPools()
+{
+    map<string, std::uint32_t> poolIds; 
+    poolSlots.clear(); 
+    for (vector<PoolDeclaration>::const_iterator p = poolDeclarations.begin(); p != poolDeclarations.end(); ++p)
+    {   if ( ! poolIds.insert(make_pair(p->poolName, static_cast<std::uint32_t>(poolSlots.size()))).second)
+            throw std::runtime_error("Pool \"" + p->poolName + "\" is declared more than once."); 
+        poolSlots.push_back(PoolSlots()); 
+        poolSlots.back().depth = p->depth; 
+    }
+
+    poolOfNode.assign(graph.getNumNodes(), noPool()); 
+    for (vector<GoalPool>::const_iterator g = goalPools.begin(); g != goalPools.end(); ++g)
+    {   map<string, Node*>::iterator node = nodes.find(g->goalName); 
+        if (node == nodes.end())
+            node = nodes.find(g->alternateGoalName); 
+        if (node == nodes.end())
+            throw std::runtime_error("Cannot find matching node for goal-pool \"" + g->goalName + "\"."); 
+        map<string, std::uint32_t>::const_iterator pool = poolIds.find(g->poolName); 
+        if (pool == poolIds.end())
+            throw std::runtime_error("Cannot find pool \"" + g->poolName + "\" for goal-pool \"" + g->goalName + "\"."); 
+        poolOfNode[node->second->id] = pool->second; 
+    }
+}
+
+void jjm::JjmakeContext::computePriorities()
+{
+    if ( ! arguments.criticalPathFirst)
+        return; 
+
+    if (arguments.dependencyMode == NoDependencies)
+    {   priorities = weights; 
+        return; 
+    }
+
+    //Visit the activated nodes in reverse execution order, starting with the
+    //nodes which have nothing activated downstream. When a node is visited, 
+    //its priority holds the largest priority of its downstream nodes. 
+    //Nodes in a dependency cycle are never visited, and they never execute. 
+    bool const forward = arguments.dependencyMode == AllDependencies; 
+    vector<std::uint32_t> numUnvisitedDownstream(graph.getNumNodes(), 0); 
+    vector<Graph::NodeId> pending; 
+    for (Graph::NodeId n = 0; n < graph.getNumNodes(); ++n)
+    {   if ( ! activated[n])
+            continue; 
+        Graph::IdRange const downstream = forward ? graph.getDependents(n) : graph.getDependencies(n); 
+        for (Graph::NodeId const * d = downstream.begin(); d != downstream.end(); ++d)
+        {   if (activated[*d])
+                ++numUnvisitedDownstream[n]; 
+        }
+        if (numUnvisitedDownstream[n] == 0)
+            pending.push_back(n); 
+    }
+    for ( ; pending.size(); )
+    {   Graph::NodeId const n = pending.back(); 
+        pending.pop_back(); 
+        priorities[n] += weights[n]; 
+        Graph::IdRange const upstream = forward ? graph.getDependencies(n) : graph.getDependents(n); 
+        for (Graph::NodeId const * u = upstream.begin(); u != upstream.end(); ++u)
+        {   if ( ! activated[*u])
+                continue; 
+            priorities[*u] = std::max(priorities[*u], priorities[n]); 
+            if (0 == --numUnvisitedDownstream[*u])
+                pending.push_back(*u); 
+        }
+    }
+}
+
+void jjm::JjmakeContext::refreshOutputs(Graph::NodeId node)
+{
+    //Goals which read the outputs run after this one, and they must see the
+    //new file metadata. 
+    Graph::IdRange const outputs = graph.getOutputPaths(node); 
+    for (Graph::PathId const * output = outputs.begin(); output != outputs.end(); ++output)
+        statCache.refresh(*output); 
+    vector<Path> const& dynamicOutputs = graph.getNode(node)->dynamicOutputPaths; 
+    for (vector<Path>::const_iterator output = dynamicOutputs.begin(); output != dynamicOutputs.end(); ++output)
+    {   Graph::PathId const path = graph.findPath(*output); 
+        if (path != Graph::noPath())
+            statCache.refresh(path); 
+    }
+}
+
+bool jjm::JjmakeContext::getOutputHashes(Graph::NodeId node, std::vector<std::uint64_t> & hashes)
+{
+    hashes.clear(); 
+    Graph::IdRange const outputs = graph.getOutputPaths(node); 
+    for (Graph::PathId const * output = outputs.begin(); output != outputs.end(); ++output)
+    {   hashes.push_back(0); 
+        if ( ! signatures.getContentHash(*output, hashes.back()))
+            return false; 
+    }
+    return true; 
+}
+
+bool jjm::JjmakeContext::getActionKey(Graph::NodeId node, std::uint64_t & key)
+{
+    //Goals without outputs have nothing to restore. 
+    if (( ! actionCache.isOpen() && ! remoteCache.isOpen()) || ! signatures.isLoaded() || graph.getOutputPaths(node).size() == 0)
+        return false; 
+    //The outputs of a goal with a depfile depend on inputs which are not 
+    //known until it executed once. 
+    Path depfile; 
+    Path baseDir; 
+    if (graph.getDiscoveredInputPaths(node).size() == 0 && graph.getNode(node)->getDepfile(depfile, baseDir))
+        return false; 
+    //The caches keep the outputs of the graph, but not the dynamic outputs, 
+    //and not stamps. 
+    Node const* const n = graph.getNode(node); 
+    if (n->dynamicInputPaths.size() || n->dynamicOutputPaths.size() || n->hasStampOutputs())
+        return false; 
+    return signatures.getActionKey(node, key); 
+}
+
+bool jjm::JjmakeContext::restoreFromActionCache(Graph::NodeId node, std::uint64_t key)
+{
+    //An up to date goal is left to Node::execute(), and --always-make 
+    //executes every goal. 
+    if ( ! actionCache.isOpen() || arguments.alwaysMake || ! signatures.hasChanged(node))
+        return false; 
+    vector<Path> outputs; 
+    Graph::IdRange const outputIds = graph.getOutputPaths(node); 
+    for (Graph::PathId const * output = outputIds.begin(); output != outputIds.end(); ++output)
+        outputs.push_back(graph.getPath(*output)); 
+    if ( ! actionCache.restore(key, outputs))
+    {   refreshOutputs(node); //a failed restore may have removed outputs
+        return false; 
+    }
+    refreshOutputs(node); 
+    signatures.recordSuccess(node); 
+    return true; 
+}
+
+void jjm::JjmakeContext::storeInActionCache(Graph::NodeId node, std::uint64_t key)
+{
+    vector<std::uint64_t> hashes; 
+    if ( ! actionCache.isOpen() || ! getOutputHashes(node, hashes))
+        return; 
+    vector<Path> outputs; 
+    Graph::IdRange const outputIds = graph.getOutputPaths(node); 
+    for (Graph::PathId const * output = outputIds.begin(); output != outputIds.end(); ++output)
+        outputs.push_back(graph.getPath(*output)); 
+    //The goal succeeded, and a full or broken cache does not change that. 
+    try
+    {   actionCache.store(key, outputs, hashes); 
+    }catch (std::exception & e)
+    {   toStdErr(string() + "[jjmake] Warning: Failed to store goal \"" + graph.getNode(node)->goalName 
+                + "\" in the action cache. Cause:\n" + e.what() + "\n"); 
+    }
+}
+
+bool jjm::JjmakeContext::restoreFromCacheServer(Graph::NodeId node, std::uint64_t key)
+{
+    if ( ! remoteCache.isOpen() || arguments.alwaysMake || ! signatures.hasChanged(node))
+        return false; 
+    vector<Path> outputs; 
+    Graph::IdRange const outputIds = graph.getOutputPaths(node); 
+    for (Graph::PathId const * output = outputIds.begin(); output != outputIds.end(); ++output)
+        outputs.push_back(graph.getPath(*output)); 
+    //The goal executes when the server fails. 
+    try
+    {   if ( ! remoteCache.fetch(key, outputs))
+            return false; 
+    }catch (std::exception & e)
+    {   toStdErr(string() + "[jjmake] Warning: No longer using the cache server. Cause:\n" + e.what() + "\n"); 
+        return false; 
+    }
+    refreshOutputs(node); 
+    signatures.recordSuccess(node); 
+    storeInActionCache(node, key); 
+    return true; 
+}
+
+void jjm::JjmakeContext::uploadToCacheServer(Graph::NodeId node, std::uint64_t key)
+{
+    vector<std::uint64_t> hashes; 
+    if ( ! remoteCache.isOpen() || remoteCache.isDisabled() || ! getOutputHashes(node, hashes))
+        return; 
+    vector<Path> outputs; 
+    Graph::IdRange const outputIds = graph.getOutputPaths(node); 
+    for (Graph::PathId const * output = outputIds.begin(); output != outputIds.end(); ++output)
+        outputs.push_back(graph.getPath(*output)); 
+    try
+    {   remoteCache.upload(key, outputs, hashes); 
+    }catch (std::exception & e)
+    {   toStdErr(string() + "[jjmake] Warning: No longer using the cache server. Cause:\n" + e.what() + "\n"); 
+    }
 }
 
 class jjm::JjmakeContext::ExecuteGoalRunnable : public jjm::Thread::Runnable
 {
 public:
-    ExecuteGoalRunnable() : context(0), node(0) {}
+    ExecuteGoalRunnable() : context(0), node(Graph::noNode()), holdsPoolSlot(false), isAdmitted(false) {}
     jjm::JjmakeContext * context; 
-    jjm::Node * node; 
+    Graph::NodeId node; 
+    bool holdsPoolSlot; 
+    bool isAdmitted; //by memory
     virtual void run()
     {
+        //When this goal makes other goals ready, the one with the highest 
+        //priority is executed directly on this thread, and the rest are handed
+        //to the pool in bulk. This avoids a queue round trip for every link of
+        //a dependency chain, and keeps the critical path moving. 
+        //A goal of a full resource pool is left waiting in its pool, and this
+        //thread is free for other goals. When a goal of a pool completes, the
+        //slot passes to the waiting goal of the pool with the highest 
+        //priority, which is executed next on this thread. 
+        //A goal whose predicted memory does not fit is likewise left waiting
+        //for admission, and is added as a task once it fits. 
+        //The goal then waits for a jobserver token, which limits the jobs of 
+        //this jjmake together with those of the processes which share its 
+        //jobserver. 
+        while (node != Graph::noNode())
+        {   if ( ! holdsPoolSlot && ! context->acquirePoolSlot(node))
+                return; 
+            holdsPoolSlot = true; 
+            if ( ! isAdmitted && ! context->admitByMemory(node))
+                return; 
+            JobServerClient::Token token; 
+            bool const holdsToken = context->acquireJobToken(token); 
+            Graph::NodeId next = executeGoal(node); 
+            if (holdsToken)
+                context->releaseJobToken(token); 
+            context->releaseMemory(node); 
+            isAdmitted = false; 
+            Graph::NodeId const waiting = context->releasePoolSlot(node); 
+            holdsPoolSlot = waiting != Graph::noNode(); 
+            if (holdsPoolSlot)
+            {   if (next != Graph::noNode())
+                    context->addExecuteGoalTasks(vector<Graph::NodeId>(1, next)); 
+                next = waiting; 
+            }
+            node = next; 
+        }
+    }
+
+    //Returns a ready goal to execute next on this thread, or noNode(). 
+    Graph::NodeId executeGoal(Graph::NodeId const id)
+    {
+        Node * const node = context->graph.getNode(id); 
+        Graph::NodeId next = Graph::noNode(); 
+        GoalOutputScope goalOutputScope(context); 
         try
         {   if (context->failFlag && ! context->arguments.keepGoing)
-                return; 
+                return Graph::noNode(); 
 
-            if (context->arguments.executionMode == JjmakeContext::ExecuteGoals)
-            {   context->toStdOut("[jjmake] Executing goal: " + node->goalName + "\n"); 
-                node->execute(); 
+            std::uint64_t actionKey = 0; 
+            bool const haveActionKey = context->arguments.executionMode == JjmakeContext::ExecuteGoals 
+                    && context->getActionKey(id, actionKey); 
+            //Whether the outputs were brought up to date, which forces the 
+            //dependents to execute too, unless with early cutoff. 
+            bool executed = false; 
+            if (haveActionKey && context->restoreFromActionCache(id, actionKey))
+            {   context->toStdOut("[jjmake] Restored goal from the action cache: " + node->goalName + "\n"); 
+                executed = true; 
+            }else if (haveActionKey && context->restoreFromCacheServer(id, actionKey))
+            {   context->toStdOut("[jjmake] Restored goal from the cache server: " + node->goalName + "\n"); 
+                executed = true; 
+            }else if (context->arguments.executionMode == JjmakeContext::ExecuteGoals)
+            {   std::int64_t const start = getMonotonicClockNanoSec(); 
+                resetJoinedPeakRssBytes(); 
+                vector<Path> discoveredInputs; 
+                bool haveDiscoveredInputs = false; 
+                bool discoveredInputsChanged = false; 
+                try
+                {   executed = node->execute(); 
+                    if (executed)
+                        haveDiscoveredInputs = context->ingestDepfile(id, discoveredInputs, discoveredInputsChanged); 
+                }catch (...)
+                {   context->recordExecution(node, start, 1); 
+                    throw; 
+                }
+                //An up to date goal keeps its entry of the history, of its 
+                //last execution, and its outputs are already in the caches. 
+                if (executed)
+                {   context->refreshOutputs(id); 
+                    context->recordExecution(node, start, 0, haveDiscoveredInputs ? & discoveredInputs : 0); 
+                    //The action key covers the discovered inputs of the graph, 
+                    //so the outputs are kept only when the execution 
+                    //discovered the same inputs. 
+                    if (haveActionKey && ! discoveredInputsChanged)
+                    {   context->storeInActionCache(id, actionKey); 
+                        context->uploadToCacheServer(id, actionKey); 
+                    }
+                }else if (context->arguments.earlyCutoff && context->dependencyExecuted[id])
+                {   //Up to date, although a goal it depends on executed. 
+                    context->toStdOut("[jjmake] Skipping goal, its inputs are unchanged: " + node->goalName + "\n"); 
+                    ++context->numSkippedByEarlyCutoff; 
+                }
             }else if (context->arguments.executionMode == JjmakeContext::PrintGoals)
             {   context->toStdOut("[jjmake] Goal: " + node->goalName + "\n"); 
             }else
                 JFATAL(context->arguments.executionMode, 0); 
+            //The goals named by the dyndep file still wait for this goal while
+            //their edges are added. 
+            vector<Graph::NodeId> ready; 
+            if (context->arguments.dependencyMode == JjmakeContext::AllDependencies)
+                context->applyDyndepFile(id, ready); 
+            context->completed[id] = 1; 
 
-            set<Node*> * downstream = 0;
+            if (context->arguments.dependencyMode == JjmakeContext::NoDependencies)
+                return Graph::noNode(); 
+            Graph::IdRange const downstream = 
+                    context->arguments.dependencyMode == JjmakeContext::AllDependencies 
+                    ? context->graph.getDependents(id) 
+                    : context->graph.getDependencies(id); 
+            bool const forceDependents = executed && context->arguments.dependencyMode == JjmakeContext::AllDependencies; 
+            for (Graph::NodeId const * d = downstream.begin(); d != downstream.end(); ++d)
+            {   if ( ! context->activated[*d])
+                    continue; 
+                if (forceDependents)
+                    context->setDependencyExecuted(*d); 
+                std::int32_t const numOutstandingPrereqsOfD = --context->numOutstandingPrereqs[*d]; 
+                if (numOutstandingPrereqsOfD < 0)
+                    JFATAL(0, 0);
+                if (numOutstandingPrereqsOfD == 0)
+                    ready.push_back(*d); 
+            }
             if (context->arguments.dependencyMode == JjmakeContext::AllDependencies)
-                downstream = & node->dependents;
-            if (context->arguments.dependencyMode == JjmakeContext::AllDependents)
-                downstream = & node->dependencies;
-            if (downstream)
-            {   for (set<Node*>::iterator d = downstream->begin(); d != downstream->end(); ++d)
-                {   if ( ! (**d).activated)
-                        continue; 
-                    ssize_t numOutstandingPrereqsOfD; 
-                    {
-                        Lock lock((**d).mutex); 
-                        numOutstandingPrereqsOfD  = --(**d).numOutstandingPrereqs;
-                    }
-                    if (numOutstandingPrereqsOfD < 0)
-                        JFATAL(0, 0);
-                    if (numOutstandingPrereqsOfD == 0)
-                    {   UniquePtr<ExecuteGoalRunnable*> newRunnable(new ExecuteGoalRunnable);
-                        newRunnable.get()->context = context;
-                        newRunnable.get()->node = *d;
-                        context->threadPool.addTask(newRunnable.release()); 
-                    }
-                }
+                context->releaseDynamicDependents(id, executed, ready); 
+            if (ready.empty())
+                return Graph::noNode(); 
+
+            vector<Graph::NodeId>::iterator best = ready.begin(); 
+            for (vector<Graph::NodeId>::iterator r = ready.begin(); r != ready.end(); ++r)
+            {   if (context->priorities[*r] > context->priorities[*best])
+                    best = r; 
             }
+            std::swap(*best, ready.back()); 
+            next = ready.back(); 
+            ready.pop_back(); 
+            context->addExecuteGoalTasks(ready); 
         }catch (std::exception & e)
         {   
             context->setFailFlag(); 
@@ -328,6 +1238,7 @@ public:
             message += "\n"; 
             context->toStdErr(message); 
         }
+        return next; 
     }
 };
 
@@ -337,28 +1248,562 @@ void jjm::JjmakeContext::phase2()
     //the threadpool to avoid a data race. 
     //The first loop accesses "numOutstandingPrereqs", which can be modified
     //when a task in the threadpool completes. 
-    vector<Node*> toExecute; 
-    for (map<string, Node*>::iterator node = nodes.begin(); node != nodes.end(); ++node)
-    {   if (node->second->activated && node->second->numOutstandingPrereqs == 0)
-            toExecute.push_back(node->second); 
+    vector<Graph::NodeId> toExecute; 
+    for (Graph::NodeId n = 0; n < graph.getNumNodes(); ++n)
+    {   if (activated[n] && numOutstandingPrereqs[n] == 0)
+            toExecute.push_back(n); 
     }
-    for (vector<Node*>::iterator node = toExecute.begin(); node != toExecute.end(); ++node)
+    addExecuteGoalTasks(toExecute); 
+    threadPool.waitUntilIdle(); 
+}
+
+void jjm::JjmakeContext::addExecuteGoalTasks(std::vector<Graph::NodeId> const& toExecute, bool admittedByMemory)
+{
+    vector<ThreadPool::PrioritizedTask> newRunnables; 
+    struct Guard
+    {   vector<ThreadPool::PrioritizedTask> & v; 
+        Guard(vector<ThreadPool::PrioritizedTask> & v_) : v(v_) {}
+        ~Guard() { for (size_t i = 0; i < v.size(); ++i) delete v[i].second; }
+    } guard(newRunnables); 
+
+    for (vector<Graph::NodeId>::const_iterator node = toExecute.begin(); node != toExecute.end(); ++node)
     {   UniquePtr<ExecuteGoalRunnable*> newRunnable(new ExecuteGoalRunnable);
         newRunnable.get()->context = this;
         newRunnable.get()->node = *node;
-        threadPool.addTask(newRunnable.release()); 
+        //A goal admitted after waiting already holds its pool slot. 
+        newRunnable.get()->holdsPoolSlot = admittedByMemory; 
+        newRunnable.get()->isAdmitted = admittedByMemory; 
+        newRunnables.push_back(ThreadPool::PrioritizedTask(priorities[*node], 0)); 
+        newRunnables.back().second = newRunnable.release(); 
+    }
+    threadPool.addTasks(newRunnables); 
+}
+
+bool jjm::JjmakeContext::acquirePoolSlot(Graph::NodeId node)
+{
+    std::uint32_t const pool = poolOfNode[node]; 
+    if (pool == noPool())
+        return true; 
+    Lock lock(poolSlotsMutex); 
+    PoolSlots & slots = poolSlots[pool]; 
+    if (slots.numRunning < slots.depth)
+    {   ++slots.numRunning; 
+        return true; 
+    }
+    slots.waiting.push_back(node); 
+    std::push_heap(slots.waiting.begin(), slots.waiting.end(), LowerPriority(priorities)); 
+    return false; 
+}
+
+void jjm::JjmakeContext::applyMemoryPredictions()
+{
+    predictedMemory.assign(graph.getNumNodes(), 0); 
+    admittedMemory = 0; 
+    numAdmitted = 0; 
+    memoryWaiting.clear(); 
+    std::int64_t available = 0; 
+    if ( ! arguments.memoryAdmission || arguments.executionMode != ExecuteGoals || ! getAvailableMemory(available))
+        return; 
+    History::SortedFinder finder(history); 
+    for (Graph::NodeId n = 0; n < graph.getNumNodes(); ++n)
+    {   if ( ! activated[n])
+            continue; 
+        History::Entry entry; 
+        if (history.size() && finder.find(graph.getNode(n)->goalName, entry) && entry.peakRssBytes > 0)
+            predictedMemory[n] = entry.peakRssBytes; 
+        else
+            predictedMemory[n] = arguments.defaultGoalMemoryBytes; 
+    }
+}
+
+bool jjm::JjmakeContext::admitByMemory(Graph::NodeId node)
+{
+    std::int64_t const predicted = predictedMemory[node]; 
+    if (predicted == 0)
+        return true; 
+    std::int64_t available = 0; 
+    bool const haveAvailable = getAvailableMemory(available); 
+    Lock lock(admissionMutex); 
+    //With nothing admitted, a goal which does not fit at all still executes,
+    //alone. 
+    if (numAdmitted == 0 || ! haveAvailable || predicted <= available - admittedMemory)
+    {   ++numAdmitted; 
+        admittedMemory += predicted; 
+        return true; 
+    }
+    memoryWaiting.push_back(node); 
+    std::push_heap(memoryWaiting.begin(), memoryWaiting.end(), LowerPriority(priorities)); 
+    ++numDelayedByMemory; 
+    return false; 
+}
+
+void jjm::JjmakeContext::releaseMemory(Graph::NodeId node)
+{
+    std::int64_t const predicted = predictedMemory[node]; 
+    if (predicted == 0)
+        return; 
+    //Read after the processes of the goal exited, so their memory is free.
+    std::int64_t available = 0; 
+    bool const haveAvailable = getAvailableMemory(available); 
+    vector<Graph::NodeId> admitted; 
+    {   Lock lock(admissionMutex); 
+        --numAdmitted; 
+        admittedMemory -= predicted; 
+        while (memoryWaiting.size())
+        {   Graph::NodeId const top = memoryWaiting.front(); 
+            if ( ! (numAdmitted == 0 || ! haveAvailable || predictedMemory[top] <= available - admittedMemory))
+                break; 
+            std::pop_heap(memoryWaiting.begin(), memoryWaiting.end(), LowerPriority(priorities)); 
+            memoryWaiting.pop_back(); 
+            ++numAdmitted; 
+            admittedMemory += predictedMemory[top]; 
+            admitted.push_back(top); 
+        }
+    }
+    addExecuteGoalTasks(admitted, true); 
+}
+
+void jjm::JjmakeContext::startConcurrencyController()
+{
+    if (concurrencyController.get())
+        return; 
+    if (arguments.autoThreads)
+    {   int const numCpus = getNumOnlineCpus(); 
+        double const maxLoad = arguments.maxLoad > 0 ? arguments.maxLoad : numCpus; 
+        concurrencyController.reset(new ConcurrencyController(threadPool, numCpus, maxLoad)); 
+    }else if (arguments.maxLoad > 0)
+        concurrencyController.reset(new ConcurrencyController(threadPool, arguments.numThreads, arguments.maxLoad)); 
+}
+
+void jjm::JjmakeContext::startJobServer()
+{
+    if (jobServerClient.get() || arguments.executionMode != ExecuteGoals)
+        return; 
+    jobServerClient.reset(JobServerClient::fromEnvironment()); 
+    if (jobServerClient.get())
+        return; 
+    jobServer.reset(new JobServer(arguments.numThreads)); 
+    jobServerClient.reset(JobServerClient::fromMakeFlags(jobServer.get()->getMakeFlags())); 
+    if (jobServerClient.get() == 0)
+        JFATAL(0, 0); 
+}
+
+void jjm::JjmakeContext::startDispatcher()
+{
+    if (dispatcher.get() || arguments.remoteWorkers.empty() || arguments.executionMode != ExecuteGoals)
+        return; 
+    dispatcher.reset(new Dispatcher(arguments.numLocalJobs > 0 ? arguments.numLocalJobs : getNumOnlineCpus())); 
+    for (size_t i = 0; i < arguments.remoteWorkers.size(); ++i)
+    {   try
+        {   dispatcher.get()->addWorker(arguments.remoteWorkers[i], workerConnectTimeoutNanoSec); 
+        }catch (std::exception & e)
+        {   toStdErr(string() + "[jjmake] Warning: The remote worker \"" + arguments.remoteWorkers[i] 
+                    + "\" is not used. Cause:\n" + e.what() + "\n"); 
+        }
     }
+}
+
+bool jjm::JjmakeContext::acquireJobToken(JobServerClient::Token & token)
+{
+    if (jobServerClient.get() == 0)
+        return false; 
+    try
+    {   //Polls so that a failure of another goal is noticed. 
+        while ( ! jobServerClient.get()->acquire(token, 50))
+        {   if (failFlag && ! arguments.keepGoing)
+                return false; 
+        }
+        return true; 
+    }catch (std::exception & e)
+    {   setFailFlag(); 
+        toStdErr(string("Failure to acquire a jobserver token. Cause:\n") + typeid(e).name() + ": " + e.what() + "\n"); 
+        return false; 
+    }
+}
+
+void jjm::JjmakeContext::releaseJobToken(JobServerClient::Token const& token)
+{
+    try
+    {   jobServerClient.get()->release(token); 
+    }catch (std::exception & e)
+    {   setFailFlag(); 
+        toStdErr(string("Failure to release a jobserver token. Cause:\n") + typeid(e).name() + ": " + e.what() + "\n"); 
+    }
+}
+
+jjm::Graph::NodeId jjm::JjmakeContext::releasePoolSlot(Graph::NodeId node)
+{
+    std::uint32_t const pool = poolOfNode[node]; 
+    if (pool == noPool())
+        return Graph::noNode(); 
+    Lock lock(poolSlotsMutex); 
+    PoolSlots & slots = poolSlots[pool]; 
+    if (slots.waiting.empty())
+    {   --slots.numRunning; 
+        return Graph::noNode(); 
+    }
+    std::pop_heap(slots.waiting.begin(), slots.waiting.end(), LowerPriority(priorities)); 
+    Graph::NodeId const next = slots.waiting.back(); 
+    slots.waiting.pop_back(); 
+    return next; 
+}
+
+void jjm::JjmakeContext::printStats()
+{
+    size_t const numNodes = graph.getNumNodes(); 
+    size_t const frozenBytes = graph.getMemoryUsage() 
+            + activated.capacity() * sizeof(char) 
+            + weights.capacity() * sizeof(std::int64_t) 
+            + priorities.capacity() * sizeof(std::int64_t) 
+            + numOutstandingPrereqs.capacity() * sizeof(std::atomic<std::int32_t>) 
+            + numNodes * sizeof(Graph::NodeId); 
+    size_t const pointerBytes = graph.estimatePointerGraphMemoryUsage(); 
+    size_t const divisor = numNodes ? numNodes : 1; 
+
+    toStdOut("[jjmake] Stats: nodes " + toDecStr(numNodes) 
+            + ", edges " + toDecStr(graph.getNumEdges()) 
+            + ", paths " + toDecStr(graph.getNumPaths()) + "\n"); 
+    toStdOut("[jjmake] Stats: graph bytes per node: pointer-based (estimated) " + toDecStr(pointerBytes / divisor) 
+            + ", frozen " + toDecStr(frozenBytes / divisor) + "\n"); 
+    toStdOut("[jjmake] Stats: stat calls " + toDecStr(statCache.getNumStatCalls()) 
+            + ", saved by the stat cache " + toDecStr(statCache.getNumSavedStatCalls()) + "\n"); 
+    toStdOut("[jjmake] Stats: files hashed " + toDecStr(signatures.getNumHashedFiles()) 
+            + ", bytes hashed " + toDecStr(signatures.getNumHashedBytes()) 
+            + ", journal records at startup " + toDecStr(signatures.getNumJournalRecords()) + "\n"); 
+    if (depsLog.isLoaded())
+    {   toStdOut("[jjmake] Stats: depfiles read " + toDecStr(numDepfilesRead) 
+                + ", discovered inputs changed for " + toDecStr(depsLog.getNumRecorded()) + " goals so far" 
+                + ", deps log records at startup " + toDecStr(depsLog.getNumJournalRecords()) + "\n"); 
+    }
+    if (numDynamicEdges != 0)
+    {   toStdOut("[jjmake] Stats: dependency edges added by dyndep files so far " + toDecStr(numDynamicEdges) 
+                + ", goals activated by them " + toDecStr(numDynamicallyActivated) + "\n"); 
+    }
+    toStdOut("[jjmake] Stats: goals skipped by early cutoff " + toDecStr(numSkippedByEarlyCutoff) + "\n"); 
+    toStdOut("[jjmake] Stats: goals delayed by memory admission " + toDecStr(numDelayedByMemory) + "\n"); 
+    if (actionCache.isOpen())
+    {   toStdOut("[jjmake] Stats: action cache hits " + toDecStr(actionCache.getNumHits()) 
+                + ", misses " + toDecStr(actionCache.getNumMisses()) 
+                + ", stored " + toDecStr(actionCache.getNumStored()) 
+                + ", evicted " + toDecStr(actionCache.getNumEvicted()) + "\n"); 
+    }
+    if (remoteCache.isOpen())
+    {   toStdOut("[jjmake] Stats: cache server hits " + toDecStr(remoteCache.getNumHits()) 
+                + ", misses " + toDecStr(remoteCache.getNumMisses()) 
+                + ", uploaded " + toDecStr(remoteCache.getNumUploaded()) 
+                + (remoteCache.isDisabled() ? ", stopped after a failure\n" : "\n")); 
+    }
+    if (concurrencyController.get())
+    {   toStdOut("[jjmake] Stats: concurrency limit lowest " + toDecStr(concurrencyController.get()->getLowestLimit()) 
+                + ", highest " + toDecStr(concurrencyController.get()->getHighestLimit()) 
+                + ", now " + toDecStr(threadPool.getConcurrencyLimit()) + "\n"); 
+    }
+    if (dispatcher.get())
+    {   toStdOut("[jjmake] Stats: exec-node goals executed locally " + toDecStr(dispatcher.get()->getNumLocal()) 
+                + ", remotely " + toDecStr(dispatcher.get()->getNumRemote()) 
+                + ", bytes sent " + toDecStr(dispatcher.get()->getNumBytesSent()) 
+                + ", received " + toDecStr(dispatcher.get()->getNumBytesReceived()) 
+                + ", workers failed " + toDecStr(dispatcher.get()->getNumWorkersFailed()) + "\n"); 
+    }
+    toStdOut("[jjmake] Stats: worker processes started so far " + toDecStr(workerPool.getNumStarted()) + "\n"); 
+    if (consoleWriter.get())
+        toStdOut("[jjmake] Stats: console batches written so far " + toDecStr(consoleWriter.get()->getNumBatches()) + "\n"); 
+}
+
+void jjm::JjmakeContext::watch()
+{
+    //A burst of writes, such as an editor saving several files, is handled 
+    //as one change. 
+    int const debounceMillis = 100; 
+
+    DirectoryWatcher watcher; 
+    vector<Path> changedPaths; 
+    bool overflowed = false; 
+    //Goals which failed, or which did not execute because of a failure, are
+    //executed again with the goals affected by the next change. 
+    set<string> retryGoals; 
+    for (Graph::NodeId n = 0; n < graph.getNumNodes(); ++n)
+    {   if (activated[n] && ! completed[n])
+            retryGoals.insert(graph.getNode(n)->goalName); 
+    }
+    //Set while the graph could not be frozen after a build file changed. 
+    //Nothing executes until a build file changes again. 
+    bool graphIsStale = false; 
+
+    for (;;)
+    {
+        if (changedPaths.empty() && ! overflowed)
+        {   addWatchedDirectories(watcher); 
+            toStdOut("[jjmake] Watching for changes.\n"); 
+            flushOutput(); 
+            watcher.waitForChanges(changedPaths, -1, debounceMillis, overflowed); 
+        }
+        vector<Path> changes; 
+        changes.swap(changedPaths); 
+        bool const everything = overflowed || graphIsStale; 
+        overflowed = false; 
+
+        vector<string> changedBuildFiles; 
+        for (vector<Path>::const_iterator c = changes.begin(); c != changes.end(); ++c)
+        {   if (buildFiles.count(c->getStringRep()))
+                changedBuildFiles.push_back(c->getStringRep()); 
+        }
+
+        failFlag = false; 
+        try
+        {   set<string> newGoals; 
+            if (changedBuildFiles.size())
+            {   graphIsStale = true; 
+                reloadBuildFiles(changedBuildFiles, newGoals); 
+                graphIsStale = false; 
+            }else if (graphIsStale)
+                continue; 
+            else if (discoveredInputsChanged)
+            {   //Changes to the newly discovered inputs are only noticed once 
+                //they are paths of the graph. 
+                signatures.detach(); 
+                freezeGraph(); 
+                if (signatures.isLoaded())
+                    attachSignatures(); 
+            }else
+                resetGoalState(); 
+
+            activateSpecifiedGoals(); 
+            enableDependenciesDependents(arguments.dependencyMode); 
+            if ( ! everything)
+            {   newGoals.insert(retryGoals.begin(), retryGoals.end()); 
+                activateAffectedGoals(changes, newGoals); 
+            }
+            if (std::find(activated.begin(), activated.end(), 1) != activated.end())
+            {   executeActivatedGoals(); 
+                retryGoals.clear(); 
+                for (Graph::NodeId n = 0; n < graph.getNumNodes(); ++n)
+                {   if (activated[n] && ! completed[n])
+                        retryGoals.insert(graph.getNode(n)->goalName); 
+                }
+            }
+        }catch (std::exception & e)
+        {   string message; 
+            message += typeid(e).name() ;
+            message += ": ";
+            message += e.what(); 
+            message += "\n"; 
+            toStdErr(message); 
+        }
+
+        //The goals wrote their outputs, and those changes are not changes to
+        //react to. Other changes made during the build are kept for the next
+        //round. 
+        vector<Path> duringBuild; 
+        watcher.waitForChanges(duringBuild, 0, 0, overflowed); 
+        for (vector<Path>::const_iterator c = duringBuild.begin(); c != duringBuild.end(); ++c)
+        {   if ( ! isProducedPath(*c))
+                changedPaths.push_back(*c); 
+        }
+    }
+}
+
+void jjm::JjmakeContext::addWatchedDirectories(DirectoryWatcher & watcher)
+{
+    //The directories of the build files, and of the source files, which are
+    //the paths that no goal outputs. 
+    set<string> dirs; 
+    for (map<string, BuildFile>::const_iterator f = buildFiles.begin(); f != buildFiles.end(); ++f)
+        dirs.insert(Path(f->first).getParent().getStringRep()); 
+    for (Graph::PathId p = 0; p < graph.getNumPaths(); ++p)
+    {   if (graph.getProducer(p) == Graph::noNode())
+            dirs.insert(graph.getPath(p).getParent().getStringRep()); 
+    }
+    for (set<string>::const_iterator d = dirs.begin(); d != dirs.end(); ++d)
+    {   if (d->empty() || watcher.isWatched(Path(*d)))
+            continue; 
+        //A directory which does not exist yet is not watched. 
+        try
+        {   watcher.addDirectory(Path(*d)); 
+        }catch (std::exception & )
+        {
+        }
+    }
+}
+
+void jjm::JjmakeContext::reloadBuildFiles(std::vector<std::string> const& changedBuildFiles, std::set<std::string> & newGoals)
+{
+    //Evaluating a build file also evaluates the files it includes, so only 
+    //the topmost of the changed files are evaluated again. 
+    set<string> const changed(changedBuildFiles.begin(), changedBuildFiles.end()); 
+    vector<string> topmost; 
+    vector<string> includingFiles; 
+    for (vector<string>::const_iterator f = changedBuildFiles.begin(); f != changedBuildFiles.end(); ++f)
+    {   string const includingFile = buildFiles[*f].includingBuildFile; 
+        bool nested = false; 
+        for (string x = includingFile; x.size() && ! nested; )
+        {   nested = changed.count(x) != 0; 
+            map<string, BuildFile>::const_iterator parent = buildFiles.find(x); 
+            x = parent == buildFiles.end() ? string() : parent->second.includingBuildFile; 
+        }
+        if (nested)
+            continue; 
+        topmost.push_back(*f); 
+        includingFiles.push_back(includingFile); 
+    }
+
+    //The signatures are matched to the goals by name, and the goals of the 
+    //changed files are about to be deleted. 
+    signatures.detach(); 
+    for (size_t i = 0; i < topmost.size(); ++i)
+        removeBuildFile(topmost[i]); 
+
+    //Each file is evaluated in a context which sees the variables of the 
+    //root context, as of the end of the previous evaluation, and with .PWD 
+    //and .FILE of the file which included it. 
+    vector<Thread::Runnable*> newRunnables; 
+    struct Guard
+    {   vector<Thread::Runnable*> & v; 
+        Guard(vector<Thread::Runnable*> & v_) : v(v_) {}
+        ~Guard() { for (size_t i = 0; i < v.size(); ++i) delete v[i]; }
+    } guard(newRunnables); 
+    for (size_t i = 0; i < topmost.size(); ++i)
+    {   toStdOut("[jjmake] Reading changed build file: " + topmost[i] + "\n"); 
+        ParserContext * const c = rootParserContext->split(); 
+        Path const pwd = includingFiles[i].empty() ? Path(".").getRealPath() : Path(includingFiles[i]).getParent(); 
+        c->setValue(".PWD", pwd.getStringRep()); 
+        c->setValue(".FILE", includingFiles[i]); 
+        UniquePtr<InitialParseNode*> newRunnable(new InitialParseNode); 
+        newRunnable.get()->jjmakeContext = this; 
+        newRunnable.get()->parserContext = c; 
+        newRunnable.get()->rootEvalText = "(include '" + escapeSingleQuote(topmost[i]) + "')\n"; 
+        newRunnables.push_back(0); 
+        newRunnables.back() = newRunnable.release(); 
+    }
+    threadPool.addTasks(newRunnables); 
     threadPool.waitUntilIdle(); 
+
+    for (map<string, Node*>::const_iterator node = nodes.begin(); node != nodes.end(); ++node)
+    {   if (node->second->id == Graph::noNode())
+            newGoals.insert(node->first); 
+    }
+    freezeGraph(); 
+    if (signatures.isLoaded())
+        attachSignatures(); 
+}
+
+void jjm::JjmakeContext::removeBuildFile(std::string const& buildFile)
+{
+    //The file, and every file it included, directly or indirectly. 
+    set<string> removed; 
+    removed.insert(buildFile); 
+    for (bool grew = true; grew; )
+    {   grew = false; 
+        for (map<string, BuildFile>::const_iterator f = buildFiles.begin(); f != buildFiles.end(); ++f)
+        {   if ( ! removed.count(f->first) && removed.count(f->second.includingBuildFile))
+            {   removed.insert(f->first); 
+                grew = true; 
+            }
+        }
+    }
+
+    for (set<string>::const_iterator r = removed.begin(); r != removed.end(); ++r)
+    {   map<string, BuildFile>::iterator f = buildFiles.find(*r); 
+        if (f == buildFiles.end())
+            continue; 
+        for (vector<string>::const_iterator g = f->second.goalNames.begin(); g != f->second.goalNames.end(); ++g)
+        {   map<string, Node*>::iterator node = nodes.find(*g); 
+            if (node == nodes.end())
+                continue; 
+            delete node->second; 
+            nodes.erase(node); 
+        }
+        buildFiles.erase(f); 
+    }
+
+    vector<GoalWeight> keptWeights; 
+    for (vector<GoalWeight>::const_iterator w = goalWeights.begin(); w != goalWeights.end(); ++w)
+    {   if ( ! removed.count(w->buildFile))
+            keptWeights.push_back(*w); 
+    }
+    goalWeights.swap(keptWeights); 
+
+    vector<PoolDeclaration> keptPools; 
+    for (vector<PoolDeclaration>::const_iterator p = poolDeclarations.begin(); p != poolDeclarations.end(); ++p)
+    {   if ( ! removed.count(p->buildFile))
+            keptPools.push_back(*p); 
+    }
+    poolDeclarations.swap(keptPools); 
+
+    vector<GoalPool> keptGoalPools; 
+    for (vector<GoalPool>::const_iterator g = goalPools.begin(); g != goalPools.end(); ++g)
+    {   if ( ! removed.count(g->buildFile))
+            keptGoalPools.push_back(*g); 
+    }
+    goalPools.swap(keptGoalPools); 
+}
+
+void jjm::JjmakeContext::activateAffectedGoals(std::vector<Path> const& changedPaths, std::set<std::string> const& extraGoals)
+{
+    //Of the requested goals, only those affected by the changes execute: 
+    //the goals which read or write a changed path, the extra goals, and 
+    //every goal which depends on them. 
+    vector<char> requested(graph.getNumNodes(), 0); 
+    requested.swap(activated); 
+
+    vector<char> isChanged(graph.getNumPaths(), 0); 
+    bool anyChanged = false; 
+    for (vector<Path>::const_iterator c = changedPaths.begin(); c != changedPaths.end(); ++c)
+    {   Graph::PathId const p = graph.findPath(*c); 
+        if (p == Graph::noPath())
+            continue; 
+        isChanged[p] = 1; 
+        anyChanged = true; 
+    }
+    for (Graph::NodeId n = 0; anyChanged && n < graph.getNumNodes(); ++n)
+    {   Graph::IdRange const inputs = graph.getInputPaths(n); 
+        for (Graph::PathId const * p = inputs.begin(); p != inputs.end(); ++p)
+        {   if (isChanged[*p])
+                activated[n] = 1; 
+        }
+        Graph::IdRange const discoveredInputs = graph.getDiscoveredInputPaths(n); 
+        for (Graph::PathId const * p = discoveredInputs.begin(); p != discoveredInputs.end(); ++p)
+        {   if (isChanged[*p])
+                activated[n] = 1; 
+        }
+        Graph::IdRange const outputs = graph.getOutputPaths(n); 
+        for (Graph::PathId const * p = outputs.begin(); p != outputs.end(); ++p)
+        {   if (isChanged[*p])
+                activated[n] = 1; 
+        }
+    }
+    for (set<string>::const_iterator g = extraGoals.begin(); g != extraGoals.end(); ++g)
+    {   map<string, Node*>::const_iterator node = nodes.find(*g); 
+        if (node != nodes.end())
+            activated[node->second->id] = 1; 
+    }
+
+    enableDependenciesDependents(AllDependents); 
+    for (Graph::NodeId n = 0; n < graph.getNumNodes(); ++n)
+        activated[n] = activated[n] && requested[n]; 
+}
+
+bool jjm::JjmakeContext::isProducedPath(Path const& path) const
+{
+    Graph::PathId const p = graph.findPath(path); 
+    return p != Graph::noPath() && graph.getProducer(p) != Graph::noNode(); 
 }
 
 void jjm::JjmakeContext::setFailFlag()
 {
     failFlag = true; 
-    if ( ! arguments.keepGoing)
+    //A stopped pool cannot be restarted, and watch mode builds again. The 
+    //queued goals see the fail flag and return without executing. 
+    if ( ! arguments.keepGoing && ! arguments.watch)
         threadPool.setStopFlag(); 
 }
 
 void jjm::JjmakeContext::newNode(jjm::Node * node_)
+{
+    newNode(node_, string()); 
+}
+
+void jjm::JjmakeContext::newNode(jjm::Node * node_, std::string const& buildFile)
 {
     UniquePtr<Node*> node(node_); 
     if (node_->goalName.size() == 0)
@@ -370,5 +1815,58 @@ void jjm::JjmakeContext::newNode(jjm::Node * node_)
         if (node2 != 0)
             throw std::runtime_error("New node has same name as another node."); 
         node2 = node.release(); 
+        if (buildFile.size())
+            buildFiles[buildFile].goalNames.push_back(node_->goalName); 
     }
 }
+
+void jjm::JjmakeContext::addBuildFile(std::string const& buildFile, std::string const& includingBuildFile)
+{
+    Lock lock(nodesMutex); 
+    //A file included twice keeps its first includer. 
+    if (buildFiles.find(buildFile) == buildFiles.end())
+        buildFiles[buildFile].includingBuildFile = includingBuildFile; 
+}
+
+void jjm::JjmakeContext::setGoalWeight(std::string const& goalName, std::string const& alternateGoalName, std::int64_t weight, 
+        std::string const& buildFile)
+{
+    GoalWeight w; 
+    w.goalName = goalName; 
+    w.alternateGoalName = alternateGoalName; 
+    w.weight = weight; 
+    w.buildFile = buildFile; 
+    Lock lock(goalWeightsMutex); 
+    goalWeights.push_back(w); 
+}
+
+void jjm::JjmakeContext::declareWorkerTool(std::string const& key, std::int32_t maxWorkers, std::int32_t maxRequests, 
+        std::vector<std::string> const& command)
+{
+    ProcessBuilder pb; 
+    for (size_t i = 0; i < command.size(); ++i)
+        pb.arg(command[i]); 
+    workerPool.declareTool(key, pb, maxWorkers, maxRequests); 
+}
+
+void jjm::JjmakeContext::declarePool(std::string const& poolName, std::int32_t depth, std::string const& buildFile)
+{
+    PoolDeclaration p; 
+    p.poolName = poolName; 
+    p.depth = depth; 
+    p.buildFile = buildFile; 
+    Lock lock(poolsMutex); 
+    poolDeclarations.push_back(p); 
+}
+
+void jjm::JjmakeContext::setGoalPool(std::string const& goalName, std::string const& alternateGoalName, std::string const& poolName, 
+        std::string const& buildFile)
+{
+    GoalPool g; 
+    g.goalName = goalName; 
+    g.alternateGoalName = alternateGoalName; 
+    g.poolName = poolName; 
+    g.buildFile = buildFile; 
+    Lock lock(poolsMutex); 
+    goalPools.push_back(g); 
+}
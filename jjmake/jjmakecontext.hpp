@@ -6,12 +6,26 @@
 #ifndef JJMAKE_JJMAKECONTEXT_HPP_HEADER_GUARD
 #define JJMAKE_JJMAKECONTEXT_HPP_HEADER_GUARD
 
+#include "actioncache.hpp"
+#include "concurrency.hpp"
+#include "consolewriter.hpp"
+#include "depslog.hpp"
+#include "graph.hpp"
+#include "history.hpp"
 #include "node.hpp"
+#include "remotecache.hpp"
+#include "remoteexec.hpp"
+#include "signatures.hpp"
+#include "statcache.hpp"
 #include "jbase/juniqueptr.hpp"
+#include "josutils/jjobserver.hpp"
 #include "josutils/jthreading.hpp"
 #include "josutils/jstdstreams.hpp"
+#include "josutils/jworker.hpp"
 
+#include <atomic>
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -19,6 +33,7 @@
 namespace jjm
 {
 
+class DirectoryWatcher; 
 class ParserContext;
 
 class JjmakeContext
@@ -26,6 +41,7 @@ class JjmakeContext
 public:
     enum ExecutionMode { ExecuteGoals, PrintGoals }; 
     enum DependencyMode { NoDependencies, AllDependencies, AllDependents }; 
+    enum OutputSync { OutputSyncNone, OutputSyncLine, OutputSyncGoal }; 
 
     class Arguments
     {
@@ -36,7 +52,21 @@ public:
                 alwaysMake(false), 
                 allGoals(false), 
                 keepGoing(false), 
-                numThreads(1)
+                criticalPathFirst(true), 
+                earlyCutoff(false), 
+                printStats(false), 
+                watch(false), 
+                numThreads(1), 
+                autoThreads(false), 
+                maxLoad(0), 
+                memoryAdmission(true), 
+                defaultGoalMemoryBytes(0), 
+                actionCacheBytes(0), 
+                cacheServerTimeoutMillis(5000), 
+                numLocalJobs(0), 
+                workerToolTimeoutMillis(0), 
+                outputSync(OutputSyncLine), 
+                stateDir(".jjmake")
                 {}
         ExecutionMode executionMode; 
         DependencyMode dependencyMode; 
@@ -44,8 +74,80 @@ public:
         bool alwaysMake; 
         bool allGoals; 
         bool keepGoing; 
+        bool criticalPathFirst; 
+
+        //Without early cutoff, a goal executes whenever a goal it depends on
+        //executed. With it, such a goal is skipped when its inputs are 
+        //unchanged since its last successful execution, as when the goals 
+        //it depends on executed without changing their outputs. Needs the 
+        //state directory. 
+        bool earlyCutoff; 
+        bool printStats; 
+
+        //After the first build, keep the graph in memory, wait for changes 
+        //to the source files and to the build files, and build again only 
+        //the goals affected by the changes. Never returns. Linux only. 
+        bool watch; 
         int numThreads; 
+
+        //Start from the number of online processors, and adjust the number 
+        //of goals executing at once to the load of the machine, up to twice
+        //the number of processors. numThreads is ignored. 
+        bool autoThreads; 
+        //Execute fewer goals at once while the load average is above maxLoad.
+        //Zero means no limit, or the number of processors with autoThreads.
+        double maxLoad; 
+
+        //Execute a ready goal only when its predicted peak memory fits into 
+        //the available memory, less the predicted peak memory of the goals 
+        //already executing. The prediction is the peak resident set size of
+        //the processes of the goal in its last execution, from the history,
+        //or else defaultGoalMemoryBytes. A goal predicted to use nothing is
+        //never held back. Needs the state directory. 
+        bool memoryAdmission; 
+        std::int64_t defaultGoalMemoryBytes; 
+
+        //Keep the outputs of successful goals in the state directory, by the
+        //hash of the command and of the inputs, and restore them instead of 
+        //executing a goal whose command and inputs match a kept execution. 
+        //The least recently used are evicted above this size. Zero, the 
+        //default, disables the cache. Needs the state directory. 
+        std::int64_t actionCacheBytes; 
+
+        //The address of a cache server, as "<host>:<port>" or "unix:<path>",
+        //which is asked for the outputs of an out of date goal missing from
+        //the action cache, and given the outputs of every executed goal. 
+        //Each request gives up after the timeout, and after the first 
+        //failure the server is no longer used. Empty for no server. Needs 
+        //the state directory. 
+        std::string cacheServerAddress; 
+        std::int64_t cacheServerTimeoutMillis; 
+
+        //The addresses of remote workers, as "<host>:<port>" or "unix:<path>",
+        //to which the commands of exec-node goals are sent when they are 
+        //expected to complete sooner there than by waiting for one of the 
+        //numLocalJobs local slots. Zero local jobs is the number of online 
+        //processors. A worker which cannot be reached is not used. 
+        std::vector<std::string> remoteWorkers; 
+        std::int32_t numLocalJobs; 
+
+        //A worker of a worker-tool which has not responded this long after a
+        //request is killed, and the goal fails. The next request starts a 
+        //new worker. Zero, the default, waits without a deadline. 
+        std::int64_t workerToolTimeoutMillis; 
         std::string rootEvalText; 
+
+        //OutputSyncNone writes every message from the calling thread, under
+        //a lock, with one flush each. OutputSyncLine hands every message to
+        //a writer thread, which writes them in large batches. OutputSyncGoal
+        //also collects what is printed during the execution of a goal, and 
+        //writes it as one block when the goal completes. 
+        OutputSync outputSync; 
+
+        //Directory for state kept between runs, such as the history of goal
+        //durations. Relative paths are relative to the current directory. 
+        //Empty means nothing is kept between runs. 
+        std::string stateDir; 
     }; 
 
 public:
@@ -59,21 +161,58 @@ public:
     //is safe to call newNode() concurrently on the same JjmakeContext object
     void newNode(jjm::Node* node); 
 
+    //As above, for a node defined by the build file. In watch mode, the node
+    //is replaced when the build file changes. 
+    void newNode(jjm::Node* node, std::string const& buildFile); 
+
+    //Sets the weight of a goal, which may not have been created yet. 
+    //The goal is looked up by goalName, and then by alternateGoalName. 
+    //It is safe to call concurrently on the same JjmakeContext object. 
+    void setGoalWeight(std::string const& goalName, std::string const& alternateGoalName, std::int64_t weight, 
+            std::string const& buildFile = std::string()); 
+
+    //Declares a pool, of which at most depth goals execute at once. 
+    //It is safe to call concurrently on the same JjmakeContext object. 
+    void declarePool(std::string const& poolName, std::int32_t depth, std::string const& buildFile = std::string()); 
+
+    //Assigns a goal, which may not have been created yet, to a pool. The goal
+    //is looked up as by setGoalWeight(). A goal is in at most one pool. 
+    //It is safe to call concurrently on the same JjmakeContext object. 
+    void setGoalPool(std::string const& goalName, std::string const& alternateGoalName, std::string const& poolName, 
+            std::string const& buildFile = std::string()); 
+
+    //Declares the tool of persistent workers with the key, which runs 
+    //command, or replaces its declaration. See WorkerPool::declareTool(). 
+    //It is safe to call concurrently on the same JjmakeContext object. 
+    void declareWorkerTool(std::string const& key, std::int32_t maxWorkers, std::int32_t maxRequests, 
+            std::vector<std::string> const& command); 
+
+    //Records that the build file is included by includingBuildFile, which is
+    //empty for the files included by the root context. 
+    //It is safe to call concurrently on the same JjmakeContext object. 
+    void addBuildFile(std::string const& buildFile, std::string const& includingBuildFile); 
+
+    //Valid after execute(). 
+    StatCache const& getStatCache() const { return statCache; }
+
+    //The estimated duration of the goal in milliseconds, as used for its 
+    //priority. Valid while the goals execute. 
+    std::int64_t getGoalWeight(Graph::NodeId node) const { return weights[node]; }
+
+    //True when a goal which the goal depends on executed in this build, or 
+    //had its outputs restored, and so the goal must execute too. Always 
+    //false with early cutoff, where the goal executes only when the content
+    //of its inputs changed. Valid while the goal executes. 
+    bool isForcedByDependency(Graph::NodeId node) const { return ! arguments.earlyCutoff && dependencyExecuted[node]; }
+
+    //The pool which evaluates the build files and executes the goals. 
+    ThreadPool & getThreadPool() { return threadPool; }
+
     //meant for public use by everyone
-    void toStdOut(Utf8String const& str)
-    {
-        Lock lock(stdOutErrMutex); 
-        if ( ! (jout() << str << flush))
-            throw std::runtime_error("Writing to stdout failed."); 
-    }
+    void toStdOut(Utf8String const& str) { print(false, str); }
     
     //meant for public use by everyone
-    void toStdErr(Utf8String const& str)
-    {
-        Lock lock(stdOutErrMutex); 
-        if ( ! (jerr() << str << flush))
-            throw std::runtime_error("Writing to stderr failed."); 
-    }
+    void toStdErr(Utf8String const& str) { print(true, str); }
 private:
     JjmakeContext(JjmakeContext const& ); //not defined, not copyable
     JjmakeContext& operator= (JjmakeContext const& ); //not defined, not copyable
@@ -83,31 +222,256 @@ private:
     void phase1(); 
     class InitialParseNode; 
 
-    void initPathMaps(); 
-    void createImplicitDependencies(); 
+    void freezeGraph(); 
+    void resetGoalState(); 
 
     void activateSpecifiedGoals();
-    void enableDependenciesDependents();
+    void enableDependenciesDependents(DependencyMode mode);
     void setNumOutstandingPrereqs(); 
+    void loadHistory(); 
+    void loadSignatures(); 
+    //Called before the graph is first frozen, which adds the logged 
+    //discovered inputs. 
+    void loadDepsLog(); 
+    void attachSignatures(); 
+    void executeActivatedGoals(); 
+    void applyGoalWeights(); 
+    void applyGoalPools(); 
+    void computePriorities(); 
+    class HashFilesRunnable; 
+    void hashSourceFiles(); 
 
     void phase2();
     class ExecuteGoalRunnable; 
+    void addExecuteGoalTasks(std::vector<Graph::NodeId> const& toExecute, bool admittedByMemory = false); 
+    //Returns false when the pool of the node is full, and the node is left 
+    //waiting in the pool. 
+    bool acquirePoolSlot(Graph::NodeId node); 
+    //Returns the waiting node which now holds the slot, or noNode(). 
+    Graph::NodeId releasePoolSlot(Graph::NodeId node); 
+    void applyMemoryPredictions(); 
+    //Returns false when the predicted memory of the node does not fit, and 
+    //the node is left waiting for admission. 
+    bool admitByMemory(Graph::NodeId node); 
+    //Admits the waiting nodes which now fit, and adds them as tasks. 
+    void releaseMemory(Graph::NodeId node); 
+    void startConcurrencyController(); 
+    void startJobServer(); 
+    //Connects to the remote workers, and warns of those which cannot be 
+    //reached. 
+    void startDispatcher(); 
+    //Returns false when there is no jobserver, or when execution is failing
+    //before a token became available. 
+    bool acquireJobToken(JobServerClient::Token & token); 
+    void releaseJobToken(JobServerClient::Token const& token); 
 
     void setFailFlag(); 
+    void printStats(); 
+
+    void print(bool toStdErr, Utf8String const& str); 
+    //Waits until everything printed so far is written. 
+    void flushOutput(); 
+    class GoalOutputScope; 
+
+    void watch(); 
+    void addWatchedDirectories(DirectoryWatcher & watcher); 
+    void reloadBuildFiles(std::vector<std::string> const& changedBuildFiles, std::set<std::string> & newGoals); 
+    void removeBuildFile(std::string const& buildFile); 
+    void activateAffectedGoals(std::vector<Path> const& changedPaths, std::set<std::string> const& extraGoals); 
+    bool isProducedPath(Path const& path) const; 
+
+    void recordExecution(Node * node, std::int64_t startNanoSec, std::int32_t exitStatus, 
+            std::vector<Path> const* discoveredInputs = 0); 
+    //Reads the depfile of the goal after it executed, logs its inputs which 
+    //are not inputs of the build files, and removes it. Returns false when 
+    //there is no depfile. 
+    //Throws std::exception on errors. 
+    bool ingestDepfile(Graph::NodeId node, std::vector<Path> & discoveredInputs, bool & changed); 
+
+    //Adds the inputs and outputs of the dyndep file of the goal, which just 
+    //completed, to the goals which the file names, with the dependency edges
+    //they imply, and appends the goals which became ready to ready. Does 
+    //nothing for a goal without a dyndep file. 
+    //Throws std::exception when the file is invalid, when an edge would make
+    //a cycle, or when it would make a goal which already started wait. 
+    void applyDyndepFile(Graph::NodeId node, std::vector<Graph::NodeId> & ready); 
+    //The following are called with dynamicEdgesMutex. 
+    bool isActive(Graph::NodeId node) const { return activated[node] || dynamicallyActivated[node]; }
+    //Makes dependent wait for dependency, unless it already does. 
+    void addDynamicEdge(Graph::NodeId dependency, Graph::NodeId dependent, Path const& dyndepFile, 
+            std::vector<Graph::NodeId> & ready); 
+    //Counts the edge, which was already added to the outstanding 
+    //prerequisites of dependent, down at once when dependency has completed.
+    void linkDynamicEdge(Graph::NodeId dependency, Graph::NodeId dependent, std::vector<Graph::NodeId> & ready); 
+    //Activates the goal, which is not active, and its inactive dependencies. 
+    void activateDynamically(Graph::NodeId node, Graph::NodeId dependent, Path const& dyndepFile, 
+            std::vector<Graph::NodeId> & ready); 
+    //Returns noNode() when no goal outputs the path, by the graph or by a 
+    //dyndep file. 
+    Graph::NodeId findDynamicProducer(Path const& path) const; 
+    //The goals from first to last, each a dependent of the one before it, or
+    //empty when last does not depend on first. 
+    void findDependentsPath(Graph::NodeId first, Graph::NodeId last, std::vector<Graph::NodeId> & path) const; 
+    //The goals which read the path of the graph, by its build files. 
+    Graph::IdRange getConsumers(Graph::PathId path); 
+    //Called when the goal completes. 
+    //Marks the dependents as forced when the goal executed. 
+    void releaseDynamicDependents(Graph::NodeId node, bool executed, std::vector<Graph::NodeId> & ready); 
+    void releasePrereq(Graph::NodeId node, std::vector<Graph::NodeId> & ready); 
+    void setDependencyExecuted(Graph::NodeId node); 
+    void refreshOutputs(Graph::NodeId node); 
+    bool getOutputHashes(Graph::NodeId node, std::vector<std::uint64_t> & hashes); 
+    //Returns false when the goal is not cached. 
+    bool getActionKey(Graph::NodeId node, std::uint64_t & key); 
+    //Returns true when the outputs of an out of date goal were restored. 
+    bool restoreFromActionCache(Graph::NodeId node, std::uint64_t key); 
+    void storeInActionCache(Graph::NodeId node, std::uint64_t key); 
+    //Returns true when the outputs of an out of date goal were downloaded. 
+    bool restoreFromCacheServer(Graph::NodeId node, std::uint64_t key); 
+    void uploadToCacheServer(Graph::NodeId node, std::uint64_t key); 
 
     //data members
 
     Arguments arguments; 
 
     Mutex stdOutErrMutex; 
+    UniquePtr<ConsoleWriter*> consoleWriter; //null with OutputSyncNone
 
     ThreadPool threadPool; 
+    UniquePtr<ConcurrencyController*> concurrencyController; //null for a fixed number of threads
     UniquePtr<ParserContext*> rootParserContext; 
-    jjm::Mutex nodesMutex; //protects this->nodes
+    jjm::Mutex nodesMutex; //protects this->nodes and this->buildFiles
     std::map<std::string, jjm::Node*> nodes; //ownership
-    std::map<std::string, std::vector<jjm::Node*> > inputPathMap; 
-    std::map<std::string, jjm::Node*> outputPathMap; 
     bool failFlag; 
+
+    //Every included build file, by absolute path, with the goals it defined.
+    class BuildFile
+    {
+    public:
+        std::string includingBuildFile; 
+        std::vector<std::string> goalNames; 
+    }; 
+    std::map<std::string, BuildFile> buildFiles; 
+
+    //The graph, and the per-node state, indexed by node id. 
+    //Only numOutstandingPrereqs is modified during phase2 goal execution. 
+    Graph graph; 
+    std::vector<char> activated; 
+    std::vector<std::int64_t> weights; //estimated duration in milliseconds
+    std::vector<std::int64_t> priorities; //total weight of the longest chain starting with the node
+    std::vector<std::atomic<std::int32_t> > numOutstandingPrereqs; 
+    //Set, with the mutex of the dependents of the goal, before a goal which
+    //executed or was restored counts its dependents down. 
+    std::vector<char> dependencyExecuted; 
+    //Set when the goal executed successfully, or was skipped. 
+    std::vector<char> completed; 
+    std::atomic<std::int64_t> numSkippedByEarlyCutoff; 
+
+    //Dependency edges which dyndep files add during phase2. The additions 
+    //are serialized by dynamicEdgesMutex, which is never held by the goals 
+    //which complete meanwhile, so that each addition is checked for cycles 
+    //against all the others. An edge raises numOutstandingPrereqs of its 
+    //dependent only while that is above zero, before the dependent started.
+    //A goal sets dependentsReleased when it completes, with the mutex of its
+    //dependents, with which the edges from it are added, so that each edge 
+    //is counted down exactly once. Goals activated by edges are kept apart 
+    //from activated until phase2 ends, as completing goals read activated 
+    //without a lock. 
+    jjm::Mutex dynamicEdgesMutex; //protects the following five during phase2
+    std::vector<char> dynamicallyActivated; 
+    std::map<std::string, Graph::NodeId> dynamicProducers; //by path
+    std::map<std::string, std::vector<Graph::NodeId> > dynamicConsumers; //of paths without a producer yet
+    std::vector<std::uint32_t> consumerOffsets; //built when first needed
+    std::vector<Graph::NodeId> consumerIds; 
+    enum { numDependentsMutexes = 64 }; 
+    jjm::Mutex & getDependentsMutex(Graph::NodeId node) { return dependentsMutexes[node % numDependentsMutexes]; }
+    jjm::Mutex dependentsMutexes[numDependentsMutexes]; //protect the following three, and dependencyExecuted
+    std::vector<std::vector<Graph::NodeId> > dynamicDependents; //modified with dynamicEdgesMutex too
+    std::vector<char> dependentsReleased; 
+    std::vector<char> releasedByExecution; //set with dependentsReleased when the goal executed
+    std::atomic<std::int64_t> numDynamicEdges; 
+    std::atomic<std::int64_t> numDynamicallyActivated; 
+
+    //Memoized file metadata, shared by every node. 
+    StatCache statCache; 
+    Signatures signatures; 
+    DepsLog depsLog; 
+    //Set when a goal discovered other inputs than those of the graph, which 
+    //is then frozen again in watch mode. 
+    std::atomic<bool> discoveredInputsChanged; 
+    std::atomic<std::int64_t> numDepfilesRead; 
+    ActionCache actionCache; 
+    RemoteCache remoteCache; 
+
+    class GoalWeight
+    {
+    public:
+        std::string goalName; 
+        std::string alternateGoalName; 
+        std::int64_t weight; 
+        std::string buildFile; 
+    }; 
+    jjm::Mutex goalWeightsMutex; //protects this->goalWeights
+    std::vector<GoalWeight> goalWeights; 
+
+    class PoolDeclaration
+    {
+    public:
+        std::string poolName; 
+        std::int32_t depth; 
+        std::string buildFile; 
+    }; 
+    class GoalPool
+    {
+    public:
+        std::string goalName; 
+        std::string alternateGoalName; 
+        std::string poolName; 
+        std::string buildFile; 
+    }; 
+    jjm::Mutex poolsMutex; //protects this->poolDeclarations and this->goalPools
+    std::vector<PoolDeclaration> poolDeclarations; 
+    std::vector<GoalPool> goalPools; 
+
+    //A goal of a full pool waits in the pool, and not on a worker thread, 
+    //until a goal of the pool completes. 
+    class PoolSlots
+    {
+    public:
+        PoolSlots() : depth(0), numRunning(0) {}
+        std::int32_t depth; 
+        std::int32_t numRunning; 
+        std::vector<Graph::NodeId> waiting; //heap, highest priority first
+    }; 
+    static std::uint32_t noPool() { return static_cast<std::uint32_t>(-1); }
+    std::vector<std::uint32_t> poolOfNode; //by node id, or noPool()
+    jjm::Mutex poolSlotsMutex; //protects this->poolSlots during phase2
+    std::vector<PoolSlots> poolSlots; 
+
+    //A goal whose predicted memory does not fit waits for admission, and 
+    //not on a worker thread, until an admitted goal completes. It keeps its
+    //pool slot while it waits. 
+    std::vector<std::int64_t> predictedMemory; //bytes, by node id
+    jjm::Mutex admissionMutex; //protects the following three during phase2
+    std::int64_t admittedMemory; //total prediction of the admitted goals
+    std::int32_t numAdmitted; 
+    std::vector<Graph::NodeId> memoryWaiting; //heap, highest priority first
+    std::atomic<std::int64_t> numDelayedByMemory; 
+
+    //Every goal holds a jobserver token while it executes. The client is of
+    //the jobserver inherited through MAKEFLAGS, or else of this->jobServer, 
+    //which is passed on to the processes of the goals. 
+    UniquePtr<JobServerClient*> jobServerClient; 
+    UniquePtr<JobServer*> jobServer; 
+
+    //The persistent workers of the worker-node goals. They are stopped when
+    //the context is destroyed. 
+    WorkerPool workerPool; 
+
+    //Null without remote workers. 
+    UniquePtr<Dispatcher*> dispatcher; 
+
+    History history; 
 };
 
 }//namespace jjm
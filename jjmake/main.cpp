@@ -4,6 +4,8 @@
 //  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
 
 #include "jjmakecontext.hpp"
+#include "remotecache.hpp"
+#include "remoteexec.hpp"
 
 #include "jbase/jinttostring.hpp"
 #include "jbase/jnulltermiter.hpp"
@@ -13,7 +15,9 @@
 #include "junicode/jutfstring.hpp"
 #include "josutils/jenv.hpp"
 #include "josutils/jstdstreams.hpp"
+#include "josutils/jsysload.hpp"
 #include <iostream>
+#include <limits>
 #include <stdlib.h>
 #include <string>
 #include <string.h>
@@ -242,6 +246,13 @@ namespace
         s << "        Create a variable with the given name and\n"; 
         s << "        value in the root context.\n"; 
         s << "\n";
+        s << "--early-cutoff\n";
+        s << "        By default, a goal executes whenever a goal it depends on\n";
+        s << "        executed. With this option, such a goal is skipped when the\n";
+        s << "        content of its inputs did not change since its last successful\n";
+        s << "        execution, as when the goals it depends on left their outputs\n";
+        s << "        with the same content. Requires the state directory.\n";
+        s << "\n";
         s << "<goal>\n";
         s << "-G<goal>\n";
         s << "-G <goal>\n";
@@ -263,16 +274,126 @@ namespace
         s << "        Continue as much as possible after a goal execution failure.\n";
         s << "        The default is to stop as soon as possible after a goal execution fails.\n";
         s << "\n";
+        s << "--no-critical-path\n";
+        s << "        Do not prefer goals on the longest chain of remaining work when\n";
+        s << "        choosing which ready goal to execute next. By default, goals are\n";
+        s << "        ordered by the total weight of their longest chain of dependents.\n";
+        s << "        The weight of a goal is its duration from the previous run, or its\n";
+        s << "        goal-weight from the build file.\n";
+        s << "\n";
+        s << "--output-sync=none\n";
+        s << "--output-sync=line\n";
+        s << "--output-sync=goal\n";
+        s << "        How the output of concurrent goals is written. With none, every\n";
+        s << "        message is written and flushed by the thread which prints it.\n";
+        s << "        With line, whole messages are handed to a writer thread, which\n";
+        s << "        writes them in large batches. With goal, the output of a goal is\n";
+        s << "        held until the goal completes, and then written as one block.\n";
+        s << "        The default is line.\n";
+        s << "\n";
         s << "-P\n";
         s << "--just-print\n";
         s << "        Instead of executing goals, print the names of goals when they\n";
         s << "        would be executed.\n";
         s << "\n";
+        s << "--stats\n";
+        s << "        After execution, print the size of the goal graph and the memory\n";
+        s << "        it uses per goal.\n";
+        s << "\n";
+        s << "--state-dir=<dir>\n";
+        s << "        The directory where jjmake keeps state between runs, such as the\n";
+        s << "        duration of every executed goal, the inputs which goals found in\n";
+        s << "        their depfiles, and the content signatures of files. Without it,\n";
+        s << "        depfiles are not read. With signatures, a goal is out of date only\n";
+        s << "        when the content of an input changed, and not when only its\n";
+        s << "        timestamp changed.\n";
+        s << "        The default is .jjmake in the current directory. An empty value\n";
+        s << "        keeps no state, and goals are compared by timestamps.\n";
+        s << "\n";
         s << "-T<N>\n";
         s << "-T <N>\n";
         s << "--threads=<N>\n";
         s << "        Specify the number of goals to run concurrently.\n";
         s << "\n";
+        s << "--threads=auto\n";
+        s << "        Start with as many concurrent goals as there are processors, and\n";
+        s << "        keep adjusting the number to the load of the machine, up to twice\n";
+        s << "        the number of processors. The load is the load average, and on\n";
+        s << "        Linux also the CPU pressure stall information. Unless --max-load\n";
+        s << "        is given, the machine is overloaded when the load average exceeds\n";
+        s << "        the number of processors.\n";
+        s << "\n";
+        s << "--max-load=<L>\n";
+        s << "        Run fewer goals concurrently while the load average is above L,\n";
+        s << "        and more again, up to the number of threads, once it falls.\n";
+        s << "\n";
+        s << "--default-goal-memory=<MiB>\n";
+        s << "        The predicted peak memory of a goal without a recorded peak. A\n";
+        s << "        ready goal executes only when its predicted peak memory fits into\n";
+        s << "        the available memory, less the predictions of the goals already\n";
+        s << "        executing. The prediction of a goal is the peak resident set size\n";
+        s << "        of its processes in its last execution. The default is 0, and\n";
+        s << "        such goals are not held back.\n";
+        s << "\n";
+        s << "--no-memory-admission\n";
+        s << "        Do not hold back goals by their predicted peak memory.\n";
+        s << "\n";
+        s << "--action-cache\n";
+        s << "        Keep an action cache in the state directory, which keeps the\n";
+        s << "        outputs of successful goals by the hash of their command and of\n";
+        s << "        the content of their inputs. An out of date goal whose command\n";
+        s << "        and inputs match a kept execution has its outputs restored, by\n";
+        s << "        reflink or copy and with new timestamps, instead of executing.\n";
+        s << "        The outputs of touch-node goals are never kept. This option is\n";
+        s << "        disabled by default.\n";
+        s << "\n";
+        s << "--action-cache-size=<MiB>\n";
+        s << "        The size of the action cache, above which the least recently\n";
+        s << "        used executions are evicted. The default is 1024.\n";
+        s << "\n";
+        s << "--use-cache-server=<address>\n";
+        s << "        Share the outputs of goals with the cache server at the address,\n";
+        s << "        which is <host>:<port> or unix:<path>. An out of date goal which\n";
+        s << "        is not in the action cache is downloaded from the server when the\n";
+        s << "        server has it, and the outputs of every executed goal are uploaded.\n";
+        s << "        Needs the state directory.\n";
+        s << "\n";
+        s << "--cache-server-timeout=<millis>\n";
+        s << "        The longest time one request to the cache server may take, from\n";
+        s << "        connecting to its last byte. After the first request which fails\n";
+        s << "        or times out, the server is no longer used. The default is 5000.\n";
+        s << "\n";
+        s << "--cache-server --listen=<address>\n";
+        s << "        Instead of building, serve the cache in the state directory to the\n";
+        s << "        builds of --use-cache-server=<address>, until killed. A port of 0\n";
+        s << "        picks a free port. --action-cache-size limits the cache.\n";
+        s << "\n";
+        s << "--remote-worker=<address>\n";
+        s << "        Send the commands of exec-node goals to the remote worker at the\n";
+        s << "        address, which is <host>:<port> or unix:<path>, when they are\n";
+        s << "        expected to complete sooner there, inputs transfer included, than\n";
+        s << "        by waiting for a local slot. May be given more than once. The\n";
+        s << "        commands must name their files by relative paths.\n";
+        s << "\n";
+        s << "--local-jobs=<N>\n";
+        s << "        With --remote-worker, the number of exec-node commands which\n";
+        s << "        execute locally at once. The default is the number of processors.\n";
+        s << "        --threads limits the goals in total, and so should also count the\n";
+        s << "        slots of the remote workers.\n";
+        s << "\n";
+        s << "--worker-tool-timeout=<millis>\n";
+        s << "        The longest time a worker of a worker-tool may take to respond to\n";
+        s << "        a request. A worker which takes longer is killed, its goal fails,\n";
+        s << "        and the next request of the tool starts a new worker. The default\n";
+        s << "        is 0, which waits without a deadline. Not kept on Windows.\n";
+        s << "\n";
+        s << "--worker --listen=<address> [--worker-slots=<N>]\n";
+        s << "        Instead of building, execute the commands sent by the builds of\n";
+        s << "        --remote-worker=<address>, N at once, until killed. The default N\n";
+        s << "        is the number of processors. Inputs are kept in the state\n";
+        s << "        directory, limited by --action-cache-size. The worker executes\n";
+        s << "        whatever it is sent, so listen only where every client is trusted.\n";
+        s << "\n";
         s << "-v\n"; 
         s << "-V\n"; 
         s << "-version\n"; 
@@ -280,6 +401,12 @@ namespace
         s << "--version\n"; 
         s << "--Version\n"; 
         s << "        Display version information.\n"; 
+        s << "\n";
+        s << "--watch\n";
+        s << "        After the build, keep running and watch the source files and the\n";
+        s << "        build files for changes. On a change, execute again only the goals\n";
+        s << "        which are affected by it, and the goals which depend on them. When\n";
+        s << "        a build file changes, only that file is read again. Linux only.\n";
         s << flush; 
     }
 }
@@ -288,6 +415,12 @@ int jjm::jjmakemain(vector<string> const& args)
 {
     JjmakeContext::Arguments jjarguments; 
     bool hasInclude = false; 
+    bool actionCache = false; 
+    std::int64_t actionCacheBytes = std::int64_t(1024) * 1024 * 1024; 
+    bool cacheServer = false; 
+    bool worker = false; 
+    std::int32_t numWorkerSlots = 0; 
+    string listenAddress; 
     for (std::vector<string>::const_iterator arg = args.begin(); arg != args.end(); ++arg)
     {
         if (*arg == "--all-dependencies")
@@ -366,14 +499,46 @@ int jjm::jjmakemain(vector<string> const& args)
         {   jjarguments.keepGoing = true; 
             continue; 
         }
+        if (*arg == "--early-cutoff")
+        {   jjarguments.earlyCutoff = true; 
+            continue; 
+        }
+        if (*arg == "--no-critical-path")
+        {   jjarguments.criticalPathFirst = false; 
+            continue; 
+        }
         if (*arg == "--no-dependencies")
         {   jjarguments.dependencyMode = JjmakeContext::NoDependencies; 
             continue; 
         }
+        if (startsWith(*arg, "--state-dir="))
+        {   jjarguments.stateDir = arg->substr(strlen("--state-dir=")); 
+            continue; 
+        }
+        if (*arg == "--stats")
+        {   jjarguments.printStats = true; 
+            continue; 
+        }
+        if (*arg == "--watch")
+        {   jjarguments.watch = true; 
+            continue; 
+        }
         if (*arg == "-P" || *arg == "--just-print")
         {   jjarguments.executionMode = JjmakeContext::PrintGoals; 
             continue; 
         }
+        if (startsWith(*arg, "--output-sync="))
+        {   string const x = arg->substr(strlen("--output-sync=")); 
+            if (x == "none")
+                jjarguments.outputSync = JjmakeContext::OutputSyncNone; 
+            else if (x == "line")
+                jjarguments.outputSync = JjmakeContext::OutputSyncLine; 
+            else if (x == "goal")
+                jjarguments.outputSync = JjmakeContext::OutputSyncGoal; 
+            else
+                throw std::runtime_error("Invalid value in --output-sync=none|line|goal command line option \"" + *arg + "\"."); 
+            continue; 
+        }
         if (startsWith(*arg, "-T"))
         {   string x; 
             if (arg->size() == 2)
@@ -391,6 +556,107 @@ int jjm::jjmakemain(vector<string> const& args)
             jjarguments.numThreads = y; 
             continue;
         }
+        if (*arg == "--no-memory-admission")
+        {   jjarguments.memoryAdmission = false; 
+            continue;
+        }
+        if (startsWith(*arg, "--default-goal-memory="))
+        {   string const x = arg->substr(strlen("--default-goal-memory=")); 
+            std::int64_t y = 0; 
+            if (false == decStrToInteger(y, x))
+                throw std::runtime_error("Not a valid number in --default-goal-memory=<MiB> command line option \"" + *arg + "\"."); 
+            if (y < 0 || y > (std::numeric_limits<std::int64_t>::max)() / (1024 * 1024))
+                throw std::runtime_error("Invalid number in --default-goal-memory=<MiB> command line option \"" + *arg + "\"."); 
+            jjarguments.defaultGoalMemoryBytes = y * 1024 * 1024; 
+            continue;
+        }
+        if (startsWith(*arg, "--action-cache-size="))
+        {   string const x = arg->substr(strlen("--action-cache-size=")); 
+            std::int64_t y = 0; 
+            if (false == decStrToInteger(y, x))
+                throw std::runtime_error("Not a valid number in --action-cache-size=<MiB> command line option \"" + *arg + "\"."); 
+            if (y < 0 || y > (std::numeric_limits<std::int64_t>::max)() / (1024 * 1024))
+                throw std::runtime_error("Invalid number in --action-cache-size=<MiB> command line option \"" + *arg + "\"."); 
+            actionCacheBytes = y * 1024 * 1024; 
+            continue;
+        }
+        if (*arg == "--action-cache")
+        {   actionCache = true; 
+            continue;
+        }
+        if (*arg == "--cache-server")
+        {   cacheServer = true; 
+            continue;
+        }
+        if (startsWith(*arg, "--listen="))
+        {   listenAddress = arg->substr(strlen("--listen=")); 
+            continue;
+        }
+        if (startsWith(*arg, "--use-cache-server="))
+        {   jjarguments.cacheServerAddress = arg->substr(strlen("--use-cache-server=")); 
+            continue;
+        }
+        if (startsWith(*arg, "--cache-server-timeout="))
+        {   string const x = arg->substr(strlen("--cache-server-timeout=")); 
+            std::int64_t y = 0; 
+            if (false == decStrToInteger(y, x))
+                throw std::runtime_error("Not a valid number in --cache-server-timeout=<millis> command line option \"" + *arg + "\"."); 
+            if (y < 1 || y > (std::numeric_limits<std::int64_t>::max)() / (1000 * 1000))
+                throw std::runtime_error("Invalid number in --cache-server-timeout=<millis> command line option \"" + *arg + "\"."); 
+            jjarguments.cacheServerTimeoutMillis = y; 
+            continue;
+        }
+        if (startsWith(*arg, "--remote-worker="))
+        {   jjarguments.remoteWorkers.push_back(arg->substr(strlen("--remote-worker="))); 
+            continue;
+        }
+        if (startsWith(*arg, "--local-jobs="))
+        {   string const x = arg->substr(strlen("--local-jobs=")); 
+            std::int32_t y = 0; 
+            if (false == decStrToInteger(y, x))
+                throw std::runtime_error("Not a valid number in --local-jobs=<N> command line option \"" + *arg + "\"."); 
+            if (y < 1)
+                throw std::runtime_error("Invalid number in --local-jobs=<N> command line option \"" + *arg + "\"."); 
+            jjarguments.numLocalJobs = y; 
+            continue;
+        }
+        if (startsWith(*arg, "--worker-tool-timeout="))
+        {   string const x = arg->substr(strlen("--worker-tool-timeout=")); 
+            std::int64_t y = 0; 
+            if (false == decStrToInteger(y, x))
+                throw std::runtime_error("Not a valid number in --worker-tool-timeout=<millis> command line option \"" + *arg + "\"."); 
+            if (y < 0 || y > (std::numeric_limits<std::int64_t>::max)() / (1000 * 1000))
+                throw std::runtime_error("Invalid number in --worker-tool-timeout=<millis> command line option \"" + *arg + "\"."); 
+            jjarguments.workerToolTimeoutMillis = y; 
+            continue;
+        }
+        if (*arg == "--worker")
+        {   worker = true; 
+            continue;
+        }
+        if (startsWith(*arg, "--worker-slots="))
+        {   string const x = arg->substr(strlen("--worker-slots=")); 
+            if (false == decStrToInteger(numWorkerSlots, x))
+                throw std::runtime_error("Not a valid number in --worker-slots=<N> command line option \"" + *arg + "\"."); 
+            if (numWorkerSlots < 1)
+                throw std::runtime_error("Invalid number in --worker-slots=<N> command line option \"" + *arg + "\"."); 
+            continue;
+        }
+        if (*arg == "--threads=auto")
+        {   jjarguments.autoThreads = true; 
+            continue;
+        }
+        if (startsWith(*arg, "--max-load="))
+        {   string const x = arg->substr(strlen("--max-load=")); 
+            char * end = 0; 
+            double const y = x.size() ? strtod(x.c_str(), & end) : 0; 
+            if (x.empty() || *end != 0)
+                throw std::runtime_error("Not a valid number in --max-load=<L> command line option \"" + *arg + "\"."); 
+            if ( ! (y > 0))
+                throw std::runtime_error("Invalid number in --max-load=<L> command line option \"" + *arg + "\"."); 
+            jjarguments.maxLoad = y; 
+            continue;
+        }
         if (startsWith(*arg, "--threads="))
         {   string x = arg->substr(strlen("--threads=")); 
             int y = 0; 
@@ -417,6 +683,37 @@ int jjm::jjmakemain(vector<string> const& args)
         throw std::runtime_error(message); 
     }
 
+    if (actionCache)
+        jjarguments.actionCacheBytes = actionCacheBytes; 
+
+    if (cacheServer)
+    {   if (listenAddress.empty())
+            throw std::runtime_error("Command line option \"--cache-server\" without \"--listen=<address>\"."); 
+        if (jjarguments.stateDir.empty() || actionCacheBytes == 0)
+            throw std::runtime_error("Command line option \"--cache-server\" needs the state directory and the action cache."); 
+        Path const dir = Path::join(Path(jjarguments.stateDir).getAbsolutePath(), Path("cache")); 
+        CacheServer server; 
+        server.open(dir, actionCacheBytes, listenAddress); 
+        jout() << "[jjmake] Cache server listening on " << server.getAddress() << ", with the cache in \"" << dir.getStringRep() << "\"\n" << flush; 
+        server.run(); 
+        return 0; 
+    }
+
+    if (worker)
+    {   if (listenAddress.empty())
+            throw std::runtime_error("Command line option \"--worker\" without \"--listen=<address>\"."); 
+        if (jjarguments.stateDir.empty())
+            throw std::runtime_error("Command line option \"--worker\" needs the state directory."); 
+        Path const dir = Path::join(Path(jjarguments.stateDir).getAbsolutePath(), Path("worker")); 
+        std::int32_t const numSlots = numWorkerSlots > 0 ? numWorkerSlots : getNumOnlineCpus(); 
+        RemoteWorker remoteWorker; 
+        remoteWorker.open(dir, actionCacheBytes, numSlots, listenAddress); 
+        jout() << "[jjmake] Remote worker listening on " << remoteWorker.getAddress() << ", with " << numSlots 
+               << " slots, and the inputs in \"" << dir.getStringRep() << "\"\n" << flush; 
+        remoteWorker.run(); 
+        return 0; 
+    }
+
     if (hasInclude == false)
         jjarguments.rootEvalText += "(include jjmake.txt)\n"; 
 
@@ -5,13 +5,26 @@
 
 #include "node.hpp"
 
+#include "jjmakecontext.hpp"
+#include "signatures.hpp"
+#include "statcache.hpp"
 #include "jbase/jfatal.hpp"
+#include "josutils/jstat.hpp"
 
 #include <stdlib.h>
 
 using namespace jjm;
 using namespace std;
 
+namespace
+{
+    //Dynamic paths which are not paths of the graph are not cached. 
+    Stat statPath(Graph const& graph, StatCache & statCache, Path const& path)
+    {   Graph::PathId const id = graph.findPath(path); 
+        return id != Graph::noPath() ? statCache.stat(id) : Stat::stat2(path); 
+    }
+}
+
 jjm::Node::Node(
             std::string const& goalName_, 
             std::vector<jjm::Path> const& inputPaths_, 
@@ -21,8 +34,15 @@ jjm::Node::Node(
     goalName(goalName_),
     inputPaths(inputPaths_), 
     outputPaths(outputPaths_), 
-    activated(false), 
-    numOutstandingPrereqs(0)
+    id(Graph::noNode()), 
+    graph(0), 
+    statCache(0), 
+    signatures(0), 
+    jobServer(0), 
+    workerPool(0), 
+    dispatcher(0), 
+    context(0), 
+    alwaysMake(false)
 {
     for (size_t i = 0; i < inputPaths.size(); ++i)
     {   if ( ! inputPaths[i].isAbsolute())
@@ -33,3 +53,111 @@ jjm::Node::Node(
             JFATAL(0, 0); 
     }
 }
+
+jjm::Graph const& jjm::Node::getGraph() const
+{
+    if (graph == 0)
+        JFATAL(0, goalName); 
+    return * graph; 
+}
+
+jjm::StatCache & jjm::Node::getStatCache() const
+{
+    if (statCache == 0)
+        JFATAL(0, goalName); 
+    return * statCache; 
+}
+
+jjm::WorkerPool & jjm::Node::getWorkerPool() const
+{
+    if (workerPool == 0)
+        JFATAL(0, goalName); 
+    return * workerPool; 
+}
+
+std::int64_t jjm::Node::getWeightMillis() const
+{
+    if (context == 0)
+        JFATAL(0, goalName); 
+    return context->getGoalWeight(id); 
+}
+
+bool jjm::Node::getContentHash(Graph::PathId path, std::uint64_t & contentHash) const
+{
+    if (signatures == 0 || getStatCache().stat(path).type != FileType::RegularFile)
+        return false; 
+    return signatures->getContentHash(path, contentHash); 
+}
+
+void jjm::Node::beginExecution() const
+{
+    if (context == 0)
+        JFATAL(0, goalName); 
+    context->toStdOut("[jjmake] Executing goal: " + goalName + "\n"); 
+}
+
+void jjm::Node::toStdOut(Utf8String const& str) const
+{
+    if (context == 0)
+        JFATAL(0, goalName); 
+    context->toStdOut(str); 
+}
+
+void jjm::Node::toStdErr(Utf8String const& str) const
+{
+    if (context == 0)
+        JFATAL(0, goalName); 
+    context->toStdErr(str); 
+}
+
+bool jjm::Node::isOutOfDate() const
+{
+    Graph const& graph = getGraph(); 
+    StatCache & statCache = getStatCache(); 
+
+    bool haveOutputTime = false; 
+    std::int64_t oldestOutputTime = 0; 
+    Graph::IdRange const outputs = graph.getOutputPaths(id); 
+    for (Graph::PathId const * output = outputs.begin(); output != outputs.end(); ++output)
+    {   Stat const st = statCache.stat(*output); 
+        if (st.type == FileType::NoExist)
+            return true; 
+        if ( ! haveOutputTime || st.lastWriteTimeNanoSec < oldestOutputTime)
+            oldestOutputTime = st.lastWriteTimeNanoSec; 
+        haveOutputTime = true; 
+    }
+    for (vector<Path>::const_iterator output = dynamicOutputPaths.begin(); output != dynamicOutputPaths.end(); ++output)
+    {   Stat const st = statPath(graph, statCache, *output); 
+        if (st.type == FileType::NoExist)
+            return true; 
+        if ( ! haveOutputTime || st.lastWriteTimeNanoSec < oldestOutputTime)
+            oldestOutputTime = st.lastWriteTimeNanoSec; 
+        haveOutputTime = true; 
+    }
+
+    if (context == 0)
+        JFATAL(0, goalName); 
+    if (context->isForcedByDependency(id))
+        return true; 
+    if (signatures != 0)
+        return signatures->hasChanged(id); 
+
+    Graph::IdRange const inputRanges[2] = { graph.getInputPaths(id), graph.getDiscoveredInputPaths(id) }; 
+    for (int r = 0; r < 2; ++r)
+    {   for (Graph::PathId const * input = inputRanges[r].begin(); input != inputRanges[r].end(); ++input)
+        {   Stat const st = statCache.stat(*input); 
+            if (st.type == FileType::NoExist)
+                return true; 
+            if (haveOutputTime && st.lastWriteTimeNanoSec > oldestOutputTime)
+                return true; 
+        }
+    }
+    for (vector<Path>::const_iterator input = dynamicInputPaths.begin(); input != dynamicInputPaths.end(); ++input)
+    {   Stat const st = statPath(graph, statCache, *input); 
+        if (st.type == FileType::NoExist)
+            return true; 
+        if (haveOutputTime && st.lastWriteTimeNanoSec > oldestOutputTime)
+            return true; 
+    }
+    return false; 
+}
@@ -6,18 +6,23 @@
 #ifndef JJMAKE_NODE_HPP_HEADER_GUARD
 #define JJMAKE_NODE_HPP_HEADER_GUARD
 
-#include "josutils/jthreading.hpp"
+#include "graph.hpp"
 #include "jbase/jstdint.hpp"
 #include "josutils/jpath.hpp"
+#include "junicode/jutfstring.hpp"
 #include <string>
-#include <set>
 #include <vector>
 
 namespace jjm
 {
 
+class Dispatcher; 
 class JjmakeContext; 
+class JobServer; 
 class ParserContext; 
+class Signatures; 
+class StatCache; 
+class WorkerPool; 
 
 class Node
 {
@@ -26,9 +31,36 @@ public:
 
     //The logic of determining up-to-date should be delayed until this function 
     //is called. 
-    //If the node is already up to date, then this function should merely exit
-    //successfully. 
-    virtual void execute() = 0; 
+    //If the node is already up to date, then this function should merely 
+    //return false. Otherwise it calls beginExecution(), brings the goal up 
+    //to date, and returns true. Only a goal which executed is recorded in the
+    //history and stored in the action cache. 
+    virtual bool execute() = 0; 
+
+    //Describes what execute() does, such as a command line. A change of the 
+    //command makes the goal out of date. 
+    virtual std::string getCommand() const { return std::string(); }
+
+    //The depfile which execute() leaves, such as gcc -MD writes, and the 
+    //directory of its relative paths. Returns false when there is none. 
+    //After every successful execution, jjmake logs the prerequisites of the 
+    //depfile as the discovered inputs of the goal, and removes the depfile. 
+    //Needs the state directory. 
+    virtual bool getDepfile(jjm::Path & depfile, jjm::Path & baseDir) const { return false; }
+
+    //The dyndep file which execute() leaves, in the format of DyndepParser, 
+    //and the directory of its relative paths. Returns false when there is 
+    //none. Whenever the goal completes, jjmake adds the inputs and outputs of
+    //the file to the goals it names, which must depend on this goal and 
+    //wait for it. 
+    virtual bool getDyndepFile(jjm::Path & dyndepFile, jjm::Path & baseDir) const { return false; }
+
+    //True when the outputs are stamps, files whose last write time is what 
+    //execute() changes, rather than their content. The signatures of stamps
+    //include their last write times, so the goals which depend on a stamp 
+    //execute after it is touched. Stamps are never kept in the caches, as a 
+    //restored stamp would not be touched. 
+    virtual bool hasStampOutputs() const { return false; }
 
 protected: 
 
@@ -40,6 +72,56 @@ protected:
             std::vector<jjm::Path> const& outputPaths_ 
             ); 
 
+    //The following are valid once the Graph is frozen, which is before 
+    //execute() is called. 
+    Graph const& getGraph() const; 
+    Graph::NodeId getId() const { return id; }
+    //The StatCache is shared by all nodes of the build. 
+    StatCache & getStatCache() const; 
+    //True when every goal is to be treated as out of date. 
+    bool isAlwaysMake() const { return alwaysMake; }
+    //The jobserver to pass to child processes with 
+    //ProcessBuilder::jobServer(), or null when jjmake uses the jobserver of 
+    //its parent, which is already in the environment. 
+    JobServer const* getJobServer() const { return jobServer; }
+    //The persistent workers declared by the build files, shared by all 
+    //nodes of the build. 
+    WorkerPool & getWorkerPool() const; 
+    //The dispatcher of commands to remote workers, shared by all nodes of 
+    //the build, or null when the build has no remote workers. 
+    Dispatcher * getDispatcher() const { return dispatcher; }
+    //The estimated duration of the goal in milliseconds, from the history or
+    //from goal-weight, and otherwise 1. 
+    std::int64_t getWeightMillis() const; 
+    //The content hash of the file, as hash64() of its content, when jjmake 
+    //keeps state between runs and the file is a regular file. Otherwise 
+    //returns false. 
+    //Throws std::exception on errors. 
+    bool getContentHash(Graph::PathId path, std::uint64_t & contentHash) const; 
+    //The inputs and outputs which dyndep files added to the goal during 
+    //this build, in addition to those of the graph. Valid once execute() is
+    //called. 
+    std::vector<jjm::Path> const& getDynamicInputPaths() const { return dynamicInputPaths; }
+    std::vector<jjm::Path> const& getDynamicOutputPaths() const { return dynamicOutputPaths; }
+    //Called by execute() once it found the goal out of date, before it runs
+    //a command or changes a file. Prints that the goal executes. 
+    void beginExecution() const; 
+    //As JjmakeContext::toStdOut() and JjmakeContext::toStdErr(). 
+    void toStdOut(Utf8String const& str) const; 
+    void toStdErr(Utf8String const& str) const; 
+
+    //Returns true when an output or an input does not exist, when a goal 
+    //which the goal depends on executed in this build, unless with early 
+    //cutoff, or when the inputs changed since the last successful execution. 
+    //The inputs include the discovered inputs of the graph and the dynamic 
+    //inputs, and the outputs include the dynamic outputs. When jjmake keeps 
+    //state between runs, the inputs, the outputs and the command are 
+    //compared by content signatures, and otherwise the inputs are compared 
+    //by last write times against the outputs. 
+    //Does not consider isAlwaysMake(). 
+    //Throws std::exception on errors. 
+    bool isOutOfDate() const; 
+
 private:
     Node(Node const& ); //not defined, not copyable
     Node& operator= (Node const& ); //not defined, not copyable
@@ -47,21 +129,31 @@ private:
 private:
     friend class jjm::JjmakeContext; 
     friend class jjm::ParserContext; 
+    friend class jjm::Graph::Builder; 
+    friend class jjm::Signatures; 
 
-    //the following fields should remain fixed once phase2 goal execution has begun: 
     std::string goalName; 
+
+    //The paths are moved into the Graph when it is frozen after phase1, 
+    //and these vectors are then emptied. 
     std::vector<jjm::Path> inputPaths; 
     std::vector<jjm::Path> outputPaths; 
-    std::set<Node*> dependencies; 
-    std::set<Node*> dependents; 
-    bool activated; 
 
-    Mutex mutex; 
+    //Set while the goal waits for the goals with the dyndep files, and 
+    //emptied when the goal state is reset. 
+    std::vector<jjm::Path> dynamicInputPaths; 
+    std::vector<jjm::Path> dynamicOutputPaths; 
 
-    //The following fields may be modified during phase2 goal execution. 
-    //Once phase2 goal execution has begun, access to this field should be
-    //protected by this->mutex. 
-    ssize_t numOutstandingPrereqs; 
+    //Set when the Graph is frozen. 
+    Graph::NodeId id; 
+    Graph const* graph; 
+    StatCache * statCache; 
+    Signatures * signatures; //null when jjmake keeps no state
+    JobServer const* jobServer; 
+    WorkerPool * workerPool; 
+    Dispatcher * dispatcher; 
+    JjmakeContext * context; 
+    bool alwaysMake; 
 };
 
 } //namespace jjm
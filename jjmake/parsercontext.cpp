@@ -5,7 +5,9 @@
 #include "jbase/jfatal.hpp"
 #include "jbase/jstdint.hpp"
 #include "jbase/jinttostring.hpp"
+#include "josutils/jthreading.hpp"
 
+#include <atomic>
 #include <deque>
 #include <list>
 #include <memory>
@@ -803,6 +805,7 @@ jjm::ParserContext::ParserContext()
 {
     jjmakeContext = 0; 
     parent = 0; 
+    heldEffects = 0; 
 }
 
 jjm::ParserContext::~ParserContext()
@@ -818,9 +821,133 @@ jjm::ParserContext* jjm::ParserContext::newRoot(JjmakeContext * jjmakeContext_)
     return c;
 }
 
+class jjm::ParserContext::Effect
+{
+public:
+    enum Kind { NewNode, GoalWeight, Pool, GoalPool, WorkerTool, BuildFile, StdOut }; 
+
+    explicit Effect(Kind kind_) : kind(kind_), node(0), number(0), maxRequests(0) {}
+    ~Effect() { delete node; }
+
+    Kind const kind; 
+    Node * node; //ownership
+    //The build file which the effect is of, or which included buildFile. 
+    string currentBuildFile; 
+    //The goal, the pool, the worker tool, the build file or the output. 
+    string name; 
+    string alternateGoalName; 
+    string poolName; 
+    std::int64_t number; //weight, depth or max workers
+    std::int32_t maxRequests; 
+    vector<string> command; 
+
+private:
+    Effect(Effect const& ); //not defined, not copyable
+    Effect& operator= (Effect const& ); //not defined, not copyable
+}; 
+
+void jjm::ParserContext::perform(Effect * effect_)
+{
+    UniquePtr<Effect*> effect(effect_); 
+    if (heldEffects)
+    {   heldEffects->push_back(0); 
+        heldEffects->back() = effect.release(); 
+        return; 
+    }
+    Effect & e = * effect.get(); 
+    switch (e.kind)
+    {
+    case Effect::NewNode: 
+        {   Node * const node = e.node; 
+            e.node = 0; 
+            jjmakeContext->newNode(node, e.currentBuildFile); 
+        }
+        return; 
+    case Effect::GoalWeight: 
+        jjmakeContext->setGoalWeight(e.name, e.alternateGoalName, e.number, e.currentBuildFile); 
+        return; 
+    case Effect::Pool: 
+        jjmakeContext->declarePool(e.name, static_cast<std::int32_t>(e.number), e.currentBuildFile); 
+        return; 
+    case Effect::GoalPool: 
+        jjmakeContext->setGoalPool(e.name, e.alternateGoalName, e.poolName, e.currentBuildFile); 
+        return; 
+    case Effect::WorkerTool: 
+        jjmakeContext->declareWorkerTool(e.name, static_cast<std::int32_t>(e.number), e.maxRequests, e.command); 
+        return; 
+    case Effect::BuildFile: 
+        jjmakeContext->addBuildFile(e.name, e.currentBuildFile); 
+        return; 
+    case Effect::StdOut: 
+        jjmakeContext->toStdOut(e.name); 
+        return; 
+    }
+    JFATAL(e.kind, 0); 
+}
+
 void jjm::ParserContext::newNode(jjm::Node * node_)
 {
-    jjmakeContext->newNode(node_); 
+    UniquePtr<Node*> node(node_); 
+    UniquePtr<Effect*> effect(new Effect(Effect::NewNode)); 
+    effect.get()->currentBuildFile = getCurrentBuildFile(); 
+    effect.get()->node = node.release(); 
+    perform(effect.release()); 
+}
+
+void jjm::ParserContext::setGoalWeight(std::string const& goalName, std::string const& alternateGoalName, std::int64_t weight)
+{
+    UniquePtr<Effect*> effect(new Effect(Effect::GoalWeight)); 
+    effect.get()->currentBuildFile = getCurrentBuildFile(); 
+    effect.get()->name = goalName; 
+    effect.get()->alternateGoalName = alternateGoalName; 
+    effect.get()->number = weight; 
+    perform(effect.release()); 
+}
+
+void jjm::ParserContext::declarePool(std::string const& poolName, std::int32_t depth)
+{
+    UniquePtr<Effect*> effect(new Effect(Effect::Pool)); 
+    effect.get()->currentBuildFile = getCurrentBuildFile(); 
+    effect.get()->name = poolName; 
+    effect.get()->number = depth; 
+    perform(effect.release()); 
+}
+
+void jjm::ParserContext::setGoalPool(std::string const& goalName, std::string const& alternateGoalName, std::string const& poolName)
+{
+    UniquePtr<Effect*> effect(new Effect(Effect::GoalPool)); 
+    effect.get()->currentBuildFile = getCurrentBuildFile(); 
+    effect.get()->name = goalName; 
+    effect.get()->alternateGoalName = alternateGoalName; 
+    effect.get()->poolName = poolName; 
+    perform(effect.release()); 
+}
+
+void jjm::ParserContext::declareWorkerTool(std::string const& key, std::int32_t maxWorkers, std::int32_t maxRequests, 
+        std::vector<std::string> const& command)
+{
+    UniquePtr<Effect*> effect(new Effect(Effect::WorkerTool)); 
+    effect.get()->name = key; 
+    effect.get()->number = maxWorkers; 
+    effect.get()->maxRequests = maxRequests; 
+    effect.get()->command = command; 
+    perform(effect.release()); 
+}
+
+void jjm::ParserContext::addBuildFile(std::string const& buildFile)
+{
+    UniquePtr<Effect*> effect(new Effect(Effect::BuildFile)); 
+    effect.get()->currentBuildFile = getCurrentBuildFile(); 
+    effect.get()->name = buildFile; 
+    perform(effect.release()); 
+}
+
+std::string jjm::ParserContext::getCurrentBuildFile()
+{
+    Value const * file = getValue(".FILE"); 
+    if (file && file->value.size())
+        return file->value[0]; 
+    return string(); 
 }
 
 
@@ -833,6 +960,7 @@ jjm::ParserContext* jjm::ParserContext::split()
     if (variables.size() == 0 && parent)
     {   owned.push_back(0); 
         ParserContext * newChild = owned.back() = new ParserContext; 
+        newChild->jjmakeContext = jjmakeContext; 
         newChild->parent = parent; 
         return newChild; 
     }
@@ -842,6 +970,8 @@ jjm::ParserContext* jjm::ParserContext::split()
     owned.push_back(0); 
     ParserContext * newChild = owned.back() = new ParserContext; 
 
+    newParent->jjmakeContext = jjmakeContext; 
+    newChild->jjmakeContext = jjmakeContext; 
     newParent->parent = this->parent; 
     this->parent = newParent; 
     newChild->parent = newParent; 
@@ -852,6 +982,145 @@ jjm::ParserContext* jjm::ParserContext::split()
     return newChild; 
 }
 
+//The tasks of one runSplit(). It is deleted with its last reference, which 
+//is either runSplit() or a SplitRunnable still queued in the thread pool. 
+class jjm::ParserContext::SplitGroup
+{
+public:
+    class Slot
+    {
+    public:
+        Slot() : task(0), context(0), claimed(false), failed(false) {}
+        ~Slot() { for (size_t i = 0; i < effects.size(); ++i) delete effects[i]; }
+        SplitTask * task; 
+        ParserContext * context; 
+        std::atomic<bool> claimed; 
+        bool failed; 
+        string error; 
+        vector<Effect*> effects; //ownership
+    }; 
+
+    explicit SplitGroup(size_t numSlots) : numReferences(1), numUnfinished(numSlots) 
+    {   for (size_t i = 0; i < numSlots; ++i)
+        {   slots.push_back(0); 
+            slots.back() = new Slot; 
+        }
+    }
+    ~SplitGroup() { for (size_t i = 0; i < slots.size(); ++i) delete slots[i]; }
+
+    void addReference() { ++numReferences; }
+    void release()
+    {   if (--numReferences == 0)
+            delete this; 
+    }
+
+    //Runs the task, unless another thread has claimed it. 
+    void run(size_t index)
+    {   Slot & slot = * slots[index]; 
+        if (slot.claimed.exchange(true))
+            return; 
+        try
+        {   slot.task->run(slot.context); 
+        } catch (std::exception & e)
+        {   slot.failed = true; 
+            slot.error = e.what(); 
+        }
+        Lock lock(mutex); 
+        if (--numUnfinished == 0)
+            finished.notify_all(); 
+    }
+
+    void waitUntilFinished()
+    {   Lock lock(mutex); 
+        while (numUnfinished != 0)
+            wait(lock, finished); 
+    }
+
+    vector<Slot*> slots; //ownership
+
+private:
+    SplitGroup(SplitGroup const& ); //not defined, not copyable
+    SplitGroup& operator= (SplitGroup const& ); //not defined, not copyable
+
+    std::atomic<int> numReferences; 
+    Mutex mutex; 
+    CondVar finished; 
+    size_t numUnfinished; 
+}; 
+
+class jjm::ParserContext::SplitRunnable : public jjm::Thread::Runnable
+{
+public:
+    SplitRunnable(SplitGroup * group_, size_t index_) : group(group_), index(index_) { group->addReference(); }
+    ~SplitRunnable() { group->release(); }
+    virtual void run() { group->run(index); }
+private:
+    SplitRunnable(SplitRunnable const& ); //not defined, not copyable
+    SplitRunnable& operator= (SplitRunnable const& ); //not defined, not copyable
+    SplitGroup * const group; 
+    size_t const index; 
+}; 
+
+void jjm::ParserContext::runSplit(vector<SplitTask*> const& tasks)
+{
+    if (tasks.empty())
+        return; 
+    SplitGroup * const group = new SplitGroup(tasks.size()); 
+    struct Release
+    {   SplitGroup * g; 
+        Release(SplitGroup * g_) : g(g_) {}
+        ~Release() { g->release(); }
+    } release(group); 
+
+    for (size_t i = 0; i < tasks.size(); ++i)
+    {   SplitGroup::Slot & slot = * group->slots[i]; 
+        slot.task = tasks[i]; 
+        slot.context = split(); 
+        slot.context->heldEffects = & slot.effects; 
+    }
+
+    //The first task is left to this thread. A worker which dequeues a task 
+    //that this thread already ran does nothing. 
+    vector<Thread::Runnable*> runnables; 
+    struct Guard
+    {   vector<Thread::Runnable*> & v; 
+        Guard(vector<Thread::Runnable*> & v_) : v(v_) {}
+        ~Guard() { for (size_t i = 0; i < v.size(); ++i) delete v[i]; }
+    } guard(runnables); 
+    for (size_t i = 1; i < tasks.size(); ++i)
+    {   runnables.push_back(0); 
+        runnables.back() = new SplitRunnable(group, i); 
+    }
+    jjmakeContext->getThreadPool().addTasks(runnables); 
+
+    //This thread never waits for a task which has not started, so nested 
+    //calls cannot deadlock, even with one worker. 
+    for (size_t i = 0; i < tasks.size(); ++i)
+        group->run(i); 
+    group->waitUntilFinished(); 
+
+    for (size_t i = 0; i < tasks.size(); ++i)
+        group->slots[i]->context->heldEffects = 0; 
+    for (size_t i = 0; i < tasks.size(); ++i)
+    {   SplitGroup::Slot & slot = * group->slots[i]; 
+        for (size_t k = 0; k < slot.effects.size(); ++k)
+        {   string const buildFile = slot.effects[k]->currentBuildFile; 
+            Effect * const effect = slot.effects[k]; 
+            slot.effects[k] = 0; 
+            try
+            {   perform(effect); 
+            } catch (std::exception & e)
+            {   //Such as a node of the same name as a node of a task before. 
+                if (buildFile.empty())
+                    throw; 
+                throw std::runtime_error("Evaluation failure at file \"" + buildFile + "\". Cause:\n" + e.what()); 
+            }
+        }
+        if (slot.failed)
+            throw std::runtime_error(slot.error); 
+    }
+}
+
 vector<string> jjm::ParserContext::eval(string const& text)
 {
     Evaluator evaluator(this); 
@@ -898,5 +1167,11 @@ void jjm::ParserContext::setValue(string const& name, vector<string> const& valu
 
 void jjm::ParserContext::toStdOut(Utf8String const& str)
 {
-    jjmakeContext->toStdOut(str); 
+    if (heldEffects == 0)
+    {   jjmakeContext->toStdOut(str); 
+        return; 
+    }
+    UniquePtr<Effect*> effect(new Effect(Effect::StdOut)); 
+    effect.get()->name = str; 
+    perform(effect.release()); 
 }
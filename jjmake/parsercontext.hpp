@@ -6,6 +6,7 @@
 #ifndef JJMAKE_PARSERCONTEXT_HPP_HEADER_GUARD
 #define JJMAKE_PARSERCONTEXT_HPP_HEADER_GUARD
 
+#include "jbase/jstdint.hpp"
 #include "junicode/jutfstring.hpp"
 
 #include <map>
@@ -39,6 +40,27 @@ public:
     //all of these created ParserContexts. 
     ParserContext* split(); 
 
+    class SplitTask
+    {
+    public:
+        virtual ~SplitTask() {}
+        virtual void run(ParserContext * c) = 0; 
+    }; 
+
+    //Runs every task in a context of its own, split from this one, on the 
+    //thread pool of the JjmakeContext, and returns once all of them are 
+    //done. The calling thread runs the tasks which no worker has started. 
+    //
+    //The nodes, goal weights, pools, worker tools, build files and output 
+    //of the tasks are held back, and then passed on in the order of the 
+    //tasks, so that the graph and the output are those of running the tasks 
+    //one after another. When tasks throw, the exception of the first one is 
+    //rethrown, as std::runtime_error, after what it and the tasks before it 
+    //did, and what the tasks after it did is dropped. The variables which a 
+    //task sets are not seen by this context or by the other tasks. 
+    //Does not take ownership of the tasks. 
+    void runSplit(std::vector<SplitTask*> const& tasks); 
+
 public:
     class Value
     {
@@ -78,8 +100,21 @@ public:
     static void registerNativeFunction(std::string const& name, NativeFunction* nativeFunction); 
 
     //always takes ownership 
+    //The node is attributed to the build file named by ".FILE". 
     void newNode(jjm::Node * node); 
 
+    void setGoalWeight(std::string const& goalName, std::string const& alternateGoalName, std::int64_t weight); 
+
+    void declarePool(std::string const& poolName, std::int32_t depth); 
+    void setGoalPool(std::string const& goalName, std::string const& alternateGoalName, std::string const& poolName); 
+
+    void declareWorkerTool(std::string const& key, std::int32_t maxWorkers, std::int32_t maxRequests, 
+            std::vector<std::string> const& command); 
+
+    //Records that the build file is being included by the build file named 
+    //by ".FILE". 
+    void addBuildFile(std::string const& buildFile); 
+
     void toStdOut(Utf8String const& str); 
 
 private:
@@ -88,10 +123,22 @@ private:
 
     ParserContext(); 
 
+    std::string getCurrentBuildFile(); 
+
+    //An effect on the JjmakeContext, such as a new node. 
+    class Effect; 
+    class SplitGroup; 
+    class SplitRunnable; 
+
+    //Always takes ownership. Passes the effect on to the JjmakeContext, or 
+    //holds it back while this context runs a task of runSplit(). 
+    void perform(Effect * effect); 
+
     JjmakeContext * jjmakeContext; 
     ParserContext* parent; 
     std::vector<ParserContext*> owned; 
     std::map<std::string, Value> variables; 
+    std::vector<Effect*> * heldEffects; //not ownership, null unless held back
 
     class Evaluator; 
 
@@ -0,0 +1,416 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "remotecache.hpp"
+
+#include "transfer.hpp"
+#include "jbase/jinttostring.hpp"
+#include "jbase/juniqueptr.hpp"
+#include "josutils/jclock.hpp"
+#include "josutils/jfilehandle.hpp"
+#include "josutils/jfilesystem.hpp"
+#include "josutils/jopen.hpp"
+#include "josutils/jstat.hpp"
+
+#include <iostream>
+#include <stdexcept>
+#include <string.h>
+
+using namespace jjm; 
+using namespace std; 
+
+namespace
+{
+    char const magic[4] = { 'J', 'J', 'C', '1' }; 
+    std::uint32_t const getOperation = 1; 
+    std::uint32_t const putOperation = 2; 
+    std::uint32_t const maxFiles = 64 * 1024; 
+
+    //A client which sends nothing for this long is disconnected. 
+    std::int64_t const idleTimeoutNanoSec = std::int64_t(10) * 60 * 1000 * 1000 * 1000; 
+    std::int64_t const trimIntervalNanoSec = std::int64_t(10) * 1000 * 1000 * 1000; 
+
+    string makeRequest(std::uint32_t operation, std::uint64_t key)
+    {   string out(magic, 4); 
+        appendUint32(out, operation); 
+        appendUint64(out, key); 
+        return out; 
+    }
+
+    void removeFiles(vector<Path> const& paths)
+    {   for (size_t i = 0; i < paths.size(); ++i)
+        {   try
+            {   removeFile(paths[i]); 
+            }catch (std::exception & )
+            {
+            }
+        }
+    }
+
+    //Closes the files at the end of the scope. 
+    class FileHandles
+    {
+    public:
+        FileHandles() {}
+        ~FileHandles() 
+        {   for (size_t i = 0; i < files.size(); ++i)
+                files[i].close2(); 
+        }
+        vector<FileHandle> files; 
+    private:
+        FileHandles(FileHandles const& ); //not defined, not copyable
+        FileHandles& operator= (FileHandles const& ); //not defined, not copyable
+    }; 
+}
+
+
+//Keeps trim() from running while a request uses the cache. 
+class jjm::CacheServer::CacheUse
+{
+public:
+    CacheUse(CacheServer * server_) : server(server_)
+    {   Lock lock(server->mutex); 
+        while (server->trimming)
+            wait(lock, server->condition); 
+        ++server->numUsingCache; 
+    }
+    ~CacheUse()
+    {   Lock lock(server->mutex); 
+        --server->numUsingCache; 
+        server->condition.notify_all(); 
+    }
+private:
+    CacheServer * server; 
+}; 
+
+class jjm::CacheServer::ConnectionMain
+{
+public:
+    ConnectionMain(CacheServer * server_, Socket * socket_) : server(server_), socket(socket_) {}
+    void operator() () { server->serveConnection(socket); }
+private:
+    CacheServer * server; 
+    Socket * socket; 
+}; 
+
+jjm::CacheServer::CacheServer()
+    : stopped(false), numUsingCache(0), trimming(false), lastTrimNanoSec(0), numIncomingFiles(0)
+{}
+
+jjm::CacheServer::~CacheServer()
+{
+    stop(); 
+}
+
+void jjm::CacheServer::open(Path const& dir, std::int64_t maxBytes, std::string const& address)
+{
+    cache.open(dir, maxBytes); 
+    incomingDir = Path::join(dir, Path("incoming")); 
+    createDirectories(incomingDir); 
+    vector<string> const leftovers = listDirectory(incomingDir); 
+    for (size_t i = 0; i < leftovers.size(); ++i)
+        removeFile(Path::join(incomingDir, Path(leftovers[i]))); 
+    listener.listen(address); 
+    lastTrimNanoSec = getMonotonicClockNanoSec(); 
+}
+
+void jjm::CacheServer::run()
+{
+    for (;;)
+    {   UniquePtr<Socket*> socket(new Socket); 
+        if ( ! listener.accept( * socket.get()))
+            return; 
+        Lock lock(mutex); 
+        if (stopped)
+            return; 
+        connections.insert(socket.get()); 
+        try
+        {   Thread thread(ConnectionMain(this, socket.get()), Thread::DetachInDtor); 
+        }catch (...)
+        {   connections.erase(socket.get()); 
+            throw; 
+        }
+        socket.release(); 
+    }
+}
+
+void jjm::CacheServer::stop()
+{
+    listener.stop(); 
+    Lock lock(mutex); 
+    stopped = true; 
+    for (set<Socket*>::iterator s = connections.begin(); s != connections.end(); ++s)
+        (*s)->shutdown(); 
+    while ( ! connections.empty())
+        wait(lock, condition); 
+}
+
+void jjm::CacheServer::serveConnection(Socket * socket)
+{
+    try
+    {   while (serveRequest( * socket))
+            ; 
+    }catch (std::exception & e)
+    {   Lock lock(mutex); 
+        if ( ! stopped)
+            cerr << "[jjmake] Cache server: Closed a connection. Cause:\n" << e.what() << endl; 
+    }
+    Lock lock(mutex); 
+    connections.erase(socket); 
+    delete socket; 
+    condition.notify_all(); 
+}
+
+bool jjm::CacheServer::serveRequest(Socket & socket)
+{
+    socket.setDeadline(getMonotonicClockNanoSec() + idleTimeoutNanoSec); 
+    unsigned char header[16]; 
+    if ( ! socket.readCompleteOrEof(header, sizeof(header)))
+        return false; 
+    if (0 != memcmp(header, magic, 4))
+        throw std::runtime_error("jjm::CacheServer::serveRequest() failed. Cause:\nThe client does not speak the protocol."); 
+    std::uint32_t const operation = static_cast<std::uint32_t>(getUint(header + 4, 4)); 
+    std::uint64_t const key = getUint(header + 8, 8); 
+    if (operation == getOperation)
+        serveGet(socket, key); 
+    else if (operation == putOperation)
+        servePut(socket, key); 
+    else
+        throw std::runtime_error("jjm::CacheServer::serveRequest() failed. Cause:\nUnknown operation " + toDecStr(operation) + "."); 
+    return true; 
+}
+
+void jjm::CacheServer::serveGet(Socket & socket, std::uint64_t key)
+{
+    //Open files outlive an eviction. 
+    FileHandles blobs; 
+    vector<std::uint64_t> sizes; 
+    {   CacheUse use(this); 
+        vector<Path> blobPaths; 
+        if (cache.lookup(key, blobPaths))
+        {   try
+            {   for (size_t i = 0; i < blobPaths.size(); ++i)
+                {   blobs.files.push_back(FileOpener().openExistingOnly().readOnly().open(blobPaths[i])); 
+                    Stat const st = Stat::get2(blobs.files.back()); 
+                    if (st.type != FileType::RegularFile)
+                        throw std::runtime_error("Not a regular file."); 
+                    sizes.push_back(st.sizeBytes); 
+                }
+            }catch (std::exception & )
+            {   sizes.clear(); //evicted meanwhile 
+            }
+        }
+    }
+    bool const found = sizes.size() == blobs.files.size() && ! sizes.empty(); 
+    writeUint32(socket, found ? 1 : 0); 
+    if ( ! found)
+        return; 
+    writeUint32(socket, static_cast<std::uint32_t>(sizes.size())); 
+    for (size_t i = 0; i < sizes.size(); ++i)
+    {   string size; 
+        appendUint64(size, sizes[i]); 
+        socket.writeComplete(size.data(), size.size()); 
+        sendFileChunks(socket, blobs.files[i], sizes[i]); 
+    }
+}
+
+void jjm::CacheServer::servePut(Socket & socket, std::uint64_t key)
+{
+    bool const wanted = ! cache.isStored(key); 
+    writeUint32(socket, wanted ? 1 : 0); 
+    if ( ! wanted)
+        return; 
+    std::uint32_t const numFiles = readUint32(socket); 
+    if (numFiles == 0 || numFiles > maxFiles)
+        throw std::runtime_error("jjm::CacheServer::servePut() failed. Cause:\nInvalid number of files " + toDecStr(numFiles) + "."); 
+
+    std::int64_t firstFile = 0; 
+    {   Lock lock(mutex); 
+        firstFile = numIncomingFiles; 
+        numIncomingFiles += numFiles; 
+    }
+    vector<Path> files; 
+    vector<std::uint64_t> hashes; 
+    try
+    {   for (std::uint32_t i = 0; i < numFiles; ++i)
+        {   hashes.push_back(readUint64(socket)); 
+            std::uint64_t const size = readUint64(socket); 
+            files.push_back(Path::join(incomingDir, Path(toDecStr(firstFile + i)))); 
+            FileHandleOwner file(FileOpener().createOrOpen().truncate().writeOnly().open(files.back())); 
+            receiveFileChunks(socket, file.get(), size); 
+        }
+    }catch (...)
+    {   removeFiles(files); 
+        throw; 
+    }
+
+    bool stored = false; 
+    try
+    {   CacheUse use(this); 
+        cache.store(key, files, hashes); 
+        stored = true; 
+    }catch (std::exception & e)
+    {   Lock lock(mutex); 
+        cerr << "[jjmake] Cache server: Failed to store a put. Cause:\n" << e.what() << endl; 
+    }
+    removeFiles(files); 
+    writeUint32(socket, stored ? 1 : 0); 
+    if (stored)
+        maybeTrim(); 
+}
+
+void jjm::CacheServer::maybeTrim()
+{
+    Lock lock(mutex); 
+    if (trimming || getMonotonicClockNanoSec() - lastTrimNanoSec < trimIntervalNanoSec)
+        return; 
+    trimming = true; 
+    while (numUsingCache > 0)
+        wait(lock, condition); 
+    try
+    {   ReverseLock unlock(lock); 
+        cache.trim(); 
+    }catch (std::exception & e)
+    {   cerr << "[jjmake] Cache server: Failed to trim the cache. Cause:\n" << e.what() << endl; 
+    }
+    trimming = false; 
+    lastTrimNanoSec = getMonotonicClockNanoSec(); 
+    condition.notify_all(); 
+}
+
+
+jjm::RemoteCache::RemoteCache()
+    : timeoutNanoSec(0), disabled(false), numHits(0), numMisses(0), numUploaded(0)
+{}
+
+jjm::RemoteCache::~RemoteCache()
+{
+    for (size_t i = 0; i < idleConnections.size(); ++i)
+        delete idleConnections[i]; 
+}
+
+void jjm::RemoteCache::open(std::string const& address_, std::int64_t timeoutNanoSec_)
+{
+    address = address_; 
+    timeoutNanoSec = timeoutNanoSec_; 
+}
+
+jjm::Socket * jjm::RemoteCache::takeConnection(std::int64_t deadlineNanoSec)
+{
+    UniquePtr<Socket*> socket; 
+    {   Lock lock(mutex); 
+        if ( ! idleConnections.empty())
+        {   socket.reset(idleConnections.back()); 
+            idleConnections.pop_back(); 
+        }
+    }
+    if ( ! socket.get())
+    {   socket.reset(new Socket); 
+        socket.get()->setDeadline(deadlineNanoSec); 
+        socket.get()->connect(address); 
+    }
+    socket.get()->setDeadline(deadlineNanoSec); 
+    return socket.release(); 
+}
+
+void jjm::RemoteCache::returnConnection(Socket * socket)
+{
+    Lock lock(mutex); 
+    idleConnections.push_back(socket); 
+}
+
+void jjm::RemoteCache::fail(char const * function, std::exception const& cause)
+{
+    if ( ! disabled.exchange(true))
+        throw std::runtime_error(string() + function + " failed for the cache server \"" + address + "\". Cause:\n" + cause.what()); 
+}
+
+bool jjm::RemoteCache::fetch(std::uint64_t key, std::vector<Path> const& outputs)
+{
+    if (disabled)
+        return false; 
+    vector<Path> downloads; 
+    try
+    {   //A broken connection is dropped, as its position in the protocol is
+        //unknown. 
+        UniquePtr<Socket*> socket(takeConnection(getMonotonicClockNanoSec() + timeoutNanoSec)); 
+        string const request = makeRequest(getOperation, key); 
+        socket.get()->writeComplete(request.data(), request.size()); 
+        if (readUint32( * socket.get()) == 0)
+        {   returnConnection(socket.release()); 
+            ++numMisses; 
+            return false; 
+        }
+        std::uint32_t const numFiles = readUint32( * socket.get()); 
+        if (numFiles != outputs.size())
+            throw std::runtime_error("The server sent " + toDecStr(numFiles) + " files for " + toDecStr(outputs.size()) + " outputs."); 
+        for (size_t i = 0; i < outputs.size(); ++i)
+        {   std::uint64_t const size = readUint64( * socket.get()); 
+            downloads.push_back(Path(outputs[i].getStringRep() + ".jjmake-download")); 
+            createDirectories(outputs[i].getParent()); 
+            FileHandleOwner file(FileOpener().createOrOpen().truncate().writeOnly().open(downloads.back())); 
+            receiveFileChunks( * socket.get(), file.get(), size); 
+            if (0 != file.release().close2())
+                throw std::runtime_error("Closing \"" + downloads.back().getStringRep() + "\" failed."); 
+        }
+        returnConnection(socket.release()); 
+        for (size_t i = 0; i < outputs.size(); ++i)
+            renameFile(downloads[i], outputs[i]); 
+    }catch (std::exception & e)
+    {   removeFiles(downloads); 
+        fail("jjm::RemoteCache::fetch()", e); 
+        return false; 
+    }
+    ++numHits; 
+    return true; 
+}
+
+void jjm::RemoteCache::upload(std::uint64_t key, std::vector<Path> const& outputs, std::vector<std::uint64_t> const& contentHashes)
+{
+    if (disabled)
+        return; 
+    if (outputs.size() != contentHashes.size())
+        throw std::runtime_error("jjm::RemoteCache::upload() failed. Cause:\nThe number of content hashes does not match the number of outputs."); 
+
+    //Only regular files are kept, as in the local cache. 
+    FileHandles files; 
+    vector<std::uint64_t> sizes; 
+    try
+    {   for (size_t i = 0; i < outputs.size(); ++i)
+        {   files.files.push_back(FileOpener().openExistingOnly().readOnly().open(outputs[i])); 
+            Stat const st = Stat::get2(files.files.back()); 
+            if (st.type != FileType::RegularFile)
+                return; 
+            sizes.push_back(st.sizeBytes); 
+        }
+    }catch (std::exception & )
+    {   return; 
+    }
+
+    try
+    {   UniquePtr<Socket*> socket(takeConnection(getMonotonicClockNanoSec() + timeoutNanoSec)); 
+        string const request = makeRequest(putOperation, key); 
+        socket.get()->writeComplete(request.data(), request.size()); 
+        if (readUint32( * socket.get()) == 0)
+        {   returnConnection(socket.release()); 
+            return; 
+        }
+        string header; 
+        appendUint32(header, static_cast<std::uint32_t>(outputs.size())); 
+        socket.get()->writeComplete(header.data(), header.size()); 
+        for (size_t i = 0; i < outputs.size(); ++i)
+        {   header.clear(); 
+            appendUint64(header, contentHashes[i]); 
+            appendUint64(header, sizes[i]); 
+            socket.get()->writeComplete(header.data(), header.size()); 
+            sendFileChunks( * socket.get(), files.files[i], sizes[i]); 
+        }
+        if (readUint32( * socket.get()) != 0)
+            ++numUploaded; 
+        returnConnection(socket.release()); 
+    }catch (std::exception & e)
+    {   fail("jjm::RemoteCache::upload()", e); 
+    }
+}
@@ -0,0 +1,151 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#ifndef JJMAKE_REMOTECACHE_HPP_HEADER_GUARD
+#define JJMAKE_REMOTECACHE_HPP_HEADER_GUARD
+
+#include "actioncache.hpp"
+#include "jbase/jstdint.hpp"
+#include "josutils/jpath.hpp"
+#include "josutils/jsocket.hpp"
+#include "josutils/jthreading.hpp"
+
+#include <atomic>
+#include <exception>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace jjm
+{
+
+/* A cache of goal outputs which several build hosts share. The cache server,
+"jjmake --cache-server", keeps an ActionCache in its state directory, and 
+RemoteCache is its client in a build, which asks the server for the outputs
+of an out of date goal before executing it, and uploads the outputs after 
+executing it. Both use the action keys of Signatures::getActionKey(). 
+
+The protocol, over TCP or a Unix domain socket, in the framing of 
+transfer.hpp. A connection carries any number of requests, one after 
+another. 
+    request:  "JJC1", then the operation (4 bytes), then the key (8 bytes). 
+    get (1):  reply found (4 bytes, 0 or 1). When found, the number of files
+              (4 bytes), then per file its size (8 bytes) and its chunks. 
+    put (2):  reply wanted (4 bytes, 0 when the key is already stored). When
+              wanted, the number of files (4 bytes), then per file its 
+              content hash (8 bytes), its size (8 bytes) and its chunks, and
+              then reply stored (4 bytes, 0 or 1). */
+class CacheServer
+{
+public:
+    CacheServer(); 
+
+    //Stops, as stop(). 
+    ~CacheServer(); 
+
+    //Opens the cache in the directory, and listens on the address of 
+    //jjm::Socket. 
+    //Throws std::exception on errors. 
+    void open(Path const& dir, std::int64_t maxBytes, std::string const& address); 
+
+    //The address listened on, with the port that was picked for port 0. 
+    std::string const& getAddress() const { return listener.getAddress(); }
+
+    //Serves every connection on a thread of its own, until stop(). 
+    //Throws std::exception on errors. 
+    void run(); 
+
+    //Makes run() return, closes every connection, and waits for their 
+    //threads. It is safe to call concurrently with run(). 
+    void stop(); 
+
+    ActionCache const& getActionCache() const { return cache; }
+
+private:
+    CacheServer(CacheServer const& ); //not defined, not copyable
+    CacheServer& operator= (CacheServer const& ); //not defined, not copyable
+
+    class ConnectionMain; 
+    class CacheUse; 
+
+    void serveConnection(Socket * socket); 
+    //Returns false when the client closed the connection. 
+    bool serveRequest(Socket & socket); 
+    void serveGet(Socket & socket, std::uint64_t key); 
+    void servePut(Socket & socket, std::uint64_t key); 
+    //Trims the cache at most every 10 seconds, once no request uses it. 
+    void maybeTrim(); 
+
+    ActionCache cache; 
+    Path incomingDir; 
+    ListeningSocket listener; 
+
+    Mutex mutex; 
+    CondVar condition; 
+    bool stopped; 
+    std::set<Socket*> connections; 
+    int numUsingCache; 
+    bool trimming; 
+    std::int64_t lastTrimNanoSec; 
+    std::int64_t numIncomingFiles; 
+}; 
+
+
+/* The client of a CacheServer. Connections are kept open between requests,
+and each request, from connecting to its last byte, fails once the timeout 
+passes, so that a slow server holds up a goal for no longer than the 
+timeout. After the first failure, the server is not used again, and the 
+build goes on with the local cache alone. */
+class RemoteCache
+{
+public:
+    RemoteCache(); 
+    ~RemoteCache(); 
+
+    void open(std::string const& address, std::int64_t timeoutNanoSec); 
+    bool isOpen() const { return ! address.empty(); }
+
+    //On a hit, replaces the outputs with the files kept by the server, and
+    //returns true. Returns false on a miss, and once the server is no 
+    //longer used. 
+    //Throws std::exception on the failure which stops the use of the 
+    //server, and leaves the outputs as they were. 
+    //It is safe to call concurrently. 
+    bool fetch(std::uint64_t key, std::vector<Path> const& outputs); 
+
+    //Uploads the outputs, which are regular files with the given content
+    //hashes, unless the server has the key already. 
+    //Throws as fetch(). 
+    //It is safe to call concurrently. 
+    void upload(std::uint64_t key, std::vector<Path> const& outputs, std::vector<std::uint64_t> const& contentHashes); 
+
+    std::int64_t getNumHits() const { return numHits; }
+    std::int64_t getNumMisses() const { return numMisses; }
+    std::int64_t getNumUploaded() const { return numUploaded; }
+    bool isDisabled() const { return disabled; }
+
+private:
+    RemoteCache(RemoteCache const& ); //not defined, not copyable
+    RemoteCache& operator= (RemoteCache const& ); //not defined, not copyable
+
+    //Returns an idle connection, or a new one. 
+    Socket * takeConnection(std::int64_t deadlineNanoSec); 
+    void returnConnection(Socket * socket); 
+    //Throws on the first failure, and returns on every later one. 
+    void fail(char const * function, std::exception const& cause); 
+
+    std::string address; 
+    std::int64_t timeoutNanoSec; 
+    Mutex mutex; 
+    std::vector<Socket*> idleConnections; //ownership
+    std::atomic<bool> disabled; 
+    std::atomic<std::int64_t> numHits; 
+    std::atomic<std::int64_t> numMisses; 
+    std::atomic<std::int64_t> numUploaded; 
+}; 
+
+} //namespace jjm
+
+#endif
@@ -0,0 +1,793 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "remoteexec.hpp"
+
+#include "transfer.hpp"
+#include "jbase/jhash.hpp"
+#include "jbase/jinttostring.hpp"
+#include "jbase/juniqueptr.hpp"
+#include "josutils/jclock.hpp"
+#include "josutils/jfilehandle.hpp"
+#include "josutils/jfilesystem.hpp"
+#include "josutils/jmmap.hpp"
+#include "josutils/jopen.hpp"
+#include "josutils/jprocess.hpp"
+#include "josutils/jstat.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string.h>
+
+using namespace jjm; 
+using namespace std; 
+
+namespace
+{
+    char const magic[4] = { 'J', 'J', 'W', '1' }; 
+    std::uint32_t const execOperation = 1; 
+    std::uint32_t const maxSlots = 4096; 
+    std::uint32_t const maxItems = 64 * 1024; 
+    std::uint32_t const maxStringBytes = 1024 * 1024; 
+    std::uint32_t const maxOutputBytes = 64 * 1024 * 1024; 
+
+    //A client which stops in the middle of a command for this long is 
+    //disconnected. Between commands, a client may keep its connection idle 
+    //for as long as it likes. 
+    std::int64_t const commandTimeoutNanoSec = std::int64_t(10) * 60 * 1000 * 1000 * 1000; 
+
+    //The first guesses, until commands were sent and executed. 
+    double const initialBytesPerSecond = 100.0 * 1000 * 1000; 
+    double const initialAverageMillis = 1000; 
+
+    string getBlobName(std::uint64_t contentHash, std::uint64_t sizeBytes)
+    {   return toHexStr(contentHash) + "-" + toDecStr(sizeBytes); 
+    }
+
+    //Reads an absolute path without ".." components, which cannot leave the 
+    //sandbox. 
+    Path readPath(Socket & socket)
+    {   string const x = readString(socket, maxStringBytes); 
+        Path const path(x); 
+        bool dotDot = false; 
+        for (size_t start = 0; start <= x.size(); )
+        {   size_t end = x.find_first_of("/\\", start); 
+            if (end == string::npos)
+                end = x.size(); 
+            if (x.compare(start, end - start, "..") == 0)
+                dotDot = true; 
+            start = end + 1; 
+        }
+        if ( ! path.isAbsolute() || dotDot)
+            throw std::runtime_error("Received the path \"" + x + "\", which is not absolute, or has \"..\"."); 
+        return path; 
+    }
+
+    Path inSandbox(Path const& sandbox, Path const& path)
+    {   return Path(sandbox.getStringRep() + path.getStringRep()); 
+    }
+
+    void removeTree(Path const& path)
+    {   Stat const st = Stat::lstat2(path); 
+        if (st.type == FileType::NoExist)
+            return; 
+        if (st.type != FileType::Directory)
+        {   removeFile(path); 
+            return; 
+        }
+        vector<string> const names = listDirectory(path); 
+        for (size_t i = 0; i < names.size(); ++i)
+            removeTree(Path::join(path, Path(names[i]))); 
+        removeDirectory(path); 
+    }
+
+    void removeFiles(vector<Path> const& paths)
+    {   for (size_t i = 0; i < paths.size(); ++i)
+        {   try
+            {   removeFile(paths[i]); 
+            }catch (std::exception & )
+            {
+            }
+        }
+    }
+
+    std::uint32_t readCount(Socket & socket, std::uint32_t maxCount)
+    {   std::uint32_t const n = readUint32(socket); 
+        if (n > maxCount)
+            throw std::runtime_error("Received the count " + toDecStr(n) + ", which is above the limit " + toDecStr(maxCount) + "."); 
+        return n; 
+    }
+
+    class ByLastUse
+    {
+    public:
+        bool operator() (pair<std::int64_t, string> const& a, pair<std::int64_t, string> const& b) const { return a.first < b.first; }
+    }; 
+}
+
+jjm::ExecResult jjm::executeLocally(ExecCommand const& command)
+{
+    if (command.args.empty())
+        throw std::runtime_error("jjm::executeLocally() failed. Cause:\nThe command is empty."); 
+    ProcessBuilder pb; 
+    for (size_t i = 0; i < command.args.size(); ++i)
+        pb.arg(command.args[i]); 
+    pb.dir(command.dir).pipeOut().errToOut(); 
+    if (command.jobServer)
+        pb.jobServer(*command.jobServer); 
+    SyncExec exec(pb); 
+    ExecResult result; 
+    result.exitcode = exec.exitcode; 
+    result.output = exec.out; 
+    return result; 
+}
+
+
+class jjm::RemoteWorker::ConnectionMain
+{
+public:
+    ConnectionMain(RemoteWorker * worker_, Socket * socket_) : worker(worker_), socket(socket_) {}
+    void operator() () { worker->serveConnection(socket); }
+private:
+    RemoteWorker * worker; 
+    Socket * socket; 
+}; 
+
+jjm::RemoteWorker::RemoteWorker()
+    : maxBytes(0), numSlots(0), stopped(false), totalBlobBytes(0), useCounter(0), numRunning(0),
+    numIncomingFiles(0), numSandboxes(0), numExecuted(0)
+{}
+
+jjm::RemoteWorker::~RemoteWorker()
+{
+    stop(); 
+}
+
+void jjm::RemoteWorker::open(Path const& dir, std::int64_t maxBytes_, std::int32_t numSlots_, std::string const& address)
+{
+    if (numSlots_ < 1 || static_cast<std::uint32_t>(numSlots_) > maxSlots)
+        throw std::runtime_error("jjm::RemoteWorker::open() failed. Cause:\nInvalid number of slots " + toDecStr(numSlots_) + "."); 
+    blobsDir = Path::join(dir, Path("blobs")); 
+    incomingDir = Path::join(dir, Path("incoming")); 
+    sandboxesDir = Path::join(dir, Path("sandboxes")); 
+    createDirectories(blobsDir); 
+    removeTree(incomingDir); 
+    removeTree(sandboxesDir); 
+    createDirectories(incomingDir); 
+    createDirectories(sandboxesDir); 
+
+    //The blobs kept by an earlier run are used in the order of their last 
+    //write times, before every blob used since. 
+    vector<pair<std::int64_t, string> > kept; 
+    vector<string> const names = listDirectory(blobsDir); 
+    for (size_t i = 0; i < names.size(); ++i)
+    {   Stat const st = Stat::stat2(Path::join(blobsDir, Path(names[i]))); 
+        if (st.type != FileType::RegularFile)
+            continue; 
+        kept.push_back(make_pair(st.lastWriteTimeNanoSec, names[i])); 
+        blobs[names[i]].sizeBytes = st.sizeBytes; 
+        totalBlobBytes += st.sizeBytes; 
+    }
+    std::sort(kept.begin(), kept.end(), ByLastUse()); 
+    for (size_t i = 0; i < kept.size(); ++i)
+        blobs[kept[i].second].lastUse = static_cast<std::int64_t>(i) - static_cast<std::int64_t>(kept.size()); 
+
+    maxBytes = maxBytes_; 
+    numSlots = numSlots_; 
+    listener.listen(address); 
+}
+
+void jjm::RemoteWorker::run()
+{
+    for (;;)
+    {   UniquePtr<Socket*> socket(new Socket); 
+        if ( ! listener.accept( * socket.get()))
+            return; 
+        Lock lock(mutex); 
+        if (stopped)
+            return; 
+        connections.insert(socket.get()); 
+        try
+        {   Thread thread(ConnectionMain(this, socket.get()), Thread::DetachInDtor); 
+        }catch (...)
+        {   connections.erase(socket.get()); 
+            throw; 
+        }
+        socket.release(); 
+    }
+}
+
+void jjm::RemoteWorker::stop()
+{
+    listener.stop(); 
+    Lock lock(mutex); 
+    stopped = true; 
+    condition.notify_all(); 
+    for (set<Socket*>::iterator s = connections.begin(); s != connections.end(); ++s)
+        (*s)->shutdown(); 
+    while ( ! connections.empty())
+        wait(lock, condition); 
+}
+
+void jjm::RemoteWorker::serveConnection(Socket * socket)
+{
+    try
+    {   unsigned char hello[4]; 
+        socket->setDeadline(getMonotonicClockNanoSec() + commandTimeoutNanoSec); 
+        if (socket->readCompleteOrEof(hello, sizeof(hello)))
+        {   if (0 != memcmp(hello, magic, 4))
+                throw std::runtime_error("jjm::RemoteWorker::serveConnection() failed. Cause:\nThe client does not speak the protocol."); 
+            writeUint32( * socket, static_cast<std::uint32_t>(numSlots)); 
+            while (serveCommand( * socket))
+                ; 
+        }
+    }catch (std::exception & e)
+    {   Lock lock(mutex); 
+        if ( ! stopped)
+            cerr << "[jjmake] Remote worker: Closed a connection. Cause:\n" << e.what() << endl; 
+    }
+    Lock lock(mutex); 
+    connections.erase(socket); 
+    delete socket; 
+    condition.notify_all(); 
+}
+
+bool jjm::RemoteWorker::serveCommand(Socket & socket)
+{
+    socket.setDeadline(0); 
+    unsigned char header[4]; 
+    if ( ! socket.readCompleteOrEof(header, sizeof(header)))
+        return false; 
+    socket.setDeadline(getMonotonicClockNanoSec() + commandTimeoutNanoSec); 
+    std::uint32_t const operation = static_cast<std::uint32_t>(getUint(header, 4)); 
+    if (operation != execOperation)
+        throw std::runtime_error("jjm::RemoteWorker::serveCommand() failed. Cause:\nUnknown operation " + toDecStr(operation) + "."); 
+
+    Path const dir = readPath(socket); 
+    vector<string> args(readCount(socket, maxItems)); 
+    if (args.empty())
+        throw std::runtime_error("jjm::RemoteWorker::serveCommand() failed. Cause:\nReceived an empty command."); 
+    for (size_t i = 0; i < args.size(); ++i)
+        args[i] = readString(socket, maxStringBytes); 
+    vector<Path> inputs(readCount(socket, maxItems)); 
+    vector<std::uint64_t> hashes(inputs.size()); 
+    vector<std::uint64_t> sizes(inputs.size()); 
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {   inputs[i] = readPath(socket); 
+        hashes[i] = readUint64(socket); 
+        sizes[i] = readUint64(socket); 
+    }
+    vector<Path> outputs(readCount(socket, maxItems)); 
+    for (size_t i = 0; i < outputs.size(); ++i)
+        outputs[i] = readPath(socket); 
+
+    //Every blob of the command is used once, however many inputs share it, 
+    //and a used blob is not trimmed. 
+    vector<string> names(inputs.size()); 
+    vector<string> used; 
+    vector<std::uint32_t> missing; 
+    {   Lock lock(mutex); 
+        set<string> seen; 
+        for (size_t i = 0; i < inputs.size(); ++i)
+        {   names[i] = getBlobName(hashes[i], sizes[i]); 
+            if ( ! seen.insert(names[i]).second)
+                continue; 
+            map<string, Blob>::iterator blob = blobs.find(names[i]); 
+            if (blob == blobs.end())
+            {   missing.push_back(static_cast<std::uint32_t>(i)); 
+                continue; 
+            }
+            ++blob->second.numUsers; 
+            blob->second.lastUse = ++useCounter; 
+            used.push_back(names[i]); 
+        }
+    }
+
+    Path sandbox; 
+    ExecResult result; 
+    try
+    {   string reply; 
+        appendUint32(reply, static_cast<std::uint32_t>(missing.size())); 
+        for (size_t i = 0; i < missing.size(); ++i)
+            appendUint32(reply, missing[i]); 
+        socket.writeComplete(reply.data(), reply.size()); 
+        for (size_t i = 0; i < missing.size(); ++i)
+        {   std::uint32_t const m = missing[i]; 
+            receiveBlob(socket, names[m], hashes[m], sizes[m]); 
+            used.push_back(names[m]); 
+        }
+
+        {   Lock lock(mutex); 
+            while (numRunning >= numSlots && ! stopped)
+                wait(lock, condition); 
+            if (stopped)
+                throw std::runtime_error("jjm::RemoteWorker::serveCommand() failed. Cause:\nThe worker is stopping."); 
+            ++numRunning; 
+            sandbox = Path::join(sandboxesDir, Path(toDecStr(numSandboxes++))); 
+        }
+        try
+        {   //The inputs are copied rather than linked, so that a command
+            //which modifies its input leaves the blob as it was. 
+            for (size_t i = 0; i < inputs.size(); ++i)
+            {   Path const path = inSandbox(sandbox, inputs[i]); 
+                createDirectories(path.getParent()); 
+                removeFile(path); 
+                copyFile(Path::join(blobsDir, Path(names[i])), path, false); 
+            }
+            releaseBlobs(used); 
+            used.clear(); 
+            for (size_t i = 0; i < outputs.size(); ++i)
+                createDirectories(inSandbox(sandbox, outputs[i]).getParent()); 
+            ExecCommand command; 
+            command.dir = inSandbox(sandbox, dir); 
+            command.args = args; 
+            createDirectories(command.dir); 
+            try
+            {   result = executeLocally(command); 
+            }catch (std::exception & e)
+            {   result.exitcode = 127; 
+                result.output = string() + "[jjmake] Remote worker: Failed to execute the command. Cause:\n" + e.what() + "\n"; 
+            }
+        }catch (...)
+        {   Lock lock(mutex); 
+            --numRunning; 
+            condition.notify_all(); 
+            throw; 
+        }
+        {   Lock lock(mutex); 
+            --numRunning; 
+            condition.notify_all(); 
+        }
+        ++numExecuted; 
+
+        socket.setDeadline(getMonotonicClockNanoSec() + commandTimeoutNanoSec); 
+        reply.clear(); 
+        appendUint32(reply, static_cast<std::uint32_t>(result.exitcode)); 
+        if (result.output.size() > maxOutputBytes)
+            result.output.resize(maxOutputBytes); 
+        appendString(reply, result.output); 
+        socket.writeComplete(reply.data(), reply.size()); 
+        for (size_t i = 0; i < outputs.size(); ++i)
+        {   FileHandleOwner file; 
+            Stat st; 
+            try
+            {   file.reset(FileOpener().openExistingOnly().readOnly().open(inSandbox(sandbox, outputs[i]))); 
+                st = Stat::get2(file.get()); 
+            }catch (std::exception & )
+            {
+            }
+            if (st.type != FileType::RegularFile)
+            {   writeUint32(socket, 0); 
+                continue; 
+            }
+            reply.clear(); 
+            appendUint32(reply, 1); 
+            appendUint64(reply, st.sizeBytes); 
+            socket.writeComplete(reply.data(), reply.size()); 
+            sendFileChunks(socket, file.get(), st.sizeBytes); 
+        }
+    }catch (...)
+    {   releaseBlobs(used); 
+        if ( ! sandbox.isEmpty())
+        {   try
+            {   removeTree(sandbox); 
+            }catch (std::exception & )
+            {
+            }
+        }
+        throw; 
+    }
+    removeTree(sandbox); 
+    return true; 
+}
+
+void jjm::RemoteWorker::receiveBlob(Socket & socket, std::string const& name, std::uint64_t contentHash, std::uint64_t sizeBytes)
+{
+    Path tmpPath; 
+    {   Lock lock(mutex); 
+        tmpPath = Path::join(incomingDir, Path(toDecStr(numIncomingFiles++))); 
+    }
+    try
+    {   {   FileHandleOwner file(FileOpener().createOrOpen().truncate().writeOnly().open(tmpPath)); 
+            receiveFileChunks(socket, file.get(), sizeBytes); 
+            if (0 != file.release().close2())
+                throw std::runtime_error("Closing \"" + tmpPath.getStringRep() + "\" failed."); 
+        }
+        //A blob is found by its name alone, so a wrong blob would be used 
+        //by every later command with the same name. 
+        {   MemoryMappedFile content; 
+            {   FileHandleOwner file(FileOpener().openExistingOnly().readOnly().open(tmpPath)); 
+                content.map(file.get()); 
+            }
+            if (content.size() != sizeBytes || hash64(content.data(), content.size()) != contentHash)
+                throw std::runtime_error("jjm::RemoteWorker::receiveBlob() failed. Cause:\nThe content of an input does not match its hash."); 
+        }
+        Lock lock(mutex); 
+        renameFile(tmpPath, Path::join(blobsDir, Path(name))); 
+        map<string, Blob>::iterator blob = blobs.find(name); 
+        if (blob == blobs.end())
+        {   blob = blobs.insert(make_pair(name, Blob())).first; 
+            blob->second.sizeBytes = sizeBytes; 
+            totalBlobBytes += sizeBytes; 
+        }
+        ++blob->second.numUsers; 
+        blob->second.lastUse = ++useCounter; 
+    }catch (...)
+    {   try
+        {   removeFile(tmpPath); 
+        }catch (std::exception & )
+        {
+        }
+        throw; 
+    }
+}
+
+void jjm::RemoteWorker::releaseBlobs(std::vector<std::string> const& names)
+{
+    Lock lock(mutex); 
+    for (size_t i = 0; i < names.size(); ++i)
+    {   map<string, Blob>::iterator blob = blobs.find(names[i]); 
+        if (blob != blobs.end())
+            --blob->second.numUsers; 
+    }
+    try
+    {   trim(); 
+    }catch (std::exception & e)
+    {   cerr << "[jjmake] Remote worker: Failed to trim the blobs. Cause:\n" << e.what() << endl; 
+    }
+}
+
+void jjm::RemoteWorker::trim()
+{
+    if (totalBlobBytes <= static_cast<std::uint64_t>(maxBytes))
+        return; 
+
+    //Trims to 90% of the limit, so that not every command trims. 
+    vector<pair<std::int64_t, string> > unused; 
+    for (map<string, Blob>::const_iterator blob = blobs.begin(); blob != blobs.end(); ++blob)
+    {   if (blob->second.numUsers == 0)
+            unused.push_back(make_pair(blob->second.lastUse, blob->first)); 
+    }
+    std::sort(unused.begin(), unused.end(), ByLastUse()); 
+    std::uint64_t const target = static_cast<std::uint64_t>(maxBytes) / 10 * 9; 
+    for (size_t i = 0; i < unused.size() && totalBlobBytes > target; ++i)
+    {   removeFile(Path::join(blobsDir, Path(unused[i].second))); 
+        totalBlobBytes -= blobs[unused[i].second].sizeBytes; 
+        blobs.erase(unused[i].second); 
+    }
+}
+
+
+class jjm::Dispatcher::Worker
+{
+public:
+    Worker() : numSlots(0), numBusy(0), failed(false) {}
+    ~Worker()
+    {   for (size_t i = 0; i < idleConnections.size(); ++i)
+            delete idleConnections[i]; 
+    }
+    std::string address; 
+    std::int32_t numSlots; 
+    std::int32_t numBusy; 
+    bool failed; 
+    //The blobs, by content hash and size, which the worker was sent or had. 
+    std::set<pair<std::uint64_t, std::uint64_t> > blobs; 
+    std::vector<Socket*> idleConnections; //ownership
+private:
+    Worker(Worker const& ); //not defined, not copyable
+    Worker& operator= (Worker const& ); //not defined, not copyable
+}; 
+
+jjm::Dispatcher::Dispatcher(std::int32_t numLocalSlots_)
+    : numLocalSlots(numLocalSlots_), connectTimeoutNanoSec(0), numLocalRunning(0), numWaiting(0),
+    bytesPerSecond(initialBytesPerSecond), averageMillis(initialAverageMillis),
+    numLocal(0), numRemote(0), numBytesSent(0), numBytesReceived(0), numWorkersFailed(0)
+{}
+
+jjm::Dispatcher::~Dispatcher()
+{
+    for (size_t i = 0; i < workers.size(); ++i)
+        delete workers[i]; 
+}
+
+void jjm::Dispatcher::addWorker(std::string const& address, std::int64_t connectTimeoutNanoSec_)
+{
+    UniquePtr<Worker*> worker(new Worker); 
+    worker.get()->address = address; 
+    try
+    {   UniquePtr<Socket*> socket(new Socket); 
+        socket.get()->setDeadline(getMonotonicClockNanoSec() + connectTimeoutNanoSec_); 
+        socket.get()->connect(address); 
+        socket.get()->writeComplete(magic, 4); 
+        std::uint32_t const numSlots = readUint32( * socket.get()); 
+        if (numSlots == 0 || numSlots > maxSlots)
+            throw std::runtime_error("The worker has " + toDecStr(numSlots) + " slots."); 
+        socket.get()->setDeadline(0); 
+        worker.get()->numSlots = static_cast<std::int32_t>(numSlots); 
+        worker.get()->idleConnections.push_back(socket.release()); 
+    }catch (std::exception & e)
+    {   throw std::runtime_error("jjm::Dispatcher::addWorker() failed for the remote worker \"" + address + "\". Cause:\n" + e.what()); 
+    }
+    Lock lock(mutex); 
+    connectTimeoutNanoSec = connectTimeoutNanoSec_; 
+    workers.push_back(worker.release()); 
+    condition.notify_all(); 
+}
+
+jjm::ExecResult jjm::Dispatcher::execute(ExecCommand const& command)
+{
+    //A free local slot is taken without hashing the inputs. 
+    bool local = false; 
+    {   Lock lock(mutex); 
+        bool liveWorkers = false; 
+        for (size_t i = 0; i < workers.size(); ++i)
+            liveWorkers = liveWorkers || ! workers[i]->failed; 
+        if (numWaiting == 0 && (numLocalRunning < numLocalSlots || ( ! liveWorkers && numLocalRunning == 0)))
+        {   ++numLocalRunning; 
+            local = true; 
+        }
+    }
+    vector<std::uint64_t> hashes; 
+    vector<std::uint64_t> sizes; 
+    if ( ! local && ! command.localOnly)
+        hashInputs(command, hashes, sizes); 
+
+    string warning; 
+    for (;;)
+    {   Worker * const worker = local ? 0 : acquireSlot(command, hashes, sizes); 
+        std::int64_t const start = getMonotonicClockNanoSec(); 
+        ExecResult result; 
+        if (worker == 0)
+        {   try
+            {   result = executeLocally(command); 
+            }catch (...)
+            {   releaseSlot(0); 
+                throw; 
+            }
+            releaseSlot(0); 
+            ++numLocal; 
+        }else
+        {   try
+            {   executeRemotely(worker, command, hashes, sizes, result); 
+            }catch (std::exception & e)
+            {   warning += "Failed to execute on the remote worker \"" + worker->address
+                        + "\", which is no longer used. Cause:\n" + e.what() + "\n"; 
+                {   Lock lock(mutex); 
+                    if ( ! worker->failed)
+                        ++numWorkersFailed; 
+                    worker->failed = true; 
+                    for (size_t i = 0; i < worker->idleConnections.size(); ++i)
+                        delete worker->idleConnections[i]; 
+                    worker->idleConnections.clear(); 
+                }
+                releaseSlot(worker); 
+                continue; 
+            }
+            releaseSlot(worker); 
+            ++numRemote; 
+        }
+        recordDuration(getMonotonicClockNanoSec() - start); 
+        result.warning = warning; 
+        return result; 
+    }
+}
+
+jjm::Dispatcher::Worker * jjm::Dispatcher::acquireSlot(ExecCommand const& command, std::vector<std::uint64_t> const& hashes,
+        std::vector<std::uint64_t> const& sizes)
+{
+    Lock lock(mutex); 
+    ++numWaiting; 
+    Worker * chosen = 0; 
+    for (;;)
+    {   //Without a live worker, at least one command executes locally.
+        bool liveWorkers = false; 
+        for (size_t i = 0; i < workers.size(); ++i)
+            liveWorkers = liveWorkers || ! workers[i]->failed; 
+        std::int32_t const localSlots = liveWorkers ? numLocalSlots : std::max<std::int32_t>(numLocalSlots, 1); 
+        if (numLocalRunning < localSlots)
+        {   ++numLocalRunning; 
+            break; 
+        }
+
+        //Inputs which are not regular files cannot be sent, and then hashes 
+        //is empty. A command which is only executed locally is not hashed. 
+        Worker * best = 0; 
+        std::uint64_t bestMissingBytes = 0; 
+        for (size_t i = 0; i < workers.size() && ! command.localOnly && hashes.size() == command.inputs.size(); ++i)
+        {   Worker * const w = workers[i]; 
+            if (w->failed || w->numBusy >= w->numSlots)
+                continue; 
+            std::uint64_t missingBytes = 0; 
+            for (size_t j = 0; j < hashes.size(); ++j)
+            {   if (w->blobs.count(make_pair(hashes[j], sizes[j])) == 0)
+                    missingBytes += sizes[j]; 
+            }
+            if (best == 0 || missingBytes < bestMissingBytes)
+            {   best = w; 
+                bestMissingBytes = missingBytes; 
+            }
+        }
+        if (best != 0)
+        {   double const weightMillis = command.weightMillis > 1 ? static_cast<double>(command.weightMillis) : averageMillis; 
+            double const transferMillis = bestMissingBytes * 1000.0 / bytesPerSecond; 
+            if (localSlots == 0 || transferMillis < numWaiting * weightMillis / localSlots)
+            {   chosen = best; 
+                ++chosen->numBusy; 
+                break; 
+            }
+        }
+        wait(lock, condition); 
+    }
+    --numWaiting; 
+    return chosen; 
+}
+
+void jjm::Dispatcher::releaseSlot(Worker * worker)
+{
+    Lock lock(mutex); 
+    if (worker)
+        --worker->numBusy; 
+    else
+        --numLocalRunning; 
+    condition.notify_all(); 
+}
+
+void jjm::Dispatcher::recordDuration(std::int64_t durationNanoSec)
+{
+    Lock lock(mutex); 
+    averageMillis = 0.8 * averageMillis + 0.2 * (durationNanoSec / 1e6); 
+}
+
+void jjm::Dispatcher::hashInputs(ExecCommand const& command, std::vector<std::uint64_t> & hashes, std::vector<std::uint64_t> & sizes)
+{
+    hashes.clear(); 
+    sizes.clear(); 
+    {   Lock lock(mutex); 
+        bool liveWorkers = false; 
+        for (size_t i = 0; i < workers.size(); ++i)
+            liveWorkers = liveWorkers || ! workers[i]->failed; 
+        if ( ! liveWorkers)
+            return; 
+    }
+    for (size_t i = 0; i < command.inputs.size(); ++i)
+    {   Stat const st = Stat::stat2(command.inputs[i]); 
+        if (st.type != FileType::RegularFile)
+        {   hashes.clear(); 
+            sizes.clear(); 
+            return; 
+        }
+        sizes.push_back(st.sizeBytes); 
+        if (command.inputHashes.size() == command.inputs.size())
+        {   hashes.push_back(command.inputHashes[i]); 
+            continue; 
+        }
+
+        string const& key = command.inputs[i].getStringRep(); 
+        {   Lock lock(hashesMutex); 
+            map<string, FileHash>::const_iterator f = fileHashes.find(key); 
+            if (f != fileHashes.end() && f->second.sizeBytes == st.sizeBytes
+                    && f->second.lastWriteTimeNanoSec == st.lastWriteTimeNanoSec && f->second.fileId == st.fileId)
+            {   hashes.push_back(f->second.contentHash); 
+                continue; 
+            }
+        }
+        FileHash f; 
+        f.sizeBytes = st.sizeBytes; 
+        f.lastWriteTimeNanoSec = st.lastWriteTimeNanoSec; 
+        f.fileId = st.fileId; 
+        {   MemoryMappedFile content; 
+            {   FileHandleOwner file(FileOpener().openExistingOnly().readOnly().open(command.inputs[i])); 
+                content.map(file.get()); 
+            }
+            f.contentHash = hash64(content.data(), content.size()); 
+        }
+        hashes.push_back(f.contentHash); 
+        Lock lock(hashesMutex); 
+        fileHashes[key] = f; 
+    }
+}
+
+jjm::Socket * jjm::Dispatcher::takeConnection(Worker * worker)
+{
+    std::int64_t timeoutNanoSec = 0; 
+    {   Lock lock(mutex); 
+        if ( ! worker->idleConnections.empty())
+        {   Socket * const socket = worker->idleConnections.back(); 
+            worker->idleConnections.pop_back(); 
+            return socket; 
+        }
+        timeoutNanoSec = connectTimeoutNanoSec; 
+    }
+    UniquePtr<Socket*> socket(new Socket); 
+    socket.get()->setDeadline(getMonotonicClockNanoSec() + timeoutNanoSec); 
+    socket.get()->connect(worker->address); 
+    socket.get()->writeComplete(magic, 4); 
+    readUint32( * socket.get()); 
+    socket.get()->setDeadline(0); 
+    return socket.release(); 
+}
+
+void jjm::Dispatcher::returnConnection(Worker * worker, Socket * socket)
+{
+    Lock lock(mutex); 
+    if (worker->failed)
+        delete socket; 
+    else
+        worker->idleConnections.push_back(socket); 
+}
+
+void jjm::Dispatcher::executeRemotely(Worker * worker, ExecCommand const& command, std::vector<std::uint64_t> const& hashes,
+        std::vector<std::uint64_t> const& sizes, ExecResult & result)
+{
+    //A broken connection is dropped, as its position in the protocol is 
+    //unknown. 
+    UniquePtr<Socket*> socket(takeConnection(worker)); 
+    string request; 
+    appendUint32(request, execOperation); 
+    appendString(request, command.dir.getStringRep()); 
+    appendUint32(request, static_cast<std::uint32_t>(command.args.size())); 
+    for (size_t i = 0; i < command.args.size(); ++i)
+        appendString(request, command.args[i]); 
+    appendUint32(request, static_cast<std::uint32_t>(command.inputs.size())); 
+    for (size_t i = 0; i < command.inputs.size(); ++i)
+    {   appendString(request, command.inputs[i].getStringRep()); 
+        appendUint64(request, hashes[i]); 
+        appendUint64(request, sizes[i]); 
+    }
+    appendUint32(request, static_cast<std::uint32_t>(command.outputs.size())); 
+    for (size_t i = 0; i < command.outputs.size(); ++i)
+        appendString(request, command.outputs[i].getStringRep()); 
+
+    std::int64_t const start = getMonotonicClockNanoSec(); 
+    socket.get()->writeComplete(request.data(), request.size()); 
+    std::uint64_t bytesSent = request.size(); 
+    std::uint64_t missingBytes = 0; 
+    std::uint32_t const numMissing = readCount( * socket.get(), static_cast<std::uint32_t>(command.inputs.size())); 
+    for (std::uint32_t m = 0; m < numMissing; ++m)
+    {   std::uint32_t const i = readUint32( * socket.get()); 
+        if (i >= command.inputs.size())
+            throw std::runtime_error("The worker asked for input " + toDecStr(i) + " of " + toDecStr(command.inputs.size()) + "."); 
+        FileHandleOwner file(FileOpener().openExistingOnly().readOnly().open(command.inputs[i])); 
+        bytesSent += sendFileChunks( * socket.get(), file.get(), sizes[i]); 
+        missingBytes += sizes[i]; 
+    }
+    std::int64_t const transferNanoSec = getMonotonicClockNanoSec() - start; 
+    {   Lock lock(mutex); 
+        for (size_t i = 0; i < hashes.size(); ++i)
+            worker->blobs.insert(make_pair(hashes[i], sizes[i])); 
+        //Small transfers measure the latency more than the bandwidth. 
+        if (missingBytes >= 64 * 1024 && transferNanoSec > 0)
+            bytesPerSecond = 0.7 * bytesPerSecond + 0.3 * (missingBytes * 1e9 / transferNanoSec); 
+    }
+    numBytesSent += bytesSent; 
+
+    result.exitcode = static_cast<int>(readUint32( * socket.get())); 
+    result.output = readString( * socket.get(), maxOutputBytes); 
+    vector<Path> downloads; 
+    vector<Path> downloaded; 
+    try
+    {   for (size_t i = 0; i < command.outputs.size(); ++i)
+        {   if (readUint32( * socket.get()) == 0)
+                continue; 
+            std::uint64_t const size = readUint64( * socket.get()); 
+            downloads.push_back(Path(command.outputs[i].getStringRep() + ".jjmake-download")); 
+            downloaded.push_back(command.outputs[i]); 
+            createDirectories(command.outputs[i].getParent()); 
+            FileHandleOwner file(FileOpener().createOrOpen().truncate().writeOnly().open(downloads.back())); 
+            receiveFileChunks( * socket.get(), file.get(), size); 
+            if (0 != file.release().close2())
+                throw std::runtime_error("Closing \"" + downloads.back().getStringRep() + "\" failed."); 
+            numBytesReceived += size; 
+        }
+        returnConnection(worker, socket.release()); 
+        for (size_t i = 0; i < downloads.size(); ++i)
+            renameFile(downloads[i], downloaded[i]); 
+    }catch (...)
+    {   removeFiles(downloads); 
+        throw; 
+    }
+    result.workerAddress = worker->address; 
+}
@@ -0,0 +1,260 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#ifndef JJMAKE_REMOTEEXEC_HPP_HEADER_GUARD
+#define JJMAKE_REMOTEEXEC_HPP_HEADER_GUARD
+
+#include "jbase/jstdint.hpp"
+#include "josutils/jpath.hpp"
+#include "josutils/jsocket.hpp"
+#include "josutils/jthreading.hpp"
+#include "junicode/jutfstring.hpp"
+
+#include <atomic>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace jjm
+{
+
+class JobServer; 
+
+/* The command of an exec-node goal. It runs in dir, and reads and writes no
+files other than its inputs and outputs, which it names by paths relative
+to dir, so that it runs the same in the sandbox of a remote worker. */
+class ExecCommand
+{
+public:
+    ExecCommand() : weightMillis(0), localOnly(false), jobServer(0) {}
+    Path dir; 
+    std::vector<std::string> args; 
+    //Absolute paths. 
+    std::vector<Path> inputs; 
+    std::vector<Path> outputs; 
+    //The hash64() of the content of every input, or empty when unknown. 
+    std::vector<std::uint64_t> inputHashes; 
+    //The expected duration, or 1 or less when unknown. 
+    std::int64_t weightMillis; 
+    //Set when the inputs are not all known, such as before the first 
+    //execution of a goal with a depfile. 
+    bool localOnly; 
+    //Passed to the command when it executes locally, so that a make or 
+    //ninja which it runs shares the jobs of jjmake. Null for none. It is 
+    //not sent to remote workers. 
+    JobServer const* jobServer; 
+}; 
+
+class ExecResult
+{
+public:
+    ExecResult() : exitcode(0) {}
+    int exitcode; 
+    //stdout and stderr together. 
+    Utf8String output; 
+    //The worker which executed the command, or empty when it executed 
+    //locally. 
+    std::string workerAddress; 
+    //Why a worker failed, when the command then executed locally instead. 
+    std::string warning; 
+}; 
+
+//Executes the command in this process. 
+//Throws std::exception on errors, but not for a nonzero exit status. 
+ExecResult executeLocally(ExecCommand const& command); 
+
+
+/* The worker daemon, "jjmake --worker", which executes the commands of
+exec-node goals for the builds of other hosts, or of this host.
+
+Inputs are sent by content. The worker keeps every file it receives in
+"blobs" of its directory, named by content hash and size, and is sent only
+those it lacks. Every command runs in a sandbox directory of its own, with
+its inputs copied to their absolute paths below the sandbox, and the
+sandbox is removed after its outputs are sent back. At most numSlots
+commands execute at once, over every connection. Above maxBytes, the least
+recently used blobs are removed, except the blobs of the commands being
+served.
+
+A worker executes whatever it is sent, so it must only listen where every
+client is trusted.
+
+The protocol, over TCP or a Unix domain socket, in the framing of
+transfer.hpp. A connection starts with "JJW1" from the client, to which the
+worker replies with its number of slots (4 bytes), and then carries any
+number of commands, one after another. Every path is absolute.
+    command:  1 (4 bytes), the dir, the number of arguments (4 bytes) and
+              the arguments, the number of inputs (4 bytes) and per input
+              its path, content hash (8 bytes) and size (8 bytes), then the
+              number of outputs (4 bytes) and their paths.
+    missing:  reply the number of inputs which the worker lacks (4 bytes),
+              and their indices (4 bytes each). The client sends the chunks
+              of each, in that order.
+    result:   reply the exit status (4 bytes), the output, and per output
+              whether it exists (4 bytes), and when it does, its size (8
+              bytes) and its chunks. */
+class RemoteWorker
+{
+public:
+    RemoteWorker(); 
+
+    //Stops, as stop(). 
+    ~RemoteWorker(); 
+
+    //Opens the blobs in the directory, and listens on the address of 
+    //jjm::Socket. 
+    //Throws std::exception on errors. 
+    void open(Path const& dir, std::int64_t maxBytes, std::int32_t numSlots, std::string const& address); 
+
+    //The address listened on, with the port that was picked for port 0. 
+    std::string const& getAddress() const { return listener.getAddress(); }
+
+    //Serves every connection on a thread of its own, until stop(). 
+    //Throws std::exception on errors. 
+    void run(); 
+
+    //Makes run() return, closes every connection, and waits for their 
+    //threads. It is safe to call concurrently with run(). 
+    void stop(); 
+
+    std::int64_t getNumExecuted() const { return numExecuted; }
+
+private:
+    RemoteWorker(RemoteWorker const& ); //not defined, not copyable
+    RemoteWorker& operator= (RemoteWorker const& ); //not defined, not copyable
+
+    class ConnectionMain; 
+    class Blob
+    {
+    public:
+        Blob() : sizeBytes(0), lastUse(0), numUsers(0) {}
+        std::uint64_t sizeBytes; 
+        std::int64_t lastUse; 
+        std::int32_t numUsers; 
+    }; 
+
+    void serveConnection(Socket * socket); 
+    //Returns false when the client closed the connection. 
+    bool serveCommand(Socket & socket); 
+    //Receives the blob into incoming, and moves it into blobs. 
+    void receiveBlob(Socket & socket, std::string const& name, std::uint64_t contentHash, std::uint64_t sizeBytes); 
+    void releaseBlobs(std::vector<std::string> const& names); 
+    //Removes the least recently used blobs without users above maxBytes. 
+    //Called with the mutex. 
+    void trim(); 
+
+    Path blobsDir; 
+    Path incomingDir; 
+    Path sandboxesDir; 
+    std::int64_t maxBytes; 
+    std::int32_t numSlots; 
+    ListeningSocket listener; 
+
+    Mutex mutex; 
+    CondVar condition; 
+    bool stopped; 
+    std::set<Socket*> connections; 
+    std::map<std::string, Blob> blobs; 
+    std::uint64_t totalBlobBytes; 
+    std::int64_t useCounter; 
+    std::int32_t numRunning; 
+    std::int64_t numIncomingFiles; 
+    std::int64_t numSandboxes; 
+    std::atomic<std::int64_t> numExecuted; 
+}; 
+
+
+/* Executes the commands of exec-node goals, each either locally or on a
+RemoteWorker, and waits for it.
+
+A command executes locally while fewer than numLocalSlots commands execute
+locally. Otherwise it is sent to an idle slot of the worker which lacks the
+fewest bytes of its inputs, when sending them is expected to take less time
+than waiting for a local slot. The transfer is expected to take the missing
+bytes over the bandwidth measured so far, and the wait the commands which
+wait ahead, and this one, times its weight, over numLocalSlots. A command
+of unknown weight is expected to take the average duration of the commands
+executed so far. Otherwise the command waits until a slot becomes idle.
+
+Connections to a worker are kept between commands. A worker whose
+connection fails is not used again, and its command is dispatched again,
+usually to execute locally. */
+class Dispatcher
+{
+public:
+    explicit Dispatcher(std::int32_t numLocalSlots); 
+    ~Dispatcher(); 
+
+    //Connects to the worker, and adds its slots. 
+    //Throws std::exception on errors, and then the worker is not used. 
+    void addWorker(std::string const& address, std::int64_t connectTimeoutNanoSec); 
+
+    //Throws std::exception on errors of local execution, but not for a 
+    //nonzero exit status. The outputs are replaced as a whole, and never 
+    //left partly written. 
+    //It is safe to call concurrently. 
+    ExecResult execute(ExecCommand const& command); 
+
+    std::int64_t getNumLocal() const { return numLocal; }
+    std::int64_t getNumRemote() const { return numRemote; }
+    std::int64_t getNumBytesSent() const { return numBytesSent; }
+    std::int64_t getNumBytesReceived() const { return numBytesReceived; }
+    std::int64_t getNumWorkersFailed() const { return numWorkersFailed; }
+
+private:
+    Dispatcher(Dispatcher const& ); //not defined, not copyable
+    Dispatcher& operator= (Dispatcher const& ); //not defined, not copyable
+
+    class Worker; 
+
+    //Returns the worker to send the command to, or null for a local slot. 
+    Worker * acquireSlot(ExecCommand const& command, std::vector<std::uint64_t> const& hashes,
+            std::vector<std::uint64_t> const& sizes); 
+    void releaseSlot(Worker * worker); 
+    //Returns the content hashes of the inputs, and their sizes. 
+    void hashInputs(ExecCommand const& command, std::vector<std::uint64_t> & hashes, std::vector<std::uint64_t> & sizes); 
+    //Throws std::exception when the connection to the worker fails. 
+    void executeRemotely(Worker * worker, ExecCommand const& command, std::vector<std::uint64_t> const& hashes,
+            std::vector<std::uint64_t> const& sizes, ExecResult & result); 
+    Socket * takeConnection(Worker * worker); 
+    void returnConnection(Worker * worker, Socket * socket); 
+    void recordDuration(std::int64_t durationNanoSec); 
+
+    std::int32_t const numLocalSlots; 
+    std::int64_t connectTimeoutNanoSec; 
+
+    Mutex mutex; 
+    CondVar condition; 
+    std::vector<Worker*> workers; //ownership
+    std::int32_t numLocalRunning; 
+    std::int32_t numWaiting; 
+    double bytesPerSecond; 
+    double averageMillis; 
+
+    //The content hashes of input files, valid while the size, last write 
+    //time and file id are unchanged. 
+    class FileHash
+    {
+    public:
+        FileHash() : sizeBytes(0), lastWriteTimeNanoSec(0), fileId(0), contentHash(0) {}
+        std::uint64_t sizeBytes; 
+        std::int64_t lastWriteTimeNanoSec; 
+        std::uint64_t fileId; 
+        std::uint64_t contentHash; 
+    }; 
+    Mutex hashesMutex; 
+    std::map<std::string, FileHash> fileHashes; 
+
+    std::atomic<std::int64_t> numLocal; 
+    std::atomic<std::int64_t> numRemote; 
+    std::atomic<std::int64_t> numBytesSent; 
+    std::atomic<std::int64_t> numBytesReceived; 
+    std::atomic<std::int64_t> numWorkersFailed; 
+}; 
+
+} //namespace jjm
+
+#endif
@@ -0,0 +1,487 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "signatures.hpp"
+
+#include "node.hpp"
+#include "statcache.hpp"
+#include "jbase/jfatal.hpp"
+#include "jbase/jhash.hpp"
+#include "josutils/jclock.hpp"
+#include "josutils/jfilehandle.hpp"
+#include "josutils/jfilesystem.hpp"
+#include "josutils/jmmap.hpp"
+#include "josutils/jopen.hpp"
+
+#include <string.h>
+#include <stdexcept>
+
+using namespace jjm;
+using namespace std;
+
+
+namespace
+{
+    //File layout: 
+    //  FileHeader
+    //  records, each a Record followed by the name, padded to a multiple of 8
+
+    char const fileMagic[8] = { 'J', 'J', 'M', 'S', 'I', 'G', 'S', '2' }; 
+    std::uint32_t const byteOrderMark = 0x01020304; 
+    std::uint32_t const recordMarker = 0x4749534A; 
+
+    struct FileHeader
+    {   char magic[8]; 
+        std::uint32_t byteOrderMark; 
+        std::uint32_t reserved; 
+    }; 
+
+    enum RecordType
+    {   FileRecordType = 1,  //values: size, last write time, file id, content hash
+        GoalRecordType = 2,  //values: inputs signature, command hash, outputs signature, discovered inputs signature
+        GoalFailedRecordType = 3 //forgets the goal
+    }; 
+
+    struct Record
+    {   std::uint32_t marker; 
+        std::uint32_t type; 
+        std::uint32_t nameLength; 
+        std::uint32_t reserved; 
+        std::uint64_t values[4]; 
+        std::uint64_t check; //hash of the record, with check 0, and of the name
+    }; 
+
+    //Compaction rewrites the whole file, so only do it when most records are 
+    //dead, and the file is not tiny. 
+    std::size_t const minRecordsForCompaction = 4096; 
+
+    std::size_t const maxAppendBufferBytes = 64 * 1024; 
+    std::int64_t const maxAppendDelayNanoSec = 250 * 1000 * 1000; 
+
+    inline std::size_t padTo8(std::size_t x) { return (x + 7) & ~static_cast<std::size_t>(7); }
+
+    std::uint64_t computeCheck(Record r, char const * name)
+    {   r.check = 0; 
+        return hash64(name, r.nameLength, hash64( & r, sizeof(r))); 
+    }
+
+    //Returns false at the end of the data, or when the record is torn or 
+    //corrupt. 
+    bool readRecord(MemoryMappedFile const& file, std::size_t & offset, Record & r, string & name)
+    {   if (file.size() - offset < sizeof(r))
+            return false; 
+        memcpy( & r, file.data() + offset, sizeof(r)); 
+        if (r.marker != recordMarker || file.size() - offset - sizeof(r) < padTo8(r.nameLength))
+            return false; 
+        char const * const namePtr = file.data() + offset + sizeof(r); 
+        if (r.check != computeCheck(r, namePtr))
+            return false; 
+        name.assign(namePtr, r.nameLength); 
+        offset += sizeof(r) + padTo8(r.nameLength); 
+        return true; 
+    }
+
+    void appendRecord(string & buffer, std::uint32_t type, string const& name, std::uint64_t const (& values)[4])
+    {   Record r; 
+        memset( & r, 0, sizeof(r)); 
+        r.marker = recordMarker; 
+        r.type = type; 
+        r.nameLength = static_cast<std::uint32_t>(name.size()); 
+        for (int i = 0; i < 4; ++i)
+            r.values[i] = values[i]; 
+        r.check = computeCheck(r, name.data()); 
+        buffer.append(reinterpret_cast<char const*>( & r), sizeof(r)); 
+        buffer.append(name); 
+        buffer.append(padTo8(name.size()) - name.size(), '\0'); 
+    }
+
+    //The signature covers the names of the paths and their order, so that 
+    //adding, removing or renaming a path also changes it. 
+    void addToPathsSignature(vector<std::uint64_t> & hashes, string const& name, std::uint64_t contentHash)
+    {   hashes.push_back(hash64(name.data(), name.size())); 
+        hashes.push_back(contentHash); 
+    }
+    std::uint64_t finishPathsSignature(vector<std::uint64_t> const& hashes)
+    {   return hash64(hashes.empty() ? 0 : & hashes[0], hashes.size() * sizeof(std::uint64_t)); 
+    }
+}
+
+
+jjm::Signatures::Signatures() 
+    : graph(0), statCache(0), numJournalRecords(0), lastFlushNanoSec(0), numHashedFiles(0), numHashedBytes(0) 
+{}
+
+jjm::Signatures::~Signatures() {}
+
+void jjm::Signatures::load(Path const& path_)
+{
+    path = path_; 
+    otherFiles.clear(); 
+    otherGoals.clear(); 
+    numJournalRecords = 0; 
+    {   Lock lock(appendMutex); 
+        appendBuffer.clear(); 
+        lastFlushNanoSec = getMonotonicClockNanoSec(); 
+    }
+
+    bool needsCompaction = true; 
+    if (Stat::stat(path).type != FileType::NoExist)
+    {   MemoryMappedFile file; 
+        {   FileHandleOwner handle(FileOpener().openExistingOnly().readOnly().open(path)); 
+            file.map(handle.get()); 
+        }
+
+        FileHeader header; 
+        bool const valid = file.size() >= sizeof(header) 
+                && 0 == memcmp(file.data(), fileMagic, sizeof(fileMagic)) 
+                && (memcpy( & header, file.data(), sizeof(header)), header.byteOrderMark == byteOrderMark); 
+        if (valid)
+        {   //Replay the journal. Stop at the first torn or corrupt record. 
+            std::size_t offset = sizeof(header); 
+            Record r; 
+            string name; 
+            while (readRecord(file, offset, r, name))
+            {   ++numJournalRecords; 
+                if (r.type == FileRecordType)
+                {   FileSignature & f = otherFiles[name]; 
+                    f.sizeBytes = r.values[0]; 
+                    f.lastWriteTimeNanoSec = static_cast<std::int64_t>(r.values[1]); 
+                    f.fileId = r.values[2]; 
+                    f.contentHash = r.values[3]; 
+                }else if (r.type == GoalRecordType)
+                {   GoalSignature & g = otherGoals[name]; 
+                    g.inputsSignature = r.values[0]; 
+                    g.commandHash = r.values[1]; 
+                    g.outputsSignature = r.values[2]; 
+                    g.discoveredInputsSignature = r.values[3]; 
+                }else if (r.type == GoalFailedRecordType)
+                    otherGoals.erase(name); 
+            }
+            std::size_t const numLive = otherFiles.size() + otherGoals.size(); 
+            bool const torn = offset != file.size(); 
+            needsCompaction = torn 
+                    || (numJournalRecords >= minRecordsForCompaction && numJournalRecords - numLive > numLive); 
+        }
+    }
+    if (needsCompaction)
+        compact(); 
+}
+
+void jjm::Signatures::compact()
+{
+    string buffer; 
+    FileHeader header; 
+    memset( & header, 0, sizeof(header)); 
+    memcpy(header.magic, fileMagic, sizeof(fileMagic)); 
+    header.byteOrderMark = byteOrderMark; 
+    buffer.append(reinterpret_cast<char const*>( & header), sizeof(header)); 
+    for (map<string, FileSignature>::const_iterator f = otherFiles.begin(); f != otherFiles.end(); ++f)
+    {   std::uint64_t const values[4] = { f->second.sizeBytes, static_cast<std::uint64_t>(f->second.lastWriteTimeNanoSec), f->second.fileId, f->second.contentHash }; 
+        appendRecord(buffer, FileRecordType, f->first, values); 
+    }
+    for (map<string, GoalSignature>::const_iterator g = otherGoals.begin(); g != otherGoals.end(); ++g)
+    {   std::uint64_t const values[4] = { g->second.inputsSignature, g->second.commandHash, g->second.outputsSignature, g->second.discoveredInputsSignature }; 
+        appendRecord(buffer, GoalRecordType, g->first, values); 
+    }
+
+    //Write a new file and rename it over the old one, so that a crash leaves
+    //either the old file or the new file. 
+    Path const tmpPath(path.getStringRep() + ".tmp"); 
+    {   FileHandleOwner out(FileOpener().createOrOpen().truncate().writeOnly().open(tmpPath)); 
+        out.get().writeComplete(buffer.data(), buffer.size()); 
+        if (0 != out.release().close2())
+            throw std::runtime_error("jjm::Signatures::compact() failed. Cause:\nClosing \"" + tmpPath.getStringRep() + "\" failed."); 
+    }
+    renameFile(tmpPath, path); 
+    numJournalRecords = otherFiles.size() + otherGoals.size(); 
+}
+
+void jjm::Signatures::attach(Graph const& graph_, StatCache & statCache_)
+{
+    graph = & graph_; 
+    statCache = & statCache_; 
+    files.assign(graph->getNumPaths(), FileSignature()); 
+    hasFile.assign(graph->getNumPaths(), 0); 
+    goals.assign(graph->getNumNodes(), GoalSignature()); 
+    hasGoal.assign(graph->getNumNodes(), 0); 
+    isStamp.assign(graph->getNumPaths(), 0); 
+
+    for (Graph::PathId p = 0; p < graph->getNumPaths(); ++p)
+    {   map<string, FileSignature>::iterator f = otherFiles.find(graph->getPath(p).getStringRep()); 
+        if (f == otherFiles.end())
+            continue; 
+        files[p] = f->second; 
+        hasFile[p] = 1; 
+        otherFiles.erase(f); 
+    }
+    for (Graph::NodeId n = 0; n < graph->getNumNodes(); ++n)
+    {   if (graph->getNode(n)->hasStampOutputs())
+        {   Graph::IdRange const outputs = graph->getOutputPaths(n); 
+            for (Graph::PathId const * p = outputs.begin(); p != outputs.end(); ++p)
+                isStamp[*p] = 1; 
+        }
+        map<string, GoalSignature>::iterator g = otherGoals.find(graph->getNode(n)->goalName); 
+        if (g == otherGoals.end())
+            continue; 
+        goals[n] = g->second; 
+        hasGoal[n] = 1; 
+        otherGoals.erase(g); 
+    }
+}
+
+void jjm::Signatures::detach()
+{
+    if (graph == 0)
+        return; 
+    for (Graph::PathId p = 0; p < files.size(); ++p)
+    {   if (hasFile[p])
+            otherFiles[graph->getPath(p).getStringRep()] = files[p]; 
+    }
+    for (Graph::NodeId n = 0; n < goals.size(); ++n)
+    {   if (hasGoal[n])
+            otherGoals[graph->getNode(n)->goalName] = goals[n]; 
+    }
+    vector<FileSignature>().swap(files); 
+    vector<char>().swap(hasFile); 
+    vector<GoalSignature>().swap(goals); 
+    vector<char>().swap(hasGoal); 
+    vector<char>().swap(isStamp); 
+    graph = 0; 
+    statCache = 0; 
+}
+
+bool jjm::Signatures::getContentHash(Graph::PathId p, std::uint64_t & contentHash)
+{
+    if (graph == 0 || p >= files.size())
+        JFATAL(p, 0); 
+    Stat const st = statCache->stat(p); 
+    if (st.type == FileType::NoExist)
+        return false; 
+
+    //The file is hashed while holding the lock, so that another goal which 
+    //wants the same file waits for the result instead of hashing it again. 
+    Lock lock(getMutex(p)); 
+    if ( ! hasFile[p] || ! files[p].hasFingerprintOf(st))
+    {   FileSignature f; 
+        f.sizeBytes = st.sizeBytes; 
+        f.lastWriteTimeNanoSec = st.lastWriteTimeNanoSec; 
+        f.fileId = st.fileId; 
+        f.contentHash = hashFile(graph->getPath(p), st); 
+        files[p] = f; 
+        hasFile[p] = 1; 
+        std::uint64_t const values[4] = { f.sizeBytes, static_cast<std::uint64_t>(f.lastWriteTimeNanoSec), f.fileId, f.contentHash }; 
+        append(FileRecordType, graph->getPath(p).getStringRep(), values); 
+    }
+    contentHash = files[p].contentHash; 
+    return true; 
+}
+
+std::uint64_t jjm::Signatures::hashFile(Path const& path, Stat const& st)
+{
+    if (st.type != FileType::RegularFile)
+        return hash64( & st.lastWriteTimeNanoSec, sizeof(st.lastWriteTimeNanoSec), st.type.toEnum()); 
+
+    MemoryMappedFile file; 
+    {   FileHandleOwner handle(FileOpener().openExistingOnly().readOnly().open(path)); 
+        file.map(handle.get()); 
+    }
+    ++numHashedFiles; 
+    numHashedBytes += file.size(); 
+    return hash64(file.data(), file.size()); 
+}
+
+bool jjm::Signatures::getOtherContentHash(Path const& path, std::uint64_t & contentHash)
+{
+    Stat const st = Stat::stat2(path); 
+    if (st.type == FileType::NoExist)
+        return false; 
+    string const& name = path.getStringRep(); 
+    {   Lock lock(otherFilesMutex); 
+        map<string, FileSignature>::const_iterator f = otherFiles.find(name); 
+        if (f != otherFiles.end() && f->second.hasFingerprintOf(st))
+        {   contentHash = f->second.contentHash; 
+            return true; 
+        }
+    }
+    //Hashed without the lock, so that goals hash different files at once. 
+    FileSignature f; 
+    f.sizeBytes = st.sizeBytes; 
+    f.lastWriteTimeNanoSec = st.lastWriteTimeNanoSec; 
+    f.fileId = st.fileId; 
+    f.contentHash = hashFile(path, st); 
+    {   Lock lock(otherFilesMutex); 
+        otherFiles[name] = f; 
+    }
+    std::uint64_t const values[4] = { f.sizeBytes, static_cast<std::uint64_t>(f.lastWriteTimeNanoSec), f.fileId, f.contentHash }; 
+    append(FileRecordType, name, values); 
+    contentHash = f.contentHash; 
+    return true; 
+}
+
+bool jjm::Signatures::getSignatureHash(Graph::PathId p, std::uint64_t & hash)
+{
+    if ( ! getContentHash(p, hash))
+        return false; 
+    //A touched stamp keeps its content, so its last write time is what 
+    //tells the goals which depend on it that it changed. 
+    if (isStamp[p])
+    {   std::int64_t const lastWriteTimeNanoSec = statCache->stat(p).lastWriteTimeNanoSec; 
+        hash = hash64( & lastWriteTimeNanoSec, sizeof(lastWriteTimeNanoSec), hash); 
+    }
+    return true; 
+}
+
+bool jjm::Signatures::computePathsSignature(Graph::IdRange const& paths, std::uint64_t & signature)
+{
+    vector<std::uint64_t> hashes; 
+    hashes.reserve(2 * paths.size()); 
+    for (Graph::PathId const * p = paths.begin(); p != paths.end(); ++p)
+    {   std::uint64_t contentHash = 0; 
+        if ( ! getSignatureHash(*p, contentHash))
+            return false; 
+        addToPathsSignature(hashes, graph->getPath(*p).getStringRep(), contentHash); 
+    }
+    signature = finishPathsSignature(hashes); 
+    return true; 
+}
+
+bool jjm::Signatures::computePathsSignature(std::vector<Path> const& paths, std::uint64_t & signature)
+{
+    vector<std::uint64_t> hashes; 
+    hashes.reserve(2 * paths.size()); 
+    for (vector<Path>::const_iterator p = paths.begin(); p != paths.end(); ++p)
+    {   std::uint64_t contentHash = 0; 
+        Graph::PathId const id = graph->findPath(*p); 
+        if (id != Graph::noPath() ? ! getSignatureHash(id, contentHash) : ! getOtherContentHash(*p, contentHash))
+            return false; 
+        addToPathsSignature(hashes, p->getStringRep(), contentHash); 
+    }
+    signature = finishPathsSignature(hashes); 
+    return true; 
+}
+
+bool jjm::Signatures::addDynamicPaths(std::vector<Path> const& paths, std::uint64_t & signature)
+{
+    std::uint64_t values[2] = { signature, 0 }; 
+    if ( ! computePathsSignature(paths, values[1]))
+        return false; 
+    signature = hash64(values, sizeof(values)); 
+    return true; 
+}
+
+bool jjm::Signatures::computeGoalSignature(Graph::NodeId node, std::vector<Path> const* discoveredInputs, GoalSignature & signature)
+{
+    if ( ! computePathsSignature(graph->getInputPaths(node), signature.inputsSignature))
+        return false; 
+    if ( ! computePathsSignature(graph->getOutputPaths(node), signature.outputsSignature))
+        return false; 
+    signature.discoveredInputsSignature = 0; 
+    if (discoveredInputs != 0)
+    {   if (discoveredInputs->size() && ! computePathsSignature(*discoveredInputs, signature.discoveredInputsSignature))
+            return false; 
+    }else if (graph->getDiscoveredInputPaths(node).size() 
+            && ! computePathsSignature(graph->getDiscoveredInputPaths(node), signature.discoveredInputsSignature))
+        return false; 
+    //The dynamic paths are combined into the signatures of the discovered 
+    //inputs and of the outputs, which are those of the graph alone for a 
+    //goal without dynamic paths. 
+    Node const* const n = graph->getNode(node); 
+    if (n->dynamicInputPaths.size() && ! addDynamicPaths(n->dynamicInputPaths, signature.discoveredInputsSignature))
+        return false; 
+    if (n->dynamicOutputPaths.size() && ! addDynamicPaths(n->dynamicOutputPaths, signature.outputsSignature))
+        return false; 
+    string const command = graph->getNode(node)->getCommand(); 
+    signature.commandHash = hash64(command.data(), command.size()); 
+    return true; 
+}
+
+bool jjm::Signatures::hasChanged(Graph::NodeId node)
+{
+    GoalSignature current; 
+    if ( ! computeGoalSignature(node, 0, current))
+        return true; 
+    Lock lock(getMutex(node)); 
+    return ! hasGoal[node] || ! (goals[node] == current); 
+}
+
+bool jjm::Signatures::getActionKey(Graph::NodeId node, std::uint64_t & key)
+{
+    std::uint64_t values[4] = { 0, 0, 0, 0 }; 
+    if ( ! computePathsSignature(graph->getInputPaths(node), values[0]))
+        return false; 
+    Graph::IdRange const discoveredInputs = graph->getDiscoveredInputPaths(node); 
+    if (discoveredInputs.size() && ! computePathsSignature(discoveredInputs, values[3]))
+        return false; 
+    string const command = graph->getNode(node)->getCommand(); 
+    values[1] = hash64(command.data(), command.size()); 
+    string outputNames; 
+    Graph::IdRange const outputs = graph->getOutputPaths(node); 
+    for (Graph::PathId const * p = outputs.begin(); p != outputs.end(); ++p)
+        outputNames += graph->getPath(*p).getStringRep() + '\0'; 
+    values[2] = hash64(outputNames.data(), outputNames.size()); 
+    //The keys of goals without discovered inputs are as before there were 
+    //discovered inputs. 
+    key = hash64(values, discoveredInputs.size() ? sizeof(values) : 3 * sizeof(values[0])); 
+    return true; 
+}
+
+void jjm::Signatures::recordSuccess(Graph::NodeId node, std::vector<Path> const* discoveredInputs)
+{
+    GoalSignature current; 
+    if ( ! computeGoalSignature(node, discoveredInputs, current))
+    {   recordFailure(node); 
+        return; 
+    }
+    {   Lock lock(getMutex(node)); 
+        if (hasGoal[node] && goals[node] == current)
+            return; //an up to date goal, nothing new to record
+        goals[node] = current; 
+        hasGoal[node] = 1; 
+    }
+    std::uint64_t const values[4] = { current.inputsSignature, current.commandHash, current.outputsSignature, current.discoveredInputsSignature }; 
+    append(GoalRecordType, graph->getNode(node)->goalName, values); 
+}
+
+void jjm::Signatures::recordFailure(Graph::NodeId node)
+{
+    {   Lock lock(getMutex(node)); 
+        hasGoal[node] = 0; 
+    }
+    std::uint64_t const values[4] = { 0, 0, 0, 0 }; 
+    append(GoalFailedRecordType, graph->getNode(node)->goalName, values); 
+}
+
+void jjm::Signatures::append(std::uint32_t type, std::string const& name, std::uint64_t const (& values)[4])
+{
+    Lock lock(appendMutex); 
+    if ( ! isLoaded())
+        return; 
+    appendRecord(appendBuffer, type, name, values); 
+    if (appendBuffer.size() >= maxAppendBufferBytes 
+            || getMonotonicClockNanoSec() - lastFlushNanoSec >= maxAppendDelayNanoSec)
+        flushImpl(); 
+}
+
+void jjm::Signatures::flush()
+{
+    Lock lock(appendMutex); 
+    flushImpl(); 
+}
+
+void jjm::Signatures::flushImpl()
+{
+    lastFlushNanoSec = getMonotonicClockNanoSec(); 
+    if (appendBuffer.empty() || ! isLoaded())
+        return; 
+    //With append, records go to the end of the file even when another jjmake
+    //process is appending. A record torn by a crash or by a concurrent writer
+    //ends the journal as far as load() is concerned, and load() then compacts
+    //it away. 
+    FileHandleOwner out(FileOpener().createOrOpen().writeOnly().append().open(path)); 
+    out.get().writeComplete(appendBuffer.data(), appendBuffer.size()); 
+    appendBuffer.clear(); 
+    if (0 != out.release().close2())
+        throw std::runtime_error("jjm::Signatures::flush() failed. Cause:\nClosing \"" + path.getStringRep() + "\" failed."); 
+}
@@ -0,0 +1,195 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#ifndef JJMAKE_SIGNATURES_HPP_HEADER_GUARD
+#define JJMAKE_SIGNATURES_HPP_HEADER_GUARD
+
+#include "graph.hpp"
+#include "jbase/jstdint.hpp"
+#include "josutils/jpath.hpp"
+#include "josutils/jstat.hpp"
+#include "josutils/jthreading.hpp"
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace jjm
+{
+
+class StatCache; 
+
+/* Signatures is the record of the content of files, kept between runs of 
+jjmake, so that a file whose timestamp changed without a change of content 
+does not cause goals to execute. 
+
+For every path of the graph, it keeps a content hash together with the 
+cheap fingerprint of the file (size, last write time, and file id) at the 
+time of hashing. A file is hashed again only when its fingerprint changes. 
+The outputs of goals with stamp outputs, such as touch-node, are signed by 
+their content and last write time, as touching them is what they are for. 
+For every goal, it keeps the combined signatures of the inputs, of the 
+discovered inputs, and of the outputs, and the hash of the command, as of 
+the last successful execution of the goal. The inputs and outputs which 
+dyndep files added to a goal are part of the signatures of its discovered 
+inputs and of its outputs. An output which was modified later, or only 
+partly written by an interrupted execution, makes the goal out of date. 
+
+The file is a journal. Records are appended as files are hashed and as goals
+complete, so the work of an interrupted build is not lost. Appends are 
+buffered, and a batch is written with a single append. load() replays the 
+journal, where later records replace earlier records of the same path or 
+goal. It stops at the first torn or corrupt record. When most records are 
+dead, or the tail is torn, load() compacts the journal into one record per 
+path and goal. 
+
+Entries of paths and goals which are not in the graph are kept as they are.
+The file uses the byte order of the machine which wrote it. A file which is
+not a signature file of this machine is discarded and replaced. */
+class Signatures
+{
+public:
+    class FileSignature
+    {
+    public:
+        FileSignature() : sizeBytes(0), lastWriteTimeNanoSec(0), fileId(0), contentHash(0) {}
+        bool hasFingerprintOf(Stat const& st) const
+        {   return sizeBytes == st.sizeBytes 
+                    && lastWriteTimeNanoSec == st.lastWriteTimeNanoSec 
+                    && fileId == st.fileId; 
+        }
+        std::uint64_t sizeBytes; 
+        std::int64_t lastWriteTimeNanoSec; 
+        std::uint64_t fileId; 
+        std::uint64_t contentHash; 
+    }; 
+
+    Signatures(); 
+    ~Signatures(); 
+
+    //Reads the file when it exists. 
+    //Throws std::exception on errors. 
+    void load(Path const& path); 
+    bool isLoaded() const { return ! path.isEmpty(); }
+
+    //Matches the loaded entries to the paths and goals of the frozen graph. 
+    //Call this after load() and before the functions below. 
+    void attach(Graph const& graph, StatCache & statCache); 
+
+    //Undoes attach(), keeping every entry. Call before the graph or its nodes
+    //are modified, and then attach() to the new graph. 
+    void detach(); 
+
+    //Returns false when the file does not exist. Files which are not regular
+    //files are represented by their last write time. 
+    //It is safe to call concurrently. 
+    //Throws std::exception on errors. 
+    bool getContentHash(Graph::PathId path, std::uint64_t & contentHash); 
+
+    //Returns true when an input, a discovered input or an output does not 
+    //exist, or when the inputs, the discovered inputs, the outputs or the 
+    //command differ from those of the last successful execution of the goal. 
+    //It is safe to call concurrently. 
+    //Throws std::exception on errors. 
+    bool hasChanged(Graph::NodeId node); 
+
+    //Returns false when an input does not exist. The key is a hash of the 
+    //command of the goal, of the signature of its inputs and discovered 
+    //inputs, and of the names of its outputs, which is what the outputs of a 
+    //successful execution depend on. 
+    //It is safe to call concurrently. 
+    //Throws std::exception on errors. 
+    bool getActionKey(Graph::NodeId node, std::uint64_t & key); 
+
+    //Call after the goal executes. A failed goal has no recorded inputs, so 
+    //it always executes next time. The discovered inputs are those of the 
+    //graph, unless the execution discovered others, which need not be paths 
+    //of the graph. 
+    //It is safe to call concurrently. 
+    //Throws std::exception on errors. 
+    void recordSuccess(Graph::NodeId node, std::vector<Path> const* discoveredInputs = 0); 
+    void recordFailure(Graph::NodeId node); 
+
+    //Appends all buffered records to the file. Does nothing before load(). 
+    //Throws std::exception on errors. 
+    void flush(); 
+
+    std::int64_t getNumHashedFiles() const { return numHashedFiles; }
+    std::int64_t getNumHashedBytes() const { return numHashedBytes; }
+    //As of load(). 
+    std::size_t getNumJournalRecords() const { return numJournalRecords; }
+
+private:
+    Signatures(Signatures const& ); //not defined, not copyable
+    Signatures& operator= (Signatures const& ); //not defined, not copyable
+
+    std::uint64_t hashFile(Path const& path, Stat const& st); 
+    //As getContentHash(), for a path which is not in the graph. 
+    bool getOtherContentHash(Path const& path, std::uint64_t & contentHash); 
+    void compact(); 
+    void append(std::uint32_t type, std::string const& name, std::uint64_t const (& values)[4]); 
+    void flushImpl(); 
+
+    class GoalSignature
+    {
+    public:
+        GoalSignature() : inputsSignature(0), commandHash(0), outputsSignature(0), discoveredInputsSignature(0) {}
+        bool operator== (GoalSignature const& x) const 
+        {   return inputsSignature == x.inputsSignature 
+                    && commandHash == x.commandHash 
+                    && outputsSignature == x.outputsSignature 
+                    && discoveredInputsSignature == x.discoveredInputsSignature; 
+        }
+        std::uint64_t inputsSignature; 
+        std::uint64_t commandHash; 
+        std::uint64_t outputsSignature; 
+        //0 without discovered inputs, as in files written before there were 
+        //discovered inputs. 
+        std::uint64_t discoveredInputsSignature; 
+    }; 
+
+    //As getContentHash(), combined with the last write time of a stamp. 
+    bool getSignatureHash(Graph::PathId path, std::uint64_t & hash); 
+    //Return false when a path does not exist. 
+    bool computePathsSignature(Graph::IdRange const& paths, std::uint64_t & signature); 
+    bool computePathsSignature(std::vector<Path> const& paths, std::uint64_t & signature); 
+    bool computeGoalSignature(Graph::NodeId node, std::vector<Path> const* discoveredInputs, GoalSignature & signature); 
+    //Combines the signature of the paths into the signature. 
+    bool addDynamicPaths(std::vector<Path> const& paths, std::uint64_t & signature); 
+
+    enum { numMutexes = 64 }; 
+    Mutex & getMutex(std::uint32_t id) { return mutexes[id % numMutexes]; }
+
+    Path path; 
+    Graph const* graph; 
+    StatCache * statCache; 
+
+    //Loaded entries which are not in the graph, and the files outside the 
+    //graph which goals discovered as inputs. 
+    Mutex otherFilesMutex; //protects this->otherFiles while attached
+    std::map<std::string, FileSignature> otherFiles; 
+    std::map<std::string, GoalSignature> otherGoals; 
+
+    //Indexed by path id and by node id. 
+    std::vector<FileSignature> files; 
+    std::vector<char> hasFile; 
+    std::vector<char> isStamp; //set once by attach()
+    std::vector<GoalSignature> goals; 
+    std::vector<char> hasGoal; 
+    Mutex mutexes[numMutexes]; //protects the above vectors
+    std::size_t numJournalRecords; 
+
+    Mutex appendMutex; //protects the members below
+    std::string appendBuffer; 
+    std::int64_t lastFlushNanoSec; 
+
+    std::atomic<std::int64_t> numHashedFiles; 
+    std::atomic<std::int64_t> numHashedBytes; 
+};
+
+} //namespace jjm
+
+#endif
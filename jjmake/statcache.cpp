@@ -0,0 +1,51 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "statcache.hpp"
+
+#include "jbase/jfatal.hpp"
+
+using namespace jjm;
+using namespace std;
+
+jjm::StatCache::StatCache() : graph(0), numStatCalls(0), numSavedStatCalls(0) {}
+
+void jjm::StatCache::reset(Graph const& graph_)
+{
+    graph = & graph_; 
+    stats.assign(graph->getNumPaths(), Stat()); 
+    valid.assign(graph->getNumPaths(), 0); 
+    numStatCalls = 0; 
+    numSavedStatCalls = 0; 
+}
+
+jjm::Stat jjm::StatCache::stat(Graph::PathId path)
+{
+    if (path >= stats.size())
+        JFATAL(path, 0); 
+    //The system call is made while holding the lock, so that another goal 
+    //which wants the same path waits for the result instead of repeating it. 
+    Lock lock(getMutex(path)); 
+    if (valid[path])
+    {   ++numSavedStatCalls; 
+        return stats[path]; 
+    }
+    ++numStatCalls; 
+    stats[path] = Stat::stat(graph->getPath(path)); 
+    valid[path] = 1; 
+    return stats[path]; 
+}
+
+jjm::Stat jjm::StatCache::refresh(Graph::PathId path)
+{
+    if (path >= stats.size())
+        JFATAL(path, 0); 
+    Lock lock(getMutex(path)); 
+    ++numStatCalls; 
+    valid[path] = 0; 
+    stats[path] = Stat::stat(graph->getPath(path)); 
+    valid[path] = 1; 
+    return stats[path]; 
+}
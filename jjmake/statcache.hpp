@@ -0,0 +1,64 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#ifndef JJMAKE_STATCACHE_HPP_HEADER_GUARD
+#define JJMAKE_STATCACHE_HPP_HEADER_GUARD
+
+#include "graph.hpp"
+#include "jbase/jstdint.hpp"
+#include "josutils/jstat.hpp"
+#include "josutils/jthreading.hpp"
+
+#include <atomic>
+#include <vector>
+
+namespace jjm
+{
+
+/* StatCache memoizes jjm::Stat::stat for the paths of the frozen Graph, so 
+that a path which is an input of many goals is stat-ed once per build. 
+
+Entries are indexed by path id. Each entry is protected by one of a fixed 
+number of mutexes, so that goals on different threads rarely contend. 
+All member functions except reset() are safe to call concurrently. */
+class StatCache
+{
+public:
+    StatCache(); 
+
+    //Forgets all results, and makes room for every path of the graph. 
+    void reset(Graph const& graph); 
+
+    //Returns the result of Stat::stat for the path. Only the first call for a
+    //path makes the system call. 
+    //Throws std::exception on errors, like Stat::stat. 
+    Stat stat(Graph::PathId path); 
+
+    //Stats the path again, and replaces the remembered result. 
+    //Call this after modifying the file. 
+    //Throws std::exception on errors, like Stat::stat. 
+    Stat refresh(Graph::PathId path); 
+
+    std::int64_t getNumStatCalls() const { return numStatCalls; }
+    std::int64_t getNumSavedStatCalls() const { return numSavedStatCalls; }
+
+private:
+    StatCache(StatCache const& ); //not defined, not copyable
+    StatCache& operator= (StatCache const& ); //not defined, not copyable
+
+    enum { numMutexes = 64 }; 
+    Mutex & getMutex(Graph::PathId path) { return mutexes[path % numMutexes]; }
+
+    Graph const* graph; 
+    std::vector<Stat> stats; 
+    std::vector<char> valid; 
+    Mutex mutexes[numMutexes]; 
+    std::atomic<std::int64_t> numStatCalls; 
+    std::atomic<std::int64_t> numSavedStatCalls; 
+};
+
+} //namespace jjm
+
+#endif
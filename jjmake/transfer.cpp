@@ -0,0 +1,135 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "transfer.hpp"
+
+#include "jbase/jcompress.hpp"
+#include "jbase/jinttostring.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace jjm; 
+using namespace std; 
+
+namespace
+{
+    size_t const chunkBytes = 256 * 1024; 
+    std::uint32_t const maxChunkBytes = 4 * 1024 * 1024; 
+}
+
+void jjm::appendUint32(std::string & out, std::uint32_t x)
+{
+    for (int i = 0; i < 4; ++i)
+        out.push_back(static_cast<char>((x >> (8 * i)) & 0xFF)); 
+}
+
+void jjm::appendUint64(std::string & out, std::uint64_t x)
+{
+    for (int i = 0; i < 8; ++i)
+        out.push_back(static_cast<char>((x >> (8 * i)) & 0xFF)); 
+}
+
+void jjm::appendString(std::string & out, std::string const& x)
+{
+    appendUint32(out, static_cast<std::uint32_t>(x.size())); 
+    out += x; 
+}
+
+std::uint64_t jjm::getUint(unsigned char const * p, int sizeBytes)
+{
+    std::uint64_t x = 0; 
+    for (int i = sizeBytes - 1; i >= 0; --i)
+        x = (x << 8) | p[i]; 
+    return x; 
+}
+
+std::uint32_t jjm::readUint32(Socket & socket)
+{
+    unsigned char x[4]; 
+    socket.readComplete(x, 4); 
+    return static_cast<std::uint32_t>(getUint(x, 4)); 
+}
+
+std::uint64_t jjm::readUint64(Socket & socket)
+{
+    unsigned char x[8]; 
+    socket.readComplete(x, 8); 
+    return getUint(x, 8); 
+}
+
+std::string jjm::readString(Socket & socket, std::uint32_t maxBytes)
+{
+    std::uint32_t const size = readUint32(socket); 
+    if (size > maxBytes)
+        throw std::runtime_error("jjm::readString() failed. Cause:\nReceived a string of " + toDecStr(size) + " bytes."); 
+    string x(size, '\0'); 
+    if (size)
+        socket.readComplete( & x[0], size); 
+    return x; 
+}
+
+void jjm::writeUint32(Socket & socket, std::uint32_t x)
+{
+    string out; 
+    appendUint32(out, x); 
+    socket.writeComplete(out.data(), out.size()); 
+}
+
+std::uint64_t jjm::sendFileChunks(Socket & socket, FileHandle file, std::uint64_t sizeBytes)
+{
+    string raw(chunkBytes, '\0'); 
+    string message; 
+    std::uint64_t wireBytes = 0; 
+    for (std::uint64_t sent = 0; sent < sizeBytes; )
+    {   size_t const want = static_cast<size_t>(std::min<std::uint64_t>(chunkBytes, sizeBytes - sent)); 
+        for (size_t done = 0; done < want; )
+        {   ssize_t const n = file.read( & raw[done], want - done); 
+            if (n < 0)
+                throw std::runtime_error("jjm::sendFileChunks() failed. Cause:\nThe file became shorter while it was sent."); 
+            done += n; 
+        }
+        message.clear(); 
+        appendUint32(message, static_cast<std::uint32_t>(want)); 
+        appendUint32(message, 0); 
+        compressBlock(raw.data(), want, message); 
+        std::uint32_t packed = static_cast<std::uint32_t>(message.size() - 8); 
+        if (packed >= want)
+        {   //incompressible, sent as it is 
+            message.resize(8); 
+            message.append(raw.data(), want); 
+            packed = static_cast<std::uint32_t>(want); 
+        }
+        for (int i = 0; i < 4; ++i)
+            message[4 + i] = static_cast<char>((packed >> (8 * i)) & 0xFF); 
+        socket.writeComplete(message.data(), message.size()); 
+        sent += want; 
+        wireBytes += message.size(); 
+    }
+    return wireBytes; 
+}
+
+void jjm::receiveFileChunks(Socket & socket, FileHandle file, std::uint64_t sizeBytes)
+{
+    string packed; 
+    string raw; 
+    for (std::uint64_t received = 0; received < sizeBytes; )
+    {   std::uint32_t const rawSize = readUint32(socket); 
+        std::uint32_t const packedSize = readUint32(socket); 
+        if (rawSize == 0 || rawSize > maxChunkBytes || rawSize > sizeBytes - received || packedSize > rawSize)
+            throw std::runtime_error("jjm::receiveFileChunks() failed. Cause:\nReceived a malformed chunk header."); 
+        packed.resize(packedSize); 
+        socket.readComplete( & packed[0], packedSize); 
+        if (packedSize == rawSize)
+            file.writeComplete(packed.data(), packedSize); 
+        else
+        {   raw.clear(); 
+            if ( ! decompressBlock(packed.data(), packedSize, rawSize, raw))
+                throw std::runtime_error("jjm::receiveFileChunks() failed. Cause:\nReceived a malformed compressed chunk."); 
+            file.writeComplete(raw.data(), rawSize); 
+        }
+        received += rawSize; 
+    }
+}
@@ -0,0 +1,50 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#ifndef JJMAKE_TRANSFER_HPP_HEADER_GUARD
+#define JJMAKE_TRANSFER_HPP_HEADER_GUARD
+
+#include "jbase/jstdint.hpp"
+#include "josutils/jfilehandle.hpp"
+#include "josutils/jsocket.hpp"
+
+#include <string>
+
+namespace jjm
+{
+
+/* The framing shared by the protocols of the cache server and of the remote
+workers. Every integer is little endian. A string is its length (4 bytes) 
+and its bytes. A file is sent as chunks: 
+    chunk:    raw size (4 bytes, at most 4 MiB), packed size (4 bytes), then 
+              the packed bytes, which are compressBlock() of the raw bytes, or
+              the raw bytes themselves when the packed size is the raw size. 
+Files stream through in chunks of 256 KiB, so neither side holds a whole 
+file in memory. 
+
+The functions which read and write throw std::exception on errors, and on
+malformed input. */
+
+void appendUint32(std::string & out, std::uint32_t x); 
+void appendUint64(std::string & out, std::uint64_t x); 
+void appendString(std::string & out, std::string const& x); 
+std::uint64_t getUint(unsigned char const * p, int sizeBytes); 
+
+std::uint32_t readUint32(Socket & socket); 
+std::uint64_t readUint64(Socket & socket); 
+//Fails for strings longer than maxBytes. 
+std::string readString(Socket & socket, std::uint32_t maxBytes); 
+void writeUint32(Socket & socket, std::uint32_t x); 
+
+//Sends sizeBytes bytes read from the file as chunks. Returns the number of
+//bytes sent over the socket. 
+std::uint64_t sendFileChunks(Socket & socket, FileHandle file, std::uint64_t sizeBytes); 
+
+//Receives sizeBytes bytes as chunks, and writes them to the file. 
+void receiveFileChunks(Socket & socket, FileHandle file, std::uint64_t sizeBytes); 
+
+} //namespace jjm
+
+#endif
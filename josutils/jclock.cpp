@@ -0,0 +1,59 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "jclock.hpp"
+
+#include "jbase/jfatal.hpp"
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <errno.h>
+    #include <time.h>
+#endif
+
+
+#ifdef _WIN32
+    std::int64_t jjm::getMonotonicClockNanoSec()
+    {
+        LARGE_INTEGER frequency; 
+        if ( ! QueryPerformanceFrequency( & frequency))
+            JFATAL(0, 0); 
+        LARGE_INTEGER counter; 
+        if ( ! QueryPerformanceCounter( & counter))
+            JFATAL(0, 0); 
+        //split the multiplication to avoid overflow on long uptimes
+        std::int64_t const seconds = counter.QuadPart / frequency.QuadPart; 
+        std::int64_t const remainder = counter.QuadPart % frequency.QuadPart; 
+        return seconds * 1000 * 1000 * 1000 + (remainder * 1000 * 1000 * 1000) / frequency.QuadPart; 
+    }
+
+    std::int64_t jjm::getSystemClockNanoSec()
+    {
+        FILETIME fileTime; 
+        GetSystemTimeAsFileTime( & fileTime); 
+        ULARGE_INTEGER x; 
+        x.LowPart = fileTime.dwLowDateTime; 
+        x.HighPart = fileTime.dwHighDateTime; 
+        //FILETIME is in 100 nanosecond units since 1601-01-01. 
+        std::int64_t const epochDifference = 116444736000000000LL; 
+        return (static_cast<std::int64_t>(x.QuadPart) - epochDifference) * 100; 
+    }
+#else
+    namespace
+    {
+        inline std::int64_t getClock(clockid_t const clockId)
+        {
+            struct timespec ts; 
+            errno = 0; 
+            if (0 != clock_gettime(clockId, & ts))
+                JFATAL(errno, 0); 
+            return static_cast<std::int64_t>(ts.tv_sec) * 1000 * 1000 * 1000 + ts.tv_nsec; 
+        }
+    }
+
+    std::int64_t jjm::getMonotonicClockNanoSec() { return getClock(CLOCK_MONOTONIC); }
+    std::int64_t jjm::getSystemClockNanoSec() { return getClock(CLOCK_REALTIME); }
+#endif
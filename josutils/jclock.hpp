@@ -0,0 +1,25 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#ifndef JOSUTILS_JCLOCK_HPP_HEADER_GUARD
+#define JOSUTILS_JCLOCK_HPP_HEADER_GUARD
+
+#include "jbase/jstdint.hpp"
+
+namespace jjm
+{
+
+//Returns nanoseconds from an arbitrary fixed point in the past. 
+//The returned values never go backwards, and are unaffected by changes to the
+//system clock. Only meaningful when compared to other values from this 
+//function in the same process. 
+std::int64_t getMonotonicClockNanoSec(); 
+
+//Returns nanoseconds since the unix epoch according to the system clock. 
+std::int64_t getSystemClockNanoSec(); 
+
+} //namespace jjm
+
+#endif
@@ -0,0 +1,303 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "jfilesystem.hpp"
+
+#include "jstat.hpp"
+#include "jbase/jinttostring.hpp"
+#include "junicode/jutfstring.hpp"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <dirent.h>
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <stdio.h>
+    #include <sys/ioctl.h>
+    #include <sys/stat.h>
+    #include <sys/types.h>
+    #include <unistd.h>
+    #ifdef __linux__
+        #include <linux/fs.h>
+        #include <sys/syscall.h>
+    #endif
+#endif
+
+using namespace jjm;
+using namespace std;
+
+
+#ifdef _WIN32
+    namespace
+    {
+        Utf16String toWin32Path(Path const& path)
+        {
+            Utf16String result; 
+            auto cpRange = makeCpRange(path.getStringRep()); 
+            for (auto cp = cpRange.first; cp != cpRange.second; ++cp)
+            {   if (*cp == '/')
+                    result.push_back('\\');
+                else
+                    appendCp(result, *cp);
+            }
+            return result; 
+        }
+    }
+#endif
+
+
+void jjm::createDirectories(Path const& path)
+{
+    if (path.isEmpty())
+        return; 
+    Stat const st = Stat::stat(path); 
+    if (st.type == FileType::Directory)
+        return; 
+    if (st.type != FileType::NoExist)
+        throw std::runtime_error("Cannot create directory \"" + path.getStringRep() + "\" because a file of another type exists with the same name."); 
+    if ( ! path.isRootPath())
+        createDirectories(path.getParent()); 
+
+#ifdef _WIN32
+    SetLastError(0); 
+    if (CreateDirectoryW(toWin32Path(path).c_str(), 0))
+        return; 
+    DWORD const lastError = GetLastError(); 
+    if (lastError == ERROR_ALREADY_EXISTS && Stat::stat(path).type == FileType::Directory)
+        return; 
+    throw std::runtime_error("CreateDirectoryW(\"" + path.getStringRep() + "\", 0) failed. GetLastError() " + toDecStr(lastError) + "."); 
+#else
+    if (0 == mkdir(path.getStringRep().c_str(), 0777))
+        return; 
+    int const lastErrno = errno; 
+    //another process may have created it concurrently
+    if (lastErrno == EEXIST && Stat::stat(path).type == FileType::Directory)
+        return; 
+    throw std::runtime_error("mkdir(\"" + path.getStringRep() + "\", 0777) failed. errno " + toDecStr(lastErrno) + "."); 
+#endif
+}
+
+void jjm::renameFile(Path const& from, Path const& to)
+{
+#ifdef _WIN32
+    SetLastError(0); 
+    if (MoveFileExW(toWin32Path(from).c_str(), toWin32Path(to).c_str(), MOVEFILE_REPLACE_EXISTING))
+        return; 
+    DWORD const lastError = GetLastError(); 
+    throw std::runtime_error("MoveFileExW(\"" + from.getStringRep() + "\", \"" + to.getStringRep() + "\", MOVEFILE_REPLACE_EXISTING) failed. GetLastError() " + toDecStr(lastError) + "."); 
+#else
+    if (0 == ::rename(from.getStringRep().c_str(), to.getStringRep().c_str()))
+        return; 
+    int const lastErrno = errno; 
+    throw std::runtime_error("rename(\"" + from.getStringRep() + "\", \"" + to.getStringRep() + "\") failed. errno " + toDecStr(lastErrno) + "."); 
+#endif
+}
+
+void jjm::removeFile(Path const& path)
+{
+#ifdef _WIN32
+    SetLastError(0); 
+    if (DeleteFileW(toWin32Path(path).c_str()))
+        return; 
+    DWORD const lastError = GetLastError(); 
+    if (lastError == ERROR_FILE_NOT_FOUND)
+        return; 
+    throw std::runtime_error("DeleteFileW(\"" + path.getStringRep() + "\") failed. GetLastError() " + toDecStr(lastError) + "."); 
+#else
+    if (0 == ::unlink(path.getStringRep().c_str()))
+        return; 
+    int const lastErrno = errno; 
+    if (lastErrno == ENOENT)
+        return; 
+    throw std::runtime_error("unlink(\"" + path.getStringRep() + "\") failed. errno " + toDecStr(lastErrno) + "."); 
+#endif
+}
+
+void jjm::removeDirectory(Path const& path)
+{
+#ifdef _WIN32
+    SetLastError(0); 
+    if (RemoveDirectoryW(toWin32Path(path).c_str()))
+        return; 
+    DWORD const lastError = GetLastError(); 
+    if (lastError == ERROR_FILE_NOT_FOUND || lastError == ERROR_PATH_NOT_FOUND)
+        return; 
+    throw std::runtime_error("RemoveDirectoryW(\"" + path.getStringRep() + "\") failed. GetLastError() " + toDecStr(lastError) + "."); 
+#else
+    if (0 == ::rmdir(path.getStringRep().c_str()))
+        return; 
+    int const lastErrno = errno; 
+    if (lastErrno == ENOENT)
+        return; 
+    throw std::runtime_error("rmdir(\"" + path.getStringRep() + "\") failed. errno " + toDecStr(lastErrno) + "."); 
+#endif
+}
+
+void jjm::setFileTimesToNow(Path const& path)
+{
+#ifdef _WIN32
+    SetLastError(0); 
+    HANDLE const file = CreateFileW(toWin32Path(path).c_str(), FILE_WRITE_ATTRIBUTES, 
+            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, 0); 
+    if (file == INVALID_HANDLE_VALUE)
+    {   DWORD const lastError = GetLastError(); 
+        throw std::runtime_error("CreateFileW(\"" + path.getStringRep() + "\", FILE_WRITE_ATTRIBUTES) failed. GetLastError() " + toDecStr(lastError) + "."); 
+    }
+    FILETIME now; 
+    GetSystemTimeAsFileTime(& now); 
+    BOOL const x = SetFileTime(file, 0, & now, & now); 
+    DWORD const lastError = GetLastError(); 
+    CloseHandle(file); 
+    if (x)
+        return; 
+    throw std::runtime_error("SetFileTime() on \"" + path.getStringRep() + "\" failed. GetLastError() " + toDecStr(lastError) + "."); 
+#else
+    //A null times argument sets both times to the current time. 
+    if (0 == ::utimensat(AT_FDCWD, path.getStringRep().c_str(), 0, 0))
+        return; 
+    int const lastErrno = errno; 
+    throw std::runtime_error("utimensat(AT_FDCWD, \"" + path.getStringRep() + "\", 0, 0) failed. errno " + toDecStr(lastErrno) + "."); 
+#endif
+}
+
+std::vector<std::string> jjm::listDirectory(Path const& path)
+{
+    vector<string> names; 
+#ifdef _WIN32
+    WIN32_FIND_DATAW data; 
+    SetLastError(0); 
+    HANDLE const find = FindFirstFileW((toWin32Path(path) + L"\\*").c_str(), & data); 
+    if (find == INVALID_HANDLE_VALUE)
+    {   DWORD const lastError = GetLastError(); 
+        throw std::runtime_error("FindFirstFileW(\"" + path.getStringRep() + "\") failed. GetLastError() " + toDecStr(lastError) + "."); 
+    }
+    do
+    {   Utf8String const name = makeU8Str(Utf16String(data.cFileName)); 
+        if (name != "." && name != "..")
+            names.push_back(name); 
+    } while (FindNextFileW(find, & data)); 
+    FindClose(find); 
+#else
+    DIR * const dir = ::opendir(path.getStringRep().c_str()); 
+    if (dir == 0)
+    {   int const lastErrno = errno; 
+        throw std::runtime_error("opendir(\"" + path.getStringRep() + "\") failed. errno " + toDecStr(lastErrno) + "."); 
+    }
+    for (;;)
+    {   errno = 0; 
+        dirent * const entry = ::readdir(dir); 
+        if (entry == 0)
+        {   int const lastErrno = errno; 
+            ::closedir(dir); 
+            if (lastErrno != 0)
+                throw std::runtime_error("readdir() of \"" + path.getStringRep() + "\" failed. errno " + toDecStr(lastErrno) + "."); 
+            break; 
+        }
+        string const name = entry->d_name; 
+        if (name != "." && name != "..")
+            names.push_back(name); 
+    }
+#endif
+    return names; 
+}
+
+jjm::CopyMethod jjm::copyFile(Path const& from, Path const& to, bool allowHardLink)
+{
+#ifdef _WIN32
+    SetLastError(0); 
+    if (allowHardLink && CreateHardLinkW(toWin32Path(to).c_str(), toWin32Path(from).c_str(), 0))
+        return CopiedByHardLink; 
+    if (CopyFileW(toWin32Path(from).c_str(), toWin32Path(to).c_str(), TRUE))
+        return CopiedByCopy; 
+    DWORD const lastError = GetLastError(); 
+    throw std::runtime_error("CopyFileW(\"" + from.getStringRep() + "\", \"" + to.getStringRep() + "\") failed. GetLastError() " + toDecStr(lastError) + "."); 
+#else
+    int const src = ::open(from.getStringRep().c_str(), O_RDONLY | O_CLOEXEC); 
+    if (src == -1)
+    {   int const lastErrno = errno; 
+        throw std::runtime_error("open(\"" + from.getStringRep() + "\", O_RDONLY) failed. errno " + toDecStr(lastErrno) + "."); 
+    }
+    struct stat srcStat; 
+    if (0 != ::fstat(src, & srcStat))
+    {   int const lastErrno = errno; 
+        ::close(src); 
+        throw std::runtime_error("fstat() of \"" + from.getStringRep() + "\" failed. errno " + toDecStr(lastErrno) + "."); 
+    }
+    int const dst = ::open(to.getStringRep().c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, srcStat.st_mode & 0777); 
+    if (dst == -1)
+    {   int const lastErrno = errno; 
+        ::close(src); 
+        throw std::runtime_error("open(\"" + to.getStringRep() + "\", O_WRONLY | O_CREAT | O_EXCL) failed. errno " + toDecStr(lastErrno) + "."); 
+    }
+
+    CopyMethod method = CopiedByCopy; 
+    bool done = false; 
+    int lastErrno = 0; 
+#if defined(__linux__) && defined(FICLONE)
+    if (0 == ::ioctl(dst, FICLONE, src))
+    {   method = CopiedByReflink; 
+        done = true; 
+    }
+#endif
+    if ( ! done && allowHardLink)
+    {   ::close(dst); 
+        ::close(src); 
+        ::unlink(to.getStringRep().c_str()); 
+        if (0 == ::link(from.getStringRep().c_str(), to.getStringRep().c_str()))
+            return CopiedByHardLink; 
+        lastErrno = errno; 
+        //Another file system, or one without hard links. 
+        if (lastErrno != EXDEV && lastErrno != EPERM && lastErrno != EMLINK && lastErrno != ENOTSUP)
+            throw std::runtime_error("link(\"" + from.getStringRep() + "\", \"" + to.getStringRep() + "\") failed. errno " + toDecStr(lastErrno) + "."); 
+        return copyFile(from, to, false); 
+    }
+#if defined(__linux__) && defined(SYS_copy_file_range)
+    for (bool copied = false; ! done; )
+    {   long const n = ::syscall(SYS_copy_file_range, src, 0, dst, 0, static_cast<size_t>(1) << 30, 0U); 
+        if (n > 0)
+            copied = true; 
+        else if (n == 0)
+            done = true; 
+        else if (errno != EINTR)
+        {   //An unsupported pair of files fails before anything is copied, 
+            //and is then copied below. 
+            if (copied)
+                lastErrno = errno; 
+            break; 
+        }
+    }
+#endif
+    if ( ! done && lastErrno == 0)
+    {   char buffer[64 * 1024]; 
+        while ( ! done && lastErrno == 0)
+        {   ssize_t const n = ::read(src, buffer, sizeof(buffer)); 
+            if (n == 0)
+                done = true; 
+            else if (n < 0 && errno != EINTR)
+                lastErrno = errno; 
+            for (ssize_t written = 0; written < n && lastErrno == 0; )
+            {   ssize_t const w = ::write(dst, buffer + written, n - written); 
+                if (w > 0)
+                    written += w; 
+                else if (w < 0 && errno != EINTR)
+                    lastErrno = errno; 
+            }
+        }
+    }
+    ::close(src); 
+    if (0 != ::close(dst) && done)
+    {   done = false; 
+        lastErrno = errno; 
+    }
+    if ( ! done)
+    {   ::unlink(to.getStringRep().c_str()); 
+        throw std::runtime_error("Copying \"" + from.getStringRep() + "\" to \"" + to.getStringRep() + "\" failed. errno " + toDecStr(lastErrno) + "."); 
+    }
+    return method; 
+#endif
+}
@@ -0,0 +1,60 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#ifndef JOSUTILS_JFILESYSTEM_HPP_HEADER_GUARD
+#define JOSUTILS_JFILESYSTEM_HPP_HEADER_GUARD
+
+#include "jpath.hpp"
+
+#include <string>
+#include <vector>
+
+namespace jjm
+{
+
+//Creates the directory, and any missing parent directories. 
+//Does nothing if the directory already exists. 
+//Throws std::exception on errors. 
+void createDirectories(Path const& path); 
+
+//Renames the file "from" to "to", replacing any existing file named "to". 
+//On POSIX systems, another process sees either the old or the new "to" 
+//file, and never a missing or partial file. 
+//Throws std::exception on errors. 
+void renameFile(Path const& from, Path const& to); 
+
+//Removes the file. Does nothing if the file does not exist. 
+//Throws std::exception on errors. 
+void removeFile(Path const& path); 
+
+//Removes the directory, which must be empty. Does nothing if the directory
+//does not exist. 
+//Throws std::exception on errors. 
+void removeDirectory(Path const& path); 
+
+//Sets the last write time and the last access time of the file to the 
+//current time. The file must exist. 
+//Throws std::exception on errors. 
+void setFileTimesToNow(Path const& path); 
+
+//Returns the names of the entries of the directory, without "." and "..", 
+//in no particular order. 
+//Throws std::exception on errors. 
+std::vector<std::string> listDirectory(Path const& path); 
+
+enum CopyMethod { CopiedByReflink, CopiedByHardLink, CopiedByCopy }; 
+
+//Creates the file "to", which must not exist, with the content of "from". 
+//The cheapest available method is used: a reflink, which shares the data 
+//until either file is modified, then a hard link when allowHardLink, and 
+//then copy_file_range(), which copies within the kernel, and finally an 
+//ordinary copy. A hard link shares the file itself, so that a later change 
+//of either file changes both. 
+//Throws std::exception on errors. 
+CopyMethod copyFile(Path const& from, Path const& to, bool allowHardLink); 
+
+} //namespace jjm
+
+#endif
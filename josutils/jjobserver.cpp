@@ -0,0 +1,290 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "jjobserver.hpp"
+
+#include "jenv.hpp"
+#include "jprocess.hpp"
+#include "jbase/jfatal.hpp"
+#include "jbase/jinttostring.hpp"
+#include "jbase/juniqueptr.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <stdexcept>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+using namespace jjm;
+using namespace std;
+
+namespace
+{
+    //Returns the value of the last jobserver flag of MAKEFLAGS, or the empty
+    //string. The last flag is the one of the closest make. 
+    string findJobServerAuth(string const& makeFlags)
+    {
+        char const * const prefixes[] = { "--jobserver-auth=", "--jobserver-fds=" }; 
+        string result; 
+        for (size_t begin = 0; begin < makeFlags.size(); )
+        {   size_t end = makeFlags.find(' ', begin); 
+            if (end == string::npos)
+                end = makeFlags.size(); 
+            string const word = makeFlags.substr(begin, end - begin); 
+            for (size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); ++i)
+            {   string const prefix = prefixes[i]; 
+                if (word.compare(0, prefix.size(), prefix) == 0)
+                    result = word.substr(prefix.size()); 
+            }
+            begin = end + 1; 
+        }
+        return result; 
+    }
+
+    std::atomic<int> nextJobServerNumber(0); 
+}
+
+jjm::JobServerClient* jjm::JobServerClient::fromEnvironment()
+{
+    return fromMakeFlags(getEnvVarUtf8("MAKEFLAGS")); 
+}
+
+#ifdef _WIN32
+
+jjm::JobServerClient::JobServerClient() : implicitTokenIsFree(true), semaphore(0) {}
+
+jjm::JobServerClient::~JobServerClient()
+{
+    if (semaphore && ! CloseHandle(semaphore))
+        JFATAL(GetLastError(), 0); 
+}
+
+jjm::JobServerClient* jjm::JobServerClient::fromMakeFlags(std::string const& makeFlags)
+{
+    string const auth = findJobServerAuth(makeFlags); 
+    if (auth.empty() || auth.compare(0, 5, "fifo:") == 0 || auth.find(',') != string::npos)
+        return 0; 
+    UniquePtr<JobServerClient*> client(new JobServerClient); 
+    client.get()->semaphore = OpenSemaphoreW(SEMAPHORE_MODIFY_STATE | SYNCHRONIZE, FALSE, makeU16Str(auth).c_str()); 
+    if (client.get()->semaphore == 0)
+        return 0; 
+    return client.release(); 
+}
+
+bool jjm::JobServerClient::acquire(Token & token, int timeoutMillis)
+{
+    {   Lock lock(mutex); 
+        if (implicitTokenIsFree)
+        {   implicitTokenIsFree = false; 
+            token.isImplicit = true; 
+            return true; 
+        }
+    }
+    DWORD const waitResult = WaitForSingleObject(semaphore, timeoutMillis < 0 ? INFINITE : static_cast<DWORD>(timeoutMillis)); 
+    if (waitResult == WAIT_TIMEOUT)
+        return false; 
+    if (waitResult != WAIT_OBJECT_0)
+    {   DWORD const lastError = GetLastError(); 
+        throw std::runtime_error("jjm::JobServerClient::acquire() failed. Cause:\nWaitForSingleObject() failed. GetLastError() " + toDecStr(lastError) + "."); 
+    }
+    token.isImplicit = false; 
+    return true; 
+}
+
+void jjm::JobServerClient::release(Token const& token)
+{
+    if (token.isImplicit)
+    {   Lock lock(mutex); 
+        implicitTokenIsFree = true; 
+        return; 
+    }
+    if ( ! ReleaseSemaphore(semaphore, 1, 0))
+    {   DWORD const lastError = GetLastError(); 
+        throw std::runtime_error("jjm::JobServerClient::release() failed. Cause:\nReleaseSemaphore() failed. GetLastError() " + toDecStr(lastError) + "."); 
+    }
+}
+
+jjm::JobServer::JobServer(int numJobs) : semaphore(0)
+{
+    if (numJobs < 1)
+        JFATAL(numJobs, 0); 
+    string const name = "jjmake_jobserver_" + toDecStr(getPid()) + "_" + toDecStr(nextJobServerNumber++); 
+    LONG const numTokens = numJobs - 1; 
+    semaphore = CreateSemaphoreW(0, numTokens, numTokens > 0 ? numTokens : 1, makeU16Str(name).c_str()); 
+    if (semaphore == 0)
+    {   DWORD const lastError = GetLastError(); 
+        throw std::runtime_error("jjm::JobServer::JobServer() failed. Cause:\nCreateSemaphoreW() failed. GetLastError() " + toDecStr(lastError) + "."); 
+    }
+    makeFlags = "-j" + toDecStr(numJobs) + " --jobserver-auth=" + name; 
+}
+
+jjm::JobServer::~JobServer()
+{
+    if ( ! CloseHandle(semaphore))
+        JFATAL(GetLastError(), 0); 
+}
+
+#else
+
+jjm::JobServerClient::JobServerClient() : implicitTokenIsFree(true), readFd(-1), writeFd(-1) {}
+
+jjm::JobServerClient::~JobServerClient()
+{
+    if (readFd != -1 && 0 != close(readFd))
+        JFATAL(errno, 0); 
+    if (writeFd != -1 && writeFd != readFd && 0 != close(writeFd))
+        JFATAL(errno, 0); 
+}
+
+jjm::JobServerClient* jjm::JobServerClient::fromMakeFlags(std::string const& makeFlags)
+{
+    string const auth = findJobServerAuth(makeFlags); 
+    if (auth.empty())
+        return 0; 
+    UniquePtr<JobServerClient*> client(new JobServerClient); 
+
+    if (auth.compare(0, 5, "fifo:") == 0)
+    {   string const path = auth.substr(5); 
+        int const fd = ::open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC); 
+        if (fd == -1)
+        {   int const lastErrno = errno; 
+            throw std::runtime_error("jjm::JobServerClient::fromMakeFlags() failed. Cause:\n"
+                    "Opening the jobserver \"" + path + "\" failed. errno " + toDecStr(lastErrno) + "."); 
+        }
+        client.get()->readFd = fd; 
+        client.get()->writeFd = fd; 
+        return client.release(); 
+    }
+
+    size_t const comma = auth.find(','); 
+    int r = -1; 
+    int w = -1; 
+    if (comma == string::npos 
+            || ! decStrToInteger(r, auth.substr(0, comma)) 
+            || ! decStrToInteger(w, auth.substr(comma + 1)) 
+            || r < 0 || w < 0)
+        return 0; 
+    if (fcntl(r, F_GETFD) == -1 || fcntl(w, F_GETFD) == -1)
+        return 0; 
+
+    //Reads go through a file description of our own where possible, so that
+    //it can be nonblocking without changing the inherited one, which other 
+    //processes share. 
+    client.get()->readFd = ::open(("/proc/self/fd/" + toDecStr(r)).c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC); 
+    if (client.get()->readFd == -1)
+        client.get()->readFd = fcntl(r, F_DUPFD_CLOEXEC, 0); 
+    if (client.get()->readFd != -1)
+        client.get()->writeFd = fcntl(w, F_DUPFD_CLOEXEC, 0); 
+    if (client.get()->readFd == -1 || client.get()->writeFd == -1)
+    {   int const lastErrno = errno; 
+        throw std::runtime_error("jjm::JobServerClient::fromMakeFlags() failed. Cause:\n"
+                "Duplicating the jobserver file descriptors " + auth + " failed. errno " + toDecStr(lastErrno) + "."); 
+    }
+    return client.release(); 
+}
+
+bool jjm::JobServerClient::acquire(Token & token, int timeoutMillis)
+{
+    {   Lock lock(mutex); 
+        if (implicitTokenIsFree)
+        {   implicitTokenIsFree = false; 
+            token.isImplicit = true; 
+            return true; 
+        }
+    }
+
+    struct pollfd p; 
+    p.fd = readFd; 
+    p.events = POLLIN; 
+    p.revents = 0; 
+    int const pollResult = poll( & p, 1, timeoutMillis); 
+    if (pollResult == 0)
+        return false; 
+    if (pollResult == -1)
+    {   int const lastErrno = errno; 
+        if (lastErrno == EINTR)
+            return false; 
+        throw std::runtime_error("jjm::JobServerClient::acquire() failed. Cause:\npoll() failed. errno " + toDecStr(lastErrno) + "."); 
+    }
+    char value = 0; 
+    ssize_t const n = ::read(readFd, & value, 1); 
+    if (n == 1)
+    {   token.isImplicit = false; 
+        token.value = value; 
+        return true; 
+    }
+    if (n == 0)
+        throw std::runtime_error("jjm::JobServerClient::acquire() failed. Cause:\nThe jobserver was closed."); 
+    int const lastErrno = errno; 
+    //Another process took the token first. 
+    if (lastErrno == EAGAIN || lastErrno == EWOULDBLOCK || lastErrno == EINTR)
+        return false; 
+    throw std::runtime_error("jjm::JobServerClient::acquire() failed. Cause:\nread() failed. errno " + toDecStr(lastErrno) + "."); 
+}
+
+void jjm::JobServerClient::release(Token const& token)
+{
+    if (token.isImplicit)
+    {   Lock lock(mutex); 
+        implicitTokenIsFree = true; 
+        return; 
+    }
+    for (;;)
+    {   ssize_t const n = ::write(writeFd, & token.value, 1); 
+        if (n == 1)
+            return; 
+        int const lastErrno = errno; 
+        if (n == -1 && lastErrno == EINTR)
+            continue; 
+        throw std::runtime_error("jjm::JobServerClient::release() failed. Cause:\nwrite() failed. errno " + toDecStr(lastErrno) + "."); 
+    }
+}
+
+jjm::JobServer::JobServer(int numJobs) : fd(-1)
+{
+    if (numJobs < 1)
+        JFATAL(numJobs, 0); 
+    char const * const tmpDir = getenv("TMPDIR"); 
+    fifoPath = string(tmpDir && *tmpDir ? tmpDir : "/tmp") 
+            + "/jjmake-jobserver-" + toDecStr(getPid()) + "-" + toDecStr(nextJobServerNumber++); 
+    if (0 != mkfifo(fifoPath.c_str(), 0600))
+    {   int const lastErrno = errno; 
+        throw std::runtime_error("jjm::JobServer::JobServer() failed. Cause:\nmkfifo(\"" + fifoPath + "\") failed. errno " + toDecStr(lastErrno) + "."); 
+    }
+
+    //The tokens are kept in the pipe only while it is open, so this keeps it
+    //open until the destructor. 
+    fd = ::open(fifoPath.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC); 
+    if (fd == -1)
+    {   int const lastErrno = errno; 
+        unlink(fifoPath.c_str()); 
+        throw std::runtime_error("jjm::JobServer::JobServer() failed. Cause:\nOpening \"" + fifoPath + "\" failed. errno " + toDecStr(lastErrno) + "."); 
+    }
+    string const tokens(numJobs - 1, '+'); 
+    if (tokens.size() && static_cast<ssize_t>(tokens.size()) != ::write(fd, tokens.data(), tokens.size()))
+    {   int const lastErrno = errno; 
+        close(fd); 
+        unlink(fifoPath.c_str()); 
+        throw std::runtime_error("jjm::JobServer::JobServer() failed. Cause:\nWriting the tokens to \"" + fifoPath + "\" failed. errno " + toDecStr(lastErrno) + "."); 
+    }
+    makeFlags = "-j" + toDecStr(numJobs) + " --jobserver-auth=fifo:" + fifoPath; 
+}
+
+jjm::JobServer::~JobServer()
+{
+    if (0 != close(fd))
+        JFATAL(errno, 0); 
+    unlink(fifoPath.c_str()); 
+}
+
+#endif
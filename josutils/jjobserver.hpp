@@ -0,0 +1,110 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#ifndef JOSUTILS_JJOBSERVER_HPP_HEADER_GUARD
+#define JOSUTILS_JJOBSERVER_HPP_HEADER_GUARD
+
+#include "jthreading.hpp"
+#include "junicode/jutfstring.hpp"
+
+#include <string>
+
+#ifdef _WIN32
+    typedef void* HANDLE;
+#endif
+
+namespace jjm
+{
+
+/* The GNU make jobserver protocol limits the number of concurrent jobs of a
+tree of processes, such as make, ninja and jjmake. Every process may run one
+job with the implicit token which it was given by its parent. For every 
+other concurrent job, it takes a one-byte token from the jobserver, and it 
+gives the same byte back when the job completes. 
+
+The jobserver is named by the MAKEFLAGS environment variable: 
+    --jobserver-auth=fifo:<path>    a named pipe, GNU make 4.4 
+    --jobserver-auth=<R>,<W>        inherited pipe file descriptors
+    --jobserver-fds=<R>,<W>         the same, before GNU make 4.2
+    --jobserver-auth=<name>         a named semaphore, on Windows */
+class JobServerClient
+{
+public:
+    class Token
+    {
+    public:
+        Token() : isImplicit(false), value('+') {}
+        bool isImplicit; 
+        char value; 
+    }; 
+
+    //Returns null when makeFlags names no jobserver, or when the named 
+    //jobserver was not passed to this process, as GNU make does for commands 
+    //which it does not consider recursive. 
+    //Caller owns the returned object. 
+    //Throws std::exception when the jobserver cannot be opened. 
+    static JobServerClient* fromMakeFlags(std::string const& makeFlags); 
+    //As above, with the MAKEFLAGS environment variable. 
+    static JobServerClient* fromEnvironment(); 
+
+    ~JobServerClient(); 
+
+    //Takes the implicit token when it is free, or else a token of the 
+    //jobserver. Returns false when no token became available within 
+    //timeoutMillis. 
+    //It is safe to call concurrently. 
+    //Throws std::exception on errors. 
+    bool acquire(Token & token, int timeoutMillis); 
+
+    //Gives back a token from acquire(). 
+    //It is safe to call concurrently. 
+    //Throws std::exception on errors. 
+    void release(Token const& token); 
+
+private:
+    JobServerClient(); 
+    JobServerClient(JobServerClient const& ); //not defined, not copyable
+    JobServerClient& operator= (JobServerClient const& ); //not defined, not copyable
+
+    Mutex mutex; //protects this->implicitTokenIsFree
+    bool implicitTokenIsFree; 
+#ifdef _WIN32
+    HANDLE semaphore; 
+#else
+    int readFd; 
+    int writeFd; 
+#endif
+}; 
+
+
+/* A jobserver for child processes, with a token for every job but the 
+implicit one. On POSIX systems it is a named pipe in the temporary directory,
+which is removed by the destructor. On Windows it is a named semaphore. */
+class JobServer
+{
+public:
+    //Throws std::exception on errors. 
+    explicit JobServer(int numJobs); 
+    ~JobServer(); 
+
+    //The flags to append to MAKEFLAGS of a child process. 
+    Utf8String const& getMakeFlags() const { return makeFlags; }
+
+private:
+    JobServer(JobServer const& ); //not defined, not copyable
+    JobServer& operator= (JobServer const& ); //not defined, not copyable
+
+    Utf8String makeFlags; 
+#ifdef _WIN32
+    HANDLE semaphore; 
+#else
+    std::string fifoPath; 
+    int fd; 
+#endif
+}; 
+
+} //namespace jjm
+
+#endif
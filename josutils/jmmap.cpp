@@ -0,0 +1,86 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "jmmap.hpp"
+
+#include "jbase/jfatal.hpp"
+#include "jbase/jinttostring.hpp"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <errno.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+using namespace jjm;
+using namespace std;
+
+
+void jjm::MemoryMappedFile::map(FileHandle file)
+{
+    unmap(); 
+
+#ifdef _WIN32
+    LARGE_INTEGER fileSize; 
+    SetLastError(0); 
+    if ( ! GetFileSizeEx(file.native(), & fileSize))
+    {   DWORD const lastError = GetLastError(); 
+        throw std::runtime_error("jjm::MemoryMappedFile::map() failed. Cause:\nGetFileSizeEx() failed. GetLastError() " + toDecStr(lastError) + "."); 
+    }
+    if (fileSize.QuadPart == 0)
+        return; 
+    if (static_cast<std::uint64_t>(fileSize.QuadPart) > static_cast<std::size_t>(-1))
+        throw std::runtime_error("jjm::MemoryMappedFile::map() failed. Cause:\nThe file is too large to map."); 
+    SetLastError(0); 
+    HANDLE const mapping = CreateFileMappingW(file.native(), 0, PAGE_READONLY, 0, 0, 0); 
+    if (mapping == 0)
+    {   DWORD const lastError = GetLastError(); 
+        throw std::runtime_error("jjm::MemoryMappedFile::map() failed. Cause:\nCreateFileMappingW() failed. GetLastError() " + toDecStr(lastError) + "."); 
+    }
+    void * const view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0); 
+    DWORD const lastError = GetLastError(); 
+    CloseHandle(mapping); //the view keeps the mapping alive
+    if (view == 0)
+        throw std::runtime_error("jjm::MemoryMappedFile::map() failed. Cause:\nMapViewOfFile() failed. GetLastError() " + toDecStr(lastError) + "."); 
+    mdata = static_cast<char const*>(view); 
+    msize = static_cast<std::size_t>(fileSize.QuadPart); 
+#else
+    struct stat st; 
+    if (0 != fstat(file.native(), & st))
+    {   int const lastErrno = errno; 
+        throw std::runtime_error("jjm::MemoryMappedFile::map() failed. Cause:\nfstat() failed. errno " + toDecStr(lastErrno) + "."); 
+    }
+    if (st.st_size == 0)
+        return; 
+    if (static_cast<std::uint64_t>(st.st_size) > static_cast<std::size_t>(-1))
+        throw std::runtime_error("jjm::MemoryMappedFile::map() failed. Cause:\nThe file is too large to map."); 
+    void * const view = mmap(0, st.st_size, PROT_READ, MAP_SHARED, file.native(), 0); 
+    if (view == MAP_FAILED)
+    {   int const lastErrno = errno; 
+        throw std::runtime_error("jjm::MemoryMappedFile::map() failed. Cause:\nmmap() failed. errno " + toDecStr(lastErrno) + "."); 
+    }
+    mdata = static_cast<char const*>(view); 
+    msize = static_cast<std::size_t>(st.st_size); 
+#endif
+}
+
+void jjm::MemoryMappedFile::unmap()
+{
+    if (mdata == 0)
+        return; 
+#ifdef _WIN32
+    if ( ! UnmapViewOfFile(mdata))
+        JFATAL(GetLastError(), 0); 
+#else
+    if (0 != munmap(const_cast<char*>(mdata), msize))
+        JFATAL(errno, 0); 
+#endif
+    mdata = 0; 
+    msize = 0; 
+}
@@ -0,0 +1,44 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#ifndef JOSUTILS_JMMAP_HPP_HEADER_GUARD
+#define JOSUTILS_JMMAP_HPP_HEADER_GUARD
+
+#include "jfilehandle.hpp"
+#include "jbase/jstdint.hpp"
+
+#include <cstddef>
+
+namespace jjm
+{
+
+/* A read-only view of the entire contents of a file, mapped into memory. 
+The file handle may be closed once map() returns. The view is of the file as
+of the call to map(); later appends to the file are not visible. */
+class MemoryMappedFile
+{
+public:
+    MemoryMappedFile() : mdata(0), msize(0) {}
+    ~MemoryMappedFile() { unmap(); }
+
+    //Throws std::exception on errors. 
+    //An empty file gives an empty view with a null data(). 
+    void map(FileHandle file); 
+    void unmap(); 
+
+    char const * data() const { return mdata; }
+    std::size_t size() const { return msize; }
+
+private:
+    MemoryMappedFile(MemoryMappedFile const& ); //not defined, not copyable
+    MemoryMappedFile& operator= (MemoryMappedFile const& ); //not defined, not copyable
+
+    char const * mdata; 
+    std::size_t msize; 
+};
+
+} //namespace jjm
+
+#endif
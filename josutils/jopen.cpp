@@ -65,15 +65,13 @@ namespace
             posixopenflags = O_RDWR | O_APPEND;
 
         if (createMode == 1 && ! truncate)
-            posixopenflags = O_CREAT;
+            posixopenflags |= O_CREAT;
         if (createMode == 1 &&   truncate)
-            posixopenflags = O_CREAT | O_TRUNC;
+            posixopenflags |= O_CREAT | O_TRUNC;
         if (createMode == 2)
-            posixopenflags = O_CREAT | O_EXCL;
-        if (createMode == 3 && ! truncate)
-            posixopenflags = 0;
+            posixopenflags |= O_CREAT | O_EXCL;
         if (createMode == 3 &&   truncate)
-            posixopenflags = O_TRUNC;
+            posixopenflags |= O_TRUNC;
 
         return posixopenflags;
     }
@@ -7,6 +7,7 @@
 
 #include "jenv.hpp"
 #include "jfilehandle.hpp"
+#include "jjobserver.hpp"
 #include "jthreading.hpp"
 #include "jopen.hpp"
 #include "jpipe.hpp"
@@ -19,11 +20,31 @@
 #ifdef _WIN32
     #include <wchar.h>
     #include <windows.h>
+    #include <psapi.h>
 #else
     #include <dirent.h>
     #include <fcntl.h>
+    #include <poll.h>
+    #include <spawn.h>
+    #include <sys/mman.h>
+    #include <signal.h>
+    #include <sys/resource.h>
+    #include <sys/stat.h>
     #include <sys/wait.h>
     #include <unistd.h>
+    #ifdef __linux__
+        #include <sys/syscall.h>
+    #endif
+
+    //posix_spawn() needs file actions to close the inherited file 
+    //descriptors and to change the directory. 
+    #if defined(__GLIBC__) && defined(__GLIBC_PREREQ)
+        #if __GLIBC_PREREQ(2, 34)
+            #define JJM_HAVE_POSIX_SPAWN_FILE_ACTIONS_NP 1
+        #endif
+    #endif
+
+    extern char ** environ; 
 #endif
 
 #include <cerrno>
@@ -45,6 +66,50 @@ using namespace jjm;
     unsigned long long jjm::getPid() { return ::getpid(); }
 #endif
 
+namespace
+{
+    JJM_THREAD_LOCAL std::int64_t joinedPeakRssBytes = 0; 
+
+    void recordJoinedPeakRssBytes(std::int64_t bytes)
+    {   if (bytes > joinedPeakRssBytes)
+            joinedPeakRssBytes = bytes; 
+    }
+}
+
+std::int64_t jjm::getJoinedPeakRssBytes() { return joinedPeakRssBytes; }
+
+void jjm::resetJoinedPeakRssBytes() { joinedPeakRssBytes = 0; }
+
+void jjm::Process::join() { waitImpl(true); }
+
+bool jjm::Process::tryJoin() { return waitImpl(false); }
+
+
+jjm::ProcessBuilder&  jjm::ProcessBuilder::jobServer(JobServer const& jobServer_)
+{   
+    m_jobServerMakeFlags = jobServer_.getMakeFlags(); 
+    return *this; 
+}
+
+jjm::ProcessBuilder  jjm::ProcessBuilder::withJobServerEnv() const
+{   
+    ProcessBuilder builder(*this); 
+    builder.m_jobServerMakeFlags.clear(); 
+    if ( ! builder.m_hasCustomEnv)
+    {   builder.env(getEnvMapUtf8()); 
+#ifndef _WIN32
+        builder.m_jobServerEnv = true; 
+#endif
+    }
+    //The last jobserver flags of MAKEFLAGS take precedence, so inherited ones
+    //need not be removed. 
+    Utf8String & makeFlags = builder.m_env["MAKEFLAGS"]; 
+    if (makeFlags.size())
+        makeFlags += ' '; 
+    makeFlags += m_jobServerMakeFlags; 
+    return builder; 
+}
+
 
 namespace
 {
@@ -152,22 +217,47 @@ namespace
 }
 
 #ifdef _WIN32
-    void jjm::Process::join()
+    namespace
+    {
+        std::int64_t fileTimeToNanoSec(FILETIME const& t)
+        {   return static_cast<std::int64_t>((static_cast<unsigned long long>(t.dwHighDateTime) << 32) | t.dwLowDateTime) * 100; 
+        }
+    }
+
+    bool jjm::Process::waitImpl(bool block)
     {   
         for (;;)
         {   if ( ! GetExitCodeProcess(processHandle, & exitCode))
                 JFATAL(0, 0);
             if (STILL_ACTIVE != exitCode)
                 break;
-            DWORD const waitResult = WaitForSingleObject(processHandle, INFINITE);
+            DWORD const waitResult = WaitForSingleObject(processHandle, block ? INFINITE : 0);
+            if (WAIT_TIMEOUT == waitResult && ! block)
+                return false; 
             if (WAIT_OBJECT_0 != waitResult && WAIT_TIMEOUT != waitResult)
                 JFATAL(waitResult, 0);
         }
+        PROCESS_MEMORY_COUNTERS counters; 
+        if (GetProcessMemoryInfo(processHandle, & counters, sizeof(counters)))
+        {   peakRssBytes = static_cast<std::int64_t>(counters.PeakWorkingSetSize); 
+            recordJoinedPeakRssBytes(peakRssBytes); 
+        }
+        FILETIME creationTime, exitTime, kernelTime, userTime; 
+        if (GetProcessTimes(processHandle, & creationTime, & exitTime, & kernelTime, & userTime))
+        {   userCpuNanoSec = fileTimeToNanoSec(userTime); 
+            systemCpuNanoSec = fileTimeToNanoSec(kernelTime); 
+        }
+        return true; 
     }
 
     int jjm::Process::getExitCode() { return exitCode; }
 
-    jjm::Process::Process() : processHandle(0) {}
+    void jjm::Process::kill()
+    {   //Fails with ERROR_ACCESS_DENIED once the child exited. 
+        TerminateProcess(processHandle, 1); 
+    }
+
+    jjm::Process::Process() : processHandle(0), peakRssBytes(0), userCpuNanoSec(0), systemCpuNanoSec(0) {}
 
     jjm::Process::~Process()
     {   
@@ -235,6 +325,18 @@ namespace
                 JFATAL(argumentQuoting, 0);
         }
 
+        //A duplicate of the handle for outToFile() or errToFile(). Like the 
+        //ends of the pipes, it is made inheritable just before 
+        //CreateProcessW(), and closed just after. 
+        FileHandle duplicateForChild(FileHandle h)
+        {   HANDLE x; 
+            if ( ! DuplicateHandle(GetCurrentProcess(), h.native(), GetCurrentProcess(), & x, 0, FALSE, DUPLICATE_SAME_ACCESS))
+            {   DWORD const lastError = GetLastError(); 
+                throw std::runtime_error("jjm::ProcessBuilder::spawn() failed. Cause:\nDuplicateHandle() failed. GetLastError() " + toDecStr(lastError) + "."); 
+            }
+            return FileHandle(x); 
+        }
+
         void createPipes(
                 ProcessBuilder const& pb,
                 FileHandleOwner & pipeInReadEnd, FileHandleOwner & pipeInWriteEnd, 
@@ -251,13 +353,17 @@ namespace
             {   Pipe x = Pipe::create();
                 pipeOutReadEnd.reset(x.readable); 
                 pipeOutWriteEnd.reset(x.writeable); 
-            }else
+            }else if (pb.getOutFile() != FileHandle())
+                pipeOutWriteEnd.reset(duplicateForChild(pb.getOutFile())); 
+            else
                 pipeOutWriteEnd.reset(FileOpener().createOrOpen().writeOnly().open(Path::win32device("NUL")));
             if (pb.getPipeErr())
             {   Pipe x = Pipe::create();
                 pipeErrReadEnd.reset(x.readable); 
                 pipeErrWriteEnd.reset(x.writeable); 
-            }else if (pb.getErrToOut() && pb.getPipeOut())
+            }else if (pb.getErrFile() != FileHandle())
+                pipeErrWriteEnd.reset(duplicateForChild(pb.getErrFile())); 
+            else if (pb.getErrToOut() && (pb.getPipeOut() || pb.getOutFile() != FileHandle()))
             {   HANDLE outDup;
                 if ( ! DuplicateHandle(
                         GetCurrentProcess(), 
@@ -301,6 +407,8 @@ namespace
 
     jjm::Process* jjm::ProcessBuilder::spawn() const
     {   
+        if (m_jobServerMakeFlags.size())
+            return withJobServerEnv().spawn(); 
         if (m_cmd.size() == 0)
             throw runtime_error("ProcessBuilder : Spawn failed. cmd empty.");
         if (m_cmd[0].size() == 0)
@@ -443,17 +551,43 @@ namespace
     }
 
 #else
-    void jjm::Process::join()
+    namespace
+    {
+        std::int64_t timevalToNanoSec(timeval const& t)
+        {   return static_cast<std::int64_t>(t.tv_sec) * 1000 * 1000 * 1000 + static_cast<std::int64_t>(t.tv_usec) * 1000; 
+        }
+    }
+
+    bool jjm::Process::waitImpl(bool block)
     {   for (;;)
-        {   int x = waitpid(pid, & childStatus, 0);
+        {   struct rusage usage; 
+            int x = wait4(pid, & childStatus, block ? 0 : WNOHANG, & usage);
+            if (0 == x)
+                return false; 
             if (-1 != x)
-                return;
+            {   
+            #ifdef __APPLE__
+                peakRssBytes = usage.ru_maxrss; //bytes
+            #else
+                peakRssBytes = static_cast<std::int64_t>(usage.ru_maxrss) * 1024; //kilobytes
+            #endif
+                recordJoinedPeakRssBytes(peakRssBytes); 
+                userCpuNanoSec = timevalToNanoSec(usage.ru_utime); 
+                systemCpuNanoSec = timevalToNanoSec(usage.ru_stime); 
+                return true;
+            }
             if (EINTR == errno)
                 continue;
             JFATAL(0, 0);
         }
     }
 
+    void jjm::Process::kill()
+    {   //A child which exited and is not joined is still a zombie, so the 
+        //pid is not reused. 
+        ::kill(pid, SIGKILL); 
+    }
+
     //TODO make this right, fix up the Process API to distinguish between 
     //terminated from _exit(), and terminated from signal
     int jjm::Process::getExitCode()
@@ -470,7 +604,7 @@ namespace
         JFATAL(childStatus, 0);
     }
 
-    jjm::Process::Process() : pid(-1) {}
+    jjm::Process::Process() : pid(-1), peakRssBytes(0), userCpuNanoSec(0), systemCpuNanoSec(0) {}
 
     jjm::Process::~Process() {}
 
@@ -587,6 +721,17 @@ namespace
         //lowfd must be 0 or bigger. 
         void myCloseFrom(int const lowfd, int const errorChannel)
         {
+    #if defined(__linux__) && defined(SYS_close_range)
+            //Linux 5.9 and later close the whole range in one syscall, 
+            //without the per descriptor cost of reading /proc/self/fd. 
+            //The syscall is called directly because glibc before 2.34 has 
+            //no wrapper. Older kernels fail with ENOSYS and use the loop. 
+            errno = 0; 
+            if (0 == ::syscall(SYS_close_range, static_cast<unsigned int>(lowfd), ~0U, 0U))
+                return; 
+            if (errno != ENOSYS && errno != EINVAL)
+                jforkFatal(__FILE__, __LINE__, errorChannel); 
+    #endif
     #if (defined(__gnu_linux__) || defined (__CYGWIN__))
             //opendir may use a file descriptor.
             //We hope it uses the lowest available fd, which will be lowfd. 
@@ -607,13 +752,13 @@ namespace
                 {   errno = 0;
                     dirent* const readdirHandle = ::readdir(opendirHandle);
                     if (0 == readdirHandle)
-                    {   int const readdirErrno = readdirErrno; 
+                    {   int const readdirErrno = errno; 
                         if (0 == readdirErrno)
                         {   errno = 0; 
                             if (-1 == ::closedir(opendirHandle)) 
                                 jforkFatal(__FILE__, __LINE__, errorChannel); 
                             errno = 0; 
-                            if (::close(lowfd) && readdirErrno != EBADF) 
+                            if (::close(lowfd) && errno != EBADF) 
                                 jforkFatal(__FILE__, __LINE__, errorChannel); 
                             for (int* x = toCloseBuffer; x != toCloseEnd; ++x)
                             {   errno = 0; 
@@ -655,9 +800,217 @@ namespace
 
     jjm::Process* jjm::ProcessBuilder::spawn() const
     {   
+        if (m_jobServerMakeFlags.size())
+            return withJobServerEnv().spawn(); 
         if (m_cmd.size() == 0)
             throw runtime_error("ProcessBuilder : Spawn failed. cmd empty.");
+    #ifdef JJM_HAVE_POSIX_SPAWN_FILE_ACTIONS_NP
+        if ( ! m_forkExec)
+            return spawnPosixSpawn(); 
+    #endif
+        return spawnForkExec(); 
+    }
+
+    namespace
+    {
+        //The paths found by searching PATH, by the value of PATH and the 
+        //name. A build spawns the same few compilers and linkers many times.
+        Mutex executablePathsMutex; 
+        map<pair<string, string>, string> executablePaths; 
+
+        bool isExecutableFile(string const& path)
+        {   struct stat s; 
+            return 0 == ::stat(path.c_str(), & s) && S_ISREG(s.st_mode) && 0 == ::access(path.c_str(), X_OK); 
+        }
+
+        //Searches PATH as execvp() does. Returns the empty string when the 
+        //name is not found. 
+        string findExecutable(string const& name, string const& pathVar)
+        {   for (size_t begin = 0; begin <= pathVar.size(); )
+            {   size_t end = pathVar.find(':', begin); 
+                if (end == string::npos)
+                    end = pathVar.size(); 
+                string dir = pathVar.substr(begin, end - begin); 
+                if (dir.empty())
+                    dir = "."; 
+                string const candidate = dir + "/" + name; 
+                if (isExecutableFile(candidate))
+                    return candidate; 
+                begin = end + 1; 
+            }
+            return string(); 
+        }
+
+        string getPathVar()
+        {   char const * const pathVar = getenv("PATH"); 
+            return pathVar ? pathVar : "/bin:/usr/bin"; 
+        }
+
+        //Returns the empty string when the name is not found. 
+        string resolveExecutable(string const& name)
+        {   if (name.find('/') != string::npos)
+                return name; 
+            pair<string, string> const key(getPathVar(), name); 
+            {   Lock lock(executablePathsMutex); 
+                map<pair<string, string>, string>::const_iterator x = executablePaths.find(key); 
+                if (x != executablePaths.end())
+                    return x->second; 
+            }
+            string const path = findExecutable(name, key.first); 
+            //A path relative to the current directory is not remembered, as 
+            //it may not be the directory of the next process. 
+            if (path.size() && path[0] == '/')
+            {   Lock lock(executablePathsMutex); 
+                executablePaths[key] = path; 
+            }
+            return path; 
+        }
+
+        void forgetExecutable(string const& name)
+        {   Lock lock(executablePathsMutex); 
+            executablePaths.erase(make_pair(getPathVar(), name)); 
+        }
+
+        //The write end given to the child for outToFile() and errToFile(), 
+        //closed in the parent after the spawn as the end of a pipe is. 
+        FileHandle dupCloseOnExec(FileHandle h)
+        {   int const fd = ::fcntl(h.native(), F_DUPFD_CLOEXEC, 0); 
+            if (fd == -1)
+            {   int const lastErrno = errno; 
+                throw std::runtime_error("jjm::ProcessBuilder::spawn() failed. Cause:\nfcntl(F_DUPFD_CLOEXEC) failed. errno " + toDecStr(lastErrno) + "."); 
+            }
+            return FileHandle(fd); 
+        }
+
+    #ifdef JJM_HAVE_POSIX_SPAWN_FILE_ACTIONS_NP
+        class SpawnFileActions
+        {
+        public:
+            SpawnFileActions()
+            {   int const x = posix_spawn_file_actions_init( & actions); 
+                if (x)
+                    throw std::runtime_error("jjm::ProcessBuilder::spawn() failed. Cause:\nposix_spawn_file_actions_init() failed. errno " + toDecStr(x) + "."); 
+            }
+            ~SpawnFileActions() { posix_spawn_file_actions_destroy( & actions); }
+            posix_spawn_file_actions_t actions; 
+        private:
+            SpawnFileActions(SpawnFileActions const& ); //not defined, not copyable
+            SpawnFileActions& operator= (SpawnFileActions const& ); //not defined, not copyable
+        }; 
+
+        void checkFileAction(int const x, char const * const functionName)
+        {   if (x)
+                throw std::runtime_error(string() + "jjm::ProcessBuilder::spawn() failed. Cause:\n" + functionName + "() failed. errno " + toDecStr(x) + "."); 
+        }
+    #endif
+    }
+
+#ifdef JJM_HAVE_POSIX_SPAWN_FILE_ACTIONS_NP
+    jjm::Process* jjm::ProcessBuilder::spawnPosixSpawn() const
+    {   
+        //posix_spawn() reports the failures of the child before exec() 
+        //through its return value, so no error channel is needed. 
+        string executable = m_cmd[0]; 
+        bool searchPath = false; 
+        bool const inheritsPath = ! m_hasCustomEnv || m_jobServerEnv; 
+        if (inheritsPath)
+        {   executable = resolveExecutable(m_cmd[0]); 
+            if (executable.empty())
+                throw std::runtime_error("jjm::ProcessBuilder::spawn() failed. Cause:\nThe executable \"" + m_cmd[0] + "\" was not found in PATH."); 
+            //A relative directory of PATH is relative to the directory of the
+            //child, so leave the search to the child. 
+            if (executable[0] != '/' && m_cmd[0].find('/') == string::npos)
+            {   executable = m_cmd[0]; 
+                searchPath = true; 
+            }
+        }
+
+        //The strings are not modified, so the arguments need no copies. 
+        vector<char*> argv; 
+        argv.reserve(m_cmd.size() + 1); 
+        for (size_t i = 0; i < m_cmd.size(); ++i)
+            argv.push_back(const_cast<char*>(m_cmd[i].c_str())); 
+        argv.push_back(0); 
+
+        PosixEnvironWrapper envWrapper;
+        if (m_hasCustomEnv)
+            envWrapper.init(m_env);
+
+        FileHandleOwner inReadEnd, inWriteEnd;
+        if (m_pipeIn)
+        {   Pipe x = Pipe::create();
+            inReadEnd.reset(x.readable);
+            inWriteEnd.reset(x.writeable);
+        }
+        FileHandleOwner outReadEnd, outWriteEnd;
+        if (m_pipeOut)
+        {   Pipe x = Pipe::create();
+            outReadEnd.reset(x.readable);
+            outWriteEnd.reset(x.writeable);
+        }
+        FileHandleOwner errReadEnd, errWriteEnd;
+        if (m_pipeErr)
+        {   Pipe x = Pipe::create();
+            errReadEnd.reset(x.readable);
+            errWriteEnd.reset(x.writeable);
+        }
+        if (m_outFile != FileHandle())
+            outWriteEnd.reset(dupCloseOnExec(m_outFile)); 
+        if (m_errFile != FileHandle())
+            errWriteEnd.reset(dupCloseOnExec(m_errFile)); 
+        bool const hasOut = m_pipeOut || m_outFile != FileHandle(); 
+        bool const hasErr = m_pipeErr || m_errFile != FileHandle(); 
+
+        //The file actions run in order, so a pipe end at 0, 1 or 2 could be 
+        //replaced before it is used. That is rare enough to leave to the 
+        //fork() implementation, which moves the pipe ends out of the way. 
+        if ((m_pipeIn && inReadEnd.get().native() <= 2) 
+                || (hasOut && outWriteEnd.get().native() <= 2) 
+                || (hasErr && errWriteEnd.get().native() <= 2))
+            return spawnForkExec(); 
+
+        SpawnFileActions fileActions; 
+        posix_spawn_file_actions_t * const actions = & fileActions.actions; 
+        if (m_pipeIn)
+            checkFileAction(posix_spawn_file_actions_adddup2(actions, inReadEnd.get().native(), 0), "posix_spawn_file_actions_adddup2"); 
+        else
+            checkFileAction(posix_spawn_file_actions_addopen(actions, 0, "/dev/null", O_RDONLY, 0), "posix_spawn_file_actions_addopen"); 
+        if (hasOut)
+            checkFileAction(posix_spawn_file_actions_adddup2(actions, outWriteEnd.get().native(), 1), "posix_spawn_file_actions_adddup2"); 
+        else
+            checkFileAction(posix_spawn_file_actions_addopen(actions, 1, "/dev/null", O_WRONLY, 0), "posix_spawn_file_actions_addopen"); 
+        if (hasErr)
+            checkFileAction(posix_spawn_file_actions_adddup2(actions, errWriteEnd.get().native(), 2), "posix_spawn_file_actions_adddup2"); 
+        else if (m_errToOut && hasOut)
+            checkFileAction(posix_spawn_file_actions_adddup2(actions, 1, 2), "posix_spawn_file_actions_adddup2"); 
+        else
+            checkFileAction(posix_spawn_file_actions_addopen(actions, 2, "/dev/null", O_WRONLY, 0), "posix_spawn_file_actions_addopen"); 
+        checkFileAction(posix_spawn_file_actions_addclosefrom_np(actions, 3), "posix_spawn_file_actions_addclosefrom_np"); 
+        if (m_dir.getStringRep() != ".")
+            checkFileAction(posix_spawn_file_actions_addchdir_np(actions, m_dir.getStringRep().c_str()), "posix_spawn_file_actions_addchdir_np"); 
+
+        UniquePtr<Process*> p(new Process);
+        char ** const env = m_hasCustomEnv ? envWrapper.env : environ; 
+        int const x = searchPath 
+                ? posix_spawnp( & p.get()->pid, executable.c_str(), actions, 0, & argv[0], env) 
+                : posix_spawn( & p.get()->pid, executable.c_str(), actions, 0, & argv[0], env); 
+        if (x)
+        {   //The executable may have been removed since it was found. 
+            if (inheritsPath)
+                forgetExecutable(m_cmd[0]); 
+            throw std::runtime_error("jjm::ProcessBuilder::spawn() failed. Cause:\n"
+                    "posix_spawn(\"" + executable + "\") failed. errno " + toDecStr(x) + "."); 
+        }
 
+        p.get()->writeEndToChildsStdin.reset(inWriteEnd.release());
+        p.get()->readEndFromChildsStdout.reset(outReadEnd.release());
+        p.get()->readEndFromChildsStderr.reset(errReadEnd.release());
+        return p.release();
+    }
+#endif
+
+    jjm::Process* jjm::ProcessBuilder::spawnForkExec() const
+    {   
         auto_ptr<Process> p(new Process);
         
         struct ArgvOwner
@@ -680,8 +1033,17 @@ namespace
         }
         argv.argv[m_cmd.size()] = 0;
 
+        //execve() does not search PATH, so find the executable here when 
+        //the custom environment only adds the jobserver. 
+        string executable = m_cmd[0]; 
+        if (m_hasCustomEnv && m_jobServerEnv)
+        {   executable = resolveExecutable(m_cmd[0]); 
+            if (executable.empty())
+                throw std::runtime_error("jjm::ProcessBuilder::spawn() failed. Cause:\nThe executable \"" + m_cmd[0] + "\" was not found in PATH."); 
+        }
+
         char const * const dir_c_str = m_dir.getStringRep().c_str();
-        char const * const cmd0_c_str = m_cmd[0].c_str();
+        char const * const cmd0_c_str = executable.c_str();
 
         PosixEnvironWrapper envWrapper;
         if (m_hasCustomEnv)
@@ -705,6 +1067,12 @@ namespace
             errReadEnd.reset(x.readable);
             errWriteEnd.reset(x.writeable);
         }
+        if (m_outFile != FileHandle())
+            outWriteEnd.reset(dupCloseOnExec(m_outFile)); 
+        if (m_errFile != FileHandle())
+            errWriteEnd.reset(dupCloseOnExec(m_errFile)); 
+        bool const hasOut = m_pipeOut || m_outFile != FileHandle(); 
+        bool const hasErr = m_pipeErr || m_errFile != FileHandle(); 
         
         //Ok, we're going to open up one more pipe, to communicate possible errors from the child to the parent, 
         //such as executable file not found, etc., 
@@ -727,8 +1095,8 @@ namespace
 
                 //move any open pipes we care about to file descriptors 5 or higher
                 if (m_pipeIn  && -1 == moveFileDescToNOrHigher(childsIn, 5)) jforkFatal(__FILE__, __LINE__, errorChannel); 
-                if (m_pipeOut && -1 == moveFileDescToNOrHigher(childsOut, 5)) jforkFatal(__FILE__, __LINE__, errorChannel); 
-                if (m_pipeErr && -1 == moveFileDescToNOrHigher(childsErr, 5)) jforkFatal(__FILE__, __LINE__, errorChannel); 
+                if (hasOut && -1 == moveFileDescToNOrHigher(childsOut, 5)) jforkFatal(__FILE__, __LINE__, errorChannel); 
+                if (hasErr && -1 == moveFileDescToNOrHigher(childsErr, 5)) jforkFatal(__FILE__, __LINE__, errorChannel); 
                 if (-1 == moveFileDescToNOrHigher(errorChannel, 5)) jforkFatal(__FILE__, __LINE__, errorChannel); 
                 
                 //Now that the handles we care about are 5 or higher, close 0 
@@ -752,7 +1120,7 @@ namespace
                     if (x != 0)
                         jforkFatal(__FILE__, __LINE__, errorChannel); 
                 }
-                if (m_pipeOut)
+                if (hasOut)
                 {   if (-1 == moveFileDesc(childsOut, 1))
                         jforkFatal(__FILE__, __LINE__, errorChannel); 
                     if (-1 == clearCloseOnExec(1))
@@ -763,12 +1131,12 @@ namespace
                     if (x != 1)
                         jforkFatal(__FILE__, __LINE__, errorChannel); 
                 }
-                if (m_pipeErr)
+                if (hasErr)
                 {   if (-1 == moveFileDesc(childsErr, 2))
                         jforkFatal(__FILE__, __LINE__, errorChannel); 
                     if (-1 == clearCloseOnExec(2))
                         jforkFatal(__FILE__, __LINE__, errorChannel); 
-                }else if (m_errToOut && m_pipeOut)
+                }else if (m_errToOut && hasOut)
                 {   errno = 0; 
                     int x = ::fcntl(1, F_DUPFD, 2); //make err be a dup of out
                     if (x != 2)
@@ -781,6 +1149,11 @@ namespace
                 }
                 if (-1 == moveFileDesc(errorChannel, 3))
                     jforkFatal(__FILE__, __LINE__, errorChannel); 
+                //F_DUPFD clears close-on-exec, and without it the parent's 
+                //read of the error channel waits for the child to exit. 
+                errno = 0; 
+                if (-1 == ::fcntl(errorChannel, F_SETFD, FD_CLOEXEC))
+                    jforkFatal(__FILE__, __LINE__, errorChannel); 
 
                 myCloseFrom(4, errorChannel);
 
@@ -890,7 +1263,11 @@ namespace
         }
         return false;
     }
+}
 
+#ifdef _WIN32
+namespace
+{
     class ReadFromHandle
     {
     public:
@@ -922,10 +1299,7 @@ namespace
             }
         }
     };
-}
 
-namespace
-{
     void syncexec(
                 jjm::SyncExec& jSyncExec, 
                 jjm::ProcessBuilder const& pb, 
@@ -1003,7 +1377,179 @@ namespace
     }
 }
 
-jjm::SyncExec::SyncExec(ProcessBuilder const& pb, string const& stdinData) 
+jjm::SyncExec::SyncExec(ProcessBuilder const& pb, string const& stdinData, Capture ) 
 { 
     syncexec(*this, pb, stdinData.data(), stdinData.size()); 
 }
+
+void jjm::SyncExec::captureToFiles(ProcessBuilder const& , Utf8String const& , FileHandle , FileHandle , bool ) { JFATAL(0, 0); }
+
+#else
+namespace
+{
+    //Returns the invalid handle when the system has neither memfd_create() 
+    //nor O_TMPFILE. 
+    FileHandle createCaptureFile()
+    {
+    #if defined(__linux__) && defined(SYS_memfd_create) && defined(MFD_CLOEXEC)
+        int const memfd = static_cast<int>(::syscall(SYS_memfd_create, "jjmake-capture", MFD_CLOEXEC)); 
+        if (memfd != -1)
+            return FileHandle(memfd); 
+    #endif
+    #ifdef O_TMPFILE
+        char const * dir = getenv("TMPDIR"); 
+        if (dir == 0 || *dir == 0)
+            dir = "/tmp"; 
+        int const tmpfd = ::open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600); 
+        if (tmpfd != -1)
+            return FileHandle(tmpfd); 
+    #endif
+        return FileHandle(); 
+    }
+
+    void setNonBlocking(FileHandle h)
+    {   int const flags = ::fcntl(h.native(), F_GETFL); 
+        if (flags == -1 || -1 == ::fcntl(h.native(), F_SETFL, flags | O_NONBLOCK))
+        {   int const lastErrno = errno; 
+            throw std::runtime_error("jjm::SyncExec failed. Cause:\nfcntl() failed. errno " + toDecStr(lastErrno) + "."); 
+        }
+    }
+
+    //Drains stdout and stderr, and feeds stdin, from the calling thread. 
+    void syncexecPoll(
+                jjm::SyncExec& jSyncExec, 
+                jjm::ProcessBuilder const& pb, 
+                char const* const stdinData, 
+                size_t const stdinDataLen)
+    {   
+        UniquePtr<Process*> process(pb.spawn());
+
+        FileHandleOwner childsStdIn( pb.getPipeIn()  ? process->releaseWriteEndToChildsStdin()   : FileHandle());
+        FileHandleOwner childsStdOut(pb.getPipeOut() ? process->releaseReadEndFromChildsStdout() : FileHandle());
+        FileHandleOwner childsStdErr(pb.getPipeErr() ? process->releaseReadEndFromChildsStderr() : FileHandle());
+
+        bool stdInFailFlag = false;
+        bool stdOutFailFlag = false;
+        bool stdErrFailFlag = false;
+        try
+        {   if (pb.getPipeIn() && 0 == stdinDataLen)
+                childsStdIn.reset(); //nothing to send
+            FileHandleOwner * const handles[] = { & childsStdIn, & childsStdOut, & childsStdErr }; 
+            bool * const failFlags[] = { & stdInFailFlag, & stdOutFailFlag, & stdErrFailFlag }; 
+            string * const strs[] = { 0, & jSyncExec.out, & jSyncExec.err }; 
+            for (int i = 0; i < 3; ++i)
+            {   if (handles[i]->get() != FileHandle())
+                    setNonBlocking(handles[i]->get()); 
+            }
+            size_t stdinWritten = 0; 
+            vector<char> buffer(64 * 1024); 
+            for (;;)
+            {   pollfd fds[3]; 
+                int which[3]; 
+                nfds_t numFds = 0; 
+                for (int i = 0; i < 3; ++i)
+                {   if (handles[i]->get() == FileHandle())
+                        continue; 
+                    fds[numFds].fd = handles[i]->get().native(); 
+                    fds[numFds].events = (i == 0) ? POLLOUT : POLLIN; 
+                    fds[numFds].revents = 0; 
+                    which[numFds] = i; 
+                    ++numFds; 
+                }
+                if (numFds == 0)
+                    break; 
+                if (-1 == ::poll(fds, numFds, -1))
+                {   if (errno == EINTR)
+                        continue; 
+                    int const lastErrno = errno; 
+                    throw std::runtime_error("jjm::SyncExec failed. Cause:\npoll() failed. errno " + toDecStr(lastErrno) + "."); 
+                }
+                for (nfds_t f = 0; f < numFds; ++f)
+                {   if (fds[f].revents == 0)
+                        continue; 
+                    int const i = which[f]; 
+                    if (i == 0)
+                    {   ssize_t const n = ::write(fds[f].fd, stdinData + stdinWritten, stdinDataLen - stdinWritten); 
+                        if (n > 0)
+                            stdinWritten += n; 
+                        else if (n == -1 && errno != EAGAIN && errno != EINTR)
+                            stdInFailFlag = true; 
+                        if (stdInFailFlag || stdinWritten == stdinDataLen)
+                            childsStdIn.reset(); 
+                        continue; 
+                    }
+                    ssize_t const n = ::read(fds[f].fd, & buffer[0], buffer.size()); 
+                    if (n > 0)
+                        strs[i]->append( & buffer[0], n); 
+                    else if (n == 0)
+                        handles[i]->reset(); 
+                    else if (errno != EAGAIN && errno != EINTR)
+                    {   * failFlags[i] = true; 
+                        handles[i]->reset(); 
+                    }
+                }
+            }
+        } catch (...)
+        {   childsStdIn.reset();
+            childsStdOut.reset();
+            childsStdErr.reset();
+            process->join();
+            throw;
+        }
+        process->join();
+        jSyncExec.exitcode = process->getExitCode();
+        if (stdInFailFlag)
+            throw std::runtime_error("jjm::SyncExec failed. Cause:\nFailure when writing to child's stdin.");
+        if (stdOutFailFlag)
+            throw std::runtime_error("jjm::SyncExec failed. Cause:\nFailure when reading from child's stdout.");
+        if (stdErrFailFlag)
+            throw std::runtime_error("jjm::SyncExec failed. Cause:\nFailure when reading from child's stderr.");
+    }
+}
+
+jjm::SyncExec::SyncExec(ProcessBuilder const& pb, string const& stdinData, Capture capture) 
+{ 
+    if (capture != CapturePipes && (pb.getPipeOut() || pb.getPipeErr()))
+    {   FileHandleOwner outFile(pb.getPipeOut() ? createCaptureFile() : FileHandle()); 
+        FileHandleOwner errFile(pb.getPipeErr() ? createCaptureFile() : FileHandle()); 
+        if ((outFile.get() != FileHandle()) == pb.getPipeOut() && (errFile.get() != FileHandle()) == pb.getPipeErr())
+        {   captureToFiles(pb, stdinData, outFile.get(), errFile.get(), capture == CaptureMapped); 
+            return; 
+        }
+    }
+    syncexecPoll(*this, pb, stdinData.data(), stdinData.size()); 
+}
+
+void jjm::SyncExec::captureToFiles(ProcessBuilder const& pb, Utf8String const& stdinData, FileHandle outFile, FileHandle errFile, bool mapOutput)
+{
+    ProcessBuilder filePb(pb); 
+    if (pb.getPipeOut())
+        filePb.outToFile(outFile); 
+    if (pb.getPipeErr())
+        filePb.errToFile(errFile); 
+    UniquePtr<Process*> process(filePb.spawn()); 
+
+    //The child never waits on its output, so stdin is simply written out. 
+    bool stdInFailFlag = false; 
+    if (pb.getPipeIn())
+    {   FileHandleOwner childsStdIn(process->releaseWriteEndToChildsStdin()); 
+        if (stdinData.size() && writeToHandle(stdinData.data(), stdinData.size(), childsStdIn.get()))
+            stdInFailFlag = true; 
+    }
+    process->join(); 
+    exitcode = process->getExitCode(); 
+    if (stdInFailFlag)
+        throw std::runtime_error("jjm::SyncExec failed. Cause:\nFailure when writing to child's stdin.");
+
+    if (pb.getPipeOut())
+        outMap.map(outFile); 
+    if (pb.getPipeErr())
+        errMap.map(errFile); 
+    if ( ! mapOutput)
+    {   out.assign(outMap.data() ? outMap.data() : "", outMap.size()); 
+        err.assign(errMap.data() ? errMap.data() : "", errMap.size()); 
+        outMap.unmap(); 
+        errMap.unmap(); 
+    }
+}
+#endif
@@ -7,7 +7,9 @@
 #define JOSUTILS_JPROCESS_HPP_HEADER_GUARD
 
 #include "jfilehandle.hpp"
+#include "jmmap.hpp"
 #include "jpath.hpp" 
+#include "jbase/jstdint.hpp"
 #include "junicode/jutfstring.hpp" 
 
 #include <map>
@@ -22,6 +24,7 @@
 namespace jjm
 {
 
+class JobServer;
 class Process;
 class ProcessBuilder;
 
@@ -29,6 +32,12 @@ class ProcessBuilder;
 //returns getpid() for unix-like, GetCurrentProcessId() for win32
 unsigned long long getPid();
 
+//Returns the largest peak resident set size, in bytes, of the child processes
+//which the calling thread joined with Process::join() since the last call to
+//resetJoinedPeakRssBytes(), or 0 when there were none. 
+std::int64_t getJoinedPeakRssBytes(); 
+void resetJoinedPeakRssBytes(); 
+
 
 class ProcessBuilder
 {
@@ -41,6 +50,8 @@ public:
             m_errToOut(false)
 #ifdef _WIN32
             , m_argumentQuoting(msvc_c_main_convention)
+#else
+            , m_forkExec(false), m_jobServerEnv(false)
 #endif
         {}
 
@@ -60,15 +71,31 @@ public:
     std::pair<bool, std::map<Utf8String, Utf8String> const* >  getEnv() const  { return std::make_pair(m_hasCustomEnv, &m_env); }
 
     ProcessBuilder&  pipeIn(bool x = true)  { m_pipeIn = x; return *this; }
-    ProcessBuilder&  pipeOut(bool x = true)  { m_pipeOut = x; return *this; }
-    ProcessBuilder&  pipeErr(bool x = true)  { m_pipeErr = x; if (x) { m_errToOut = false; } return *this; }
+    ProcessBuilder&  pipeOut(bool x = true)  { m_pipeOut = x; if (x) { m_outFile = FileHandle(); } return *this; }
+    ProcessBuilder&  pipeErr(bool x = true)  { m_pipeErr = x; if (x) { m_errToOut = false; m_errFile = FileHandle(); } return *this; }
     bool  getPipeIn() const  { return m_pipeIn; }
     bool  getPipeOut() const  { return m_pipeOut; }
     bool  getPipeErr() const  { return m_pipeErr; }
 
-    ProcessBuilder&  errToOut(bool x = true)  { m_errToOut = x; if (x) { m_pipeErr = false; } return *this; }
+    ProcessBuilder&  errToOut(bool x = true)  { m_errToOut = x; if (x) { m_pipeErr = false; m_errFile = FileHandle(); } return *this; }
     bool  getErrToOut() const  { return m_errToOut; }
 
+    //The child's stdout, or stderr, is a duplicate of the given handle, such 
+    //as a file open for writing, instead of a pipe or the null device. The 
+    //caller keeps ownership of the handle, and may close it once spawn() 
+    //returns. The invalid handle clears the option. 
+    ProcessBuilder&  outToFile(FileHandle h)  { m_outFile = h; if (h != FileHandle()) { m_pipeOut = false; } return *this; }
+    ProcessBuilder&  errToFile(FileHandle h)  { m_errFile = h; if (h != FileHandle()) { m_pipeErr = false; m_errToOut = false; } return *this; }
+    FileHandle  getOutFile() const  { return m_outFile; }
+    FileHandle  getErrFile() const  { return m_errFile; }
+
+    /* Passes the jobserver to the child by appending its flags to the 
+    MAKEFLAGS environment variable of the child, on top of env() if given. 
+    A make or another jobserver client in the child then takes its tokens 
+    from the jobserver. The jobserver must outlive the child. */
+    ProcessBuilder&  jobServer(JobServer const& jobServer_); 
+    Utf8String const&  getJobServerMakeFlags() const  { return m_jobServerMakeFlags; }
+
 #ifdef _WIN32
     /* Windows fails at life because its only process creation primitive, 
     CreateProcess, takes a single string for all of the arguments, leaving it
@@ -88,6 +115,15 @@ public:
     enum WindowsArgumentQuotingConvention { msvc_c_main_convention };
     ProcessBuilder&  argumentQuoting(WindowsArgumentQuotingConvention argumentQuoting_)  { m_argumentQuoting = argumentQuoting_; return *this; }
     WindowsArgumentQuotingConvention  getArgumentQuoting() const  { return m_argumentQuoting; }
+#else
+    /* Where the C library supports the needed file actions, such as glibc 
+    2.34 and later, spawn() uses posix_spawn(), which does not copy the page 
+    tables of the parent as fork() does. Its cost then does not grow with the
+    memory of the parent. This option forces fork() and exec() instead. 
+
+    This option has no effect on windows systems. */
+    ProcessBuilder&  forkExec(bool x = true)  { m_forkExec = x; return *this; }
+    bool  getForkExec() const  { return m_forkExec; }
 #endif
 
     /* Caller owns returned object and must delete it. 
@@ -106,8 +142,23 @@ private:
     bool m_pipeOut;
     bool m_pipeErr;
     bool m_errToOut;
+    FileHandle m_outFile; 
+    FileHandle m_errFile; 
+    Utf8String m_jobServerMakeFlags; 
 #ifdef _WIN32
     WindowsArgumentQuotingConvention m_argumentQuoting;
+#else
+    bool m_forkExec; 
+    //The custom environment was made by withJobServerEnv(), so the 
+    //executable is still found with the PATH of this process. 
+    bool m_jobServerEnv; 
+#endif
+
+    //A copy with the jobserver flags moved into the custom environment
+    ProcessBuilder withJobServerEnv() const; 
+#ifndef _WIN32
+    Process* spawnForkExec() const; 
+    Process* spawnPosixSpawn() const; 
 #endif
 };
 
@@ -116,17 +167,29 @@ private:
 
 /* The SyncExec constructor will synchronously execute the specified process 
 and capture its stdout and stderr (if piped).
-if false == getPipeIn(), then stdinData is ignored. */
+if false == getPipeIn(), then stdinData is ignored. 
+
+On POSIX systems, piped output is by default captured in anonymous files 
+from memfd_create(), or else O_TMPFILE, which the child writes directly. 
+Nothing reads while the child runs, and the child never waits for the 
+parent to drain a full pipe. The files are read back with mmap() after the
+child exits. Where neither kind of file is available, and with CapturePipes,
+the calling thread drains real pipes with poll() instead. On windows, each 
+pipe is drained by its own thread. */
 class SyncExec  //TODO handle encoding
 {
 public:
+    //CaptureMapped is CaptureFiles where the files stay mapped, and out and
+    //err are left empty. Use outData() and errData() to see the output 
+    //without a copy. 
+    enum Capture { CaptureFiles, CaptureMapped, CapturePipes }; 
 
     SyncExec() {}
 
     //stdinData will be converted from UTF-8 and "\n" newline convention to 
     //the current locale's encoding and the platform's convention for newlines. 
     //TODO
-    explicit SyncExec(ProcessBuilder const& pb, Utf8String const& stdinData = Utf8String()); 
+    explicit SyncExec(ProcessBuilder const& pb, Utf8String const& stdinData = Utf8String(), Capture capture = CaptureFiles); 
 
     int exitcode;
 
@@ -136,6 +199,22 @@ public:
     //TODO
     Utf8String out; 
     Utf8String err; 
+
+    //The captured bytes, from the mapped file with CaptureMapped, and from 
+    //out and err otherwise. 
+    char const * outData() const { return outMap.data() ? outMap.data() : out.data(); }
+    std::size_t outSize() const { return outMap.data() ? outMap.size() : out.size(); }
+    char const * errData() const { return errMap.data() ? errMap.data() : err.data(); }
+    std::size_t errSize() const { return errMap.data() ? errMap.size() : err.size(); }
+
+private:
+    SyncExec(SyncExec const& ); //not defined, not copyable
+    SyncExec& operator= (SyncExec const& ); //not defined, not copyable
+
+    void captureToFiles(ProcessBuilder const& pb, Utf8String const& stdinData, FileHandle outFile, FileHandle errFile, bool mapOutput); 
+
+    MemoryMappedFile outMap; 
+    MemoryMappedFile errMap; 
 };
 
 
@@ -171,12 +250,27 @@ public:
     FileHandle releaseReadEndFromChildsStdout();
     FileHandle releaseReadEndFromChildsStderr();
 
-    //TODO kill
+    //Ends the child at once, as SIGKILL does. Does nothing when it already
+    //exited. Call join() afterwards. 
+    void kill(); 
 
     void join();
 
+    //As join(), but returns false without waiting when the child is still 
+    //running. Once it returned true, or after join(), do not call it again. 
+    bool tryJoin(); 
+
     //May call getExitCode() only after join()
     int getExitCode();
+
+    //The peak resident set size of the child, in bytes, or 0 when the 
+    //system does not report it. Valid only after join(). On POSIX systems,
+    //it is the largest of the child and its waited-for descendants. 
+    std::int64_t getPeakRssBytes() const { return peakRssBytes; }
+
+    //The user and system CPU time of the child, as getPeakRssBytes(). 
+    std::int64_t getUserCpuNanoSec() const { return userCpuNanoSec; }
+    std::int64_t getSystemCpuNanoSec() const { return systemCpuNanoSec; }
     
 private:
     Process();
@@ -184,6 +278,9 @@ private:
     Process& operator= (Process ); //not defined, not copyable
 
     friend class ProcessBuilder;
+
+    //Returns false when block is false and the child is still running. 
+    bool waitImpl(bool block); 
     
     #ifdef _WIN32
         HANDLE processHandle;
@@ -193,6 +290,9 @@ private:
         pid_t pid;
         int childStatus;
     #endif
+    std::int64_t peakRssBytes;
+    std::int64_t userCpuNanoSec; 
+    std::int64_t systemCpuNanoSec; 
 
     FileHandleOwner writeEndToChildsStdin;
     FileHandleOwner readEndFromChildsStdout;
@@ -0,0 +1,376 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "jsocket.hpp"
+
+#include "jclock.hpp"
+#include "jbase/jinttostring.hpp"
+
+#include <cerrno>
+#include <stdexcept>
+#include <string.h>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <netdb.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <sys/stat.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+#endif
+
+using namespace jjm; 
+using namespace std; 
+
+namespace
+{
+    bool startsWith(string const& s, char const * prefix)
+    {   return 0 == s.compare(0, strlen(prefix), prefix); 
+    }
+
+#ifndef _WIN32
+    //Splits "<host>:<port>", where the host may be in brackets, as "[::1]". 
+    void splitHostPort(string const& address, string & host, string & port, char const * function)
+    {   size_t const colon = address.rfind(':'); 
+        if (colon == string::npos || colon + 1 == address.size())
+            throw std::runtime_error(string() + function + " failed. Cause:\nThe address \"" + address 
+                    + "\" is neither \"unix:<path>\" nor \"<host>:<port>\"."); 
+        host = address.substr(0, colon); 
+        port = address.substr(colon + 1); 
+        if (host.size() >= 2 && host[0] == '[' && host[host.size() - 1] == ']')
+            host = host.substr(1, host.size() - 2); 
+    }
+
+    void makeUnixAddress(string const& path, sockaddr_un & addr, char const * function)
+    {   memset( & addr, 0, sizeof(addr)); 
+        addr.sun_family = AF_UNIX; 
+        if (path.empty() || path.size() >= sizeof(addr.sun_path))
+            throw std::runtime_error(string() + function + " failed. Cause:\nThe Unix socket path \"" + path 
+                    + "\" is empty or too long."); 
+        memcpy(addr.sun_path, path.data(), path.size()); 
+    }
+
+    void setNoDelay(int fd)
+    {   int const one = 1; 
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, & one, sizeof(one)); //fails harmlessly on Unix sockets
+    }
+
+    void throwErrno(char const * function, char const * call, int lastErrno)
+    {   throw std::runtime_error(string() + function + " failed. Cause:\n" + call + " failed. errno " 
+                + toDecStr(lastErrno) + ", " + strerror(lastErrno) + "."); 
+    }
+#endif
+
+#ifdef _WIN32
+    void throwNotSupported(char const * function)
+    {   throw std::runtime_error(string() + function + " failed. Cause:\nSockets are not supported on this platform."); 
+    }
+#endif
+}
+
+
+jjm::Socket::Socket() : fd(-1), deadline(0) {}
+
+jjm::Socket::~Socket() { close(); }
+
+void jjm::Socket::close()
+{
+#ifndef _WIN32
+    if (fd != -1)
+        ::close(fd); 
+#endif
+    fd = -1; 
+}
+
+void jjm::Socket::shutdown()
+{
+#ifndef _WIN32
+    if (fd != -1)
+        ::shutdown(fd, SHUT_RDWR); 
+#endif
+}
+
+void jjm::Socket::waitFor(short events, char const * function)
+{
+#ifdef _WIN32
+    throwNotSupported(function); 
+#else
+    for (;;)
+    {   int timeoutMillis = -1; 
+        if (deadline != 0)
+        {   std::int64_t const remaining = deadline - getMonotonicClockNanoSec(); 
+            if (remaining <= 0)
+                throw std::runtime_error(string() + function + " failed. Cause:\nThe deadline passed."); 
+            timeoutMillis = static_cast<int>((remaining + 999999) / 1000000); 
+        }
+        pollfd p; 
+        p.fd = fd; 
+        p.events = events; 
+        p.revents = 0; 
+        int const x = ::poll( & p, 1, timeoutMillis); 
+        if (x > 0)
+            return; 
+        if (x < 0 && errno != EINTR)
+            throwErrno(function, "poll()", errno); 
+    }
+#endif
+}
+
+void jjm::Socket::connect(std::string const& address)
+{
+    char const * const function = "jjm::Socket::connect()"; 
+    close(); 
+#ifdef _WIN32
+    throwNotSupported(function); 
+#else
+    vector<pair<sockaddr_storage, socklen_t> > addrs; 
+    if (startsWith(address, "unix:"))
+    {   sockaddr_storage storage; 
+        makeUnixAddress(address.substr(5), reinterpret_cast<sockaddr_un &>(storage), function); 
+        addrs.push_back(make_pair(storage, socklen_t(sizeof(sockaddr_un)))); 
+    }else
+    {   string host, port; 
+        splitHostPort(address, host, port, function); 
+        addrinfo hints; 
+        memset( & hints, 0, sizeof(hints)); 
+        hints.ai_family = AF_UNSPEC; 
+        hints.ai_socktype = SOCK_STREAM; 
+        addrinfo * result = 0; 
+        int const x = ::getaddrinfo(host.c_str(), port.c_str(), & hints, & result); 
+        if (x != 0)
+            throw std::runtime_error(string() + function + " failed. Cause:\ngetaddrinfo(\"" + address + "\") failed. " 
+                    + gai_strerror(x) + "."); 
+        for (addrinfo * a = result; a; a = a->ai_next)
+        {   sockaddr_storage storage; 
+            memcpy( & storage, a->ai_addr, a->ai_addrlen); 
+            addrs.push_back(make_pair(storage, a->ai_addrlen)); 
+        }
+        ::freeaddrinfo(result); 
+    }
+
+    string causes; 
+    for (size_t i = 0; i < addrs.size(); ++i)
+    {   sockaddr const * const addr = reinterpret_cast<sockaddr const *>( & addrs[i].first); 
+        fd = ::socket(addr->sa_family, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0); 
+        if (fd == -1)
+            throwErrno(function, "socket()", errno); 
+        int lastErrno = 0; 
+        if (0 != ::connect(fd, addr, addrs[i].second))
+            lastErrno = errno; 
+        if (lastErrno == EINPROGRESS || lastErrno == EAGAIN || lastErrno == EINTR)
+        {   waitFor(POLLOUT, function); 
+            socklen_t size = sizeof(lastErrno); 
+            if (0 != ::getsockopt(fd, SOL_SOCKET, SO_ERROR, & lastErrno, & size))
+                lastErrno = errno; 
+        }
+        if (lastErrno == 0)
+        {   setNoDelay(fd); 
+            return; 
+        }
+        causes += string() + "connect() failed. errno " + toDecStr(lastErrno) + ", " + strerror(lastErrno) + ".\n"; 
+        close(); 
+    }
+    throw std::runtime_error(string() + function + " failed for \"" + address + "\". Cause:\n" + causes); 
+#endif
+}
+
+void jjm::Socket::readComplete(void * buffer, size_t sizeBytes)
+{
+    if ( ! readCompleteOrEof(buffer, sizeBytes) && sizeBytes)
+        throw std::runtime_error("jjm::Socket::readComplete() failed. Cause:\nThe peer closed the connection."); 
+}
+
+bool jjm::Socket::readCompleteOrEof(void * buffer, size_t sizeBytes)
+{
+    char const * const function = "jjm::Socket::readComplete()"; 
+#ifdef _WIN32
+    throwNotSupported(function); 
+    return false; 
+#else
+    char * const p = static_cast<char *>(buffer); 
+    for (size_t done = 0; done < sizeBytes; )
+    {   ssize_t const n = ::recv(fd, p + done, sizeBytes - done, 0); 
+        if (n > 0)
+        {   done += n; 
+            continue; 
+        }
+        if (n == 0)
+        {   if (done == 0)
+                return false; 
+            throw std::runtime_error(string() + function + " failed. Cause:\nThe peer closed the connection."); 
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            waitFor(POLLIN, function); 
+        else if (errno != EINTR)
+            throwErrno(function, "recv()", errno); 
+    }
+    return true; 
+#endif
+}
+
+void jjm::Socket::writeComplete(void const * buffer, size_t sizeBytes)
+{
+    char const * const function = "jjm::Socket::writeComplete()"; 
+#ifdef _WIN32
+    throwNotSupported(function); 
+#else
+    char const * const p = static_cast<char const *>(buffer); 
+    for (size_t done = 0; done < sizeBytes; )
+    {   //MSG_NOSIGNAL, so that a closed peer is an error rather than SIGPIPE
+        ssize_t const n = ::send(fd, p + done, sizeBytes - done, MSG_NOSIGNAL); 
+        if (n >= 0)
+        {   done += n; 
+            continue; 
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            waitFor(POLLOUT, function); 
+        else if (errno != EINTR)
+            throwErrno(function, "send()", errno); 
+    }
+#endif
+}
+
+
+jjm::ListeningSocket::ListeningSocket() : fd(-1)
+{
+    wakeFds[0] = wakeFds[1] = -1; 
+}
+
+jjm::ListeningSocket::~ListeningSocket()
+{
+#ifndef _WIN32
+    for (int i = 0; i < 2; ++i)
+    {   if (wakeFds[i] != -1)
+            ::close(wakeFds[i]); 
+    }
+    if (fd != -1)
+    {   ::close(fd); 
+        if ( ! unixPath.empty())
+            ::unlink(unixPath.c_str()); 
+    }
+#endif
+}
+
+void jjm::ListeningSocket::listen(std::string const& address_)
+{
+    char const * const function = "jjm::ListeningSocket::listen()"; 
+    if (fd != -1)
+        throw std::runtime_error(string() + function + " failed. Cause:\nThe socket is already listening."); 
+#ifdef _WIN32
+    throwNotSupported(function); 
+#else
+    if (0 != ::pipe2(wakeFds, O_CLOEXEC | O_NONBLOCK))
+        throwErrno(function, "pipe2()", errno); 
+
+    if (startsWith(address_, "unix:"))
+    {   string const path = address_.substr(5); 
+        sockaddr_un addr; 
+        makeUnixAddress(path, addr, function); 
+        struct stat st; 
+        if (0 == ::lstat(path.c_str(), & st) && S_ISSOCK(st.st_mode))
+            ::unlink(path.c_str()); 
+        fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0); 
+        if (fd == -1)
+            throwErrno(function, "socket()", errno); 
+        if (0 != ::bind(fd, reinterpret_cast<sockaddr *>( & addr), sizeof(addr)))
+            throwErrno(function, ("bind(\"" + address_ + "\")").c_str(), errno); 
+        unixPath = path; 
+        address = address_; 
+    }else
+    {   string host, port; 
+        splitHostPort(address_, host, port, function); 
+        addrinfo hints; 
+        memset( & hints, 0, sizeof(hints)); 
+        hints.ai_family = AF_UNSPEC; 
+        hints.ai_socktype = SOCK_STREAM; 
+        hints.ai_flags = AI_PASSIVE; 
+        addrinfo * result = 0; 
+        int const x = ::getaddrinfo(host.empty() || host == "*" ? 0 : host.c_str(), port.c_str(), & hints, & result); 
+        if (x != 0)
+            throw std::runtime_error(string() + function + " failed. Cause:\ngetaddrinfo(\"" + address_ + "\") failed. " 
+                    + gai_strerror(x) + "."); 
+        fd = ::socket(result->ai_family, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0); 
+        int lastErrno = errno; 
+        if (fd != -1)
+        {   int const one = 1; 
+            ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, & one, sizeof(one)); 
+            if (0 != ::bind(fd, result->ai_addr, result->ai_addrlen))
+                lastErrno = errno; 
+            else
+                lastErrno = 0; 
+        }
+        ::freeaddrinfo(result); 
+        if (fd == -1)
+            throwErrno(function, "socket()", lastErrno); 
+        if (lastErrno != 0)
+            throwErrno(function, ("bind(\"" + address_ + "\")").c_str(), lastErrno); 
+
+        sockaddr_storage bound; 
+        socklen_t size = sizeof(bound); 
+        if (0 != ::getsockname(fd, reinterpret_cast<sockaddr *>( & bound), & size))
+            throwErrno(function, "getsockname()", errno); 
+        int const boundPort = bound.ss_family == AF_INET6 
+                ? ntohs(reinterpret_cast<sockaddr_in6 &>(bound).sin6_port) 
+                : ntohs(reinterpret_cast<sockaddr_in &>(bound).sin_port); 
+        address = (host.find(':') != string::npos ? "[" + host + "]" : host) + ":" + toDecStr(boundPort); 
+    }
+    if (0 != ::listen(fd, 128))
+        throwErrno(function, "listen()", errno); 
+#endif
+}
+
+bool jjm::ListeningSocket::accept(Socket & socket)
+{
+    char const * const function = "jjm::ListeningSocket::accept()"; 
+#ifdef _WIN32
+    throwNotSupported(function); 
+    return false; 
+#else
+    for (;;)
+    {   pollfd p[2]; 
+        p[0].fd = wakeFds[0]; 
+        p[0].events = POLLIN; 
+        p[0].revents = 0; 
+        p[1].fd = fd; 
+        p[1].events = POLLIN; 
+        p[1].revents = 0; 
+        int const x = ::poll(p, 2, -1); 
+        if (x < 0 && errno != EINTR)
+            throwErrno(function, "poll()", errno); 
+        if (p[0].revents)
+            return false; 
+        if (x <= 0)
+            continue; 
+        int const newFd = ::accept4(fd, 0, 0, SOCK_CLOEXEC | SOCK_NONBLOCK); 
+        if (newFd == -1)
+        {   //the connection may be gone before it was accepted 
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNABORTED)
+                continue; 
+            throwErrno(function, "accept4()", errno); 
+        }
+        setNoDelay(newFd); 
+        socket.close(); 
+        socket.fd = newFd; 
+        socket.deadline = 0; 
+        return true; 
+    }
+#endif
+}
+
+void jjm::ListeningSocket::stop()
+{
+#ifndef _WIN32
+    //The byte is never read, so the pipe stays readable. 
+    char const x = 0; 
+    if (wakeFds[1] != -1)
+        while (::write(wakeFds[1], & x, 1) < 0 && errno == EINTR)
+            ; 
+#endif
+}
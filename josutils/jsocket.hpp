@@ -0,0 +1,101 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#ifndef JOSUTILS_JSOCKET_HPP_HEADER_GUARD
+#define JOSUTILS_JSOCKET_HPP_HEADER_GUARD
+
+#include "jbase/jstdint.hpp"
+
+#include <stddef.h>
+#include <string>
+
+namespace jjm
+{
+
+/* Stream sockets, over TCP or Unix domain sockets. An address is either 
+"unix:<path>" or "<host>:<port>". 
+
+A Socket has a deadline on the monotonic clock of getMonotonicClockNanoSec(),
+after which connect(), and every read and write, fail, so a slow or hung peer 
+holds up the caller for no longer than it chose. 
+
+Only available on POSIX systems. On Windows, every function which opens a 
+socket throws. */
+class Socket
+{
+public:
+    Socket(); 
+    ~Socket(); 
+
+    //Throws std::exception on errors, including when the deadline passes. 
+    void connect(std::string const& address); 
+
+    bool isOpen() const { return fd != -1; }
+    void close(); 
+
+    //Wakes, and fails, the reads and writes of every thread, and makes 
+    //the peer read EOF. The socket is still open. 
+    void shutdown(); 
+
+    //0 is no deadline, which is the default. 
+    void setDeadline(std::int64_t deadlineNanoSec) { deadline = deadlineNanoSec; }
+
+    //Throws std::exception on errors, on EOF, and when the deadline passes. 
+    void readComplete(void * buffer, size_t sizeBytes); 
+    void writeComplete(void const * buffer, size_t sizeBytes); 
+
+    //As readComplete(), except that it returns false on EOF before the
+    //first byte. 
+    bool readCompleteOrEof(void * buffer, size_t sizeBytes); 
+
+private:
+    Socket(Socket const& ); //not defined, not copyable
+    Socket& operator= (Socket const& ); //not defined, not copyable
+
+    friend class ListeningSocket; 
+
+    //Waits for the socket to become ready for events. 
+    void waitFor(short events, char const * function); 
+
+    int fd; 
+    std::int64_t deadline; 
+}; 
+
+class ListeningSocket
+{
+public:
+    ListeningSocket(); 
+    ~ListeningSocket(); 
+
+    //Listens on the address. A TCP port of 0 picks a free port, and a stale 
+    //Unix socket file is replaced. 
+    //Throws std::exception on errors. 
+    void listen(std::string const& address); 
+
+    //The address listened on, with the port that was picked for port 0. 
+    std::string const& getAddress() const { return address; }
+
+    //Waits for a connection, and returns true with socket connected to it,
+    //or returns false once stop() was called. 
+    //Throws std::exception on errors. 
+    bool accept(Socket & socket); 
+
+    //Makes accept() return false, now and from now on. 
+    //It is safe to call concurrently with accept(). 
+    void stop(); 
+
+private:
+    ListeningSocket(ListeningSocket const& ); //not defined, not copyable
+    ListeningSocket& operator= (ListeningSocket const& ); //not defined, not copyable
+
+    int fd; 
+    int wakeFds[2]; 
+    std::string address; 
+    std::string unixPath; 
+}; 
+
+} //namespace jjm
+
+#endif
@@ -78,7 +78,7 @@ using namespace std;
         FILE_BASIC_INFO fileBasicInfo; 
         SetLastError(0);
         BOOL const x2 = GetFileInformationByHandleEx(
-                file.native(), FileStandardInfo, & fileBasicInfo, sizeof(fileBasicInfo)); 
+                file.native(), FileBasicInfo, & fileBasicInfo, sizeof(fileBasicInfo)); 
         if (0 == x2)
         {   if ( ! throwExceptionOnError)
                 return; 
@@ -89,6 +89,19 @@ using namespace std;
             throw runtime_error(msg + "GetLastError returned " + toDecStr(lastError) + ".");
         }
 
+        BY_HANDLE_FILE_INFORMATION fileInformation; 
+        SetLastError(0);
+        BOOL const x3 = GetFileInformationByHandle(file.native(), & fileInformation); 
+        if (0 == x3)
+        {   if ( ! throwExceptionOnError)
+                return; 
+            DWORD const lastError = GetLastError(); 
+            string msg = string() + stname + " failed. "
+                    + "GetFileInformationByHandle() on \"" + path.getStringRep().c_str() 
+                    + "\" failed. ";  
+            throw runtime_error(msg + "GetLastError returned " + toDecStr(lastError) + ".");
+        }
+
         st->type = getFileType(fileAttributeInfo.FileAttributes, fileAttributeInfo.ReparseTag, path); 
 
         st->lastWriteTimeNanoSec = fileBasicInfo.LastWriteTime.QuadPart; 
@@ -96,6 +109,10 @@ using namespace std;
         
         st->lastChangeTimeNanoSec = fileBasicInfo.ChangeTime.QuadPart; 
         st->lastChangeTimeNanoSec *= static_cast<std::int64_t>(100); //multiply by 100 to convert to nano-seconds
+
+        st->sizeBytes = (static_cast<std::uint64_t>(fileInformation.nFileSizeHigh) << 32) | fileInformation.nFileSizeLow; 
+        st->fileId = (static_cast<std::uint64_t>(fileInformation.nFileIndexHigh) << 32) | fileInformation.nFileIndexLow; 
+        st->linkCount = fileInformation.nNumberOfLinks; 
     }
 
     template <typename StatT>
@@ -146,6 +163,30 @@ using namespace std;
 
 #else
 
+    template <typename StatT>
+    inline void fill(StatT * const s, struct stat const& st, jjm::Path const& path)
+    {
+        if (     S_ISREG(st.st_mode)) s->type = FileType::RegularFile;
+        else if (S_ISDIR(st.st_mode)) s->type = FileType::Directory;
+        else if (S_ISLNK(st.st_mode)) s->type = FileType::Symlink;
+        else if (S_ISBLK(st.st_mode)) s->type = FileType::Other;
+        else if (S_ISCHR(st.st_mode)) s->type = FileType::Other;
+        else if (S_ISFIFO(st.st_mode)) s->type = FileType::Other;
+        else                           JFATAL(0, path.getStringRep());
+
+        s->lastWriteTimeNanoSec = 0;
+        s->lastWriteTimeNanoSec += (std::uint64_t)(st.st_mtim.tv_nsec);
+        s->lastWriteTimeNanoSec += (std::uint64_t)(st.st_mtim.tv_sec) * (std::uint64_t)1000 * (std::uint64_t)1000 * (std::uint64_t)1000;
+
+        s->lastChangeTimeNanoSec = 0;
+        s->lastChangeTimeNanoSec += (std::uint64_t)(st.st_ctim.tv_nsec);
+        s->lastChangeTimeNanoSec += (std::uint64_t)(st.st_ctim.tv_sec) * (std::uint64_t)1000 * (std::uint64_t)1000 * (std::uint64_t)1000;
+
+        s->sizeBytes = (std::uint64_t)(st.st_size);
+        s->fileId = (std::uint64_t)(st.st_ino);
+        s->linkCount = (std::uint32_t)(st.st_nlink);
+    }
+
     template <typename StatT>
     inline void init(
                 StatT * const s, 
@@ -181,24 +222,9 @@ using namespace std;
             throw runtime_error(message + "errno " + toDecStr(lastErrno) + ".");
         }
 
-        if (     S_ISREG(st.st_mode)) s->type = FileType::RegularFile;
-        else if (S_ISDIR(st.st_mode)) s->type = FileType::Directory;
-        else if (S_ISLNK(st.st_mode)) s->type = FileType::Symlink;
-        else if (S_ISBLK(st.st_mode)) s->type = FileType::Other;
-        else if (S_ISCHR(st.st_mode)) s->type = FileType::Other;
-        else if (S_ISFIFO(st.st_mode)) s->type = FileType::Other;
-        else                           JFATAL(0, path.getStringRep());
-
+        fill(s, st, path); 
         if (resolveSymlinks && s->type == FileType::Symlink)
             JFATAL(0, path.getStringRep()); 
-
-        s->lastWriteTimeNanoSec = 0;
-        s->lastWriteTimeNanoSec += (std::uint64_t)(st.st_mtim.tv_nsec);
-        s->lastWriteTimeNanoSec += (std::uint64_t)(st.st_mtim.tv_sec) * (std::uint64_t)1000 * (std::uint64_t)1000 * (std::uint64_t)1000;
-
-        s->lastChangeTimeNanoSec = 0;
-        s->lastChangeTimeNanoSec += (std::uint64_t)(st.st_ctim.tv_nsec);
-        s->lastChangeTimeNanoSec += (std::uint64_t)(st.st_ctim.tv_sec) * (std::uint64_t)1000 * (std::uint64_t)1000 * (std::uint64_t)1000;
     }
 
     jjm::Stat jjm::Stat::stat  (Path const& path) { Stat st; init(&st, true, true, path, "jjm::Stat::stat"); return st; }
@@ -206,4 +232,15 @@ using namespace std;
     jjm::Stat jjm::Stat::lstat (Path const& path) { Stat st; init(&st, false, true, path, "jjm::Stat::lstat"); return st; }
     jjm::Stat jjm::Stat::lstat2(Path const& path) { Stat st; init(&st, false, false, path, "jjm::Stat::lstat2"); return st; }
 
+    jjm::Stat jjm::Stat::get2(FileHandle file)
+    {   Stat s; 
+        struct stat st; 
+        if (0 != ::fstat(file.native(), & st))
+        {   s.type = FileType::Invalid; 
+            return s; 
+        }
+        fill(&s, st, Path()); 
+        return s; 
+    }
+
 #endif
@@ -20,7 +20,7 @@ namespace jjm
 class Stat
 {
 public:
-    Stat() : type(FileType::Invalid), lastWriteTimeNanoSec(0), lastChangeTimeNanoSec(0) {}
+    Stat() : type(FileType::Invalid), lastWriteTimeNanoSec(0), lastChangeTimeNanoSec(0), sizeBytes(0), fileId(0), linkCount(0) {}
 
     //When the path names a symbolic link, jjm::Stat returns information about
     //the target of the link. 
@@ -46,13 +46,14 @@ public:
     //(FileType::NoExist is not an error.) 
     static Stat lstat2(Path const& path); 
 
-#ifdef _WIN32
     static Stat get2(FileHandle file); //on errors, returns a stat object with FileType::Invalid
-#endif
 
     FileType type;
     std::int64_t lastWriteTimeNanoSec; //time since unix epoch
     std::int64_t lastChangeTimeNanoSec; //time since unix epoch
+    std::uint64_t sizeBytes; 
+    std::uint64_t fileId; //the inode number on POSIX, the file index on Windows
+    std::uint32_t linkCount; //the number of hard links to the file
 };
 
 } //namespace jjm
@@ -0,0 +1,109 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "jsysload.hpp"
+
+#include <cstdio>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <stdlib.h>
+    #include <unistd.h>
+#endif
+
+using namespace std;
+
+
+#ifdef _WIN32
+
+int jjm::getNumOnlineCpus()
+{
+    SYSTEM_INFO info; 
+    GetSystemInfo( & info); 
+    return info.dwNumberOfProcessors > 0 ? static_cast<int>(info.dwNumberOfProcessors) : 1; 
+}
+
+bool jjm::getLoadAverage(double & ) { return false; }
+
+bool jjm::getCpuPressure(double & ) { return false; }
+
+bool jjm::getAvailableMemory(std::int64_t & bytes)
+{
+    MEMORYSTATUSEX status; 
+    status.dwLength = sizeof(status); 
+    if ( ! GlobalMemoryStatusEx( & status))
+        return false; 
+    bytes = static_cast<std::int64_t>(status.ullAvailPhys); 
+    return true; 
+}
+
+#else
+
+namespace
+{
+    //Reads the first line of a small file of the proc filesystem. 
+    bool readFirstLine(char const * path, char * buffer, size_t bufferSize)
+    {   FILE * const file = fopen(path, "r"); 
+        if (file == 0)
+            return false; 
+        bool const success = 0 != fgets(buffer, static_cast<int>(bufferSize), file); 
+        fclose(file); 
+        return success; 
+    }
+}
+
+int jjm::getNumOnlineCpus()
+{
+    long const n = sysconf(_SC_NPROCESSORS_ONLN); 
+    return n > 0 ? static_cast<int>(n) : 1; 
+}
+
+bool jjm::getLoadAverage(double & loadAverage)
+{
+#ifdef __linux__
+    char line[256]; 
+    return readFirstLine("/proc/loadavg", line, sizeof(line)) 
+            && 1 == sscanf(line, "%lf", & loadAverage); 
+#else
+    return 1 == getloadavg( & loadAverage, 1); 
+#endif
+}
+
+bool jjm::getCpuPressure(double & stallPercent)
+{
+#ifdef __linux__
+    //The first line is: some avg10=<percent> avg60=<percent> avg300=<percent> total=<microseconds>
+    char line[256]; 
+    return readFirstLine("/proc/pressure/cpu", line, sizeof(line)) 
+            && 1 == sscanf(line, "some avg10=%lf", & stallPercent); 
+#else
+    (void)stallPercent; 
+    return false; 
+#endif
+}
+
+bool jjm::getAvailableMemory(std::int64_t & bytes)
+{
+#ifdef __linux__
+    FILE * const file = fopen("/proc/meminfo", "r"); 
+    if (file == 0)
+        return false; 
+    bool found = false; 
+    char line[256]; 
+    long long kiloBytes = 0; 
+    while ( ! found && fgets(line, sizeof(line), file))
+        found = 1 == sscanf(line, "MemAvailable: %lld kB", & kiloBytes); 
+    fclose(file); 
+    if (found)
+        bytes = static_cast<std::int64_t>(kiloBytes) * 1024; 
+    return found; 
+#else
+    (void)bytes; 
+    return false; 
+#endif
+}
+
+#endif
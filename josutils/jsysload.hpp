@@ -0,0 +1,35 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#ifndef JOSUTILS_JSYSLOAD_HPP_HEADER_GUARD
+#define JOSUTILS_JSYSLOAD_HPP_HEADER_GUARD
+
+#include "jbase/jstdint.hpp"
+
+namespace jjm
+{
+
+//Returns the number of online processors, at least 1. 
+int getNumOnlineCpus(); 
+
+//Sets loadAverage to the system load average over the last minute, the 
+//average number of runnable processes. 
+//Returns false when the system does not report it, such as on Windows. 
+bool getLoadAverage(double & loadAverage); 
+
+//Sets stallPercent to the share of the last ten seconds in which at least one
+//runnable task waited for a processor, from 0 to 100. 
+//Returns false when the system does not report it. Only Linux 4.20 and later,
+//with pressure stall information enabled, reports it. 
+bool getCpuPressure(double & stallPercent); 
+
+//Sets bytes to the memory available for new processes without swapping, 
+//MemAvailable on Linux. 
+//Returns false when the system does not report it. 
+bool getAvailableMemory(std::int64_t & bytes); 
+
+} //namespace jjm
+
+#endif
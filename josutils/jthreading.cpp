@@ -7,6 +7,8 @@
 
 #include "jbase/jfatal.hpp"
 #include "jbase/juniqueptr.hpp"
+#include <algorithm>
+#include <limits>
 #include <memory>
 
 #ifdef _WIN32
@@ -139,48 +141,152 @@ void jjm::sleep(unsigned long millisec)
 #endif
 }
 
+namespace
+{
+    //Identifies the pool and the worker index of the current thread, so that
+    //tasks added from inside a worker go onto that worker's own queue. 
+    JJM_THREAD_LOCAL jjm::ThreadPool * currentPool = 0; 
+    JJM_THREAD_LOCAL std::size_t currentWorkerIndex = 0; 
+
+    struct PriorityGreater
+    {   bool operator() (jjm::ThreadPool::PrioritizedTask const& a, jjm::ThreadPool::PrioritizedTask const& b) const
+            { return a.first > b.first; }
+    };
+}
+
+
+//A binary max-heap of tasks, ordered by priority, and then by insertion order
+//with the newest first. 
+class jjm::ThreadPool::WorkerQueue
+{
+public:
+    static std::int64_t emptyPriority() { return std::numeric_limits<std::int64_t>::min(); }
+
+    WorkerQueue() : topPriority(emptyPriority()), nextSequence(0) {}
+
+    Mutex mutex; 
+
+    //requires mutex held
+    bool empty() const { return heap.empty(); }
+    void push(Thread::Runnable* task, std::int64_t priority)
+    {   Entry entry; 
+        entry.priority = priority; 
+        entry.sequence = nextSequence++; 
+        entry.task = task; 
+        heap.push_back(entry); 
+        std::push_heap(heap.begin(), heap.end(), EntryLess()); 
+        topPriority = heap.front().priority; 
+    }
+    Thread::Runnable * pop()
+    {   std::pop_heap(heap.begin(), heap.end(), EntryLess()); 
+        Thread::Runnable * task = heap.back().task; 
+        heap.pop_back(); 
+        topPriority = heap.empty() ? emptyPriority() : heap.front().priority; 
+        return task; 
+    }
+    void deleteAll()
+    {   for (size_t i = 0; i < heap.size(); ++i)
+            delete heap[i].task; 
+        heap.clear(); 
+    }
+
+    //A copy of the priority of the top task, for thieves choosing a victim 
+    //without taking every lock. Written only with mutex held. 
+    std::atomic<std::int64_t> topPriority; 
+
+private:
+    struct Entry
+    {   std::int64_t priority; 
+        std::uint64_t sequence; 
+        Thread::Runnable * task; 
+    };
+    struct EntryLess
+    {   bool operator() (Entry const& a, Entry const& b) const
+        {   if (a.priority != b.priority)
+                return a.priority < b.priority; 
+            return a.sequence < b.sequence; 
+        }
+    };
+    std::vector<Entry> heap; 
+    std::uint64_t nextSequence; 
+};
+
 
 class jjm::ThreadPool::WorkerMain
 {   
 public:
     ThreadPool * pool;
+    std::size_t workerIndex; 
 
     void operator() ()
     {
-        Lock g(pool->mutex);
+        currentPool = pool; 
+        currentWorkerIndex = workerIndex; 
         for (;;)
-        {   UniquePtr<Thread::Runnable*> task;
-            for (;;)
-            {   if (pool->stopflag)
-                {   pool->idleCondition.notify_all();
-                    return;
-                }
-                if (pool->pendingTasks.size())
-                {   task.reset(pool->pendingTasks.back());
-                    pool->pendingTasks.pop_back();
-                    break;
-                }
-                if (0 == pool->numRunningTasks)
-                    pool->idleCondition.notify_all();
-                wait(g, pool->newTaskCondition);
+        {   if (pool->stopflag)
+            {   pool->notifyIdleWaiters(); 
+                return;
             }
-            ++pool->numRunningTasks;
-            {
-                ReverseLock rg(g);
-                task->run();
+
+            //Above the concurrency limit, sleep on a separate condition, so 
+            //that the wakeups for new tasks go only to workers which can run
+            //them. 
+            if (static_cast<int>(workerIndex) >= pool->concurrencyLimit)
+            {   Lock g(pool->sleepMutex); 
+                while (static_cast<int>(workerIndex) >= pool->concurrencyLimit && ! pool->stopflag)
+                    wait(g, pool->concurrencyCondition); 
+                continue; 
             }
-            --pool->numRunningTasks;
+
+            //Count ourselves as running before we pop, so that waitUntilIdle()
+            //never sees a popped task as neither pending nor running. 
+            ++pool->numRunningTasks; 
+            UniquePtr<Thread::Runnable*> task(pool->popOrSteal(workerIndex)); 
+            if (task.get() && ! pool->stopflag)
+                task->run(); 
+            bool const ranTask = task.get() != 0; 
+            task.reset(); 
+            if (0 == --pool->numRunningTasks && (0 == pool->numPendingTasks || pool->stopflag))
+                pool->notifyIdleWaiters(); 
+            if (ranTask)
+                continue; 
+
+            //Nothing to run and nothing to steal. Sleep until new work arrives. 
+            //Paired with wakeWorkers(): we advertise that we are sleeping 
+            //before we re-check for pending tasks, and adders advertise new
+            //pending tasks before they check for sleepers. 
+            //A worker above the concurrency limit must not sleep here, where
+            //it would take wakeups meant for the others. 
+            Lock g(pool->sleepMutex); 
+            ++pool->numSleepingWorkers; 
+            if (0 == pool->numPendingTasks && ! pool->stopflag 
+                    && static_cast<int>(workerIndex) < pool->concurrencyLimit)
+                wait(g, pool->newTaskCondition); 
+            --pool->numSleepingWorkers; 
         }
     }
 };
 
 jjm::ThreadPool::ThreadPool(int numThreads)
-    : stopflag(false), numRunningTasks(0)
+    : 
+    nextQueueForExternalTasks(0), 
+    stopflag(false), 
+    numPendingTasks(0), 
+    numRunningTasks(0), 
+    numSleepingWorkers(0), 
+    concurrencyLimit(numThreads)
 {
-    WorkerMain workerMain;
-    workerMain.pool = this;
+    if (numThreads < 1)
+        JFATAL(numThreads, 0); 
+    for (int i = 0; i < numThreads; ++i)
+    {   queues.push_back(0);
+        queues.back() = new WorkerQueue; 
+    }
     for (int i = 0; i < numThreads; ++i)
-    {   createdThreads.push_back(0);
+    {   WorkerMain workerMain;
+        workerMain.pool = this;
+        workerMain.workerIndex = i; 
+        createdThreads.push_back(0);
         createdThreads.back() = new Thread(workerMain, Thread::JoinInDtor);
     }
 }
@@ -190,13 +296,19 @@ jjm::ThreadPool::~ThreadPool()
     setStopFlag();
     for (size_t i=0; i<createdThreads.size(); ++i)
         delete createdThreads[i];
+    for (size_t i=0; i<queues.size(); ++i)
+    {   queues[i]->deleteAll(); 
+        delete queues[i]; 
+    }
 }
 
 void jjm::ThreadPool::waitUntilIdle()
 {
-    Lock g(mutex);
+    Lock g(idleMutex);
     for (;;)
-    {   if (numRunningTasks == 0 && pendingTasks.size() == 0)
+    {   //Read the number of running tasks first. A running task may add new
+        //pending tasks, but it does so before it stops counting as running. 
+        if (numRunningTasks == 0 && numPendingTasks == 0)
             return; 
         if (numRunningTasks == 0 && stopflag)
             return; 
@@ -204,22 +316,186 @@ void jjm::ThreadPool::waitUntilIdle()
     }
 }
 
-void jjm::ThreadPool::addTask(Thread::Runnable* task)
+jjm::ThreadPool::WorkerQueue & jjm::ThreadPool::selectQueueForNewTasks()
+{
+    if (currentPool == this)
+        return * queues[currentWorkerIndex]; 
+    return * queues[nextQueueForExternalTasks++ % queues.size()]; 
+}
+
+void jjm::ThreadPool::addTask(Thread::Runnable* task, std::int64_t priority)
 {
     UniquePtr<Thread::Runnable*> task2(task);
+    WorkerQueue & queue = selectQueueForNewTasks(); 
+    ++numPendingTasks; 
+    {
+        Lock g(queue.mutex);
+        queue.push(task2.get(), priority); 
+        task2.release(); 
+    }
+    wakeWorkers(1); 
+}
+
+void jjm::ThreadPool::addTasks(std::vector<Thread::Runnable*> & tasks)
+{
+    std::vector<PrioritizedTask> tasks2; 
+    struct Guard
+    {   std::vector<Thread::Runnable*> & v; 
+        Guard(std::vector<Thread::Runnable*> & v_) : v(v_) {}
+        ~Guard() { for (size_t i = 0; i < v.size(); ++i) delete v[i]; v.clear(); }
+    } guard(tasks); 
+    tasks2.reserve(tasks.size()); 
+    for (size_t i = 0; i < tasks.size(); ++i)
+        tasks2.push_back(PrioritizedTask(0, tasks[i])); 
+    tasks.clear(); 
+    addTasks(tasks2); 
+}
+
+void jjm::ThreadPool::addTasks(std::vector<PrioritizedTask> & tasks)
+{
+    if (tasks.size() == 0)
+        return; 
+
+    //Take ownership before anything can throw. 
+    std::vector<PrioritizedTask> tasks2; 
+    tasks2.swap(tasks); 
+    struct Guard
+    {   std::vector<PrioritizedTask> & v; 
+        Guard(std::vector<PrioritizedTask> & v_) : v(v_) {}
+        ~Guard() { for (size_t i = 0; i < v.size(); ++i) delete v[i].second; }
+    } guard(tasks2); 
+
+    size_t const numNewTasks = tasks2.size(); 
+    if (currentPool == this)
+    {   //Idle workers steal the highest priority siblings from this queue. 
+        WorkerQueue & queue = * queues[currentWorkerIndex]; 
+        numPendingTasks += numNewTasks; 
+        Lock g(queue.mutex);
+        for (size_t i = 0; i < numNewTasks; ++i)
+        {   queue.push(tasks2[i].second, tasks2[i].first); 
+            tasks2[i].second = 0; 
+        }
+        tasks2.clear(); 
+    }else
+    {   //Spread the tasks over all of the queues, so that every worker can
+        //start without stealing. Hand them out in priority order, so that the
+        //most important tasks land on different workers. 
+        std::stable_sort(tasks2.begin(), tasks2.end(), PriorityGreater()); 
+        size_t const numQueues = queues.size(); 
+        size_t const first = nextQueueForExternalTasks.fetch_add(numQueues); 
+        numPendingTasks += numNewTasks; 
+        for (size_t q = 0; q < numQueues && q < numNewTasks; ++q)
+        {   WorkerQueue & queue = * queues[(first + q) % numQueues]; 
+            Lock g(queue.mutex);
+            for (size_t i = q; i < numNewTasks; i += numQueues)
+            {   queue.push(tasks2[i].second, tasks2[i].first); 
+                tasks2[i].second = 0; 
+            }
+        }
+        tasks2.clear(); 
+    }
+    wakeWorkers(numNewTasks); 
+}
+
+jjm::Thread::Runnable * jjm::ThreadPool::popOrSteal(std::size_t workerIndex)
+{
+    if (0 == numPendingTasks)
+        return 0; 
+
+    {   WorkerQueue & own = * queues[workerIndex]; 
+        Lock g(own.mutex); 
+        if ( ! own.empty())
+        {   --numPendingTasks; 
+            return own.pop(); 
+        }
+    }
+
+    //Steal from the queue with the highest priority top task. The hints may be
+    //stale, so fall back to the other queues if the chosen one is empty. 
+    size_t const numQueues = queues.size(); 
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {   size_t best = workerIndex; 
+        std::int64_t bestPriority = WorkerQueue::emptyPriority(); 
+        for (size_t i = 1; i < numQueues; ++i)
+        {   size_t const q = (workerIndex + i) % numQueues; 
+            std::int64_t const p = queues[q]->topPriority; 
+            if (best == workerIndex || p > bestPriority)
+            {   best = q; 
+                bestPriority = p; 
+            }
+        }
+        if (best == workerIndex)
+            return 0; 
+        WorkerQueue & victim = * queues[best]; 
+        Lock g(victim.mutex); 
+        if ( ! victim.empty())
+        {   --numPendingTasks; 
+            return victim.pop(); 
+        }
+    }
+    for (size_t i = 1; i < numQueues; ++i)
+    {   WorkerQueue & victim = * queues[(workerIndex + i) % numQueues]; 
+        Lock g(victim.mutex); 
+        if ( ! victim.empty())
+        {   --numPendingTasks; 
+            return victim.pop(); 
+        }
+    }
+    return 0; 
+}
+
+void jjm::ThreadPool::wakeWorkers(std::size_t numNewTasks)
+{
+    if (0 == numSleepingWorkers)
+        return; 
+    //Taking and releasing sleepMutex orders us after any worker which is 
+    //between its check of numPendingTasks and its wait(). We can then signal
+    //without holding the lock, so the woken worker does not immediately block
+    //on the mutex. 
+    //Wake no more workers than there are new tasks. Waking every sleeper for
+    //a small batch only makes them contend to steal from the same deque. 
+    std::size_t numToWake = 0; 
     {
-        Lock g(mutex);
-        pendingTasks.push_back(0);
-        pendingTasks.back() = task2.release();
+        Lock g(sleepMutex); 
+        numToWake = std::min<std::size_t>(numNewTasks, numSleepingWorkers); 
     }
-    newTaskCondition.notify_one();
+    for (std::size_t i = 0; i < numToWake; ++i)
+        newTaskCondition.notify_one(); 
+}
+
+void jjm::ThreadPool::notifyIdleWaiters()
+{
+    Lock g(idleMutex); 
+    idleCondition.notify_all(); 
 }
 
 void jjm::ThreadPool::setStopFlag()
 {
+    stopflag = true;
     {
-        Lock g(mutex);
-        stopflag = true;
+        Lock g(sleepMutex);
+        newTaskCondition.notify_all();
+        concurrencyCondition.notify_all();
+    }
+    notifyIdleWaiters(); 
+}
+
+void jjm::ThreadPool::setConcurrencyLimit(int limit)
+{
+    if (limit < 1 || limit > getNumThreads())
+        JFATAL(limit, 0); 
+    {   //Under sleepMutex, so that a worker cannot miss the raise between its
+        //check of the limit and its wait(). 
+        Lock g(sleepMutex); 
+        if (concurrencyLimit == limit)
+            return; 
+        //Sleeping workers above the new limit move to concurrencyCondition.
+        if (limit < concurrencyLimit)
+            newTaskCondition.notify_all(); 
+        concurrencyLimit = limit; 
+        concurrencyCondition.notify_all(); 
     }
-    newTaskCondition.notify_all();
+    //Workers which went to sleep above the old limit may have left pending
+    //tasks behind. 
+    wakeWorkers(static_cast<std::size_t>(std::max<long>(0, numPendingTasks))); 
 }
@@ -7,6 +7,7 @@
 #define JOSUTILS_JTHREADING_HPP_HEADER_GUARD
 
 #include "jbase/jfatal.hpp"
+#include "jbase/jstdint.hpp"
 
 #ifdef _WIN32
     #include <windows.h>
@@ -20,12 +21,23 @@
 #include <cstdlib>
 
 #include <algorithm>
+#include <atomic>
 #include <functional>
 #include <limits>
 #include <memory>
+#include <utility>
 #include <vector>
 
 
+//Declares a variable with a separate instance per thread. The type must be 
+//trivially constructible and destructible. 
+#ifdef _WIN32
+    #define JJM_THREAD_LOCAL __declspec(thread)
+#else
+    #define JJM_THREAD_LOCAL __thread
+#endif
+
+
 namespace jjm
 {
 
@@ -298,33 +310,83 @@ private:
 };
 
 
+/* ThreadPool is a work-stealing pool. Each worker thread owns a queue of 
+pending tasks. A task added from inside a worker thread goes onto that 
+worker's own queue. Tasks added from outside the pool are distributed 
+round-robin. 
+
+Every task has a priority, default 0. A worker runs the highest priority task
+from its own queue. Among tasks of equal priority, the most recently added 
+runs first (LIFO, for cache locality). A worker with an empty queue steals the
+highest priority task it can find among the other queues. 
+
+Consequently, there is no single lock which every worker must take for every
+task. Priorities are only strictly honored per queue; across queues they are a
+strong hint. */
 class ThreadPool
 {
 public:
     ThreadPool(int numThreads);
     ~ThreadPool();
 
+    //Blocks until there are no pending and no running tasks. 
+    //If the stop flag is set, then this returns once no tasks are running. 
     void waitUntilIdle();
 
     //Always take ownership. 
-    void addTask(Thread::Runnable* ); 
+    void addTask(Thread::Runnable* task, std::int64_t priority = 0); 
+
+    //Always takes ownership of all of the given tasks, and clears the vector. 
+    //This is cheaper than calling addTask() once per task. The tasks are 
+    //queued with a single lock acquisition, and sleeping workers are woken at
+    //most once. 
+    void addTasks(std::vector<Thread::Runnable*> & tasks); 
+
+    //As above, with a priority per task. 
+    typedef std::pair<std::int64_t, Thread::Runnable*> PrioritizedTask; 
+    void addTasks(std::vector<PrioritizedTask> & tasks); 
 
     //will not try to interrupt already running tasks
     void setStopFlag();
+
+    int getNumThreads() const { return static_cast<int>(queues.size()); }
+
+    //Limits the number of workers which run tasks to the first limit 
+    //workers, between 1 and getNumThreads(). The other workers finish their
+    //current task, and then sleep until the limit is raised. Their queued 
+    //tasks are stolen by the running workers. 
+    //The initial limit is getNumThreads(). It is safe to call concurrently.
+    void setConcurrencyLimit(int limit); 
+    int getConcurrencyLimit() const { return concurrencyLimit; }
     
 private:
     ThreadPool(ThreadPool const& ); //not defined, not copyable
     ThreadPool& operator= (ThreadPool const& ); //not defined, not copyable
 
     class WorkerMain;
+    class WorkerQueue; 
 
-    Mutex mutex;
+    WorkerQueue & selectQueueForNewTasks(); 
+    Thread::Runnable * popOrSteal(std::size_t workerIndex); 
+    void wakeWorkers(std::size_t numNewTasks); 
+    void notifyIdleWaiters(); 
+
+    std::vector<WorkerQueue*> queues; //one per worker thread, ownership
+    std::atomic<std::size_t> nextQueueForExternalTasks; 
+
+    std::atomic<bool> stopflag;
+    std::atomic<long> numPendingTasks; //queued, not yet started
+    std::atomic<int> numRunningTasks;
+    std::atomic<int> numSleepingWorkers; 
+    std::atomic<int> concurrencyLimit; 
+
+    Mutex sleepMutex; 
     CondVar newTaskCondition;
+    CondVar concurrencyCondition; //workers above the concurrency limit wait here
+    Mutex idleMutex; 
     CondVar idleCondition;
-    bool stopflag;
-    int numRunningTasks;
+
     std::vector<Thread*> createdThreads;
-    std::vector<Thread::Runnable*> pendingTasks;
 };
 
 
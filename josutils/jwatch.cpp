@@ -0,0 +1,151 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "jwatch.hpp"
+
+#include "jbase/jfatal.hpp"
+#include "jbase/jinttostring.hpp"
+
+#include <stdexcept>
+
+#ifdef __linux__
+    #include <errno.h>
+    #include <poll.h>
+    #include <sys/inotify.h>
+    #include <unistd.h>
+#endif
+
+using namespace jjm;
+using namespace std;
+
+
+#ifdef __linux__
+
+jjm::DirectoryWatcher::DirectoryWatcher() : fd(-1)
+{
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC); 
+    if (fd == -1)
+    {   int const lastErrno = errno; 
+        throw std::runtime_error("jjm::DirectoryWatcher::DirectoryWatcher() failed. Cause:\ninotify_init1() failed. errno " + toDecStr(lastErrno) + "."); 
+    }
+}
+
+jjm::DirectoryWatcher::~DirectoryWatcher()
+{
+    if (0 != close(fd))
+        JFATAL(errno, 0); 
+}
+
+void jjm::DirectoryWatcher::addDirectory(Path const& dir_)
+{
+    Path const dir = dir_.getAbsolutePath(); 
+    if (watchesByDir.count(dir.getStringRep()))
+        return; 
+    uint32_t const mask = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE 
+            | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR; 
+    int const wd = inotify_add_watch(fd, dir.getStringRep().c_str(), mask); 
+    if (wd == -1)
+    {   int const lastErrno = errno; 
+        throw std::runtime_error("jjm::DirectoryWatcher::addDirectory() failed for \"" + dir.getStringRep() + "\". Cause:\n"
+                "inotify_add_watch() failed. errno " + toDecStr(lastErrno) + "."); 
+    }
+    dirsByWatch[wd] = dir; 
+    watchesByDir[dir.getStringRep()] = wd; 
+}
+
+bool jjm::DirectoryWatcher::isWatched(Path const& dir) const
+{
+    return watchesByDir.count(dir.getAbsolutePath().getStringRep()) != 0; 
+}
+
+bool jjm::DirectoryWatcher::readEvents(std::map<std::string, Path> & changed, int timeoutMillis, bool & overflowed)
+{
+    struct pollfd p; 
+    p.fd = fd; 
+    p.events = POLLIN; 
+    p.revents = 0; 
+    int const r = poll( & p, 1, timeoutMillis); 
+    if (r == -1)
+    {   int const lastErrno = errno; 
+        if (lastErrno == EINTR)
+            return false; 
+        throw std::runtime_error("jjm::DirectoryWatcher::waitForChanges() failed. Cause:\npoll() failed. errno " + toDecStr(lastErrno) + "."); 
+    }
+    if (r == 0)
+        return false; 
+
+    //inotify_event is followed by its name, and the buffer must be aligned 
+    //for inotify_event. 
+    union
+    {   struct inotify_event event; 
+        char bytes[64 * 1024]; 
+    } buffer; 
+    for (;;)
+    {   ssize_t const size = read(fd, buffer.bytes, sizeof(buffer.bytes)); 
+        if (size == -1)
+        {   int const lastErrno = errno; 
+            if (lastErrno == EAGAIN || lastErrno == EWOULDBLOCK)
+                return true; 
+            if (lastErrno == EINTR)
+                continue; 
+            throw std::runtime_error("jjm::DirectoryWatcher::waitForChanges() failed. Cause:\nread() failed. errno " + toDecStr(lastErrno) + "."); 
+        }
+        for (char const * x = buffer.bytes; x < buffer.bytes + size; )
+        {   struct inotify_event const * const event = reinterpret_cast<struct inotify_event const*>(x); 
+            x += sizeof(struct inotify_event) + event->len; 
+            if (event->mask & IN_Q_OVERFLOW)
+            {   overflowed = true; 
+                continue; 
+            }
+            if (event->mask & IN_IGNORED)
+            {   //The directory was removed, or its file system was unmounted.
+                map<int, Path>::iterator dir = dirsByWatch.find(event->wd); 
+                if (dir != dirsByWatch.end())
+                {   watchesByDir.erase(dir->second.getStringRep()); 
+                    dirsByWatch.erase(dir); 
+                }
+                continue; 
+            }
+            map<int, Path>::const_iterator dir = dirsByWatch.find(event->wd); 
+            if (dir == dirsByWatch.end() || event->len == 0 || event->name[0] == 0)
+                continue; 
+            Path const path = Path::join(dir->second, Path(string(event->name))); 
+            changed.insert(make_pair(path.getStringRep(), path)); 
+        }
+    }
+}
+
+bool jjm::DirectoryWatcher::waitForChanges(std::vector<Path> & changed, int timeoutMillis, int debounceMillis, bool & overflowed)
+{
+    map<string, Path> batch; 
+    if ( ! readEvents(batch, timeoutMillis, overflowed))
+        return false; 
+    for (;;)
+    {   if ( ! readEvents(batch, debounceMillis, overflowed))
+            break; 
+    }
+    for (map<string, Path>::const_iterator x = batch.begin(); x != batch.end(); ++x)
+        changed.push_back(x->second); 
+    return true; 
+}
+
+#else
+
+jjm::DirectoryWatcher::DirectoryWatcher() : fd(-1)
+{
+    throw std::runtime_error("jjm::DirectoryWatcher::DirectoryWatcher() failed. Cause:\nWatching directories is only supported on Linux."); 
+}
+
+jjm::DirectoryWatcher::~DirectoryWatcher() {}
+
+void jjm::DirectoryWatcher::addDirectory(Path const& ) { JFATAL(0, 0); }
+
+bool jjm::DirectoryWatcher::isWatched(Path const& ) const { JFATAL(0, 0); return false; }
+
+bool jjm::DirectoryWatcher::readEvents(std::map<std::string, Path> & , int , bool & ) { JFATAL(0, 0); return false; }
+
+bool jjm::DirectoryWatcher::waitForChanges(std::vector<Path> & , int , int , bool & ) { JFATAL(0, 0); return false; }
+
+#endif
@@ -0,0 +1,57 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#ifndef JOSUTILS_JWATCH_HPP_HEADER_GUARD
+#define JOSUTILS_JWATCH_HPP_HEADER_GUARD
+
+#include "jpath.hpp"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace jjm
+{
+
+/* Reports changes to the files directly inside a set of watched 
+directories. Subdirectories are not watched. Implemented with inotify, and 
+only available on Linux. */
+class DirectoryWatcher
+{
+public:
+    //Throws std::exception on errors, and when the platform is not supported.
+    DirectoryWatcher(); 
+    ~DirectoryWatcher(); 
+
+    //Does nothing if the directory is already watched. 
+    //Throws std::exception on errors, such as when the directory does not exist. 
+    void addDirectory(Path const& dir); 
+    bool isWatched(Path const& dir) const; 
+
+    //Waits up to timeoutMillis for a change, where a negative timeout waits
+    //forever. After the first change, keeps collecting changes until none 
+    //arrived for debounceMillis, so that a burst of writes is returned as 
+    //one batch. Appends the absolute path of every changed file to "changed",
+    //without duplicates. 
+    //Sets "overflowed" when the kernel dropped changes, in which case any 
+    //file in the watched directories may have changed. 
+    //Returns false on timeout. Throws std::exception on errors. 
+    bool waitForChanges(std::vector<Path> & changed, int timeoutMillis, int debounceMillis, bool & overflowed); 
+
+private:
+    DirectoryWatcher(DirectoryWatcher const& ); //not defined, not copyable
+    DirectoryWatcher& operator= (DirectoryWatcher const& ); //not defined, not copyable
+
+    //Returns false when nothing arrived within timeoutMillis. 
+    bool readEvents(std::map<std::string, Path> & changed, int timeoutMillis, bool & overflowed); 
+
+    int fd; 
+    std::map<int, Path> dirsByWatch; 
+    std::map<std::string, int> watchesByDir; 
+}; 
+
+} //namespace jjm
+
+#endif
@@ -0,0 +1,293 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#include "jworker.hpp"
+
+#include "jclock.hpp"
+#include "jbase/jfatal.hpp"
+#include "jbase/jinttostring.hpp"
+#include "jbase/juniqueptr.hpp"
+
+#ifndef _WIN32
+    #include <errno.h>
+    #include <poll.h>
+    #include <pthread.h>
+    #include <signal.h>
+    #include <time.h>
+#endif
+
+#include <stdexcept>
+
+using namespace jjm; 
+using namespace std; 
+
+
+class jjm::WorkerPool::Worker
+{
+public:
+    Worker() : numRequests(0) {}
+    UniquePtr<Process*> process; 
+    FileHandleOwner toWorker; 
+    FileHandleOwner fromWorker; 
+    std::int32_t numRequests; 
+}; 
+
+class jjm::WorkerPool::Tool
+{
+public:
+    Tool() : maxWorkers(1), maxRequests(0), numWorkers(0), replaced(false) {}
+    ProcessBuilder pb; 
+    std::int32_t maxWorkers; 
+    std::int32_t maxRequests; 
+    std::int32_t numWorkers; //idle and busy
+    std::vector<Worker*> idle; //ownership
+    bool replaced; 
+}; 
+
+namespace
+{
+    void putUint32(string & out, std::uint32_t x)
+    {   for (int i = 0; i < 4; ++i)
+            out.push_back(static_cast<char>((x >> (8 * i)) & 0xFF)); 
+    }
+
+    std::uint32_t getUint32(unsigned char const * in)
+    {   return static_cast<std::uint32_t>(in[0]) | (static_cast<std::uint32_t>(in[1]) << 8)
+            | (static_cast<std::uint32_t>(in[2]) << 16) | (static_cast<std::uint32_t>(in[3]) << 24); 
+    }
+
+    //Returns false when the worker is gone. A write to a pipe without a
+    //reader raises SIGPIPE, which would end this process, so the signal is
+    //blocked for the write, and a SIGPIPE raised by the write is consumed.
+    bool writeAll(FileHandle h, string const& data)
+    {
+    #ifdef _WIN32
+        return h.writeComplete2(data.data(), data.size()) == static_cast<ssize_t>(data.size()); 
+    #else
+        sigset_t pipeSet, oldSet, pendingSet; 
+        sigemptyset( & pipeSet); 
+        sigaddset( & pipeSet, SIGPIPE); 
+        if (0 != pthread_sigmask(SIG_BLOCK, & pipeSet, & oldSet))
+            JFATAL(0, 0); 
+        sigemptyset( & pendingSet); 
+        sigpending( & pendingSet); 
+        bool const wasPending = sigismember( & pendingSet, SIGPIPE) == 1; 
+
+        bool ok = true; 
+        for (size_t written = 0; written < data.size(); )
+        {   ssize_t const n = h.write2(data.data() + written, data.size() - written); 
+            if (n < 0)
+            {   ok = false; 
+                break; 
+            }
+            written += n; 
+        }
+
+        if ( ! ok && errno == EPIPE && ! wasPending)
+        {   timespec const zero = { 0, 0 }; 
+            while (-1 == sigtimedwait( & pipeSet, 0, & zero) && errno == EINTR)
+                ; 
+        }
+        if (0 != pthread_sigmask(SIG_SETMASK, & oldSet, 0))
+            JFATAL(0, 0); 
+        return ok; 
+    #endif
+    }
+
+    //Returns false on EOF and on errors, and when the deadline, a time of 
+    //getMonotonicClockNanoSec(), passed first, in which case timedOut is 
+    //set. A deadline of 0 is none.
+    bool readAll(FileHandle h, char * data, size_t size, std::int64_t deadlineNanoSec, bool & timedOut)
+    {   for (size_t done = 0; done < size; )
+        {
+        #ifndef _WIN32
+            if (deadlineNanoSec)
+            {   std::int64_t const left = deadlineNanoSec - getMonotonicClockNanoSec(); 
+                pollfd p; 
+                p.fd = h.native(); 
+                p.events = POLLIN; 
+                p.revents = 0; 
+                int const x = left > 0 ? ::poll( & p, 1, static_cast<int>((left + 999999) / 1000000)) : 0; 
+                if (x < 0 && errno == EINTR)
+                    continue; 
+                if (x == 0)
+                {   timedOut = true; 
+                    return false; 
+                }
+            }
+        #endif
+            ssize_t const n = h.read2(data + done, size - done); 
+            if (n < 0)
+                return false; 
+            done += n; 
+        }
+        return true; 
+    }
+}
+
+
+jjm::WorkerPool::WorkerPool() : numStarted(0), timeoutNanoSec(0) {}
+
+jjm::WorkerPool::~WorkerPool()
+{
+    vector<Tool*> all(replacedTools); 
+    for (map<string, Tool*>::iterator t = tools.begin(); t != tools.end(); ++t)
+        all.push_back(t->second); 
+    for (size_t i = 0; i < all.size(); ++i)
+    {   for (size_t w = 0; w < all[i]->idle.size(); ++w)
+        {   stopWorker(all[i]->idle[w]); 
+            delete all[i]->idle[w]; 
+        }
+        delete all[i]; 
+    }
+}
+
+void jjm::WorkerPool::declareTool(std::string const& key, ProcessBuilder const& pb, std::int32_t maxWorkers, std::int32_t maxRequests)
+{
+    if (maxWorkers < 1 || maxRequests < 0)
+        JFATAL(maxWorkers, key); 
+    UniquePtr<Tool*> tool(new Tool); 
+    tool.get()->pb = pb; 
+    tool.get()->pb.pipeIn().pipeOut(); 
+    tool.get()->maxWorkers = maxWorkers; 
+    tool.get()->maxRequests = maxRequests; 
+
+    vector<Worker*> toStop; 
+    {   Lock lock(mutex); 
+        map<string, Tool*>::iterator old = tools.find(key); 
+        if (old != tools.end())
+        {   old->second->replaced = true; 
+            toStop.swap(old->second->idle); 
+            old->second->numWorkers -= static_cast<std::int32_t>(toStop.size()); 
+            replacedTools.push_back(old->second); 
+            tools.erase(old); 
+        }
+        tools[key] = tool.release(); 
+    }
+    for (size_t i = 0; i < toStop.size(); ++i)
+    {   stopWorker(toStop[i]); 
+        delete toStop[i]; 
+    }
+}
+
+bool jjm::WorkerPool::hasTool(std::string const& key)
+{
+    Lock lock(mutex); 
+    return tools.find(key) != tools.end(); 
+}
+
+void jjm::WorkerPool::setTimeout(std::int64_t timeoutNanoSec_)
+{
+    Lock lock(mutex); 
+    timeoutNanoSec = timeoutNanoSec_; 
+}
+
+std::int64_t jjm::WorkerPool::getNumStarted()
+{
+    Lock lock(mutex); 
+    return numStarted; 
+}
+
+void jjm::WorkerPool::stopWorker(Worker * worker)
+{
+    worker->toWorker.reset(); 
+    worker->fromWorker.reset(); 
+    worker->process.get()->join(); 
+}
+
+jjm::WorkerPool::Response jjm::WorkerPool::request(std::string const& key, std::vector<std::string> const& arguments)
+{
+    string frame; 
+    for (size_t i = 0; i < arguments.size(); ++i)
+    {   frame += arguments[i]; 
+        frame.push_back('\0'); 
+    }
+    string message; 
+    putUint32(message, static_cast<std::uint32_t>(frame.size())); 
+    message += frame; 
+
+    Tool * tool = 0; 
+    UniquePtr<Worker*> worker; 
+    std::int64_t timeout = 0; 
+    {   Lock lock(mutex); 
+        timeout = timeoutNanoSec; 
+        map<string, Tool*>::iterator t = tools.find(key); 
+        if (t == tools.end())
+            throw std::runtime_error("jjm::WorkerPool::request() failed. Cause:\nNo worker tool was declared with the key \"" + key + "\"."); 
+        tool = t->second; 
+        for (;;)
+        {   if ( ! tool->idle.empty())
+            {   worker.reset(tool->idle.back()); 
+                tool->idle.pop_back(); 
+                break; 
+            }
+            if (tool->numWorkers < tool->maxWorkers)
+            {   ++tool->numWorkers; 
+                ++numStarted; 
+                ProcessBuilder const pb = tool->pb; 
+                try
+                {   ReverseLock unlock(lock); 
+                    UniquePtr<Worker*> newWorker(new Worker); 
+                    newWorker.get()->process.reset(pb.spawn()); 
+                    newWorker.get()->toWorker.reset(newWorker.get()->process.get()->releaseWriteEndToChildsStdin()); 
+                    newWorker.get()->fromWorker.reset(newWorker.get()->process.get()->releaseReadEndFromChildsStdout()); 
+                    worker.reset(newWorker.release()); 
+                } catch (...)
+                {   --tool->numWorkers; 
+                    idleCondition.notify_all(); 
+                    throw; 
+                }
+                break; 
+            }
+            wait(lock, idleCondition); 
+        }
+    }
+
+    Response response; 
+    std::int64_t const deadline = timeout ? getMonotonicClockNanoSec() + timeout : 0; 
+    bool timedOut = false; 
+    bool ok = writeAll(worker.get()->toWorker.get(), message); 
+    unsigned char header[8]; 
+    if (ok)
+        ok = readAll(worker.get()->fromWorker.get(), reinterpret_cast<char*>(header), sizeof(header), deadline, timedOut); 
+    if (ok)
+    {   response.exitcode = getUint32(header); 
+        response.output.resize(getUint32(header + 4)); 
+        if (response.output.size())
+            ok = readAll(worker.get()->fromWorker.get(), & response.output[0], response.output.size(), deadline, timedOut); 
+    }
+    ++worker.get()->numRequests; 
+
+    bool const retire = ! ok || (tool->maxRequests && worker.get()->numRequests >= tool->maxRequests); 
+    if (retire)
+    {   if (timedOut)
+            worker.get()->process.get()->kill(); 
+        stopWorker(worker.get()); 
+        int const exitcode = worker.get()->process.get()->getExitCode(); 
+        worker.reset(); 
+        Lock lock(mutex); 
+        --tool->numWorkers; 
+        idleCondition.notify_all(); 
+        if (timedOut)
+            throw std::runtime_error("jjm::WorkerPool::request() failed. Cause:\nThe worker of \"" + key
+                    + "\" did not respond within " + toDecStr(timeout / 1000000) + " milliseconds, and was killed."); 
+        if ( ! ok)
+            throw std::runtime_error("jjm::WorkerPool::request() failed. Cause:\nThe worker of \"" + key
+                    + "\" exited without a complete response, with exit code " + toDecStr(exitcode) + "."); 
+        return response; 
+    }
+
+    {   Lock lock(mutex); 
+        if ( ! tool->replaced)
+        {   tool->idle.push_back(worker.release()); 
+            idleCondition.notify_all(); 
+            return response; 
+        }
+        --tool->numWorkers; 
+        idleCondition.notify_all(); 
+    }
+    stopWorker(worker.get()); 
+    return response; 
+}
@@ -0,0 +1,96 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+#ifndef JOSUTILS_JWORKER_HPP_HEADER_GUARD
+#define JOSUTILS_JWORKER_HPP_HEADER_GUARD
+
+#include "jfilehandle.hpp"
+#include "jprocess.hpp"
+#include "jthreading.hpp"
+#include "jbase/jstdint.hpp"
+#include "junicode/jutfstring.hpp"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace jjm
+{
+
+/* Keeps long-lived tool processes, which serve one request at a time through
+their stdin and stdout, so that a tool with a slow startup is started once
+per worker rather than once per goal.
+
+The protocol, with every integer a 4 byte little endian unsigned integer:
+    request:  length, then length bytes, which are the arguments of the
+              request, each followed by a zero byte.
+    response: exit status, then length, then length bytes of output.
+A worker exits when it reads EOF on its stdin, and its stderr is inherited.
+
+A worker is stopped after it served the tool's maximum number of requests,
+and is discarded when it exits, breaks the protocol, or hangs past the 
+timeout of the pool, in which case the request fails. The next request of 
+the tool starts a new worker. */
+class WorkerPool
+{
+public:
+    struct Response
+    {   Response() : exitcode(0) {}
+        std::uint32_t exitcode; 
+        Utf8String output; 
+    }; 
+
+    WorkerPool(); 
+
+    //Stops every idle worker, and waits for them to exit.
+    ~WorkerPool(); 
+
+    //Declares the tool of the key, or replaces its declaration. The workers
+    //of a replaced declaration are stopped once they are idle.
+    //The stdin and stdout of pb are piped. At most maxWorkers workers of the
+    //tool run at once, and each serves at most maxRequests requests, or any
+    //number when maxRequests is 0.
+    //It is safe to call concurrently.
+    void declareTool(std::string const& key, ProcessBuilder const& pb, std::int32_t maxWorkers, std::int32_t maxRequests); 
+
+    bool hasTool(std::string const& key); 
+
+    //A worker which has not responded this long after a request is killed,
+    //and the request fails. Zero, the default, waits without a deadline. 
+    //The deadline is not kept on Windows. 
+    void setTimeout(std::int64_t timeoutNanoSec); 
+
+    //Sends the request to an idle worker of the tool, starting one when
+    //there is none and the tool has fewer than its maximum, and otherwise
+    //waits for a worker to become idle.
+    //Throws std::exception on errors, including when the worker exits
+    //before its response, and when the tool was never declared.
+    //It is safe to call concurrently.
+    Response request(std::string const& key, std::vector<std::string> const& arguments); 
+
+    //The number of workers started so far, over every tool.
+    std::int64_t getNumStarted(); 
+
+private:
+    WorkerPool(WorkerPool const& ); //not defined, not copyable
+    WorkerPool& operator= (WorkerPool const& ); //not defined, not copyable
+
+    class Worker; 
+    class Tool; 
+
+    //Closes the worker's stdin and joins it. Called without the mutex.
+    static void stopWorker(Worker * worker); 
+
+    Mutex mutex; 
+    CondVar idleCondition; 
+    std::map<std::string, Tool*> tools; //ownership
+    std::vector<Tool*> replacedTools; //ownership, kept until destruction
+    std::int64_t numStarted; 
+    std::int64_t timeoutNanoSec; 
+}; 
+
+} //namespace jjm
+
+#endif
@@ -159,7 +159,7 @@ namespace
 
 void jjm::DeallocateIconv::operator() (iconv_t converter) const
 {
-    if (converter != (iconv_t)-1)
+    if (converter != (iconv_t)-1 && converter != (iconv_t)0)
     {   
 #ifdef _WIN32
         SetLastError(0); 
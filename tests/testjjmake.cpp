@@ -0,0 +1,1332 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+//Tests of the jjmake classes, which build small trees of build files in 
+//directories below the current directory. 
+
+#include "jjmake/consolewriter.hpp"
+#include "jjmake/depslog.hpp"
+#include "jjmake/graph.hpp"
+#include "jjmake/history.hpp"
+#include "jjmake/jjmakecontext.hpp"
+#include "jjmake/node.hpp"
+#include "jjmake/remoteexec.hpp"
+#include "jjmake/signatures.hpp"
+#include "jjmake/statcache.hpp"
+#include "josutils/jclock.hpp"
+#include "josutils/jfilehandle.hpp"
+#include "josutils/jfilesystem.hpp"
+#include "josutils/jopen.hpp"
+#include "josutils/jpath.hpp"
+#include "josutils/jprocess.hpp"
+#include "josutils/jstat.hpp"
+#include "josutils/jthreading.hpp"
+#include "jbase/jinttostring.hpp"
+#include "jbase/juniqueptr.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <signal.h>
+    #include <unistd.h>
+#endif
+
+using namespace jjm; 
+using namespace std; 
+
+extern bool failed; 
+void jjmJjmakeExecNodeTests(); 
+void jjmJjmakeEarlyCutoffTests(); 
+void jjmJjmakeSignaturesTests(); 
+void jjmJjmakeDepsLogTests(); 
+void jjmJjmakeDyndepTests(); 
+void jjmJjmakeMemoryHistoryTests(); 
+void jjmJjmakeActionCacheTests(); 
+void jjmJjmakeStampTests(); 
+void jjmJjmakeRemoteWorkerTests(); 
+void jjmJjmakeHistoryTests(); 
+void jjmJjmakePoolTests(); 
+void jjmJjmakeParallelIncludeTests(); 
+void jjmJjmakeGraphTests(); 
+void jjmJjmakeStatCacheTests(); 
+void jjmJjmakeConsoleWriterTests(); 
+void jjmJjmakeWatchTests(); 
+int testRemoteWorkerMain(string const& dir); 
+int testWatchMain(string const& dir); 
+
+#define ASSERT_EQUALS(x, y) \
+    if ((x) != (y)) \
+    { \
+        std::cerr << "Failed test at " << __FILE__ << " " << __LINE__ << ". [" << (x) << "], [" << (y) << "]" << endl; \
+        failed = true; \
+    }
+
+namespace
+{
+    void writeFile(Path const& path, string const& text)
+    {   FileHandleOwner file(FileOpener().createOrOpen().truncate().writeOnly().open(path)); 
+        file.get().writeComplete(text.data(), text.size()); 
+    }
+
+    //Returns the empty string when the file does not exist. 
+    string readFile(Path const& path)
+    {   Stat const st = Stat::stat2(path); 
+        if (st.type == FileType::NoExist)
+            return string(); 
+        string text; 
+        FileHandleOwner file(FileOpener().openExistingOnly().readOnly().open(path)); 
+        char buffer[4096]; 
+        for (ssize_t n; (n = file.get().read(buffer, sizeof(buffer))) > 0; )
+            text.append(buffer, n); 
+        return text; 
+    }
+
+    bool contains(string const& text, string const& part)
+    {   return text.find(part) != string::npos; 
+    }
+
+    void removeTree(Path const& path)
+    {   Stat const st = Stat::lstat2(path); 
+        if (st.type == FileType::NoExist)
+            return; 
+        if (st.type != FileType::Directory)
+        {   removeFile(path); 
+            return; 
+        }
+        vector<string> const names = listDirectory(path); 
+        for (size_t i = 0; i < names.size(); ++i)
+            removeTree(Path::join(path, Path(names[i]))); 
+        removeDirectory(path); 
+    }
+
+    //An empty directory below the current directory. 
+    Path makeTestDir(string const& name)
+    {   Path const dir = Path("jjmake-tests-" + name + ".tmp").getAbsolutePath(); 
+        removeTree(dir); 
+        createDirectories(dir); 
+        return dir.getRealPath(); 
+    }
+
+#ifndef _WIN32
+    //The arguments to build every goal of dir/jjmake.txt, with the state of 
+    //the build in dir/.jjmake. 
+    JjmakeContext::Arguments makeArguments(Path const& dir)
+    {
+        JjmakeContext::Arguments arguments; 
+        arguments.allGoals = true; 
+        arguments.numThreads = 2; 
+        arguments.stateDir = Path::join(dir, Path(".jjmake")).getStringRep(); 
+        arguments.rootEvalText = "(include '" + Path::join(dir, Path("jjmake.txt")).getStringRep() + "')\n"; 
+        return arguments; 
+    }
+
+    //Sends stdout and stderr to the file until destroyed. 
+    class RedirectOutput
+    {
+    public:
+        explicit RedirectOutput(Path const& path)
+        {   savedOut = dup(1); 
+            savedErr = dup(2); 
+            int const output = open(path.getStringRep().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666); 
+            if (savedOut < 0 || savedErr < 0 || output < 0 || dup2(output, 1) < 0 || dup2(output, 2) < 0)
+                throw std::runtime_error("Redirecting the output of the build failed."); 
+            close(output); 
+        }
+        ~RedirectOutput()
+        {   dup2(savedOut, 1); 
+            dup2(savedErr, 2); 
+            close(savedOut); 
+            close(savedErr); 
+        }
+    private:
+        RedirectOutput(RedirectOutput const& ); //not defined, not copyable
+        RedirectOutput& operator= (RedirectOutput const& ); //not defined, not copyable
+        int savedOut; 
+        int savedErr; 
+    }; 
+
+    //Builds with the arguments and with the new nodes besides those of the 
+    //build files, and returns what jjmake wrote to stdout and stderr, which 
+    //is kept in dir/output.log. 
+    string runBuild(Path const& dir, JjmakeContext::Arguments const& arguments, vector<Node*> const& newNodes = vector<Node*>())
+    {
+        Path const outputPath = Path::join(dir, Path("output.log")); 
+        string error; 
+        {   RedirectOutput redirect(outputPath); 
+            try
+            {   JjmakeContext context(arguments); 
+                for (size_t i = 0; i < newNodes.size(); ++i)
+                    context.newNode(newNodes[i]); 
+                context.execute(); 
+            } catch (std::exception & e)
+            {   error = e.what(); 
+            }
+        }
+        return readFile(outputPath) + error; 
+    }
+
+    string runBuild(Path const& dir, bool earlyCutoff)
+    {
+        JjmakeContext::Arguments arguments = makeArguments(dir); 
+        arguments.earlyCutoff = earlyCutoff; 
+        return runBuild(dir, arguments); 
+    }
+#endif
+}
+
+void jjmJjmakeExecNodeTests()
+{
+#ifndef _WIN32
+    std::cout << "Running jjm::JjmakeContext exec-node tests" << endl; 
+
+    //A make run by an exec-node goal shares the jobs of jjmake. 
+    Path const dir = makeTestDir("exec-node"); 
+    writeFile(Path::join(dir, Path("jjmake.txt")),
+            "(exec-node flags.txt -- sh -c 'echo \"$MAKEFLAGS\" > flags.txt')\n"); 
+    runBuild(dir, false); 
+    ASSERT_EQUALS(contains(readFile(Path::join(dir, Path("flags.txt"))), "--jobserver-auth="), true); 
+    removeTree(dir); 
+#endif
+}
+
+void jjmJjmakeEarlyCutoffTests()
+{
+#ifndef _WIN32
+    std::cout << "Running jjm::JjmakeContext early cutoff tests" << endl; 
+
+    //gen.txt is the same whatever src.txt holds. use.txt depends only on 
+    //gen.txt, and mixed.txt also on other.txt. Every command logs its runs. 
+    Path const dir = makeTestDir("early-cutoff"); 
+    writeFile(Path::join(dir, Path("jjmake.txt")),
+            "(exec-node gen.txt src.txt -- sh -c 'echo gen >> runs.log; echo constant > gen.txt')\n"
+            "(exec-node use.txt gen.txt -- sh -c 'echo use >> runs.log; cp gen.txt use.txt')\n"
+            "(exec-node mixed.txt gen.txt other.txt -- sh -c 'echo mixed >> runs.log; cat gen.txt other.txt > mixed.txt')\n"); 
+    writeFile(Path::join(dir, Path("src.txt")), "1\n"); 
+    writeFile(Path::join(dir, Path("other.txt")), "1\n"); 
+    Path const runsPath = Path::join(dir, Path("runs.log")); 
+
+    runBuild(dir, true); 
+    string const firstRuns = readFile(runsPath); 
+    ASSERT_EQUALS(contains(firstRuns, "gen"), true); 
+    ASSERT_EQUALS(contains(firstRuns, "use"), true); 
+    ASSERT_EQUALS(contains(firstRuns, "mixed"), true); 
+
+    //gen.txt is written again, with the same content. Without early 
+    //cutoff, use.txt executes because gen.txt executed. With it, use.txt is 
+    //skipped. mixed.txt executes either way, as other.txt changed. 
+    for (int earlyCutoff = 0; earlyCutoff < 2; ++earlyCutoff)
+    {   writeFile(Path::join(dir, Path("src.txt")), earlyCutoff ? "333\n" : "22\n"); 
+        writeFile(Path::join(dir, Path("other.txt")), earlyCutoff ? "333\n" : "22\n"); 
+        writeFile(runsPath, ""); 
+        runBuild(dir, earlyCutoff != 0); 
+        string const runs = readFile(runsPath); 
+        ASSERT_EQUALS(contains(runs, "gen"), true); 
+        ASSERT_EQUALS(contains(runs, "use"), earlyCutoff == 0); 
+        ASSERT_EQUALS(contains(runs, "mixed"), true); 
+        ASSERT_EQUALS(readFile(Path::join(dir, Path("mixed.txt"))), earlyCutoff ? "constant\n333\n" : "constant\n22\n"); 
+    }
+    removeTree(dir); 
+#endif
+}
+
+void jjmJjmakeSignaturesTests()
+{
+#ifndef _WIN32
+    std::cout << "Running jjm::Signatures tests" << endl; 
+
+    Path const dir = makeTestDir("signatures"); 
+    writeFile(Path::join(dir, Path("jjmake.txt")),
+            "(exec-node a.txt src.txt -- sh -c 'echo a >> runs.log; cp src.txt a.txt')\n"
+            "(exec-node b.txt a.txt -- sh -c 'echo b >> runs.log; cp a.txt b.txt')\n"); 
+    writeFile(Path::join(dir, Path("src.txt")), "1\n"); 
+    Path const runsPath = Path::join(dir, Path("runs.log")); 
+    runBuild(dir, false); 
+    ASSERT_EQUALS(readFile(runsPath), "a\nb\n"); 
+
+    //The size of the header, which is all of a new journal. 
+    Path const emptyPath = Path::join(dir, Path("empty")); 
+    {   Signatures empty; 
+        empty.load(emptyPath); 
+    }
+    size_t const headerSize = readFile(emptyPath).size(); 
+
+    //A build interrupted while it appended leaves a torn record. Here the 
+    //records are appended again, which replaces each with itself, except 
+    //the last one, which is torn. 
+    Path const journalPath = Path::join(dir, Path(".jjmake/signatures")); 
+    string const journal = readFile(journalPath); 
+    ASSERT_EQUALS(journal.size() > headerSize + 5, true); 
+    string const tornJournal = journal + journal.substr(headerSize, journal.size() - headerSize - 5); 
+    writeFile(journalPath, tornJournal); 
+    size_t numLive = 0; 
+    {   Signatures signatures; 
+        signatures.load(journalPath); 
+        numLive = signatures.getNumJournalRecords(); 
+        ASSERT_EQUALS(numLive > 0, true); 
+    }
+    //load() compacted the journal, so it is whole again. 
+    string const compacted = readFile(journalPath); 
+    ASSERT_EQUALS(compacted.size() < tornJournal.size(), true); 
+    {   Signatures signatures; 
+        signatures.load(journalPath); 
+        ASSERT_EQUALS(signatures.getNumJournalRecords(), numLive); 
+    }
+    ASSERT_EQUALS(readFile(journalPath), compacted); 
+
+    //Every goal is still up to date, and none is restored from the action 
+    //cache either. 
+    string const output = runBuild(dir, false); 
+    ASSERT_EQUALS(readFile(runsPath), "a\nb\n"); 
+    ASSERT_EQUALS(contains(output, "Restored"), false); 
+
+    //The torn tail is also compacted away when jjmake loads the journal. 
+    writeFile(journalPath, tornJournal); 
+    runBuild(dir, false); 
+    ASSERT_EQUALS(readFile(runsPath), "a\nb\n"); 
+    writeFile(Path::join(dir, Path("src.txt")), "22\n"); 
+    runBuild(dir, false); 
+    ASSERT_EQUALS(readFile(runsPath), "a\nb\na\nb\n"); 
+    removeTree(dir); 
+#endif
+}
+
+void jjmJjmakeDepsLogTests()
+{
+    std::cout << "Running jjm::DepsLog tests" << endl; 
+
+    //As gcc -MD writes it, with a space in a name, continuations, and a 
+    //phony target per header as with -MP. 
+    string const depfile =
+            "obj/foo.o: src/foo.c include/my\\ header.h \\\n"
+            "  include/bar.h \\\n"
+            "  /usr/include/cost$$.h\n"
+            "include/my\\ header.h:\n"
+            "include/bar.h:\n"; 
+    DepfileParser parser; 
+    ASSERT_EQUALS(parser.parse(depfile.data(), depfile.data() + depfile.size()), true); 
+    vector<DepfileParser::Token> const& prerequisites = parser.getPrerequisites(); 
+    vector<Path> inputs; 
+    for (size_t i = 0; i < prerequisites.size(); ++i)
+        inputs.push_back(Path(string(prerequisites[i].data, prerequisites[i].size))); 
+    ASSERT_EQUALS(inputs.size(), 4u); 
+    if (inputs.size() == 4)
+    {   ASSERT_EQUALS(inputs[0].getStringRep(), "src/foo.c"); 
+        ASSERT_EQUALS(inputs[1].getStringRep(), "include/my header.h"); 
+        ASSERT_EQUALS(inputs[2].getStringRep(), "include/bar.h"); 
+        ASSERT_EQUALS(inputs[3].getStringRep(), "/usr/include/cost$.h"); 
+    }
+    string const notADepfile = "obj/foo.o src/foo.c\n"; 
+    ASSERT_EQUALS(parser.parse(notADepfile.data(), notADepfile.data() + notADepfile.size()), false); 
+
+    Path const dir = makeTestDir("depslog"); 
+    Path const logPath = Path::join(dir, Path("deps")); 
+    vector<Path> otherInputs(1, Path("include/bar.h")); 
+    {   DepsLog log; 
+        log.load(logPath); 
+        ASSERT_EQUALS(log.record("obj/foo.o", inputs), true); 
+        ASSERT_EQUALS(log.record("obj/foo.o", inputs), false); 
+        ASSERT_EQUALS(log.record("obj/other.o", otherInputs), true); 
+        log.flush(); 
+    }
+    {   DepsLog log; 
+        log.load(logPath); 
+        vector<Path> found; 
+        ASSERT_EQUALS(log.find("obj/foo.o", found), true); 
+        ASSERT_EQUALS(found.size(), inputs.size()); 
+        for (size_t i = 0; i < found.size() && i < inputs.size(); ++i)
+            ASSERT_EQUALS(found[i].getStringRep(), inputs[i].getStringRep()); 
+        found.clear(); 
+        ASSERT_EQUALS(log.find("obj/other.o", found), true); 
+        ASSERT_EQUALS(found.size(), 1u); 
+        ASSERT_EQUALS(log.find("obj/missing.o", found), false); 
+    }
+    removeTree(dir); 
+}
+
+void jjmJjmakeDyndepTests()
+{
+#ifndef _WIN32
+    std::cout << "Running jjm::JjmakeContext dyndep tests" << endl; 
+
+    //The scanner writes a dyndep file which makes a.o and b.o wait for each 
+    //other's module. 
+    Path const dir = makeTestDir("dyndep"); 
+    writeFile(Path::join(dir, Path("jjmake.txt")),
+            "(exec-node mods.dd --dyndep=mods.dd mods.in -- cp mods.in mods.dd)\n"
+            "(exec-node a.o mods.dd -- sh -c 'touch a.o a.mod')\n"
+            "(exec-node b.o mods.dd -- sh -c 'touch b.o b.mod')\n"); 
+    writeFile(Path::join(dir, Path("mods.in")),
+            "ninja_dyndep_version = 1\n"
+            "build a.o | a.mod: dyndep | b.mod\n"
+            "build b.o | b.mod: dyndep | a.mod\n"); 
+    string const output = runBuild(dir, false); 
+    ASSERT_EQUALS(contains(output, "Failure during execution of node \"" + Path::join(dir, Path("mods.dd")).getStringRep() + "\""), true); 
+    ASSERT_EQUALS(contains(output, "which would make a dependency cycle"), true); 
+    ASSERT_EQUALS(Stat::stat2(Path::join(dir, Path("a.o"))).type == FileType::NoExist, true); 
+    ASSERT_EQUALS(Stat::stat2(Path::join(dir, Path("b.o"))).type == FileType::NoExist, true); 
+
+    //Without the cycle, b.o waits for the module of a.o. 
+    writeFile(Path::join(dir, Path("mods.in")),
+            "ninja_dyndep_version = 1\n"
+            "build a.o | a.mod: dyndep\n"
+            "build b.o: dyndep | a.mod\n"); 
+    string const output2 = runBuild(dir, false); 
+    ASSERT_EQUALS(contains(output2, "Failure"), false); 
+    ASSERT_EQUALS(Stat::stat2(Path::join(dir, Path("a.mod"))).type == FileType::NoExist, false); 
+    ASSERT_EQUALS(Stat::stat2(Path::join(dir, Path("b.o"))).type == FileType::NoExist, false); 
+    removeTree(dir); 
+#endif
+}
+
+void jjmJjmakeMemoryHistoryTests()
+{
+#ifndef _WIN32
+    std::cout << "Running jjm::JjmakeContext memory history tests" << endl; 
+
+    //The peak memory which admission predicts from is that of the last 
+    //execution of the goal, and a build in which the goal is up to date 
+    //keeps it. 
+    Path const dir = makeTestDir("memory-history"); 
+    writeFile(Path::join(dir, Path("jjmake.txt")),
+            "(exec-node out.txt src.txt -- sh -c 'echo out >> runs.log; cp src.txt out.txt')\n"); 
+    writeFile(Path::join(dir, Path("src.txt")), "1\n"); 
+    Path const historyPath = Path::join(dir, Path(".jjmake/history")); 
+    string const goalName = Path::join(dir, Path("out.txt")).getStringRep(); 
+    runBuild(dir, false); 
+    History::Entry first; 
+    {   History history; 
+        history.load(historyPath); 
+        ASSERT_EQUALS(history.find(goalName, first), true); 
+    }
+    ASSERT_EQUALS(first.peakRssBytes > 0, true); 
+    ASSERT_EQUALS(first.durationNanoSec > 0, true); 
+    ASSERT_EQUALS(first.exitStatus, 0); 
+
+    string const output = runBuild(dir, false); 
+    ASSERT_EQUALS(readFile(Path::join(dir, Path("runs.log"))), "out\n"); 
+    ASSERT_EQUALS(contains(output, "Executing goal"), false); 
+    History::Entry second; 
+    {   History history; 
+        history.load(historyPath); 
+        ASSERT_EQUALS(history.find(goalName, second), true); 
+    }
+    ASSERT_EQUALS(second.peakRssBytes, first.peakRssBytes); 
+    ASSERT_EQUALS(second.durationNanoSec, first.durationNanoSec); 
+    ASSERT_EQUALS(second.finishTimeNanoSec, first.finishTimeNanoSec); 
+    removeTree(dir); 
+#endif
+}
+
+void jjmJjmakeActionCacheTests()
+{
+#ifndef _WIN32
+    std::cout << "Running jjm::JjmakeContext action cache tests" << endl; 
+
+    Path const dir = makeTestDir("action-cache"); 
+    writeFile(Path::join(dir, Path("jjmake.txt")),
+            "(exec-node out.txt src.txt -- sh -c 'echo out >> runs.log; cp src.txt out.txt')\n"
+            "(touch-node stamp src.txt)\n"); 
+    Path const srcPath = Path::join(dir, Path("src.txt")); 
+    Path const outPath = Path::join(dir, Path("out.txt")); 
+    Path const stampPath = Path::join(dir, Path("stamp")); 
+    Path const runsPath = Path::join(dir, Path("runs.log")); 
+    Path const cachePath = Path::join(dir, Path(".jjmake/cache")); 
+
+    //The cache is opt-in. 
+    writeFile(srcPath, "1\n"); 
+    runBuild(dir, false); 
+    ASSERT_EQUALS(Stat::stat2(cachePath).type == FileType::NoExist, true); 
+
+    JjmakeContext::Arguments arguments = makeArguments(dir); 
+    arguments.actionCacheBytes = 1024 * 1024; 
+    writeFile(srcPath, "2\n"); 
+    runBuild(dir, arguments); 
+    writeFile(srcPath, "1\n"); 
+    runBuild(dir, arguments); 
+    ASSERT_EQUALS(readFile(runsPath), "out\nout\nout\n"); 
+
+    //out.txt is restored as a file of its own, and as new as if it had 
+    //executed. The stamp is never kept, so it is touched again. 
+    writeFile(srcPath, "2\n"); 
+    std::int64_t const startNanoSec = getSystemClockNanoSec(); 
+    string const output = runBuild(dir, arguments); 
+    ASSERT_EQUALS(readFile(runsPath), "out\nout\nout\n"); 
+    ASSERT_EQUALS(contains(output, "Restored goal from the action cache: " + outPath.getStringRep()), true); 
+    ASSERT_EQUALS(contains(output, "Executing goal: " + stampPath.getStringRep()), true); 
+    ASSERT_EQUALS(readFile(outPath), "2\n"); 
+    Stat const outStat = Stat::stat(outPath); 
+    ASSERT_EQUALS(outStat.linkCount, 1u); 
+    //Within a tick of the clock of the file system. 
+    ASSERT_EQUALS(outStat.lastWriteTimeNanoSec >= startNanoSec - 100 * 1000 * 1000, true); 
+    removeTree(dir); 
+#endif
+}
+
+void jjmJjmakeStampTests()
+{
+#ifndef _WIN32
+    std::cout << "Running jjm::JjmakeContext stamp tests" << endl; 
+
+    //A touch-node stamp is empty whatever it stamps, so only its last write 
+    //time tells use.txt that src.txt changed. With early cutoff, use.txt 
+    //executes only when the signature of the stamp changed. 
+    Path const dir = makeTestDir("stamp"); 
+    writeFile(Path::join(dir, Path("jjmake.txt")),
+            "(touch-node stamp src.txt)\n"
+            "(exec-node use.txt stamp -- sh -c 'echo use >> runs.log; cp src.txt use.txt')\n"); 
+    Path const srcPath = Path::join(dir, Path("src.txt")); 
+    Path const runsPath = Path::join(dir, Path("runs.log")); 
+
+    writeFile(srcPath, "1\n"); 
+    runBuild(dir, true); 
+    ASSERT_EQUALS(readFile(runsPath), "use\n"); 
+    //Files written within a tick of the clock of the file system have the 
+    //same last write time, so wait a few ticks before each change. 
+    jjm::sleep(50); 
+    writeFile(srcPath, "2\n"); 
+    runBuild(dir, true); 
+    ASSERT_EQUALS(readFile(runsPath), "use\nuse\n"); 
+    ASSERT_EQUALS(readFile(Path::join(dir, Path("use.txt"))), "2\n"); 
+    jjm::sleep(50); 
+    writeFile(srcPath, "1\n"); 
+    runBuild(dir, true); 
+    ASSERT_EQUALS(readFile(runsPath), "use\nuse\nuse\n"); 
+    ASSERT_EQUALS(readFile(Path::join(dir, Path("use.txt"))), "1\n"); 
+
+    //An untouched stamp keeps use.txt up to date. 
+    string const output = runBuild(dir, true); 
+    ASSERT_EQUALS(readFile(runsPath), "use\nuse\nuse\n"); 
+    ASSERT_EQUALS(contains(output, "Executing goal"), false); 
+    removeTree(dir); 
+#endif
+}
+
+#ifndef _WIN32
+namespace
+{
+    //Starts "tests --test-remote-worker <dir>", and reads the line it writes. 
+    void startRemoteWorker(Path const& dir, UniquePtr<Process*> & process, pid_t & pid, string & address)
+    {
+        ProcessBuilder pb; 
+        pb.arg("/proc/self/exe").arg("--test-remote-worker").arg(dir.getStringRep()).pipeOut(); 
+        process.reset(pb.spawn()); 
+        FileHandleOwner out(process.get()->releaseReadEndFromChildsStdout()); 
+        string line; 
+        char c; 
+        while (out.get().read( & c, 1) == 1 && c != '\n')
+            line += c; 
+        size_t const space = line.find(' '); 
+        long long x = 0; 
+        if (space == string::npos || ! decStrToInteger(x, line.substr(0, space)))
+            throw std::runtime_error("Starting the remote worker failed. It wrote \"" + line + "\"."); 
+        pid = static_cast<pid_t>(x); 
+        address = line.substr(space + 1); 
+    }
+
+    class ExecuteCommand
+    {
+    public:
+        ExecuteCommand(Dispatcher & dispatcher_, ExecCommand const& command_, ExecResult & result_) 
+            : dispatcher(dispatcher_), command(command_), result(result_) {}
+        void operator() () 
+        {   try
+            {   result = dispatcher.execute(command); 
+            } catch (std::exception & e)
+            {   result.exitcode = -1; 
+                result.warning = e.what(); 
+            }
+        }
+    private:
+        Dispatcher & dispatcher; 
+        ExecCommand const& command; 
+        ExecResult & result; 
+    }; 
+
+    //Executes the commands at once, one per thread. 
+    void executeAtOnce(Dispatcher & dispatcher, vector<ExecCommand> const& commands, vector<ExecResult> & results)
+    {
+        results.assign(commands.size(), ExecResult()); 
+        vector<Thread*> threads; 
+        for (size_t i = 0; i < commands.size(); ++i)
+            threads.push_back(new Thread(ExecuteCommand(dispatcher, commands[i], results[i]), Thread::JoinInDtor)); 
+        for (size_t i = 0; i < threads.size(); ++i)
+        {   threads[i]->join(); 
+            delete threads[i]; 
+        }
+    }
+
+    ExecCommand makeCopyCommand(Path const& dir, string const& name, string const& text)
+    {
+        writeFile(Path::join(dir, Path(name + ".in")), text); 
+        ExecCommand command; 
+        command.dir = dir; 
+        command.args.push_back("sh"); 
+        command.args.push_back("-c"); 
+        command.args.push_back("sleep 0.3; cat " + name + ".in > " + name + ".out"); 
+        command.inputs.push_back(Path::join(dir, Path(name + ".in"))); 
+        command.outputs.push_back(Path::join(dir, Path(name + ".out"))); 
+        command.weightMillis = 300; 
+        return command; 
+    }
+}
+
+//"tests --test-remote-worker <dir>", a RemoteWorker with one slot on a free 
+//port of localhost. Writes "<pid> <address>\n" and serves until killed. 
+int testRemoteWorkerMain(string const& dir)
+{
+    try
+    {   RemoteWorker worker; 
+        worker.open(Path(dir), 64 * 1024 * 1024, 1, "127.0.0.1:0"); 
+        string const line = toDecStr(static_cast<std::int64_t>(getpid())) + " " + worker.getAddress() + "\n"; 
+        if (static_cast<ssize_t>(line.size()) != ::write(1, line.data(), line.size()))
+            return 1; 
+        worker.run(); 
+    } catch (std::exception & e)
+    {   std::cerr << e.what() << endl; 
+        return 1; 
+    }
+    return 0; 
+}
+#endif
+
+void jjmJjmakeRemoteWorkerTests()
+{
+#ifndef _WIN32
+    std::cout << "Running jjm::RemoteWorker tests" << endl; 
+
+    //Two worker processes with a slot each, and no local slots, so that two
+    //commands at once execute one on each worker. 
+    Path const dir = makeTestDir("remote-worker"); 
+    UniquePtr<Process*> processes[2]; 
+    pid_t pids[2] = { 0, 0 }; 
+    string addresses[2]; 
+    for (int i = 0; i < 2; ++i)
+        startRemoteWorker(Path::join(dir, Path("worker" + toDecStr(i))), processes[i], pids[i], addresses[i]); 
+    Dispatcher dispatcher(0); 
+    for (int i = 0; i < 2; ++i)
+        dispatcher.addWorker(addresses[i], std::int64_t(5) * 1000 * 1000 * 1000); 
+
+    vector<ExecCommand> commands; 
+    commands.push_back(makeCopyCommand(dir, "a", "a\n")); 
+    commands.push_back(makeCopyCommand(dir, "b", "b\n")); 
+    vector<ExecResult> results; 
+    executeAtOnce(dispatcher, commands, results); 
+    set<string> used; 
+    for (size_t i = 0; i < results.size(); ++i)
+    {   ASSERT_EQUALS(results[i].exitcode, 0); 
+        ASSERT_EQUALS(results[i].warning, ""); 
+        used.insert(results[i].workerAddress); 
+    }
+    ASSERT_EQUALS(used.size(), 2u); 
+    ASSERT_EQUALS(used.count(addresses[0]), 1u); 
+    ASSERT_EQUALS(readFile(Path::join(dir, Path("a.out"))), "a\n"); 
+    ASSERT_EQUALS(readFile(Path::join(dir, Path("b.out"))), "b\n"); 
+    ASSERT_EQUALS(dispatcher.getNumRemote(), 2); 
+    ASSERT_EQUALS(dispatcher.getNumLocal(), 0); 
+
+    //A failed worker is no longer used, and its command executes on the 
+    //other worker instead. 
+    ::kill(pids[0], SIGKILL); 
+    processes[0].get()->join(); 
+    commands.clear(); 
+    commands.push_back(makeCopyCommand(dir, "c", "c\n")); 
+    commands.push_back(makeCopyCommand(dir, "d", "d\n")); 
+    executeAtOnce(dispatcher, commands, results); 
+    size_t numWarnings = 0; 
+    for (size_t i = 0; i < results.size(); ++i)
+    {   ASSERT_EQUALS(results[i].exitcode, 0); 
+        ASSERT_EQUALS(results[i].workerAddress, addresses[1]); 
+        if (results[i].warning.size())
+        {   ++numWarnings; 
+            ASSERT_EQUALS(contains(results[i].warning, addresses[0]), true); 
+        }
+    }
+    ASSERT_EQUALS(numWarnings, 1u); 
+    ASSERT_EQUALS(readFile(Path::join(dir, Path("c.out"))), "c\n"); 
+    ASSERT_EQUALS(readFile(Path::join(dir, Path("d.out"))), "d\n"); 
+    ASSERT_EQUALS(dispatcher.getNumWorkersFailed(), 1); 
+
+    //A failing command is reported by its exit status, and the worker stays.
+    ExecCommand failing = makeCopyCommand(dir, "e", "e\n"); 
+    failing.args.back() = "cat e.in; exit 3"; 
+    ExecResult const failure = dispatcher.execute(failing); 
+    ASSERT_EQUALS(failure.exitcode, 3); 
+    ASSERT_EQUALS(failure.output, "e\n"); 
+    ASSERT_EQUALS(failure.workerAddress, addresses[1]); 
+    ASSERT_EQUALS(dispatcher.getNumWorkersFailed(), 1); 
+
+    ::kill(pids[1], SIGKILL); 
+    processes[1].get()->join(); 
+    removeTree(dir); 
+#endif
+}
+
+namespace
+{
+    History::Entry makeHistoryEntry(std::int64_t x)
+    {   History::Entry entry; 
+        entry.durationNanoSec = x; 
+        entry.finishTimeNanoSec = 2 * x; 
+        entry.peakRssBytes = 3 * x; 
+        entry.exitStatus = static_cast<std::int32_t>(x % 2); 
+        return entry; 
+    }
+
+    bool isHistoryEntry(History::Entry const& entry, std::int64_t x)
+    {   History::Entry const expected = makeHistoryEntry(x); 
+        return entry.durationNanoSec == expected.durationNanoSec 
+                && entry.finishTimeNanoSec == expected.finishTimeNanoSec 
+                && entry.peakRssBytes == expected.peakRssBytes 
+                && entry.exitStatus == expected.exitStatus; 
+    }
+
+    //Names which sort after the names of the tests, with enough records to 
+    //fill the append buffer more than once. 
+    void recordFiller(History & history, std::int64_t x)
+    {   for (int i = 0; i < 2000; ++i)
+            history.record("z" + string(100, 'f') + toDecStr(i), makeHistoryEntry(x)); 
+    }
+}
+
+void jjmJjmakeHistoryTests()
+{
+    std::cout << "Running jjm::History tests" << endl; 
+
+    Path const dir = makeTestDir("history"); 
+    Path const path = Path::join(dir, Path("history")); 
+    History::Entry entry; 
+
+    //load() creates a missing file. 
+    {   History history; 
+        history.load(path); 
+        ASSERT_EQUALS(history.size(), 0u); 
+        ASSERT_EQUALS(history.find("a", entry), false); 
+    }
+    ASSERT_EQUALS(Stat::stat2(path).type == FileType::RegularFile, true); 
+
+    //flush() at the end of the build compacts the log into the snapshot, so
+    //recording the same goals again does not grow the file. 
+    {   History history; 
+        history.load(path); 
+        history.record("c", makeHistoryEntry(1)); 
+        history.record("a", makeHistoryEntry(2)); 
+        history.record("e", makeHistoryEntry(3)); 
+        history.flush(); 
+    }
+    size_t const compactedSize = readFile(path).size(); 
+    {   History history; 
+        history.load(path); 
+        ASSERT_EQUALS(history.size(), 3u); 
+        history.record("c", makeHistoryEntry(1)); 
+        history.flush(); 
+    }
+    ASSERT_EQUALS(readFile(path).size(), compactedSize); 
+    {   History history; 
+        history.load(path); 
+        ASSERT_EQUALS(history.find("a", entry) && isHistoryEntry(entry, 2), true); 
+        ASSERT_EQUALS(history.find("c", entry) && isHistoryEntry(entry, 1), true); 
+        ASSERT_EQUALS(history.find("e", entry) && isHistoryEntry(entry, 3), true); 
+        ASSERT_EQUALS(history.find("b", entry), false); 
+    }
+
+    //A build which ends without flush() leaves the records it appended as 
+    //the log, whose entries replace those of the snapshot. SortedFinder 
+    //merges both. 
+    {   History history; 
+        history.load(path); 
+        history.record("b", makeHistoryEntry(4)); 
+        history.record("c", makeHistoryEntry(5)); 
+        recordFiller(history, 6); 
+    }
+    ASSERT_EQUALS(readFile(path).size() > compactedSize, true); 
+    {   History history; 
+        history.load(path); 
+        History::SortedFinder finder(history); 
+        ASSERT_EQUALS(finder.find("a", entry) && isHistoryEntry(entry, 2), true); 
+        ASSERT_EQUALS(finder.find("b", entry) && isHistoryEntry(entry, 4), true); 
+        ASSERT_EQUALS(finder.find("c", entry) && isHistoryEntry(entry, 5), true); 
+        ASSERT_EQUALS(finder.find("d", entry), false); 
+        ASSERT_EQUALS(finder.find("e", entry) && isHistoryEntry(entry, 3), true); 
+        ASSERT_EQUALS(finder.find("f", entry), false); 
+        ASSERT_EQUALS(history.find("c", entry) && isHistoryEntry(entry, 5), true); 
+    }
+
+    //A torn record ends the log. The entries before it are kept, and the 
+    //records appended after the next load() are not lost behind it, even 
+    //those appended before flush(). 
+    string const whole = readFile(path); 
+    writeFile(path, whole + whole.substr(whole.size() - 100, 60)); 
+    {   History history; 
+        history.load(path); 
+        ASSERT_EQUALS(history.find("b", entry) && isHistoryEntry(entry, 4), true); 
+        history.record("d", makeHistoryEntry(7)); 
+        recordFiller(history, 8); 
+    }
+    {   History history; 
+        history.load(path); 
+        ASSERT_EQUALS(history.find("a", entry) && isHistoryEntry(entry, 2), true); 
+        ASSERT_EQUALS(history.find("b", entry) && isHistoryEntry(entry, 4), true); 
+        ASSERT_EQUALS(history.find("d", entry) && isHistoryEntry(entry, 7), true); 
+        ASSERT_EQUALS(history.find("z" + string(100, 'f') + "0", entry) && isHistoryEntry(entry, 8), true); 
+        history.flush(); 
+    }
+    removeTree(dir); 
+}
+
+#ifndef _WIN32
+namespace
+{
+    //Counts the goals which are executing at once. 
+    std::atomic<int> numRunningGoals(0); 
+    std::atomic<int> maxRunningGoals(0); 
+
+    //A goal which only sleeps, and counts itself. 
+    class CountingSleepNode : public Node
+    {
+    public:
+        CountingSleepNode(string const& goalName_) : Node(goalName_, vector<Path>(), vector<Path>(1, Path(goalName_))) {}
+        virtual bool execute()
+        {   beginExecution(); 
+            int const running = ++numRunningGoals; 
+            for (int max = maxRunningGoals; running > max && ! maxRunningGoals.compare_exchange_weak(max, running); )
+                ; 
+            jjm::sleep(30); 
+            --numRunningGoals; 
+            return true; 
+        }
+    };
+}
+#endif
+
+void jjmJjmakePoolTests()
+{
+#ifndef _WIN32
+    std::cout << "Running jjm::JjmakeContext pool tests" << endl; 
+
+    //No more goals of a pool execute at once than its depth, even with more
+    //threads free. 
+    Path const dir = makeTestDir("pool"); 
+    string buildFile = "(pool link 2)\n"; 
+    vector<string> goalNames; 
+    for (int i = 0; i < 6; ++i)
+    {   goalNames.push_back(Path::join(dir, Path("link-" + toDecStr(i))).getStringRep()); 
+        buildFile += "(goal-pool '" + goalNames.back() + "' link)\n"; 
+    }
+    writeFile(Path::join(dir, Path("jjmake.txt")), buildFile); 
+    vector<Node*> newNodes; 
+    for (size_t i = 0; i < goalNames.size(); ++i)
+        newNodes.push_back(new CountingSleepNode(goalNames[i])); 
+    JjmakeContext::Arguments arguments = makeArguments(dir); 
+    arguments.numThreads = 4; 
+    numRunningGoals = 0; 
+    maxRunningGoals = 0; 
+    string const output = runBuild(dir, arguments, newNodes); 
+    ASSERT_EQUALS(contains(output, "failed"), false); 
+    ASSERT_EQUALS(maxRunningGoals > 0, true); 
+    ASSERT_EQUALS(maxRunningGoals <= 2, true); 
+    removeTree(dir); 
+#endif
+}
+
+#ifndef _WIN32
+namespace
+{
+    //Prints the goals of the build files dir/file-0.txt ... with include, or
+    //with parallel-include. The output is what the build files printed, in 
+    //order, then the goals, sorted, as goals are printed in any order, then 
+    //the error, without where it is in the root text, which differs. 
+    string printIncludedGoals(Path const& dir, int numFiles, bool parallel)
+    {
+        JjmakeContext::Arguments arguments; 
+        arguments.allGoals = true; 
+        arguments.numThreads = 4; 
+        arguments.executionMode = JjmakeContext::PrintGoals; 
+        arguments.stateDir = ""; 
+        if (parallel)
+            arguments.rootEvalText += "(parallel-include"; 
+        for (int i = 0; i < numFiles; ++i)
+        {   string const path = Path::join(dir, Path("file-" + toDecStr(i) + ".txt")).getStringRep(); 
+            arguments.rootEvalText += parallel ? " '" + path + "'" : "(include '" + path + "')\n"; 
+        }
+        if (parallel)
+            arguments.rootEvalText += ")\n"; 
+
+        string const output = runBuild(dir, arguments); 
+        string printed; 
+        vector<string> goals; 
+        string error; 
+        for (size_t begin = 0; begin < output.size(); )
+        {   size_t end = output.find('\n', begin); 
+            end = (end == string::npos) ? output.size() : end + 1; 
+            string const line = output.substr(begin, end - begin); 
+            if ( ! error.empty())
+                error += line; 
+            else if (contains(line, ": Evaluation failure at line "))
+                error = "Error:\n"; 
+            else if (line.compare(0, 15, "[jjmake] Goal: ") == 0)
+                goals.push_back(line); 
+            else
+                printed += line; 
+            begin = end; 
+        }
+        std::sort(goals.begin(), goals.end()); 
+        string result = printed; 
+        for (size_t i = 0; i < goals.size(); ++i)
+            result += goals[i]; 
+        return result + error; 
+    }
+}
+#endif
+
+void jjmJjmakeParallelIncludeTests()
+{
+#ifndef _WIN32
+    std::cout << "Running jjm::JjmakeContext parallel-include tests" << endl; 
+
+    //parallel-include gives the goals, the output and the first error of 
+    //include of the same files, one after another. 
+    Path const dir = makeTestDir("parallel-include"); 
+    int const numFiles = 8; 
+    for (int i = 0; i < numFiles; ++i)
+    {   string text; 
+        for (int g = 0; g < 20; ++g)
+        {   string const name = "out-" + toDecStr(i) + "-" + toDecStr(g); 
+            text += "(print file " + toDecStr(i) + " goal " + toDecStr(g) + ")\n"; 
+            text += "(touch-node " + name + " " + name + ".c)\n"; 
+        }
+        writeFile(Path::join(dir, Path("file-" + toDecStr(i) + ".txt")), text); 
+    }
+    string const serial = printIncludedGoals(dir, numFiles, false); 
+    ASSERT_EQUALS(contains(serial, "file 7 goal 19\n"), true); 
+    ASSERT_EQUALS(contains(serial, "[jjmake] Goal: " + Path::join(dir, Path("out-7-19")).getStringRep() + "\n"), true); 
+    ASSERT_EQUALS(printIncludedGoals(dir, numFiles, true), serial); 
+
+    //Files 3 and 5 fail. The error is that of file 3, and the goals and the
+    //output are those of the files before it, and of file 3 before its 
+    //error. 
+    writeFile(Path::join(dir, Path("file-3.txt")), "(print file 3)\n(touch-node out-3 out-3.c)\n(no-such-function-3)\n(print not printed)\n"); 
+    writeFile(Path::join(dir, Path("file-5.txt")), "(no-such-function-5)\n"); 
+    string const serialError = printIncludedGoals(dir, numFiles, false); 
+    ASSERT_EQUALS(contains(serialError, "no-such-function-3"), true); 
+    ASSERT_EQUALS(contains(serialError, "no-such-function-5"), false); 
+    ASSERT_EQUALS(contains(serialError, "file 3\n"), true); 
+    ASSERT_EQUALS(contains(serialError, "not printed"), false); 
+    ASSERT_EQUALS(contains(serialError, "file 4 goal"), false); 
+    ASSERT_EQUALS(printIncludedGoals(dir, numFiles, true), serialError); 
+    removeTree(dir); 
+#endif
+}
+
+namespace
+{
+    //A node which is only added to a Graph::Builder. 
+    class GraphTestNode : public Node
+    {
+    public:
+        GraphTestNode(string const& goalName_) : Node(goalName_, vector<Path>(), vector<Path>()) {}
+        virtual bool execute() { return false; }
+    };
+
+    string idsToString(Graph::IdRange const& ids)
+    {   string result; 
+        for (size_t i = 0; i < ids.size(); ++i)
+            result += (i ? " " : "") + toDecStr(ids[i]); 
+        return result; 
+    }
+
+    //Returns the message of the exception of Graph::Builder::build(), or the
+    //empty string when it builds the graph. 
+    string buildGraph(vector<vector<Path> > const& outputPaths)
+    {
+        vector<GraphTestNode*> nodes; 
+        Graph::Builder builder; 
+        for (size_t n = 0; n < outputPaths.size(); ++n)
+        {   nodes.push_back(new GraphTestNode("node-" + toDecStr(n))); 
+            builder.addNode(nodes.back(), vector<Path>(), outputPaths[n], vector<Path>()); 
+        }
+        string error; 
+        try
+        {   Graph graph; 
+            builder.build(graph); 
+        } catch (std::exception & e)
+        {   error = e.what(); 
+        }
+        for (size_t n = 0; n < nodes.size(); ++n)
+            delete nodes[n]; 
+        return error; 
+    }
+}
+
+void jjmJjmakeGraphTests()
+{
+    std::cout << "Running jjm::Graph tests" << endl; 
+
+    //The nodes depend on the producers of their inputs, but not of their 
+    //discovered inputs, and the dependents are the reverse edges. 
+    Path const dir = Path("jjmake-tests-graph.tmp").getAbsolutePath(); 
+    Path const src = Path::join(dir, Path("src")); 
+    Path const aObj = Path::join(dir, Path("a.o")); 
+    Path const bExe = Path::join(dir, Path("b.exe")); 
+    Path const cSrc = Path::join(dir, Path("c.c")); 
+    Path const cObj = Path::join(dir, Path("c.o")); 
+    GraphTestNode a("a"), b("b"), c("c"), d("d"); 
+    Graph graph; 
+    {   Graph::Builder builder; 
+        builder.addNode( & a, vector<Path>(1, src), vector<Path>(1, aObj), vector<Path>()); 
+        vector<Path> bInputs; 
+        bInputs.push_back(cObj); 
+        bInputs.push_back(aObj); 
+        bInputs.push_back(src); 
+        builder.addNode( & b, bInputs, vector<Path>(1, bExe), vector<Path>()); 
+        vector<Path> cInputs; 
+        cInputs.push_back(cSrc); 
+        cInputs.push_back(aObj); 
+        builder.addNode( & c, cInputs, vector<Path>(1, cObj), vector<Path>()); 
+        builder.addNode( & d, vector<Path>(), vector<Path>(), vector<Path>(1, bExe)); 
+        builder.build(graph); 
+    }
+    ASSERT_EQUALS(graph.getNumNodes(), 4u); 
+    ASSERT_EQUALS(graph.getNumEdges(), 3u); 
+    ASSERT_EQUALS(graph.getNumPaths(), 5u); 
+    ASSERT_EQUALS(graph.getNode(1), & b); 
+    ASSERT_EQUALS(idsToString(graph.getDependencies(0)), ""); 
+    ASSERT_EQUALS(idsToString(graph.getDependencies(1)), "0 2"); 
+    ASSERT_EQUALS(idsToString(graph.getDependencies(2)), "0"); 
+    ASSERT_EQUALS(idsToString(graph.getDependencies(3)), ""); 
+    ASSERT_EQUALS(idsToString(graph.getDependents(0)), "1 2"); 
+    ASSERT_EQUALS(idsToString(graph.getDependents(1)), ""); 
+    ASSERT_EQUALS(idsToString(graph.getDependents(2)), "1"); 
+    ASSERT_EQUALS(idsToString(graph.getDependents(3)), ""); 
+
+    //Paths are numbered in path order. 
+    ASSERT_EQUALS(graph.findPath(aObj), 0u); 
+    ASSERT_EQUALS(graph.findPath(src), 4u); 
+    ASSERT_EQUALS(graph.findPath(Path::join(dir, Path("other"))), Graph::noPath()); 
+    ASSERT_EQUALS(graph.getPath(3).getStringRep(), cObj.getStringRep()); 
+    ASSERT_EQUALS(idsToString(graph.getInputPaths(1)), "3 0 4"); 
+    ASSERT_EQUALS(idsToString(graph.getOutputPaths(1)), "1"); 
+    ASSERT_EQUALS(idsToString(graph.getDiscoveredInputPaths(3)), "1"); 
+    ASSERT_EQUALS(graph.getProducer(graph.findPath(bExe)), 1u); 
+    ASSERT_EQUALS(graph.getProducer(graph.findPath(src)), Graph::noNode()); 
+
+    //Two nodes may not output the same path, nor a path inside of the 
+    //output path of another. Paths which only share a prefix are fine. 
+    Path const out = Path::join(dir, Path("out")); 
+    vector<vector<Path> > outputPaths(2, vector<Path>(1, out)); 
+    string error = buildGraph(outputPaths); 
+    ASSERT_EQUALS(contains(error, "same output path"), true); 
+    ASSERT_EQUALS(contains(error, "Path: " + out.getStringRep() + "\n"), true); 
+
+    outputPaths[1][0] = Path::join(out, Path("sub/file")); 
+    error = buildGraph(outputPaths); 
+    ASSERT_EQUALS(contains(error, "conflicting output paths"), true); 
+    ASSERT_EQUALS(contains(error, "Path: " + outputPaths[1][0].getStringRep() + "\n"), true); 
+
+    outputPaths[1][0] = Path::join(dir, Path("out-file")); 
+    outputPaths.push_back(vector<Path>(1, Path::join(dir, Path("out.file")))); 
+    outputPaths.push_back(vector<Path>(1, Path::join(dir, Path("outfile")))); 
+    ASSERT_EQUALS(buildGraph(outputPaths), ""); 
+}
+
+void jjmJjmakeStatCacheTests()
+{
+#ifndef _WIN32
+    std::cout << "Running jjm::StatCache tests" << endl; 
+
+    //Only the first stat of a path makes the system call, until refresh(). 
+    Path const dir = makeTestDir("statcache"); 
+    Path const src = Path::join(dir, Path("src.txt")); 
+    writeFile(src, "1\n"); 
+    GraphTestNode node("node"); 
+    Graph graph; 
+    {   Graph::Builder builder; 
+        builder.addNode( & node, vector<Path>(1, src), vector<Path>(), vector<Path>()); 
+        builder.build(graph); 
+    }
+    StatCache statCache; 
+    statCache.reset(graph); 
+    Stat const first = statCache.stat(0); 
+    ASSERT_EQUALS(first.sizeBytes, 2u); 
+    jjm::sleep(50); 
+    writeFile(src, "22\n"); 
+    Stat const second = statCache.stat(0); 
+    ASSERT_EQUALS(second.sizeBytes, 2u); 
+    ASSERT_EQUALS(second.lastWriteTimeNanoSec, first.lastWriteTimeNanoSec); 
+    ASSERT_EQUALS(statCache.getNumStatCalls(), 1); 
+    ASSERT_EQUALS(statCache.getNumSavedStatCalls(), 1); 
+    Stat const refreshed = statCache.refresh(0); 
+    ASSERT_EQUALS(refreshed.sizeBytes, 3u); 
+    ASSERT_EQUALS(refreshed.lastWriteTimeNanoSec > first.lastWriteTimeNanoSec, true); 
+    ASSERT_EQUALS(statCache.stat(0).sizeBytes, 3u); 
+    ASSERT_EQUALS(statCache.getNumStatCalls(), 2); 
+
+    //Without a state directory, touch-node goals are up to date when their 
+    //stamps are newer than their inputs. A touch-node used to execute in 
+    //every build, and did not change the last write time of an existing 
+    //stamp, so the goals after it could not tell that it executed. 
+    std::cout << "Running jjm::JjmakeContext touch-node tests" << endl; 
+    string buildFile = "(touch-node stamp src.txt)\n(touch-node stamp2 stamp)\n"; 
+    for (int i = 0; i < 10; ++i)
+        buildFile += "(touch-node out-" + toDecStr(i) + " common.h)\n"; 
+    writeFile(Path::join(dir, Path("jjmake.txt")), buildFile); 
+    writeFile(Path::join(dir, Path("common.h")), ""); 
+    Path const stamp = Path::join(dir, Path("stamp")); 
+    Path const stamp2 = Path::join(dir, Path("stamp2")); 
+    JjmakeContext::Arguments arguments = makeArguments(dir); 
+    arguments.stateDir = ""; 
+    arguments.printStats = true; 
+
+    string output = runBuild(dir, arguments); 
+    ASSERT_EQUALS(contains(output, "Executing goal: " + stamp2.getStringRep() + "\n"), true); 
+
+    output = runBuild(dir, arguments); 
+    ASSERT_EQUALS(contains(output, "Executing goal"), false); 
+    //common.h is stat-ed once for its 10 goals. 
+    ASSERT_EQUALS(contains(output, "saved by the stat cache 0\n"), false); 
+
+    jjm::sleep(50); 
+    writeFile(src, "3\n"); 
+    Stat const srcStat = Stat::stat2(src); 
+    output = runBuild(dir, arguments); 
+    ASSERT_EQUALS(contains(output, "Executing goal: " + stamp.getStringRep() + "\n"), true); 
+    ASSERT_EQUALS(contains(output, "Executing goal: " + stamp2.getStringRep() + "\n"), true); 
+    ASSERT_EQUALS(contains(output, "Executing goal: " + Path::join(dir, Path("out-0")).getStringRep()), false); 
+    ASSERT_EQUALS(Stat::stat2(stamp).lastWriteTimeNanoSec >= srcStat.lastWriteTimeNanoSec, true); 
+    ASSERT_EQUALS(Stat::stat2(stamp2).lastWriteTimeNanoSec >= Stat::stat2(stamp).lastWriteTimeNanoSec, true); 
+
+    output = runBuild(dir, arguments); 
+    ASSERT_EQUALS(contains(output, "Executing goal"), false); 
+    removeTree(dir); 
+#endif
+}
+
+#ifndef _WIN32
+namespace
+{
+    string makeConsoleLine(int thread, int block, int line)
+    {   return "thread " + toDecStr(thread) + " block " + toDecStr(block) + " line " + toDecStr(line) + "\n"; 
+    }
+
+    //Writes blocks of lines to the ConsoleWriter, and a line on its own 
+    //after each. 
+    class ConsoleWriterClient
+    {
+    public:
+        ConsoleWriterClient(ConsoleWriter * writer_, int thread_) : writer(writer_), thread(thread_) {}
+        void operator() ()
+        {   for (int b = 0; b < 50; ++b)
+            {   vector<ConsoleWriter::Segment> block; 
+                for (int line = 0; line < 3; ++line)
+                    block.push_back(ConsoleWriter::Segment(line == 1, makeConsoleLine(thread, b, line))); 
+                writer->writeBlock(block); 
+                writer->write(false, makeConsoleLine(thread, b, 3)); 
+            }
+        }
+    private:
+        ConsoleWriter * writer; 
+        int thread; 
+    }; 
+
+    //A goal which prints lines, a few milliseconds apart. 
+    class PrintingNode : public Node
+    {
+    public:
+        PrintingNode(string const& goalName_) : Node(goalName_, vector<Path>(), vector<Path>(1, Path(goalName_))), name(goalName_) {}
+        string name; 
+        virtual bool execute()
+        {   beginExecution(); 
+            for (int line = 0; line < 4; ++line)
+            {   toStdOut(name + " line " + toDecStr(line) + "\n"); 
+                jjm::sleep(5); 
+            }
+            return true; 
+        }
+    };
+}
+#endif
+
+void jjmJjmakeConsoleWriterTests()
+{
+#ifndef _WIN32
+    std::cout << "Running jjm::ConsoleWriter tests" << endl; 
+
+    //A block is written without the text of other threads in between, and 
+    //the text of each thread is written in the order it was queued. 
+    Path const dir = makeTestDir("consolewriter"); 
+    Path const outputPath = Path::join(dir, Path("output.log")); 
+    int const numThreads = 4; 
+    std::int64_t numBatches = 0; 
+    {   RedirectOutput redirect(outputPath); 
+        ConsoleWriter writer; 
+        vector<Thread*> threads; 
+        for (int t = 0; t < numThreads; ++t)
+            threads.push_back(new Thread(ConsoleWriterClient( & writer, t), Thread::JoinInDtor)); 
+        for (size_t i = 0; i < threads.size(); ++i)
+        {   threads[i]->join(); 
+            delete threads[i]; 
+        }
+        writer.flush(); 
+        numBatches = writer.getNumBatches(); 
+    }
+    string const output = readFile(outputPath); 
+    size_t expectedSize = 0; 
+    for (int t = 0; t < numThreads; ++t)
+    {   size_t last = 0; 
+        for (int b = 0; b < 50; ++b)
+        {   string const block = makeConsoleLine(t, b, 0) + makeConsoleLine(t, b, 1) + makeConsoleLine(t, b, 2); 
+            size_t const blockPos = output.find(block); 
+            size_t const linePos = output.find(makeConsoleLine(t, b, 3)); 
+            ASSERT_EQUALS(blockPos != string::npos && blockPos >= last, true); 
+            ASSERT_EQUALS(linePos != string::npos && linePos > blockPos, true); 
+            last = linePos; 
+            expectedSize += block.size() + makeConsoleLine(t, b, 3).size(); 
+        }
+    }
+    ASSERT_EQUALS(output.size(), expectedSize); 
+    ASSERT_EQUALS(numBatches >= 1 && numBatches <= numThreads * 50 * 2, true); 
+
+    //Every --output-sync mode writes all the lines of each goal in order. 
+    //With --output-sync=goal, the lines of a goal follow the line which 
+    //says that it is executing, without the lines of other goals between. 
+    std::cout << "Running jjm::JjmakeContext output sync tests" << endl; 
+    writeFile(Path::join(dir, Path("jjmake.txt")), ""); 
+    JjmakeContext::OutputSync const modes[3] = { JjmakeContext::OutputSyncNone, JjmakeContext::OutputSyncLine, JjmakeContext::OutputSyncGoal }; 
+    for (int m = 0; m < 3; ++m)
+    {   vector<string> goalNames; 
+        vector<Node*> newNodes; 
+        for (int i = 0; i < 4; ++i)
+        {   goalNames.push_back(Path::join(dir, Path("goal-" + toDecStr(i))).getStringRep()); 
+            newNodes.push_back(new PrintingNode(goalNames.back())); 
+        }
+        JjmakeContext::Arguments arguments = makeArguments(dir); 
+        arguments.numThreads = 4; 
+        arguments.stateDir = ""; 
+        arguments.outputSync = modes[m]; 
+        string const output = runBuild(dir, arguments, newNodes); 
+        for (size_t i = 0; i < goalNames.size(); ++i)
+        {   size_t last = output.find("[jjmake] Executing goal: " + goalNames[i] + "\n"); 
+            ASSERT_EQUALS(last != string::npos, true); 
+            string block = "[jjmake] Executing goal: " + goalNames[i] + "\n"; 
+            for (int line = 0; line < 4; ++line)
+            {   string const text = goalNames[i] + " line " + toDecStr(line) + "\n"; 
+                size_t const pos = output.find(text); 
+                ASSERT_EQUALS(pos != string::npos && pos > last, true); 
+                last = pos; 
+                block += text; 
+            }
+            if (modes[m] == JjmakeContext::OutputSyncGoal)
+                ASSERT_EQUALS(contains(output, block), true); 
+        }
+    }
+    removeTree(dir); 
+#endif
+}
+
+#ifndef _WIN32
+//Builds the goals of dir/jjmake.txt in watch mode, with its output in 
+//dir/log/watch.log. Writes "<pid>\n" and builds until killed. 
+int testWatchMain(string const& dir)
+{
+    try
+    {   string const line = toDecStr(static_cast<std::int64_t>(getpid())) + "\n"; 
+        if (static_cast<ssize_t>(line.size()) != ::write(1, line.data(), line.size()))
+            return 1; 
+        RedirectOutput redirect(Path::join(Path(dir), Path("log/watch.log"))); 
+        JjmakeContext::Arguments arguments = makeArguments(Path(dir)); 
+        arguments.watch = true; 
+        JjmakeContext context(arguments); 
+        context.execute(); 
+    } catch (std::exception & e)
+    {   std::cerr << e.what() << endl; 
+        return 1; 
+    }
+    return 0; 
+}
+
+namespace
+{
+    size_t countOf(string const& text, string const& part)
+    {   size_t n = 0; 
+        for (size_t pos = text.find(part); pos != string::npos; pos = text.find(part, pos + part.size()))
+            ++n; 
+        return n; 
+    }
+
+    //Waits until the watching build is done with its nth build, and returns
+    //its output. 
+    string waitForWatching(Path const& logPath, size_t n)
+    {   for (int i = 0; i < 400; ++i)
+        {   string const output = readFile(logPath); 
+            if (countOf(output, "[jjmake] Watching for changes.\n") >= n)
+                return output; 
+            jjm::sleep(50); 
+        }
+        return readFile(logPath); 
+    }
+}
+#endif
+
+void jjmJjmakeWatchTests()
+{
+#ifdef __linux__
+    std::cout << "Running jjm::JjmakeContext watch tests" << endl; 
+
+    //A change to a build file re-evaluates it, and executes only the goals 
+    //it changed, and a change to a source file executes only the goals 
+    //which depend on it. The log is in a directory which is not watched. 
+    Path const dir = makeTestDir("watch"); 
+    createDirectories(Path::join(dir, Path("log"))); 
+    writeFile(Path::join(dir, Path("jjmake.txt")), 
+            "(include '" + Path::join(dir, Path("a.txt")).getStringRep() + "')\n"
+            "(include '" + Path::join(dir, Path("b.txt")).getStringRep() + "')\n"); 
+    writeFile(Path::join(dir, Path("a.txt")), "(exec-node a.out a.src -- sh -c 'echo a >> log/runs.log; cp a.src a.out')\n"); 
+    writeFile(Path::join(dir, Path("b.txt")), "(exec-node b.out b.src -- sh -c 'echo b >> log/runs.log; cp b.src b.out')\n"); 
+    writeFile(Path::join(dir, Path("a.src")), "a\n"); 
+    writeFile(Path::join(dir, Path("b.src")), "b\n"); 
+    Path const runsPath = Path::join(dir, Path("log/runs.log")); 
+    Path const logPath = Path::join(dir, Path("log/watch.log")); 
+
+    ProcessBuilder pb; 
+    pb.arg("/proc/self/exe").arg("--test-watch").arg(dir.getStringRep()).pipeOut(); 
+    UniquePtr<Process*> process(pb.spawn()); 
+    string line; 
+    {   FileHandleOwner out(process.get()->releaseReadEndFromChildsStdout()); 
+        char c; 
+        while (out.get().read( & c, 1) == 1 && c != '\n')
+            line += c; 
+    }
+    long long pid = 0; 
+    ASSERT_EQUALS(decStrToInteger(pid, line), true); 
+
+    string output = waitForWatching(logPath, 1); 
+    ASSERT_EQUALS(countOf(readFile(runsPath), "a\n"), 1u); 
+    ASSERT_EQUALS(countOf(readFile(runsPath), "b\n"), 1u); 
+
+    jjm::sleep(50); 
+    writeFile(Path::join(dir, Path("a.txt")), "(exec-node a.out a.src -- sh -c 'echo a2 >> log/runs.log; cp a.src a.out')\n"); 
+    output = waitForWatching(logPath, 2); 
+    ASSERT_EQUALS(countOf(readFile(runsPath), "a2\n"), 1u); 
+    ASSERT_EQUALS(countOf(readFile(runsPath), "b\n"), 1u); 
+    ASSERT_EQUALS(countOf(output, "Executing goal: " + Path::join(dir, Path("b.out")).getStringRep()), 1u); 
+
+    jjm::sleep(50); 
+    writeFile(Path::join(dir, Path("b.src")), "b2\n"); 
+    output = waitForWatching(logPath, 3); 
+    ASSERT_EQUALS(countOf(readFile(runsPath), "a2\n"), 1u); 
+    ASSERT_EQUALS(countOf(readFile(runsPath), "b\n"), 2u); 
+    ASSERT_EQUALS(readFile(Path::join(dir, Path("b.out"))), "b2\n"); 
+
+    if (pid > 0)
+        ::kill(static_cast<pid_t>(pid), SIGKILL); 
+    process.get()->join(); 
+    removeTree(dir); 
+#endif
+}
@@ -3,17 +3,30 @@
 //      (See accompanying file LICENSE.TXT or copy at
 //  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
 
+#include "josutils/jclock.hpp"
+#include "josutils/jfilehandle.hpp"
+#include "josutils/jfilesystem.hpp"
+#include "josutils/jopen.hpp"
+#include "josutils/jstat.hpp"
+#include "josutils/jjobserver.hpp"
 #include "josutils/jpath.hpp"
 #include "josutils/jprocess.hpp"
+#include "josutils/jsocket.hpp"
+#include "josutils/jworker.hpp"
 #include "josutils/jthreading.hpp"
 #include "josutils/jstdstreams.hpp"
 #include "junicode/jutfstring.hpp"
 #include "junicode/jiconv.hpp"
+#include "jbase/jcompress.hpp"
+#include "jbase/jhash.hpp"
 #include "jbase/jinttostring.hpp"
+#include "jbase/juniqueptr.hpp"
 #include "jbase/jstreams.hpp"
 #include <algorithm>
+#include <atomic>
 #include <errno.h>
 #include <iostream>
+#include <map>
 #include <typeinfo>
 
 using namespace jjm;
@@ -22,23 +35,84 @@ using namespace std;
 bool failed = false; 
 void junicodeTests(); 
 void jjmPathTests(); 
+void jjmThreadPoolTests(); 
+void jjmHashTests(); 
+void jjmCompressTests(); 
+void jjmJobServerTests(); 
+void jjmProcessTests(); 
+void jjmWorkerTests(); 
+void jjmFileSystemTests(); 
+void jjmSocketTests(); 
+void jjmJjmakeExecNodeTests(); 
+void jjmJjmakeEarlyCutoffTests(); 
+void jjmJjmakeSignaturesTests(); 
+void jjmJjmakeDepsLogTests(); 
+void jjmJjmakeDyndepTests(); 
+void jjmJjmakeMemoryHistoryTests(); 
+void jjmJjmakeActionCacheTests(); 
+void jjmJjmakeStampTests(); 
+void jjmJjmakeRemoteWorkerTests(); 
+void jjmJjmakeHistoryTests(); 
+void jjmJjmakePoolTests(); 
+void jjmJjmakeParallelIncludeTests(); 
+void jjmJjmakeGraphTests(); 
+void jjmJjmakeStatCacheTests(); 
+void jjmJjmakeConsoleWriterTests(); 
+void jjmJjmakeWatchTests(); 
+int testWorkerMain(); 
+int testRemoteWorkerMain(string const& dir); 
+int testWatchMain(string const& dir); 
 
 #ifdef _WIN32
     #include <windows.h>
     #include <psapi.h>
+#else
+    #include <unistd.h>
 #endif
 
 
 #ifdef _WIN32
 int wmain()
 #else
-int main()
+int main(int argc, char** argv)
 #endif
 {
+#ifndef _WIN32
+    if (argc == 2 && string(argv[1]) == "--test-worker")
+        return testWorkerMain(); 
+    if (argc == 3 && string(argv[1]) == "--test-remote-worker")
+        return testRemoteWorkerMain(argv[2]); 
+    if (argc == 3 && string(argv[1]) == "--test-watch")
+        return testWatchMain(argv[2]); 
+#endif
     try
     {
         junicodeTests(); 
         jjmPathTests(); 
+        jjmThreadPoolTests(); 
+        jjmHashTests(); 
+        jjmCompressTests(); 
+        jjmJobServerTests(); 
+        jjmProcessTests(); 
+        jjmWorkerTests(); 
+        jjmFileSystemTests(); 
+        jjmSocketTests(); 
+        jjmJjmakeExecNodeTests(); 
+        jjmJjmakeEarlyCutoffTests(); 
+        jjmJjmakeSignaturesTests(); 
+        jjmJjmakeDepsLogTests(); 
+        jjmJjmakeDyndepTests(); 
+        jjmJjmakeMemoryHistoryTests(); 
+        jjmJjmakeActionCacheTests(); 
+        jjmJjmakeStampTests(); 
+        jjmJjmakeRemoteWorkerTests(); 
+        jjmJjmakeHistoryTests(); 
+        jjmJjmakePoolTests(); 
+        jjmJjmakeParallelIncludeTests(); 
+        jjmJjmakeGraphTests(); 
+        jjmJjmakeStatCacheTests(); 
+        jjmJjmakeConsoleWriterTests(); 
+        jjmJjmakeWatchTests(); 
 
         if (failed)
             return 1;
@@ -323,6 +397,615 @@ void jjmPathTests()
     ASSERT_EQUALS(Path(""), Path("//").getParent());
 }
 
+namespace
+{
+    class CountingTask : public Thread::Runnable
+    {
+    public:
+        CountingTask(std::atomic<long> & counter_) : counter(counter_) {}
+        std::atomic<long> & counter; 
+        virtual void run() { ++counter; }
+    };
+
+    class SpawningTask : public Thread::Runnable
+    {
+    public:
+        SpawningTask(ThreadPool & pool_, std::atomic<long> & counter_, int depth_) 
+            : pool(pool_), counter(counter_), depth(depth_) {}
+        ThreadPool & pool; 
+        std::atomic<long> & counter; 
+        int depth; 
+        virtual void run()
+        {   ++counter; 
+            if (depth == 0)
+                return; 
+            //one child through addTask, two through addTasks
+            pool.addTask(new SpawningTask(pool, counter, depth - 1)); 
+            vector<Thread::Runnable*> children; 
+            children.push_back(new SpawningTask(pool, counter, depth - 1)); 
+            children.push_back(new SpawningTask(pool, counter, depth - 1)); 
+            pool.addTasks(children); 
+            ASSERT_EQUALS(children.size(), 0); 
+        }
+    };
+
+    class GateTask : public Thread::Runnable
+    {
+    public:
+        GateTask(Mutex & mutex_, CondVar & condVar_, bool & started_, bool & open_) 
+            : mutex(mutex_), condVar(condVar_), started(started_), open(open_) {}
+        Mutex & mutex; 
+        CondVar & condVar; 
+        bool & started; 
+        bool & open; 
+        virtual void run()
+        {   Lock g(mutex); 
+            started = true; 
+            condVar.notify_all(); 
+            while ( ! open)
+                wait(g, condVar); 
+        }
+    };
+
+    class RecordingTask : public Thread::Runnable
+    {
+    public:
+        RecordingTask(vector<int> & record_, int id_) : record(record_), id(id_) {}
+        vector<int> & record; 
+        int id; 
+        virtual void run() { record.push_back(id); }
+    };
+
+    class OverlapTask : public Thread::Runnable
+    {
+    public:
+        OverlapTask(std::atomic<int> & numRunning_, std::atomic<int> & maxRunning_) 
+            : numRunning(numRunning_), maxRunning(maxRunning_) {}
+        std::atomic<int> & numRunning; 
+        std::atomic<int> & maxRunning; 
+        virtual void run()
+        {   int const n = ++numRunning; 
+            for (int m = maxRunning; n > m && ! maxRunning.compare_exchange_weak(m, n); )
+                ; 
+            jjm::sleep(2); 
+            --numRunning; 
+        }
+    };
+}
+
+void jjmHashTests()
+{
+    std::cout << "Running jjm::hash64 tests" << endl;
+    //reference values of XXH64
+    ASSERT_EQUALS(0xEF46DB3751D8E999ULL, hash64("", 0)); 
+    ASSERT_EQUALS(0x44BC2CF5AD770999ULL, hash64("abc", 3)); 
+    ASSERT_EQUALS(0xBEA9CA8199328908ULL, hash64("abc", 3, 1)); 
+    string const fox = "The quick brown fox jumps over the lazy dog"; 
+    ASSERT_EQUALS(0x0B242D361FDA71BCULL, hash64(fox.data(), fox.size())); 
+}
+
+void jjmCompressTests()
+{
+    std::cout << "Running jjm::compressBlock tests" << endl;
+    vector<string> inputs; 
+    inputs.push_back(""); 
+    inputs.push_back("abc"); 
+    inputs.push_back("The quick brown fox jumps over the lazy dog"); 
+    inputs.push_back(string(100000, 'x')); //long overlapping matches
+    string text; 
+    for (int i = 0; text.size() < 300000; ++i)
+        text += "int f" + toDecStr(i % 1000) + "() { return " + toDecStr(i) + "; }\n"; 
+    inputs.push_back(text); 
+    string noise; 
+    std::uint64_t x = 1; 
+    for (int i = 0; i < 70000; ++i)
+    {   x = x * 6364136223846793005ULL + 1442695040888963407ULL; 
+        noise.push_back(static_cast<char>(x >> 56)); 
+    }
+    inputs.push_back(noise); 
+    inputs.push_back(noise + noise); //matches more than 65535 bytes back are out of reach
+
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {   string packed; 
+        compressBlock(inputs[i].data(), inputs[i].size(), packed); 
+        string raw = "prefix"; 
+        ASSERT_EQUALS(decompressBlock(packed.data(), packed.size(), inputs[i].size(), raw), true); 
+        ASSERT_EQUALS(raw, "prefix" + inputs[i]); 
+        if (inputs[i].size() > 1 && inputs[i] != noise)
+        {   //a wrong size, and a cut block, are malformed
+            raw.clear(); 
+            ASSERT_EQUALS(decompressBlock(packed.data(), packed.size(), inputs[i].size() - 1, raw), false); 
+            raw.clear(); 
+            ASSERT_EQUALS(decompressBlock(packed.data(), packed.size() - 1, inputs[i].size(), raw), false); 
+        }
+    }
+    string packed; 
+    compressBlock(text.data(), text.size(), packed); 
+    ASSERT_EQUALS(packed.size() < text.size() / 4, true); 
+}
+
+void jjmProcessTests()
+{
+    std::cout << "Running jjm::Process tests" << endl;
+
+    //the peak resident set size of joined children
+    resetJoinedPeakRssBytes(); 
+    ASSERT_EQUALS(getJoinedPeakRssBytes(), 0); 
+    ProcessBuilder builder; 
+#ifdef _WIN32
+    builder.arg("cmd.exe").arg("/c").arg("exit 3"); 
+#else
+    builder.arg("/bin/sh").arg("-c").arg("exit 3"); 
+#endif
+    UniquePtr<Process*> process(builder.spawn()); 
+    process.get()->join(); 
+    ASSERT_EQUALS(process.get()->getExitCode(), 3); 
+    ASSERT_EQUALS(process.get()->getPeakRssBytes() > 0, true); 
+    ASSERT_EQUALS(getJoinedPeakRssBytes(), process.get()->getPeakRssBytes()); 
+    resetJoinedPeakRssBytes(); 
+    ASSERT_EQUALS(getJoinedPeakRssBytes(), 0); 
+
+#ifndef _WIN32
+    //tryJoin() does not wait for a running child
+    {   ProcessBuilder pb; 
+        pb.arg("sleep").arg("1"); 
+        UniquePtr<Process*> sleeping(pb.spawn()); 
+        ASSERT_EQUALS(sleeping.get()->tryJoin(), false); 
+        sleeping.get()->join(); 
+        ASSERT_EQUALS(sleeping.get()->getExitCode(), 0); 
+    }
+
+    //the posix_spawn() and fork() implementations behave the same
+    for (int forkExec = 0; forkExec < 2; ++forkExec)
+    {   {   ProcessBuilder pb; 
+            pb.forkExec(forkExec != 0).arg("sh").arg("-c").arg("echo out; echo err 1>&2; pwd").dir(Path("/")).pipeOut().pipeErr(); 
+            SyncExec exec(pb); 
+            ASSERT_EQUALS(exec.exitcode, 0); 
+            ASSERT_EQUALS(exec.out, "out\n/\n"); 
+            ASSERT_EQUALS(exec.err, "err\n"); 
+        }
+        {   ProcessBuilder pb; 
+            pb.forkExec(forkExec != 0).arg("sh").arg("-c").arg("echo out; echo err 1>&2; exit 4").pipeOut().errToOut(); 
+            SyncExec exec(pb); 
+            ASSERT_EQUALS(exec.exitcode, 4); 
+            ASSERT_EQUALS(exec.out, "out\nerr\n"); 
+        }
+        {   std::map<Utf8String, Utf8String> env; 
+            env["JJM_TEST"] = "x"; 
+            ProcessBuilder pb; 
+            pb.forkExec(forkExec != 0).arg("/bin/sh").arg("-c").arg("echo $JJM_TEST").env(env).pipeOut(); 
+            SyncExec exec(pb); 
+            ASSERT_EQUALS(exec.out, "x\n"); 
+        }
+        {   bool threw = false; 
+            try
+            {   ProcessBuilder pb; 
+                UniquePtr<Process*> p(pb.forkExec(forkExec != 0).arg("jjmake-no-such-executable").spawn()); 
+            }catch (std::exception & )
+            {   threw = true; 
+            }
+            ASSERT_EQUALS(threw, true); 
+        }
+        {   //spawn() returns without waiting for the child to exit
+            ProcessBuilder pb; 
+            pb.forkExec(forkExec != 0).arg("sleep").arg("1"); 
+            std::int64_t const start = getMonotonicClockNanoSec(); 
+            UniquePtr<Process*> p(pb.spawn()); 
+            std::int64_t const end = getMonotonicClockNanoSec(); 
+            ASSERT_EQUALS(end - start < 500 * 1000 * 1000, true); 
+            p.get()->join(); 
+        }
+    }
+
+    //each capture mode sees the same bytes, also past a pipe buffer's size
+    SyncExec::Capture const captures[] = { SyncExec::CaptureFiles, SyncExec::CaptureMapped, SyncExec::CapturePipes }; 
+    for (int c = 0; c < 3; ++c)
+    {   {   ProcessBuilder pb; 
+            pb.arg("sh").arg("-c").arg("head -c 300000 /dev/zero; echo err 1>&2; exit 2").pipeOut().pipeErr(); 
+            SyncExec exec(pb, Utf8String(), captures[c]); 
+            ASSERT_EQUALS(exec.exitcode, 2); 
+            ASSERT_EQUALS(exec.outSize(), 300000); 
+            ASSERT_EQUALS(std::string(exec.outData(), exec.outSize()), std::string(300000, '\0')); 
+            ASSERT_EQUALS(std::string(exec.errData(), exec.errSize()), "err\n"); 
+            ASSERT_EQUALS(exec.out.size(), captures[c] == SyncExec::CaptureMapped ? 0 : 300000); 
+        }
+        {   std::string const input(200000, 'x'); 
+            ProcessBuilder pb; 
+            pb.arg("cat").pipeIn().pipeOut().pipeErr(); 
+            SyncExec exec(pb, input, captures[c]); 
+            ASSERT_EQUALS(exec.exitcode, 0); 
+            ASSERT_EQUALS(std::string(exec.outData(), exec.outSize()), input); 
+            ASSERT_EQUALS(exec.errSize(), 0); 
+        }
+        {   ProcessBuilder pb; 
+            pb.arg("sh").arg("-c").arg("echo out; echo err 1>&2").pipeOut().errToOut(); 
+            SyncExec exec(pb, Utf8String(), captures[c]); 
+            ASSERT_EQUALS(std::string(exec.outData(), exec.outSize()), "out\nerr\n"); 
+        }
+    }
+#endif
+}
+
+void jjmJobServerTests()
+{
+    std::cout << "Running jjm::JobServer tests" << endl;
+
+    ASSERT_EQUALS(JobServerClient::fromMakeFlags(""), (JobServerClient*)0); 
+    ASSERT_EQUALS(JobServerClient::fromMakeFlags("-j4"), (JobServerClient*)0); 
+#ifndef _WIN32
+    //descriptors which were not passed to this process
+    ASSERT_EQUALS(JobServerClient::fromMakeFlags("-j4 --jobserver-auth=1020,1021"), (JobServerClient*)0); 
+#endif
+
+    //a stand-in for the jobserver of a parent make
+    JobServer server(3); 
+    UniquePtr<JobServerClient*> client(JobServerClient::fromMakeFlags("kw -j2 --jobserver-auth=other " + server.getMakeFlags())); 
+    ASSERT_EQUALS(client.get() != 0, true); 
+
+    //the implicit token and two tokens of the jobserver
+    JobServerClient::Token tokens[4]; 
+    ASSERT_EQUALS(client.get()->acquire(tokens[0], 0), true); 
+    ASSERT_EQUALS(tokens[0].isImplicit, true); 
+    ASSERT_EQUALS(client.get()->acquire(tokens[1], 0), true); 
+    ASSERT_EQUALS(tokens[1].isImplicit, false); 
+    ASSERT_EQUALS(client.get()->acquire(tokens[2], 0), true); 
+    ASSERT_EQUALS(client.get()->acquire(tokens[3], 10), false); 
+
+    //another client of the same jobserver sees the tokens in use
+    UniquePtr<JobServerClient*> other(JobServerClient::fromMakeFlags(server.getMakeFlags())); 
+    ASSERT_EQUALS(other.get()->acquire(tokens[3], 0), true); 
+    ASSERT_EQUALS(tokens[3].isImplicit, true); 
+    JobServerClient::Token otherToken; 
+    ASSERT_EQUALS(other.get()->acquire(otherToken, 0), false); 
+
+    client.get()->release(tokens[1]); 
+    ASSERT_EQUALS(other.get()->acquire(otherToken, 0), true); 
+    ASSERT_EQUALS(otherToken.isImplicit, false); 
+    other.get()->release(otherToken); 
+    other.get()->release(tokens[3]); 
+
+    client.get()->release(tokens[0]); 
+    ASSERT_EQUALS(client.get()->acquire(tokens[0], 0), true); 
+    ASSERT_EQUALS(tokens[0].isImplicit, true); 
+    client.get()->release(tokens[0]); 
+    client.get()->release(tokens[2]); 
+}
+
+void jjmFileSystemTests()
+{
+#ifndef _WIN32
+    std::cout << "Running jjm::copyFile tests" << endl;
+
+    Path const dir("/tmp/jjmake-test-" + toDecStr(static_cast<std::int64_t>(getpid()))); 
+    createDirectories(dir); 
+    Path const from = Path::join(dir, Path("from")); 
+    string const content(100000, 'x'); 
+    {   FileHandleOwner file(FileOpener().createOrOpen().truncate().writeOnly().open(from)); 
+        file.get().writeComplete(content.data(), content.size()); 
+    }
+
+    for (int allowHardLink = 0; allowHardLink < 2; ++allowHardLink)
+    {   Path const to = Path::join(dir, Path("to" + toDecStr(allowHardLink))); 
+        CopyMethod const method = copyFile(from, to, allowHardLink != 0); 
+        Stat const st = Stat::stat(to); 
+        ASSERT_EQUALS(st.sizeBytes, content.size()); 
+        ASSERT_EQUALS(method == CopiedByHardLink, st.fileId == Stat::stat(from).fileId); 
+        if ( ! allowHardLink)
+            ASSERT_EQUALS(method == CopiedByHardLink, false); 
+
+        //the target must not exist
+        bool threw = false; 
+        try
+        {   copyFile(from, to, allowHardLink != 0); 
+        } catch (std::exception & )
+        {   threw = true; 
+        }
+        ASSERT_EQUALS(threw, true); 
+    }
+    ASSERT_EQUALS(Stat::stat(Path::join(dir, Path("to0"))).linkCount, 1); 
+
+    //setFileTimesToNow() touches an existing file, and keeps its content. 
+    std::cout << "Running jjm::setFileTimesToNow tests" << endl;
+    Stat const before = Stat::stat(from); 
+    jjm::sleep(50); 
+    std::int64_t const startNanoSec = getSystemClockNanoSec(); 
+    setFileTimesToNow(from); 
+    Stat const after = Stat::stat(from); 
+    ASSERT_EQUALS(after.lastWriteTimeNanoSec > before.lastWriteTimeNanoSec, true); 
+    //Within a tick of the clock of the file system. 
+    ASSERT_EQUALS(after.lastWriteTimeNanoSec >= startNanoSec - 20 * 1000 * 1000, true); 
+    ASSERT_EQUALS(after.sizeBytes, content.size()); 
+
+    vector<string> names = listDirectory(dir); 
+    std::sort(names.begin(), names.end()); 
+    ASSERT_EQUALS(names.size(), 3); 
+    if (names.size() == 3)
+    {   ASSERT_EQUALS(names[0], "from"); 
+        ASSERT_EQUALS(names[1], "to0"); 
+        ASSERT_EQUALS(names[2], "to1"); 
+    }
+    for (size_t i = 0; i < names.size(); ++i)
+        removeFile(Path::join(dir, Path(names[i]))); 
+    ASSERT_EQUALS(listDirectory(dir).size(), 0); 
+    ::rmdir(dir.getStringRep().c_str()); 
+#endif
+}
+
+namespace
+{
+    //Accepts one connection, and echoes it in pieces of 4 bytes until EOF. 
+    class EchoServer
+    {
+    public:
+        EchoServer(ListeningSocket * listener_) : listener(listener_) {}
+        void operator() ()
+        {   Socket socket; 
+            if ( ! listener->accept(socket))
+                return; 
+            char buffer[4]; 
+            while (socket.readCompleteOrEof(buffer, 4))
+                socket.writeComplete(buffer, 4); 
+        }
+    private:
+        ListeningSocket * listener; 
+    }; 
+}
+
+void jjmSocketTests()
+{
+#ifndef _WIN32
+    std::cout << "Running jjm::Socket tests" << endl;
+
+    string const unixAddress = "unix:/tmp/jjmake-test-" + toDecStr(static_cast<std::int64_t>(getpid())) + ".sock"; 
+    char const * const addresses[] = { unixAddress.c_str(), "127.0.0.1:0" }; 
+    for (int i = 0; i < 2; ++i)
+    {   ListeningSocket listener; 
+        listener.listen(addresses[i]); 
+        ASSERT_EQUALS(listener.getAddress() != "127.0.0.1:0", true); 
+        Thread server(EchoServer( & listener), Thread::JoinInDtor); 
+        Socket client; 
+        client.setDeadline(getMonotonicClockNanoSec() + std::int64_t(10) * 1000 * 1000 * 1000); 
+        client.connect(listener.getAddress()); 
+        client.writeComplete("pingpong", 8); 
+        char reply[9] = {}; 
+        client.readComplete(reply, 8); 
+        ASSERT_EQUALS(string(reply), "pingpong"); 
+        client.close(); 
+        server.join(); 
+    }
+
+    //A peer which never replies holds up a read until the deadline. 
+    {   ListeningSocket listener; 
+        listener.listen("127.0.0.1:0"); 
+        Socket client; 
+        client.connect(listener.getAddress()); 
+        std::int64_t const start = getMonotonicClockNanoSec(); 
+        client.setDeadline(start + 100 * 1000 * 1000); 
+        bool threw = false; 
+        try
+        {   char x; 
+            client.readComplete( & x, 1); 
+        }catch (std::exception & )
+        {   threw = true; 
+        }
+        std::int64_t const millis = (getMonotonicClockNanoSec() - start) / (1000 * 1000); 
+        ASSERT_EQUALS(threw, true); 
+        ASSERT_EQUALS(millis >= 99 && millis < 5000, true); 
+
+        listener.stop(); 
+        Socket unused; 
+        ASSERT_EQUALS(listener.accept(unused), false); 
+    }
+
+    bool threw = false; 
+    try
+    {   Socket client; 
+        client.connect(unixAddress); 
+    }catch (std::exception & )
+    {   threw = true; 
+    }
+    ASSERT_EQUALS(threw, true); 
+#endif
+}
+
+void jjmWorkerTests()
+{
+#ifdef __linux__
+    std::cout << "Running jjm::WorkerPool tests" << endl;
+
+    //this executable is the worker, see testworker.cpp
+    ProcessBuilder pb; 
+    pb.arg("/proc/self/exe").arg("--test-worker"); 
+
+    {   WorkerPool workers; 
+        workers.declareTool("t", pb, 1, 3); 
+        ASSERT_EQUALS(workers.hasTool("t"), true); 
+        ASSERT_EQUALS(workers.hasTool("u"), false); 
+
+        vector<string> echo; 
+        echo.push_back("echo"); 
+        echo.push_back("a"); 
+        echo.push_back("b c"); 
+        WorkerPool::Response r = workers.request("t", echo); 
+        ASSERT_EQUALS(r.exitcode, 0); 
+        ASSERT_EQUALS(r.output, "a b c"); 
+
+        vector<string> exit5; 
+        exit5.push_back("exit"); 
+        exit5.push_back("5"); 
+        r = workers.request("t", exit5); 
+        ASSERT_EQUALS(r.exitcode, 5); 
+        ASSERT_EQUALS(r.output, ""); 
+
+        //the third request is the last one of the worker
+        vector<string> pid(1, "pid"); 
+        string const pid1 = workers.request("t", pid).output; 
+        string const pid2 = workers.request("t", pid).output; 
+        string const pid3 = workers.request("t", pid).output; 
+        ASSERT_EQUALS(pid1 != pid2, true); 
+        ASSERT_EQUALS(pid2, pid3); 
+        ASSERT_EQUALS(workers.getNumStarted(), 2); 
+
+        //a crash fails the request, and the next request has a new worker
+        bool threw = false; 
+        try
+        {   workers.request("t", vector<string>(1, "crash")); 
+        } catch (std::exception & )
+        {   threw = true; 
+        }
+        ASSERT_EQUALS(threw, true); 
+        ASSERT_EQUALS(workers.request("t", echo).output, "a b c"); 
+        ASSERT_EQUALS(workers.getNumStarted(), 3); 
+
+        threw = false; 
+        try
+        {   workers.request("u", echo); 
+        } catch (std::exception & )
+        {   threw = true; 
+        }
+        ASSERT_EQUALS(threw, true); 
+
+        //a redeclared tool starts new workers
+        workers.declareTool("t", pb, 1, 0); 
+        string const pid4 = workers.request("t", pid).output; 
+        ASSERT_EQUALS(pid4 != pid3, true); 
+        ASSERT_EQUALS(workers.getNumStarted(), 4); 
+
+        //a worker which hangs past the timeout is killed, the request fails,
+        //and the next request has a new worker
+        workers.setTimeout(std::int64_t(200) * 1000 * 1000); 
+        string message; 
+        std::int64_t const start = getMonotonicClockNanoSec(); 
+        try
+        {   workers.request("t", vector<string>(1, "hang")); 
+        } catch (std::exception & e)
+        {   message = e.what(); 
+        }
+        std::int64_t const end = getMonotonicClockNanoSec(); 
+        ASSERT_EQUALS(message.find("did not respond within 200 milliseconds") != string::npos, true); 
+        ASSERT_EQUALS(end - start >= std::int64_t(200) * 1000 * 1000, true); 
+        ASSERT_EQUALS(end - start < std::int64_t(5) * 1000 * 1000 * 1000, true); 
+        string const pid5 = workers.request("t", pid).output; 
+        ASSERT_EQUALS(pid5 != pid4, true); 
+        ASSERT_EQUALS(workers.request("t", pid).output, pid5); 
+        ASSERT_EQUALS(workers.getNumStarted(), 5); 
+    }
+#endif
+}
+
+void jjmThreadPoolTests()
+{
+    std::cout << "Running jjm::ThreadPool tests" << endl;
+
+    for (int numThreads = 1; numThreads <= 8; numThreads *= 2)
+    {   ThreadPool pool(numThreads); 
+        std::atomic<long> counter(0); 
+
+        //tasks added from outside the pool
+        for (int i = 0; i < 1000; ++i)
+            pool.addTask(new CountingTask(counter)); 
+        vector<Thread::Runnable*> tasks; 
+        for (int i = 0; i < 1000; ++i)
+            tasks.push_back(new CountingTask(counter)); 
+        pool.addTasks(tasks); 
+        ASSERT_EQUALS(tasks.size(), 0); 
+        pool.waitUntilIdle(); 
+        ASSERT_EQUALS(counter, 2000); 
+
+        //tasks added from inside the pool, 3^0 + 3^1 + ... + 3^7 tasks
+        counter = 0; 
+        pool.addTask(new SpawningTask(pool, counter, 7)); 
+        pool.waitUntilIdle(); 
+        ASSERT_EQUALS(counter, 3280); 
+
+        //the pool is reusable after becoming idle
+        counter = 0; 
+        pool.addTask(new CountingTask(counter)); 
+        pool.waitUntilIdle(); 
+        ASSERT_EQUALS(counter, 1); 
+    }
+
+    //with one worker, queued tasks run highest priority first, and newest 
+    //first among equal priorities
+    {   ThreadPool pool(1); 
+        Mutex mutex; 
+        CondVar condVar; 
+        bool started = false; 
+        bool open = false; 
+        pool.addTask(new GateTask(mutex, condVar, started, open)); 
+        {   Lock g(mutex); 
+            while ( ! started)
+                wait(g, condVar); 
+        }
+
+        vector<int> record; 
+        vector<ThreadPool::PrioritizedTask> tasks; 
+        tasks.push_back(ThreadPool::PrioritizedTask(1, new RecordingTask(record, 1))); 
+        tasks.push_back(ThreadPool::PrioritizedTask(3, new RecordingTask(record, 3))); 
+        tasks.push_back(ThreadPool::PrioritizedTask(2, new RecordingTask(record, 2))); 
+        pool.addTasks(tasks); 
+        ASSERT_EQUALS(tasks.size(), 0); 
+        pool.addTask(new RecordingTask(record, 5), 5); 
+        pool.addTask(new RecordingTask(record, 10), 0); 
+        pool.addTask(new RecordingTask(record, 11), 0); 
+        {   Lock g(mutex); 
+            open = true; 
+            condVar.notify_all(); 
+        }
+        pool.waitUntilIdle(); 
+        ASSERT_EQUALS(record.size(), 6); 
+        ASSERT_EQUALS(record[0], 5); 
+        ASSERT_EQUALS(record[1], 3); 
+        ASSERT_EQUALS(record[2], 2); 
+        ASSERT_EQUALS(record[3], 1); 
+        ASSERT_EQUALS(record[4], 11); 
+        ASSERT_EQUALS(record[5], 10); 
+    }
+
+    //at most the concurrency limit of workers run tasks, and the tasks queued
+    //on the other workers still run
+    {   ThreadPool pool(4); 
+        std::atomic<int> numRunning(0); 
+        std::atomic<int> maxRunning(0); 
+        pool.setConcurrencyLimit(2); 
+        ASSERT_EQUALS(pool.getConcurrencyLimit(), 2); 
+        vector<Thread::Runnable*> tasks; 
+        for (int i = 0; i < 40; ++i)
+            tasks.push_back(new OverlapTask(numRunning, maxRunning)); 
+        pool.addTasks(tasks); 
+        pool.waitUntilIdle(); 
+        ASSERT_EQUALS(maxRunning <= 2, true); 
+
+        pool.setConcurrencyLimit(1); 
+        maxRunning = 0; 
+        for (int i = 0; i < 20; ++i)
+            tasks.push_back(new OverlapTask(numRunning, maxRunning)); 
+        pool.addTasks(tasks); 
+        pool.waitUntilIdle(); 
+        ASSERT_EQUALS(maxRunning, 1); 
+
+        //raising the limit while tasks are queued
+        pool.setConcurrencyLimit(1); 
+        maxRunning = 0; 
+        for (int i = 0; i < 200; ++i)
+            tasks.push_back(new OverlapTask(numRunning, maxRunning)); 
+        pool.addTasks(tasks); 
+        pool.setConcurrencyLimit(4); 
+        pool.waitUntilIdle(); 
+        ASSERT_EQUALS(maxRunning <= 4, true); 
+        ASSERT_EQUALS(numRunning, 0); 
+    }
+
+    //after the stop flag, waitUntilIdle() returns, and queued tasks are not run
+    {   ThreadPool pool(2); 
+        std::atomic<long> counter(0); 
+        pool.setStopFlag(); 
+        pool.addTask(new CountingTask(counter)); 
+        pool.waitUntilIdle(); 
+        ASSERT_EQUALS(counter, 0); 
+    }
+}
+
 
 #if 0
 
@@ -0,0 +1,106 @@
+// Copyright (c) 2010-2015, Informatica Corporation, Joshua Maurice
+//       Distributed under the 3-clause BSD License
+//      (See accompanying file LICENSE.TXT or copy at
+//  http://www.w3.org/Consortium/Legal/2008/03-bsd-license.html)
+
+//A worker of the jjm::WorkerPool protocol, run by the tests as
+//"tests --test-worker". The first argument of a request selects the reply:
+//    echo <args>...  replies with the arguments, separated by spaces
+//    exit <n>        replies with exit status n and no output
+//    pid             replies with the process id of the worker
+//    crash           exits without a reply
+//    hang            never replies
+
+#include "jbase/jinttostring.hpp"
+#include "jbase/jstdint.hpp"
+
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+    #include <unistd.h>
+#endif
+
+using namespace jjm; 
+using namespace std; 
+
+#ifndef _WIN32
+
+namespace
+{
+    bool readAll(char * data, size_t size)
+    {   for (size_t done = 0; done < size; )
+        {   ssize_t const n = ::read(0, data + done, size - done); 
+            if (n <= 0)
+                return false; 
+            done += n; 
+        }
+        return true; 
+    }
+
+    bool writeAll(string const& data)
+    {   for (size_t done = 0; done < data.size(); )
+        {   ssize_t const n = ::write(1, data.data() + done, data.size() - done); 
+            if (n <= 0)
+                return false; 
+            done += n; 
+        }
+        return true; 
+    }
+
+    void putUint32(string & out, std::uint32_t x)
+    {   for (int i = 0; i < 4; ++i)
+            out.push_back(static_cast<char>((x >> (8 * i)) & 0xFF)); 
+    }
+}
+
+int testWorkerMain()
+{
+    for (;;)
+    {   unsigned char header[4]; 
+        if ( ! readAll(reinterpret_cast<char*>(header), 4))
+            return 0; 
+        std::uint32_t const size = header[0] | (header[1] << 8) | (header[2] << 16) | (std::uint32_t(header[3]) << 24); 
+        string frame(size, '\0'); 
+        if (size && ! readAll( & frame[0], size))
+            return 1; 
+
+        vector<string> args; 
+        for (size_t start = 0; start < frame.size(); )
+        {   size_t const end = frame.find('\0', start); 
+            args.push_back(frame.substr(start, end - start)); 
+            start = end + 1; 
+        }
+
+        std::uint32_t status = 0; 
+        string output; 
+        if (args.empty())
+            status = 2; 
+        else if (args[0] == "echo")
+        {   for (size_t i = 1; i < args.size(); ++i)
+                output += (i > 1 ? " " : "") + args[i]; 
+        }else if (args[0] == "exit" && args.size() == 2)
+        {   int n = 0; 
+            decStrToInteger(n, args[1]); 
+            status = n; 
+        }else if (args[0] == "pid")
+            output = toDecStr(static_cast<std::int64_t>(getpid())); 
+        else if (args[0] == "crash")
+            _exit(3); 
+        else if (args[0] == "hang")
+        {   for (;;)
+                ::pause(); 
+        }
+        else
+            status = 2; 
+
+        string reply; 
+        putUint32(reply, status); 
+        putUint32(reply, static_cast<std::uint32_t>(output.size())); 
+        reply += output; 
+        if ( ! writeAll(reply))
+            return 1; 
+    }
+}
+
+#endif